@@ -329,6 +329,15 @@ void Camera::releaseRecordingFrame(const sp<IMemory>& mem, int bufIdx)
     c->releaseRecordingFrame(mem);
 }
 
+// release a copied preview frame
+void Camera::releasePreviewFrame(const sp<IMemory>& mem)
+{
+    ALOGV("releasePreviewFrame");
+    sp <ICamera> c = mCamera;
+    if (c == 0) return;
+    c->releasePreviewFrame(mem);
+}
+
 // get preview state
 bool Camera::previewEnabled()
 {
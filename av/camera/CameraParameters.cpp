@@ -200,6 +200,8 @@ const char CameraParameters::KEY_AWEXTEND_VIDEO_CAPTURE_BUFFER_NUM[] = "video-ca
 
 const char CameraParameters::KEY_AWEXTEND_PREVIEW_ROTATION[] = "preview-rotation";
 
+const char CameraParameters::KEY_AWEXTEND_PREVIEW_CALLBACK_BUFFER_NUM[] = "preview-callback-buffer-num";
+
 
 CameraParameters::CameraParameters()
                 : mMap()
@@ -602,6 +604,16 @@ int CameraParameters::getPreviewRotation() const
     return getInt(KEY_AWEXTEND_PREVIEW_ROTATION);
 }
 
+void CameraParameters::setPreviewCallbackBufferNum(int number)
+{
+	set(KEY_AWEXTEND_PREVIEW_CALLBACK_BUFFER_NUM, number);
+}
+
+int CameraParameters::getPreviewCallbackBufferNum() const
+{
+    return getInt(KEY_AWEXTEND_PREVIEW_CALLBACK_BUFFER_NUM);
+}
+
 void CameraParameters::dump() const
 {
     ALOGD("dump: mMap.size = %d", mMap.size());
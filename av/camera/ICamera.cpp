@@ -56,6 +56,7 @@ enum {
     SET_WATER_MARK,
     SET_UVC_GADGET_MODE,
     SET_ADAS_GSENSOR_DATA,
+    RELEASE_PREVIEW_FRAME,
 };
 
 class BpCamera: public BpInterface<ICamera>
@@ -160,6 +161,15 @@ public:
         remote()->transact(RELEASE_RECORDING_FRAME, data, &reply);
     }
 
+    void releasePreviewFrame(const sp<IMemory>& mem)
+    {
+        ALOGV("releasePreviewFrame");
+        Parcel data, reply;
+        data.writeInterfaceToken(ICamera::getInterfaceDescriptor());
+        data.writeStrongBinder(mem->asBinder());
+        remote()->transact(RELEASE_PREVIEW_FRAME, data, &reply);
+    }
+
     status_t storeMetaDataInBuffers(bool enabled)
     {
         ALOGV("storeMetaDataInBuffers: %s", enabled? "true": "false");
@@ -428,6 +438,13 @@ status_t BnCamera::onTransact(
             releaseRecordingFrame(mem);
             return NO_ERROR;
         } break;
+        case RELEASE_PREVIEW_FRAME: {
+            ALOGV("RELEASE_PREVIEW_FRAME");
+            CHECK_INTERFACE(ICamera, data, reply);
+            sp<IMemory> mem = interface_cast<IMemory>(data.readStrongBinder());
+            releasePreviewFrame(mem);
+            return NO_ERROR;
+        } break;
         case STORE_META_DATA_IN_BUFFERS: {
             ALOGV("STORE_META_DATA_IN_BUFFERS");
             CHECK_INTERFACE(ICamera, data, reply);
@@ -198,4 +198,25 @@ status_t Display::openAdasScreen(unsigned int hlay, int open)
 	return d->openSurface(hlay, open);
 }
 
+status_t Display::beginTransaction()
+{
+	sp <IDisplay> d = mDisplay;
+    if (d == 0) return NO_INIT;
+	return d->beginTransaction();
+}
+
+status_t Display::commitTransaction()
+{
+	sp <IDisplay> d = mDisplay;
+    if (d == 0) return NO_INIT;
+	return d->commitTransaction();
+}
+
+status_t Display::setPresentMode(unsigned int hlay, int mode)
+{
+	sp <IDisplay> d = mDisplay;
+    if (d == 0) return NO_INIT;
+	return d->setPresentMode(hlay, mode);
+}
+
 }; // namespace android
@@ -39,6 +39,9 @@ enum {
     OPEN_SURFACE,
     SECOND_SCREEN,
     CLEAR_SURFACE,
+    BEGIN_TRANSACTION,
+    COMMIT_TRANSACTION,
+    SET_PRESENT_MODE,
 };
 
 class BpDisplay: public BpInterface<IDisplay>
@@ -154,6 +157,32 @@ public:
 		remote()->transact(OPEN_SURFACE, data, &reply);
 		return reply.readInt32();
 	}
+
+	status_t beginTransaction()
+	{
+		Parcel data, reply;
+		data.writeInterfaceToken(IDisplay::getInterfaceDescriptor());
+		remote()->transact(BEGIN_TRANSACTION, data, &reply);
+		return reply.readInt32();
+	}
+
+	status_t commitTransaction()
+	{
+		Parcel data, reply;
+		data.writeInterfaceToken(IDisplay::getInterfaceDescriptor());
+		remote()->transact(COMMIT_TRANSACTION, data, &reply);
+		return reply.readInt32();
+	}
+
+	status_t setPresentMode(const unsigned int hlay, const int mode)
+	{
+		Parcel data, reply;
+		data.writeInterfaceToken(IDisplay::getInterfaceDescriptor());
+		data.writeInt32(hlay);
+		data.writeInt32(mode);
+		remote()->transact(SET_PRESENT_MODE, data, &reply);
+		return reply.readInt32();
+	}
 };
 
 IMPLEMENT_META_INTERFACE(Display, "android.hardware.IDisplay");
@@ -253,6 +282,25 @@ status_t BnDisplay::onTransact(
             reply->writeInt32(otherScreen(screen, hlay1, hlay2));
 			return NO_ERROR;
 		}break;
+		case BEGIN_TRANSACTION: {
+			CHECK_INTERFACE(IDisplay, data, reply);
+			reply->writeInt32(beginTransaction());
+			return NO_ERROR;
+		}break;
+		case COMMIT_TRANSACTION: {
+			CHECK_INTERFACE(IDisplay, data, reply);
+			reply->writeInt32(commitTransaction());
+			return NO_ERROR;
+		}break;
+		case SET_PRESENT_MODE: {
+			CHECK_INTERFACE(IDisplay, data, reply);
+			unsigned int hlay;
+			int mode;
+			hlay = data.readInt32();
+			mode = data.readInt32();
+			reply->writeInt32(setPresentMode(hlay, mode));
+			return NO_ERROR;
+		}break;
         default:
             return BBinder::onTransact(code, data, reply, flags);
     }
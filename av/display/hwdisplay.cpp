@@ -30,7 +30,13 @@
 #include <semaphore.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <cutils/atomic.h>
+#include <utils/Timers.h>
  
 #include "hwdisplay.h"
 
@@ -57,9 +63,25 @@ HwDisplay::HwDisplay()
 {
 	LOG1("(%s %d)\n", __FUNCTION__, __LINE__);
 	memset(mLayerStatus, 0, sizeof(mLayerStatus));
+#ifdef DE_2
+	memset(mLayerConfig, 0, sizeof(mLayerConfig));
+	memset(mPresentQueue, 0, sizeof(mPresentQueue));
+	mUeventFd = -1;
+	mUeventMisses = 0;
+	mVsyncExit = false;
+	mVsyncPeriod = 1000000000LL / 60;
+	mLastVsync = 0;
+#endif
+	memset(&mStats, 0, sizeof(mStats));
 	hwd_init();
 }
 
+int HwDisplay::disp_ioctl(int cmd, unsigned long *args)
+{
+	android_atomic_inc((volatile int32_t *)&mStats.ioctls);
+	return ioctl(mDisp_fd, cmd, args);
+}
+
 HwDisplay::~HwDisplay()
 {
 	if (mInitialized) {
@@ -144,7 +166,7 @@ int HwDisplay::layer_release(int hlay)
 	//return layer_cmd(hlay, DISP_CMD_LAYER_RELEASE);
 }
 
-int HwDisplay::layer_config(__DISP_t cmd, disp_layer_config *pinfo)
+int HwDisplay::layer_config(__DISP_t cmd, disp_layer_config *pinfo, int num)
 {
 	LOG2("(%s %d)\n", __FUNCTION__, __LINE__);
 	unsigned long args[4] = {0};
@@ -152,23 +174,79 @@ int HwDisplay::layer_config(__DISP_t cmd, disp_layer_config *pinfo)
 	
 	args[0] = mScreen;
     args[1] = (unsigned long)pinfo;
-    args[2] = 1;
-    ret = ioctl(mDisp_fd, cmd, args);
+    args[2] = num;
+    ret = disp_ioctl(cmd, args);
 	if(RET_OK != ret) {
-		ALOGE("fail to get para\n");
+		ALOGE("fail to %s para\n", (cmd == DISP_LAYER_GET_CONFIG) ? "get" : "set");
 		ret = RET_FAIL;
 	}
 	return ret;
 }
 
+int HwDisplay::layer_shadow_index(disp_layer_config *pinfo)
+{
+	if (pinfo->channel >= CHN_NUM || pinfo->layer_id >= LYL_NUM) {
+		return -1;
+	}
+	return HLAY(pinfo->channel, pinfo->layer_id);
+}
+
+// Layers requested through hwd_layer_request are only changed by us, so
+// their config is read back from mLayerConfig instead of the driver. A
+// thread in a transaction sees what it staged itself.
 int HwDisplay::layer_get_para(disp_layer_config *pinfo)
 {
+	int idx = layer_shadow_index(pinfo);
+	if (idx >= 0) {
+		Mutex::Autolock lock(mConfigLock);
+		transaction *t = bound_transaction_locked();
+		if (t != NULL && (t->staged & (1 << idx))) {
+			*pinfo = t->configs[idx];
+			mStats.shadow_reads++;
+			return RET_OK;
+		}
+		if (mLayerStatus[pinfo->channel][pinfo->layer_id] & HWD_STATUS_SHADOWED) {
+			*pinfo = mLayerConfig[idx];
+			mStats.shadow_reads++;
+			return RET_OK;
+		}
+	}
 	return layer_config(DISP_LAYER_GET_CONFIG, pinfo);
 }
 
 int HwDisplay::layer_set_para(disp_layer_config *pinfo)
 {
-	return layer_config(DISP_LAYER_SET_CONFIG, pinfo);
+	int idx = layer_shadow_index(pinfo);
+	int ret;
+
+	if (idx < 0) {
+		return layer_config(DISP_LAYER_SET_CONFIG, pinfo);
+	}
+	{
+		Mutex::Autolock lock(mConfigLock);
+		transaction *t = bound_transaction_locked();
+		if (t != NULL) {
+			t->configs[idx] = *pinfo;
+			t->staged |= 1 << idx;
+			return RET_OK;
+		}
+		expire_transactions_locked();
+		mLayerConfig[idx] = *pinfo;
+		// a frame set meanwhile must not be undone by an older staged copy
+		for (size_t i = 0; i < mTransactions.size(); i++) {
+			t = mTransactions.valueAt(i);
+			if (t->staged & (1 << idx)) {
+				memcpy(t->configs[idx].info.fb.addr, pinfo->info.fb.addr,
+						sizeof(pinfo->info.fb.addr));
+			}
+		}
+	}
+	ret = layer_config(DISP_LAYER_SET_CONFIG, pinfo);
+	if (ret != RET_OK) {
+		Mutex::Autolock lock(mConfigLock);
+		mLayerStatus[pinfo->channel][pinfo->layer_id] &= ~HWD_STATUS_SHADOWED;
+	}
+	return ret;
 }
 
 #define ALIGN_16B(x) (((x) + (15)) & ~(15))
@@ -434,7 +512,7 @@ void HwDisplay::hwd_set_rot(int screen, int rot)
        unsigned long args[4]={0};
        args[0] = screen;
        args[1] = rot;
-       ioctl(mDisp_fd, DISP_ROTATION_SW_SET_ROT, args);
+       disp_ioctl(DISP_ROTATION_SW_SET_ROT, args);
 }
 
 void HwDisplay::openHdmi(int screen, int val)
@@ -453,13 +531,15 @@ void HwDisplay::openHdmi(int screen, int val)
 	unsigned long args[4]={0};
 	args[0] = screen;
 	args[1] = type;
-	ioctl(mDisp_fd, DISP_DEVICE_SWITCH, args);
+	disp_ioctl(DISP_DEVICE_SWITCH, args);
 	return ;
 }
 
 int HwDisplay::hwd_layer_other_screen(int arg, unsigned int hlay1, unsigned int hlay2)
 {
 	disp_layer_config ui_config, csi_config;
+
+	hwd_begin_transaction();
 	csi_config.channel = 0;
 	csi_config.layer_id = 0;
 	layer_get_para(&csi_config);
@@ -478,6 +558,7 @@ int HwDisplay::hwd_layer_other_screen(int arg, unsigned int hlay1, unsigned int
 		layer_set_para(&ui_config);
 		csi_config.info.zorder = 1;	//set the csi layer to the top to avoid be covered by ui
 		layer_set_para(&csi_config);
+		hwd_commit_transaction();
 	} else {
 		ui_config.channel = 1;
 		ui_config.layer_id = 0;
@@ -492,6 +573,7 @@ int HwDisplay::hwd_layer_other_screen(int arg, unsigned int hlay1, unsigned int
 		layer_set_para(&ui_config);	//restore ui to (1,0)
 		csi_config.info.zorder = 0;	//set the csi to the bottom, because ui can do alpha with it
 		layer_set_para(&csi_config);
+		hwd_commit_transaction();
 		openHdmi(SCREEN_0, 0);
 	}
 	return 0;
@@ -501,15 +583,26 @@ int HwDisplay::hwd_layer_clear(unsigned int hlay)
 {
 	int channel	= HD2CHN(hlay);
 	int layer_id = HD2LYL(hlay);
+	present_flush(hlay);
 	hwd_layer_close(hlay);
 	mLayerStatus[channel][layer_id] &= ~HWD_STATUS_OPENED;
+	if (hlay < CHN_NUM * LYL_NUM) {
+		release_list released;
+		Mutex::Autolock releaseLock(mReleaseLock);
+		released.count = 0;
+		{
+			Mutex::Autolock lock(mPresentLock);
+			present_retire_locked(hlay, systemTime(SYSTEM_TIME_MONOTONIC), &released);
+			mPresentCond.broadcast();
+		}
+		release_frames(&released);
+	}
 	return 0;
 }
 
-int HwDisplay::hwd_layer_render(unsigned int hlay, libhwclayerpara_t *picture)
+int HwDisplay::layer_render_frame(unsigned int hlay, libhwclayerpara_t *picture)
 {
 	LOG2("(%s %d)\n", __FUNCTION__, __LINE__);
-	int ret;
 	disp_layer_config config;
 	
 	memset(&config, 0, sizeof(disp_layer_config));
@@ -520,13 +613,13 @@ int HwDisplay::hwd_layer_render(unsigned int hlay, libhwclayerpara_t *picture)
 	config.info.fb.addr[0] = picture->top_y;
 	config.info.fb.addr[1] = picture->top_c;
 	config.info.fb.addr[2] = picture->bottom_y;
-	ret = layer_set_para(&config);
 	if(!(mLayerStatus[config.channel][config.layer_id] & HWD_STATUS_OPENED)) {
 		LOG2("(%s %d) %d\n", __FUNCTION__, __LINE__, hlay);
-		hwd_layer_open(hlay); //to avoid that the first frame is not initialized 
+		//open together with the first frame, so it is never shown uninitialized
+		config.enable = 1;
 		mLayerStatus[config.channel][config.layer_id] |= HWD_STATUS_OPENED;
 	}
-	return ret;
+	return layer_set_para(&config);
 }
 
 int HwDisplay::hwd_layer_exchange(unsigned int hlay1, unsigned int hlay2, int otherOnTop)
@@ -553,9 +646,10 @@ int HwDisplay::hwd_layer_exchange(unsigned int hlay1, unsigned int hlay2, int ot
     config1.info.zorder = config2.info.zorder;
     config2.info.zorder = zorder_tmp;
     
+	hwd_begin_transaction();
 	layer_set_para(&config1);
 	layer_set_para(&config2);
-	return RET_OK;
+	return hwd_commit_transaction();
 }
 
 int HwDisplay::hwd_layer_switch(unsigned int hlay, int bOpen)
@@ -568,6 +662,385 @@ int HwDisplay::hwd_layer_switch(unsigned int hlay, int bOpen)
 	return RET_FAIL;
 }
 
+int HwDisplay::hwd_layer_render(unsigned int hlay, libhwclayerpara_t *picture)
+{
+	release_list released;
+	bool queued;
+	int ret;
+
+	if (hlay >= CHN_NUM * LYL_NUM) {
+		ALOGE("hlay %d invalid", hlay);
+		return RET_FAIL;
+	}
+	{
+		Mutex::Autolock lock(mPresentLock);
+		present_queue *q = &mPresentQueue[hlay];
+		nsecs_t deadline = systemTime(SYSTEM_TIME_MONOTONIC) + 2 * mVsyncPeriod;
+		nsecs_t now;
+
+		// a full FIFO holds the producer back for up to two vsyncs
+		while (q->mode == HWD_PRESENT_FIFO && q->count == HWD_PRESENT_QUEUE_DEPTH
+				&& (now = systemTime(SYSTEM_TIME_MONOTONIC)) < deadline) {
+			mPresentCond.waitRelative(mPresentLock, deadline - now);
+		}
+	}
+
+	// not held while waiting, the vsync thread needs it to free a slot
+	Mutex::Autolock releaseLock(mReleaseLock);
+	released.count = 0;
+	{
+		Mutex::Autolock lock(mPresentLock);
+		present_queue *q = &mPresentQueue[hlay];
+
+		queued = q->mode != HWD_PRESENT_IMMEDIATE;
+		if (queued) {
+			int slot;
+			if (q->count == HWD_PRESENT_QUEUE_DEPTH) {
+				present_hand_back_locked(hlay, &q->frames[q->head], 0, &released);
+				q->head = (q->head + 1) % HWD_PRESENT_QUEUE_DEPTH;
+				q->count--;
+				q->stats.dropped++;
+			}
+			slot = (q->head + q->count) % HWD_PRESENT_QUEUE_DEPTH;
+			q->frames[slot] = *picture;
+			q->queued_at[slot] = systemTime(SYSTEM_TIME_MONOTONIC);
+			q->count++;
+			mPresentCond.broadcast();
+		} else {
+			q->stats.presented++;
+		}
+	}
+	if (queued) {
+		release_frames(&released);
+		return RET_OK;
+	}
+
+	ret = layer_render_frame(hlay, picture);
+	{
+		// replaces the frame a queued mode left on screen, if any
+		Mutex::Autolock lock(mPresentLock);
+		present_retire_locked(hlay, systemTime(SYSTEM_TIME_MONOTONIC), &released);
+		mPresentCond.broadcast();
+	}
+	release_frames(&released);
+	return ret;
+}
+
+void HwDisplay::present_flush(unsigned int hlay)
+{
+	release_list released;
+
+	if (hlay >= CHN_NUM * LYL_NUM) {
+		return;
+	}
+	Mutex::Autolock releaseLock(mReleaseLock);
+	released.count = 0;
+	{
+		Mutex::Autolock lock(mPresentLock);
+		present_queue *q = &mPresentQueue[hlay];
+		for (int i = 0; i < q->count; i++) {
+			present_hand_back_locked(hlay, &q->frames[(q->head + i) % HWD_PRESENT_QUEUE_DEPTH],
+					0, &released);
+		}
+		q->stats.dropped += q->count;
+		q->head = 0;
+		q->count = 0;
+		mPresentCond.broadcast();
+	}
+	release_frames(&released);
+}
+
+// Queued for the callback of hlay, if it has one. Called with mReleaseLock
+// and mPresentLock held.
+void HwDisplay::present_hand_back_locked(unsigned int hlay, const libhwclayerpara_t *frame,
+		int shown, release_list *list)
+{
+	present_queue *q = &mPresentQueue[hlay];
+	released_frame *r;
+
+	if (q->release == NULL) {
+		return;
+	}
+	r = &list->frames[list->count++];
+	r->release = q->release;
+	r->cookie = q->cookie;
+	r->hlay = hlay;
+	r->shown = shown;
+	r->frame = *frame;
+}
+
+// The frame on the layer was replaced at now. It is handed back once a
+// vsync came after now; list takes the oldest if too many are waiting.
+void HwDisplay::present_retire_locked(unsigned int hlay, nsecs_t now, release_list *list)
+{
+	present_queue *q = &mPresentQueue[hlay];
+
+	if (!q->has_current) {
+		return;
+	}
+	if (q->retired_count == HWD_RETIRED_MAX) {
+		ALOGW("hlay %d: %d frames wait for a vsync, handing back the oldest", hlay,
+				q->retired_count);
+		present_hand_back_locked(hlay, &q->retired[0], 1, list);
+		q->retired_count--;
+		memmove(q->retired, q->retired + 1, q->retired_count * sizeof(q->retired[0]));
+		memmove(q->retired_at, q->retired_at + 1, q->retired_count * sizeof(q->retired_at[0]));
+	}
+	q->retired[q->retired_count] = q->current;
+	q->retired_at[q->retired_count] = now;
+	q->retired_count++;
+	q->has_current = false;
+}
+
+// Frames replaced before before, the detection of a vsync earlier than the
+// one just seen: the driver has latched their replacement since.
+void HwDisplay::present_release_retired_locked(unsigned int hlay, nsecs_t before,
+		release_list *list)
+{
+	present_queue *q = &mPresentQueue[hlay];
+	int n = 0;
+
+	while (n < q->retired_count && q->retired_at[n] < before) {
+		present_hand_back_locked(hlay, &q->retired[n], 1, list);
+		n++;
+	}
+	if (n > 0) {
+		q->retired_count -= n;
+		memmove(q->retired, q->retired + n, q->retired_count * sizeof(q->retired[0]));
+		memmove(q->retired_at, q->retired_at + n, q->retired_count * sizeof(q->retired_at[0]));
+	}
+}
+
+void HwDisplay::present_release_all_locked(unsigned int hlay, release_list *list)
+{
+	present_queue *q = &mPresentQueue[hlay];
+	int i;
+
+	for (i = 0; i < q->retired_count; i++) {
+		present_hand_back_locked(hlay, &q->retired[i], 1, list);
+	}
+	if (q->has_current) {
+		present_hand_back_locked(hlay, &q->current, 1, list);
+	}
+	for (i = 0; i < q->count; i++) {
+		present_hand_back_locked(hlay, &q->frames[(q->head + i) % HWD_PRESENT_QUEUE_DEPTH],
+				0, list);
+	}
+	q->retired_count = 0;
+	q->has_current = false;
+}
+
+// Called with mReleaseLock held and mPresentLock not.
+void HwDisplay::release_frames(const release_list *list)
+{
+	for (int i = 0; i < list->count; i++) {
+		const released_frame *r = &list->frames[i];
+		r->release(r->cookie, r->hlay, &r->frame, r->shown);
+	}
+}
+
+int HwDisplay::hwd_layer_set_release_callback(unsigned int hlay,
+		hwd_release_callback callback, void *cookie)
+{
+	if (hlay >= CHN_NUM * LYL_NUM) {
+		return RET_FAIL;
+	}
+	Mutex::Autolock releaseLock(mReleaseLock);
+	Mutex::Autolock lock(mPresentLock);
+	present_queue *q = &mPresentQueue[hlay];
+	q->release = callback;
+	q->cookie = cookie;
+	q->has_current = false;
+	q->retired_count = 0;
+	return RET_OK;
+}
+
+int HwDisplay::hwd_layer_set_present_mode(unsigned int hlay, int mode)
+{
+	if (hlay >= CHN_NUM * LYL_NUM
+			|| mode < HWD_PRESENT_IMMEDIATE || mode > HWD_PRESENT_FIFO) {
+		return RET_FAIL;
+	}
+	LOG1("(%s %d) hlay %d, mode %d\n", __FUNCTION__, __LINE__, hlay, mode);
+	if (mode == HWD_PRESENT_IMMEDIATE) {
+		present_flush(hlay);
+	}
+
+	Mutex::Autolock lock(mPresentLock);
+	mPresentQueue[hlay].mode = mode;
+	if (mode != HWD_PRESENT_IMMEDIATE && mVsyncThread == 0) {
+		struct sockaddr_nl addr;
+		unsigned long args[4] = {0};
+
+		memset(&addr, 0, sizeof(addr));
+		addr.nl_family = AF_NETLINK;
+		addr.nl_groups = 0xffffffff;
+		mUeventFd = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT);
+		args[0] = mScreen;
+		args[1] = 1;
+		if (mUeventFd >= 0 && (bind(mUeventFd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+				|| disp_ioctl(DISP_VSYNC_EVENT_EN, args) != RET_OK)) {
+			close(mUeventFd);
+			mUeventFd = -1;
+		}
+		if (mUeventFd < 0) {
+			ALOGW("no vsync events, emulating them every %lld ns", mVsyncPeriod);
+		}
+		mVsyncThread = new VsyncThread(this);
+		mVsyncThread->run("HwDisplayVsync", ANDROID_PRIORITY_URGENT_DISPLAY);
+	}
+	return RET_OK;
+}
+
+int HwDisplay::hwd_get_layer_stats(unsigned int hlay, struct hwd_layer_stats *stats)
+{
+	if (hlay >= CHN_NUM * LYL_NUM) {
+		return RET_FAIL;
+	}
+	Mutex::Autolock lock(mPresentLock);
+	*stats = mPresentQueue[hlay].stats;
+	stats->mode = mPresentQueue[hlay].mode;
+	stats->queued = mPresentQueue[hlay].count;
+	return RET_OK;
+}
+
+// The driver reports vsync as a "VSYNC<screen>=<timestamp>" uevent once
+// DISP_VSYNC_EVENT_EN is set. If it has none, or stops sending them, vsync
+// is emulated with a timer that keeps the phase of the last one.
+nsecs_t HwDisplay::wait_vsync()
+{
+	nsecs_t now;
+
+	if (mUeventFd >= 0) {
+		char buf[1024];
+		char key[16];
+		struct pollfd pfd;
+		int len;
+
+		snprintf(key, sizeof(key), "VSYNC%d=", mScreen);
+		pfd.fd = mUeventFd;
+		pfd.events = POLLIN;
+		while (poll(&pfd, 1, ns2ms(2 * mVsyncPeriod) + 1) > 0) {
+			len = recv(mUeventFd, buf, sizeof(buf) - 1, 0);
+			if (len <= 0) {
+				break;
+			}
+			buf[len] = '\0';
+			for (char *p = buf; p < buf + len; p += strlen(p) + 1) {
+				if (strncmp(p, key, strlen(key)) != 0) {
+					continue;
+				}
+				now = systemTime(SYSTEM_TIME_MONOTONIC);
+				if (mLastVsync != 0 && now - mLastVsync < mVsyncPeriod * 3 / 2) {
+					mVsyncPeriod += (now - mLastVsync - mVsyncPeriod) / 8;
+				}
+				mUeventMisses = 0;
+				return now;
+			}
+		}
+		if (++mUeventMisses >= 3) {
+			ALOGW("vsync events stopped, emulating them every %lld ns", mVsyncPeriod);
+			close(mUeventFd);
+			mUeventFd = -1;
+		}
+	}
+
+	struct timespec ts;
+	nsecs_t next;
+
+	now = systemTime(SYSTEM_TIME_MONOTONIC);
+	next = now + mVsyncPeriod - (now - mLastVsync) % mVsyncPeriod;
+	ts.tv_sec = next / 1000000000LL;
+	ts.tv_nsec = next % 1000000000LL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+	return next;
+}
+
+bool HwDisplay::vsyncThread()
+{
+	libhwclayerpara_t frames[CHN_NUM * LYL_NUM];
+	release_list released;
+	unsigned int due = 0;
+	nsecs_t vsync, now;
+	unsigned int idx;
+
+	{
+		Mutex::Autolock lock(mPresentLock);
+		for (;;) {
+			if (mVsyncExit) {
+				return false;
+			}
+			for (idx = 0; idx < CHN_NUM * LYL_NUM; idx++) {
+				if (mPresentQueue[idx].count > 0 || mPresentQueue[idx].retired_count > 0) {
+					break;
+				}
+			}
+			if (idx < CHN_NUM * LYL_NUM) {
+				break;
+			}
+			mPresentCond.wait(mPresentLock);
+		}
+	}
+
+	vsync = wait_vsync();
+
+	Mutex::Autolock releaseLock(mReleaseLock);
+	released.count = 0;
+	{
+	// Held while rendering so a layer flushed or released meanwhile is not
+	// brought back by a frame taken from its queue.
+	Mutex::Autolock lock(mPresentLock);
+	for (idx = 0; idx < CHN_NUM * LYL_NUM; idx++) {
+		present_queue *q = &mPresentQueue[idx];
+		int n, slot, i;
+
+		present_release_retired_locked(idx, mLastVsync, &released);
+		if (q->count == 0) {
+			continue;
+		}
+		n = (q->mode == HWD_PRESENT_LATEST) ? q->count : 1;
+		slot = (q->head + n - 1) % HWD_PRESENT_QUEUE_DEPTH;
+		frames[idx] = q->frames[slot];
+		// queued before the previous vsync, so it missed at least one
+		if (q->queued_at[slot] < mLastVsync) {
+			q->stats.late++;
+		}
+		for (i = 0; i < n - 1; i++) {
+			present_hand_back_locked(idx, &q->frames[(q->head + i) % HWD_PRESENT_QUEUE_DEPTH],
+					0, &released);
+		}
+		q->stats.dropped += n - 1;
+		q->stats.presented++;
+		q->head = (q->head + n) % HWD_PRESENT_QUEUE_DEPTH;
+		q->count -= n;
+		due |= 1 << idx;
+	}
+	mLastVsync = vsync;
+	mPresentCond.broadcast();
+
+	hwd_begin_transaction();
+	for (idx = 0; idx < CHN_NUM * LYL_NUM; idx++) {
+		if (due & (1 << idx)) {
+			layer_render_frame(idx, &frames[idx]);
+		}
+	}
+	hwd_commit_transaction();
+
+	now = systemTime(SYSTEM_TIME_MONOTONIC);
+	for (idx = 0; idx < CHN_NUM * LYL_NUM; idx++) {
+		present_queue *q = &mPresentQueue[idx];
+
+		if ((due & (1 << idx)) && q->release != NULL) {
+			present_retire_locked(idx, now, &released);
+			q->current = frames[idx];
+			q->has_current = true;
+		}
+	}
+	}
+	release_frames(&released);
+	return true;
+}
+
 #else
 int HwDisplay::layer_cmd(unsigned int hlay, __disp_cmd_t cmd)
 {
@@ -967,6 +1440,23 @@ int HwDisplay::hwd_layer_switch(unsigned int hlay, int bOpen)
 	return RET_FAIL;
 }
 
+// no vsync events on this driver, frames are always set at once
+int HwDisplay::hwd_layer_set_present_mode(unsigned int hlay, int mode)
+{
+	return (mode == HWD_PRESENT_IMMEDIATE) ? RET_OK : RET_FAIL;
+}
+
+int HwDisplay::hwd_get_layer_stats(unsigned int hlay, struct hwd_layer_stats *stats)
+{
+	return RET_FAIL;
+}
+
+int HwDisplay::hwd_layer_set_release_callback(unsigned int hlay,
+		hwd_release_callback callback, void *cookie)
+{
+	return RET_FAIL;
+}
+
 #endif
 
 int HwDisplay::hwd_layer_request(struct view_info* surface)
@@ -992,7 +1482,10 @@ int HwDisplay::hwd_layer_request(struct view_info* surface)
 	config.info.fb.color_space = (surface->h<720)?DISP_BT601:DISP_BT709;
 	config.info.zorder = HLAY(ch, id);
     ALOGI("hlay:%d, zorder=%d, cnt:%d", hlay, config.info.zorder, mCurLayerCnt);
-	layer_set_para(&config);
+	if (layer_set_para(&config) == RET_OK) {
+		Mutex::Autolock lock(sLock);
+		mLayerStatus[ch][id] |= HWD_STATUS_SHADOWED;
+	}
 	return hlay;
 #else
 	LOG1("(%s %d)\n", __FUNCTION__, __LINE__);
@@ -1055,7 +1548,20 @@ int HwDisplay::hwd_layer_release(unsigned int hlay)
 #ifdef DE_2
 	int chn = HD2CHN(hlay);
 	int lyl = HD2LYL(hlay);
-	int ret = layer_release(hlay);
+	release_list released;
+	int ret;
+
+	// frames go back once the layer is gone, not a vsync later
+	Mutex::Autolock releaseLock(mReleaseLock);
+	released.count = 0;
+	if (hlay < CHN_NUM * LYL_NUM) {
+		Mutex::Autolock lock(mPresentLock);
+		present_release_all_locked(hlay, &released);
+		memset(&mPresentQueue[hlay], 0, sizeof(mPresentQueue[hlay]));
+		mPresentCond.broadcast();
+	}
+	ret = layer_release(hlay);
+	release_frames(&released);
 	if (RET_OK == ret) {
 		Mutex::Autolock lock(sLock);
 		if (chn >=0 && lyl >=0 && mLayerStatus[chn][lyl]) {
@@ -1078,6 +1584,158 @@ int HwDisplay::hwd_layer_release(unsigned int hlay)
 #endif
 }
 
+// caller holds mConfigLock
+HwDisplay::transaction *HwDisplay::bound_transaction_locked()
+{
+	ssize_t i = mTransactionOwners.indexOfKey(gettid());
+	if (i < 0) {
+		return NULL;
+	}
+	i = mTransactions.indexOfKey(mTransactionOwners.valueAt(i));
+	return (i >= 0) ? mTransactions.valueAt(i) : NULL;
+}
+
+// caller holds mConfigLock
+int HwDisplay::flush_transaction_locked(transaction *t)
+{
+	int ret = RET_OK;
+	int num = 0;
+
+#ifdef DE_2
+	disp_layer_config configs[CHN_NUM * LYL_NUM];
+	unsigned int staged = t->staged;
+	int idx;
+
+	for (idx = 0; idx < CHN_NUM * LYL_NUM; idx++) {
+		if (staged & (1 << idx)) {
+			mLayerConfig[idx] = t->configs[idx];
+			configs[num++] = t->configs[idx];
+		}
+	}
+	t->staged = 0;
+	if (num > 0) {
+		ret = layer_config(DISP_LAYER_SET_CONFIG, configs, num);
+		if (ret != RET_OK) {
+			// the driver state of these layers is unknown now
+			for (idx = 0; idx < CHN_NUM * LYL_NUM; idx++) {
+				if (staged & (1 << idx)) {
+					mLayerStatus[HD2CHN(idx)][HD2LYL(idx)] &= ~HWD_STATUS_SHADOWED;
+				}
+			}
+		}
+	}
+#endif
+	if (num > 0) {
+		mStats.commits++;
+		mStats.last_commit_ioctls = mStats.ioctls - t->start_ioctls;
+		mStats.last_commit_layers = num;
+		mStats.commit_ioctls += mStats.last_commit_ioctls;
+		LOG2("commit %d layers, %d ioctls", num, mStats.last_commit_ioctls);
+	}
+	return ret;
+}
+
+// A client that never commits must not hold its layers back for good, so
+// whatever it staged goes out once it has been open too long. Checked on
+// begin, commit and on every change made outside a transaction.
+void HwDisplay::expire_transactions_locked()
+{
+	nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+	size_t i;
+
+	for (i = 0; i < mTransactions.size(); i++) {
+		transaction *t = mTransactions.valueAt(i);
+		if (t->staged != 0 && now - t->started >= ms2ns(HWD_TRANSACTION_TIMEOUT_MS)) {
+			ALOGW("transaction %p open for %lld ms, committing what it staged",
+					mTransactions.keyAt(i), ns2ms(now - t->started));
+			flush_transaction_locked(t);
+			t->started = now;
+			t->start_ioctls = mStats.ioctls;
+		}
+	}
+}
+
+int HwDisplay::hwd_begin_transaction(const void *owner)
+{
+	Mutex::Autolock lock(mConfigLock);
+	pid_t tid = gettid();
+	transaction *t;
+	ssize_t i;
+
+	expire_transactions_locked();
+	if (owner == NULL) {
+		i = mTransactionOwners.indexOfKey(tid);
+		owner = (i >= 0) ? mTransactionOwners.valueAt(i) : NULL;
+	}
+	i = (owner != NULL) ? mTransactions.indexOfKey(owner) : -1;
+	if (i >= 0) {
+		t = mTransactions.valueAt(i);
+	} else {
+		t = new transaction;
+		memset(t, 0, sizeof(*t));
+		if (owner == NULL) {
+			// private to this thread until the outermost commit
+			t->thread_private = true;
+			owner = t;
+			mTransactionOwners.add(tid, owner);
+		}
+		mTransactions.add(owner, t);
+	}
+	if (t->depth++ == 0) {
+		t->started = systemTime(SYSTEM_TIME_MONOTONIC);
+		t->start_ioctls = mStats.ioctls;
+	}
+	return RET_OK;
+}
+
+int HwDisplay::hwd_commit_transaction(const void *owner)
+{
+	Mutex::Autolock lock(mConfigLock);
+	pid_t tid = gettid();
+	transaction *t;
+	ssize_t i;
+	int ret;
+
+	if (owner == NULL) {
+		i = mTransactionOwners.indexOfKey(tid);
+		owner = (i >= 0) ? mTransactionOwners.valueAt(i) : NULL;
+	}
+	i = (owner != NULL) ? mTransactions.indexOfKey(owner) : -1;
+	if (i < 0) {
+		ALOGE("commit without a transaction");
+		return RET_FAIL;
+	}
+	t = mTransactions.valueAt(i);
+	if (--t->depth > 0) {
+		expire_transactions_locked();
+		return RET_OK;
+	}
+	mTransactions.removeItemsAt(i);
+	if (t->thread_private) {
+		mTransactionOwners.removeItem(tid);
+	}
+	ret = flush_transaction_locked(t);
+	delete t;
+	expire_transactions_locked();
+	return ret;
+}
+
+void HwDisplay::hwd_bind_transaction(const void *owner)
+{
+	Mutex::Autolock lock(mConfigLock);
+	if (owner != NULL) {
+		mTransactionOwners.replaceValueFor(gettid(), owner);
+	} else {
+		mTransactionOwners.removeItem(gettid());
+	}
+}
+
+void HwDisplay::hwd_get_stats(struct hwd_stats *stats)
+{
+	Mutex::Autolock lock(mConfigLock);
+	*stats = mStats;
+}
+
 int HwDisplay::hwd_init(void)
 {
 	LOG1("(%s %d)\n", __FUNCTION__, __LINE__);
@@ -1101,10 +1759,10 @@ int HwDisplay::hwd_init(void)
 #endif
 #ifdef DE_2
 //display resume
-	int args[4]={0};
+	unsigned long args[4]={0};
 	args[0] = 0;
 	args[1] = 0;
-	ioctl(mDisp_fd, DISP_BLANK, args);
+	disp_ioctl(DISP_BLANK, args);
 
 #endif
 	mInitialized = true;
@@ -1116,7 +1774,26 @@ int HwDisplay::hwd_exit(void)
 {
 	LOG1("(%s %d)\n", __FUNCTION__, __LINE__);
 	int ret = RET_OK;
-			
+
+#ifdef DE_2
+	if (mVsyncThread != 0) {
+		unsigned long args[4] = {0};
+		{
+			Mutex::Autolock lock(mPresentLock);
+			mVsyncExit = true;
+			mPresentCond.broadcast();
+		}
+		mVsyncThread->requestExitAndWait();
+		mVsyncThread.clear();
+		if (mUeventFd >= 0) {
+			args[0] = mScreen;
+			args[1] = 0;
+			disp_ioctl(DISP_VSYNC_EVENT_EN, args);
+			close(mUeventFd);
+			mUeventFd = -1;
+		}
+	}
+#endif
     close(mDisp_fd);
 	
     return ret;
@@ -18,6 +18,7 @@
 #ifndef _HWDISPLAY_H
 #define _HWDISPLAY_H
 #include <utils/threads.h>
+#include <utils/KeyedVector.h>
 #include <semaphore.h>
 
 
@@ -58,9 +59,40 @@ enum
 {
 	HWD_STATUS_REQUESTED    = 1,
 	HWD_STATUS_NOTUSED		= 2,
-    HWD_STATUS_OPENED       = 4
+    HWD_STATUS_OPENED       = 4,
+    HWD_STATUS_SHADOWED     = 8     // mLayerConfig holds the driver's config
 };
 
+struct hwd_stats
+{
+	unsigned int ioctls;            // all display driver ioctls
+	unsigned int commits;           // transactions that reached the driver
+	unsigned int commit_ioctls;     // ioctls issued inside those transactions
+	unsigned int last_commit_ioctls;
+	unsigned int last_commit_layers;
+	unsigned int shadow_reads;      // layer configs served without an ioctl
+};
+
+// A transaction open this long has what it staged sent to the driver.
+#define HWD_TRANSACTION_TIMEOUT_MS  100
+
+struct hwd_layer_stats
+{
+	int mode;
+	unsigned int presented;         // frames set on the layer
+	unsigned int dropped;           // frames replaced before they were shown
+	unsigned int late;              // frames shown one or more vsyncs after queued
+	unsigned int queued;            // frames waiting now
+};
+
+// Frame of a LATEST or FIFO layer the display is done with, see
+// hwd_layer_set_release_callback. shown is 0 if it was dropped unseen.
+typedef void (*hwd_release_callback)(void *cookie, unsigned int hlay,
+		const libhwclayerpara_t *frame, int shown);
+
+// Frames replaced on a layer whose owner is not told yet, normally one.
+#define HWD_RETIRED_MAX 3
+
 namespace android {
 class HwDisplay {
 public:
@@ -98,11 +130,61 @@ public:
 	 int hwd_layer_switch(unsigned int hlay, int bOpen);
 	 int hwd_layer_other_screen(int screen, unsigned int hlay1, unsigned int hlay2);
 	 int hwd_layer_clear(unsigned int hlay);
+
+	 // Layer changes made between begin and commit are staged and sent to the
+	 // driver in one DISP_LAYER_SET_CONFIG call, so they show up on the same
+	 // vsync. Transactions nest; only the outermost commit reaches the driver.
+	 //
+	 // A transaction belongs to an owner and only stages the changes made by
+	 // threads bound to that owner; everybody else's, such as frames other
+	 // clients render meanwhile, still go straight to the driver. A NULL
+	 // owner is the one the calling thread is bound to, or a private one
+	 // for the thread until the outermost commit. A transaction left open
+	 // for HWD_TRANSACTION_TIMEOUT_MS has its changes sent as they stand.
+	 int hwd_begin_transaction(const void *owner = NULL);
+	 int hwd_commit_transaction(const void *owner = NULL);
+	 // For owners whose calls come in on varying threads, such as binder
+	 // clients: binds the calling thread to owner, NULL unbinds it.
+	 void hwd_bind_transaction(const void *owner);
+	 void hwd_get_stats(struct hwd_stats *stats);
+
+	 class TransactionBinding {
+	 public:
+		TransactionBinding(HwDisplay *hwd, const void *owner) : mHwd(hwd) {
+			mHwd->hwd_bind_transaction(owner);
+		}
+		~TransactionBinding() { mHwd->hwd_bind_transaction(NULL); }
+	 private:
+		HwDisplay *mHwd;
+	 };
+
+	 // Frames of a layer in LATEST or FIFO mode are queued by hwd_layer_render
+	 // and released by the vsync thread; all layers with a frame due go to the
+	 // driver in one transaction. The caller must keep the last
+	 // HWD_PRESENT_QUEUE_DEPTH + 1 buffers it rendered untouched, or learn
+	 // from a release callback when each is free, so only whoever renders to
+	 // the layer may switch it; layers start IMMEDIATE.
+	 int hwd_layer_set_present_mode(unsigned int hlay, int mode);
+	 int hwd_get_layer_stats(unsigned int hlay, struct hwd_layer_stats *stats);
+	 // With a callback set, every frame a LATEST or FIFO layer queued is
+	 // handed back once: at once if it is dropped, or a vsync after a later
+	 // frame, or closing the layer by hwd_layer_clear, took it off the
+	 // screen. The owner may reuse a buffer as soon as it is handed back
+	 // instead of keeping the last HWD_PRESENT_QUEUE_DEPTH + 1. A frame left
+	 // on screen by a switch to IMMEDIATE goes back once the first IMMEDIATE
+	 // frame replaced it; hwd_layer_release hands back all of them at once.
+	 // The callback runs on the vsync thread or on the thread whose call
+	 // dropped the frame, and must not call into HwDisplay. A NULL callback
+	 // forgets the frames not handed back yet; no callback for the layer
+	 // runs after this returns.
+	 int hwd_layer_set_release_callback(unsigned int hlay,
+			hwd_release_callback callback, void *cookie);
 protected:
 #ifdef DE_2
 	void hwd_set_rot(int screen, int rot);
 	int layer_request(int *pCh, int *pId);
-	int layer_config(__DISP_t cmd, disp_layer_config *pinfo);
+	int layer_config(__DISP_t cmd, disp_layer_config *pinfo, int num = 1);
+	int layer_shadow_index(disp_layer_config *pinfo);
 #else
 	 int layer_request();
 #endif
@@ -114,6 +196,17 @@ protected:
 	int layer_cmd(int screen, unsigned int hlay);
 	int layer_get_para(disp_layer_config *pinfo);
 	int layer_set_para(disp_layer_config *pinfo);
+	int layer_render_frame(unsigned int hlay, libhwclayerpara_t *picture);
+	bool vsyncThread();
+	nsecs_t wait_vsync();
+	void present_flush(unsigned int hlay);
+	struct release_list;
+	void present_hand_back_locked(unsigned int hlay, const libhwclayerpara_t *frame,
+			int shown, release_list *list);
+	void present_retire_locked(unsigned int hlay, nsecs_t now, release_list *list);
+	void present_release_retired_locked(unsigned int hlay, nsecs_t before, release_list *list);
+	void present_release_all_locked(unsigned int hlay, release_list *list);
+	void release_frames(const release_list *list);
 #else
 	 int layer_cmd(unsigned int hlay, __disp_cmd_t cmd);
 	 int layer_cmd(int screen, unsigned int hlay, __disp_cmd_t cmd);
@@ -122,6 +215,22 @@ protected:
 #endif
 	 int layer_set_normal(unsigned int hlay);
 	 void openHdmi(int screen, int val);
+	 int disp_ioctl(int cmd, unsigned long *args);
+
+	struct transaction
+	{
+		int depth;
+		bool thread_private;        // owner is the transaction itself
+		nsecs_t started;            // outermost begin, or last timeout flush
+		unsigned int start_ioctls;
+		unsigned int staged;        // HLAY() bits of configs
+#ifdef DE_2
+		disp_layer_config configs[CHN_NUM * LYL_NUM];
+#endif
+	};
+	transaction *bound_transaction_locked();
+	int flush_transaction_locked(transaction *t);
+	void expire_transactions_locked();
 protected:
 	struct buf_info
 	{
@@ -138,9 +247,66 @@ protected:
 	 int		mScaler_hdl;
 #ifdef DE_2
 	unsigned int mLayerStatus[CHN_NUM][LYL_NUM];
+	// last config sent for each layer, indexed by HLAY()
+	disp_layer_config mLayerConfig[CHN_NUM * LYL_NUM];
+
+	struct present_queue
+	{
+		int mode;
+		int head;
+		int count;
+		libhwclayerpara_t frames[HWD_PRESENT_QUEUE_DEPTH];
+		nsecs_t queued_at[HWD_PRESENT_QUEUE_DEPTH];
+		struct hwd_layer_stats stats;
+		// frames on and just off the screen, tracked with a release callback
+		hwd_release_callback release;
+		void *cookie;
+		bool has_current;
+		libhwclayerpara_t current;
+		int retired_count;
+		libhwclayerpara_t retired[HWD_RETIRED_MAX];
+		nsecs_t retired_at[HWD_RETIRED_MAX];    // replaced on the layer then
+	};
+	struct released_frame
+	{
+		hwd_release_callback release;
+		void *cookie;
+		unsigned int hlay;
+		int shown;
+		libhwclayerpara_t frame;
+	};
+	// frames handed back by one call, reported once the present lock is dropped
+	struct release_list
+	{
+		int count;
+		released_frame frames[CHN_NUM * LYL_NUM * (HWD_PRESENT_QUEUE_DEPTH + HWD_RETIRED_MAX)];
+	};
+	class VsyncThread : public Thread {
+	public:
+		VsyncThread(HwDisplay *hwd) : Thread(false), mHwd(hwd) {}
+	private:
+		virtual bool threadLoop() { return mHwd->vsyncThread(); }
+		HwDisplay *mHwd;
+	};
+	present_queue mPresentQueue[CHN_NUM * LYL_NUM];
+	Mutex mPresentLock;
+	Condition mPresentCond;     // a frame was queued or a slot freed
+	// Taken before mPresentLock and held from collecting handed back frames
+	// until their callbacks ran, so a callback never outlives its setting.
+	Mutex mReleaseLock;
+	sp<VsyncThread> mVsyncThread;
+	int mUeventFd;              // vsync uevents from the driver, -1 to emulate
+	int mUeventMisses;
+	bool mVsyncExit;
+	nsecs_t mVsyncPeriod;
+	nsecs_t mLastVsync;
 #else
 	unsigned int mLayerStatus[MAX_LAYER];
 #endif
+	Mutex mConfigLock;
+	KeyedVector<const void *, transaction *> mTransactions;    // open ones, by owner
+	KeyedVector<pid_t, const void *> mTransactionOwners;       // by bound thread
+	struct hwd_stats mStats;
 private:
 	 int mScreen;
 	 static bool		mInitialized;
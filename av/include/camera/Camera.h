@@ -124,6 +124,9 @@ public:
             // release a recording frame
             void        releaseRecordingFrame(const sp<IMemory>& mem, int bufIdx);
 
+            // release a copied preview frame
+            void        releasePreviewFrame(const sp<IMemory>& mem);
+
             // autoFocus - status returned from callback
             status_t    autoFocus();
 
@@ -120,6 +120,8 @@ public:
 
     void setPreviewRotation(int rotation);
     int getPreviewRotation() const;
+    void setPreviewCallbackBufferNum(int number);
+    int getPreviewCallbackBufferNum() const;
 
     void dump() const;
     status_t dump(int fd, const Vector<String16>& args) const;
@@ -738,6 +740,11 @@ public:
 
     static const char KEY_AWEXTEND_PREVIEW_ROTATION[];
 
+    // number of buffers for copied preview frames (CAMERA_FRAME_CALLBACK_FLAG_COPY_OUT_MASK).
+    // If it is set, every frame must be given back by releasePreviewFrame(), frames are
+    // dropped when all buffers are held by client.
+    static const char KEY_AWEXTEND_PREVIEW_CALLBACK_BUFFER_NUM[];
+
 private:
     DefaultKeyedVector<String8,String8>    mMap;
 };
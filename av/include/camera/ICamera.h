@@ -81,6 +81,9 @@ public:
     // release a recording frame
     virtual void            releaseRecordingFrame(const sp<IMemory>& mem) = 0;
 
+    // release a copied preview frame, see KEY_AWEXTEND_PREVIEW_CALLBACK_BUFFER_NUM
+    virtual void            releasePreviewFrame(const sp<IMemory>& mem) = 0;
+
     // auto focus
     virtual status_t        autoFocus() = 0;
 
@@ -47,6 +47,9 @@ public:
 	status_t 	open(unsigned int hlay, int open);
 	status_t    openAdasScreen(unsigned int hlay, int open);
 	status_t	clearSurface(unsigned int hlay1);
+	status_t	beginTransaction();
+	status_t	commitTransaction();
+	status_t	setPresentMode(unsigned int hlay, int mode);
 private:
                         Display();
                         Display(const Display&);
@@ -40,6 +40,12 @@ public:
 	virtual status_t        clearSurface(const unsigned int hlay1) = 0;
 	virtual status_t		otherScreen(const int screen, const unsigned int hlay1, const unsigned int hlay2) = 0;
 	virtual status_t		openSurface(const unsigned int hlay, const int open) = 0;
+	// Changes between begin and commit reach the display together.
+	virtual status_t		beginTransaction() = 0;
+	virtual status_t		commitTransaction() = 0;
+	// HWD_PRESENT_* from hwdisp_def.h. Only for layers whose renderer keeps
+	// its last HWD_PRESENT_QUEUE_DEPTH + 1 buffers, see hwdisplay.h.
+	virtual status_t		setPresentMode(const unsigned int hlay, const int mode) = 0;
 };
 
 // ----------------------------------------------------------------------------
@@ -19,6 +19,7 @@
 #define ANDROID_IMEDIARECORDER_H
 
 #include <binder/IInterface.h>
+#include <media/mediarecorder.h>
 
 namespace android {
 
@@ -61,6 +62,12 @@ public:
     virtual status_t queueBuffer(int index, int addr_y, int addr_c, int64_t timestamp) = 0;
     virtual	sp<IMemory> getOneBsFrame(int mode) = 0;
 	virtual void freeOneBsFrame() = 0;
+    virtual int registerBsConsumer(int dropPolicy) = 0;
+    virtual status_t unregisterBsConsumer(int consumerId) = 0;
+    virtual status_t getBsConsumerStatus(int consumerId, BsConsumerStatus *pStatus) = 0;
+    virtual status_t getBsFrames(int consumerId, int maxFrames, int timeoutMs, Vector<sp<IMemoryHeap> > *heaps, Vector<BsFrameDesc> *frames) = 0;
+    virtual status_t freeBsFrames(int consumerId, int64_t lastSeq) = 0;
+    virtual status_t waitBsFrames(int consumerId, int minFrames, int waitFlags, int timeoutMs, int *pQueuedFrames) = 0;
 	virtual	sp<IMemory> getEncDataHeader() = 0;
 	virtual status_t setVideoEncodingBitRateSync(int bitRate) = 0;
 	virtual status_t setVideoFrameRateSync(int frames_per_second) = 0;
@@ -68,6 +75,8 @@ public:
     virtual status_t reencodeIFrame() = 0;
     virtual status_t setOutputFileSync(int fd, int64_t fallocateLength, int muxerId) = 0;
     virtual status_t setOutputFileSync(const char* path, int64_t fallocateLength, int muxerId) = 0;
+    virtual status_t prepareOutputFile(int fd, int64_t fallocateLength) = 0;
+    virtual status_t prepareOutputFile(const char* path, int64_t fallocateLength) = 0;
     virtual status_t setSdcardState(bool bExist) = 0;
     virtual int addOutputFormatAndOutputSink(int of, int fd, int FallocateLen, bool callback_out_flag) = 0;
     virtual int addOutputFormatAndOutputSink(int of, const char* path, int FallocateLen, bool callback_out_flag) = 0;
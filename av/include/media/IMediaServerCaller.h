@@ -15,6 +15,9 @@ public:
     virtual void            disconnect() = 0;
     virtual sp<IMemory>     jpegDecode(int fd) = 0;
     virtual sp<IMemory>     jpegDecode(const char *path) = 0;
+    // RGB565 picture fitted into width x height, served from a cache
+    // while the file is unchanged.
+    virtual sp<IMemory>     jpegDecodeThumbnail(const char *path, int width, int height) = 0;
 };
 
 // ----------------------------------------------------------------------------
@@ -61,6 +61,13 @@ struct MediaRecorderBase {
     virtual status_t queueBuffer(int index, int addr_y, int addr_c, int64_t timestamp) = 0;
     virtual	sp<IMemory> getOneBsFrame(int mode) = 0;
 	virtual	void freeOneBsFrame() = 0;
+    virtual int registerBsConsumer(int dropPolicy) {return INVALID_OPERATION;}
+    virtual status_t unregisterBsConsumer(int consumerId) {return INVALID_OPERATION;}
+    virtual status_t getBsConsumerStatus(int consumerId, BsConsumerStatus *pStatus) {return INVALID_OPERATION;}
+    virtual status_t getBsFrames(int consumerId, int maxFrames, int timeoutMs, Vector<sp<IMemoryHeap> > *heaps, Vector<BsFrameDesc> *frames) {return INVALID_OPERATION;}
+    virtual status_t freeBsFrames(int consumerId, int64_t lastSeq) {return INVALID_OPERATION;}
+    virtual status_t waitBsFrames(int consumerId, int minFrames, int waitFlags, int timeoutMs, int *pQueuedFrames) {return INVALID_OPERATION;}
+    virtual void abortBsFrameWaits() {}
 	virtual	sp<IMemory> getEncDataHeader() = 0;
 	virtual status_t setVideoEncodingBitRateSync(int bitRate) = 0;
 	virtual status_t setVideoFrameRateSync(int frames_per_second) = 0;
@@ -68,6 +75,8 @@ struct MediaRecorderBase {
     virtual status_t reencodeIFrame() = 0;
     virtual status_t setOutputFileSync(int fd, int64_t fallocateLength, int muxerId) = 0;
     virtual status_t setOutputFileSync(const char* path, int64_t fallocateLength, int muxerId) = 0;
+    virtual status_t prepareOutputFile(int fd, int64_t fallocateLength) {return INVALID_OPERATION;}
+    virtual status_t prepareOutputFile(const char* path, int64_t fallocateLength) {return INVALID_OPERATION;}
     virtual status_t setSdcardState(bool bExist) = 0;
 
     virtual int addOutputFormatAndOutputSink(int of, int fd, int FallocateLen, bool callback_out_flag) = 0;
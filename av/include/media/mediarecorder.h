@@ -21,7 +21,9 @@
 #include <utils/Log.h>
 #include <utils/threads.h>
 #include <utils/List.h>
+#include <utils/Vector.h>
 #include <utils/Errors.h>
+#include <binder/IMemory.h>
 #include <media/IMediaRecorderClient.h>
 #include <media/IMediaDeathNotifier.h>
 
@@ -206,8 +208,59 @@ enum media_recorder_info_type {
 	MEDIA_RECORDER_INFO_RECORD_FILE_DONE           = 3002,
 	MEDIA_RECORDER_INFO_DISK_SPEED_TOO_SLOW        = 3003,
 	MEDIA_RECORDER_INFO_WRITE_DISK_ERROR           = 3004,
+	MEDIA_RECORDER_INFO_BSFRAME_FORCED_RELEASE     = 3005,   // extra is consumerId, it lost the oldest frame it held
 };
 
+enum media_recorder_bsframe_flag {
+    BSFRAME_FLAG_KEYFRAME                          = 0x01,
+    BSFRAME_FLAG_CODEC_CONFIG                      = 0x02,   // frame carries SPS/PPS
+    BSFRAME_FLAG_DISPOSABLE                        = 0x04,   // non-reference frame, droppable
+};
+
+// waitFlags of waitBsFrames()
+enum media_recorder_bsframe_wait_flag {
+    BSFRAME_WAIT_KEYFRAME                          = 0x01,  //also wake up when a key frame is queued.
+};
+
+/*
+ * Describe one encoded frame returned by getBsFrames(). Frame payload is
+ * [offset, offset+size) of heaps[heapIndex], it is valid until freeBsFrames()
+ * is called with its seq or a later one, or until the recorder takes it back
+ * (MEDIA_RECORDER_INFO_BSFRAME_FORCED_RELEASE).
+ */
+typedef struct BsFrameDesc
+{
+    int32_t heapIndex;
+    int32_t offset;
+    int32_t size;
+    int32_t flags;          //BSFRAME_FLAG_XXX
+    int64_t pts;            //unit:us
+    int32_t CurrQp;
+    int32_t avQp;
+    int32_t nGopIndex;
+    int32_t nFrameIndex;
+    int32_t nTotalIndex;
+    int32_t reserved;
+    int64_t seq;            //give to freeBsFrames()
+} BsFrameDesc;
+
+// consumers of encoded frames, see registerBsConsumer().
+enum media_recorder_bsconsumer_drop_policy {
+    BSCONSUMER_DROP_OLDEST                         = 0,     //drop the oldest queued frame.
+    BSCONSUMER_SKIP_TO_KEYFRAME                    = 1,     //jump to the next key frame.
+};
+
+#define BS_DEFAULT_CONSUMER     0   //used by getOneBsFrame(), no need to register.
+
+typedef struct BsConsumerStatus
+{
+    int32_t queuedFrames;   //frames not read yet
+    int32_t inUseFrames;    //frames read but not freed
+    int64_t lagUs;          //pts distance from next frame to the newest frame
+    int64_t droppedFrames;
+    int64_t forcedReleaseFrames;
+} BsConsumerStatus;
+
 //enum media_recorder_output_sink_type
 //{
 //    SINKTYPE_FILE           = 0x01, //one muxer write to sd file.
@@ -266,6 +319,12 @@ public:
     status_t queueBuffer(int index, int addr_y, int addr_c, int64_t timestamp);
     sp<IMemory> getOneBsFrame(int mode);
     void freeOneBsFrame();
+    int registerBsConsumer(int dropPolicy);
+    status_t unregisterBsConsumer(int consumerId);
+    status_t getBsConsumerStatus(int consumerId, BsConsumerStatus *pStatus);
+    status_t getBsFrames(int consumerId, int maxFrames, int timeoutMs, Vector<sp<IMemoryHeap> > *heaps, Vector<BsFrameDesc> *frames);
+    status_t freeBsFrames(int consumerId, int64_t lastSeq);
+    status_t waitBsFrames(int consumerId, int minFrames, int waitFlags, int timeoutMs, int *pQueuedFrames);
 	sp<IMemory> getEncDataHeader();
 	status_t setVideoEncodingBitRateSync(int bitRate);
     status_t setVideoFrameRateSync(int frames_per_second);
@@ -273,6 +332,8 @@ public:
     status_t reencodeIFrame();
     status_t setOutputFileSync(int fd, int64_t fallocateLength, int muxerId);
     status_t setOutputFileSync(const char* path, int64_t fallocateLength, int muxerId);
+    status_t prepareOutputFile(int fd, int64_t fallocateLength);
+    status_t prepareOutputFile(const char* path, int64_t fallocateLength);
     status_t setSdcardState(bool bExist);
     int addOutputFormatAndOutputSink(int of, int fd, int FallocateLen, bool callback_out_flag);
     int addOutputFormatAndOutputSink(int of, const char* path, int FallocateLen, bool callback_out_flag);
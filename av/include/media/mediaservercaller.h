@@ -18,6 +18,7 @@ public:
 
     sp<IMemory> jpegDecode(int fd);
     sp<IMemory> jpegDecode(const char *path);
+    sp<IMemory> jpegDecodeThumbnail(const char *path, int width, int height);
     void disconnect();
 
 private:
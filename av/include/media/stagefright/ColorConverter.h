@@ -22,17 +22,32 @@
 
 #include <stdint.h>
 #include <utils/Errors.h>
+#include <media/stagefright/YUVRowConverter.h>
 
 #include <OMX_Video.h>
 
 namespace android {
 
 struct ColorConverter {
+    // YUV to RGB matrix, both limited range.
+    enum ColorMatrix {
+        kColorMatrixBT601,
+        kColorMatrixBT709,
+    };
+
+    // |to| is OMX_COLOR_Format16bitRGB565 or OMX_COLOR_Format32BitRGBA8888.
     ColorConverter(OMX_COLOR_FORMATTYPE from, OMX_COLOR_FORMATTYPE to);
     ~ColorConverter();
 
     bool isValid() const;
 
+    // BT.601 unless set.
+    void setColorMatrix(ColorMatrix matrix);
+
+    // The vectorized row converters are used when the cpu has them; the
+    // scalar path gives the same output and is kept for comparison.
+    void setVectorEnabled(bool enabled);
+
     status_t convert(
             const void *srcBits,
             size_t srcWidth, size_t srcHeight,
@@ -59,10 +74,18 @@ private:
         size_t mCropLeft, mCropTop, mCropRight, mCropBottom;
     };
 
+    typedef YUVRowConverter::Row YUVRow;
+
     OMX_COLOR_FORMATTYPE mSrcFormat, mDstFormat;
-    uint8_t *mClip;
+    ColorMatrix mMatrix;
+    YUVRowConverter::Coeffs mCoeffs;
+    bool mVectorEnabled;
+
+    size_t dstBytesPerPixel() const;
 
-    uint8_t *initClip();
+    // |swapRB| writes R where B goes and vice versa.
+    void convertRow(
+            const YUVRow &row, void *dst, size_t width, bool swapRB) const;
 
     status_t convertCbYCrY(
             const BitmapParams &src, const BitmapParams &dst);
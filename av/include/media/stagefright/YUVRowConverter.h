@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2009 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef YUV_ROW_CONVERTER_H_
+
+#define YUV_ROW_CONVERTER_H_
+
+#include <sys/types.h>
+
+#include <stdint.h>
+
+namespace android {
+
+// Converts single rows of YUV where two neighbouring pixels share one
+// chroma sample. The caller walks the planes; ColorConverter and the JPEG
+// decoder both sit on top of this.
+struct YUVRowConverter {
+    enum RGBFormat {
+        kRGB565,        // R in the high bits
+        kBGR565,        // B in the high bits
+        kRGBA8888,      // R, G, B, A in memory
+        kBGRA8888,      // B, G, R, A in memory
+        kBGR888,        // B, G, R in memory
+    };
+
+    // Matrix coefficients scaled by 256. mYOffset is taken off luma before
+    // it is scaled, 16 for limited range and 0 for full range.
+    struct Coeffs {
+        int32_t mYOffset;
+        int32_t mY, mUB, mUG, mVG, mVR;
+    };
+
+    // One row of YUV samples. Chroma sample i of the row is at
+    // u[i * mUVStep] and v[i * mUVStep], luma pixel x at y[x * mYStep].
+    struct Row {
+        const uint8_t *mY;
+        const uint8_t *mU;
+        const uint8_t *mV;
+        size_t mYStep;
+        size_t mUVStep;
+    };
+
+    YUVRowConverter(const Coeffs &coeffs, RGBFormat format);
+
+    // The vectorized rows are used when the cpu has them; the scalar path
+    // gives the same output and is kept for comparison.
+    void setVectorEnabled(bool enabled);
+
+    size_t bytesPerPixel() const;
+
+    // |width| pixels. mYStep and mUVStep must be 1 and 1, 1 and 2 or 2 and 4.
+    void convert(const Row &row, void *dst, size_t width) const;
+
+    // |width| pixels resampled from the row, |xStep| is the 16.16 source
+    // advance per output pixel. 1 << 16 is the same as convert().
+    void convertScaled(
+            const Row &row, void *dst, size_t width, uint32_t xStep) const;
+
+private:
+    Coeffs mCoeffs;
+    RGBFormat mFormat;
+    bool mVectorEnabled;
+};
+
+};  // namespace android
+
+#endif  // YUV_ROW_CONVERTER_H_
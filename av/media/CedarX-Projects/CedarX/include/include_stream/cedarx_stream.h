@@ -102,6 +102,14 @@ typedef struct cdx_stream_info {
   void (*reset_stream)(struct cdx_stream_info *stream);
   int (*control_stream)(struct cdx_stream_info * stream, void *arg, int cmd);
   int (*extern_writer)(void *parent, void *bs_info);
+
+  //below members are appended for write2() of file stream, keep them at the end.
+  char *mpGatherBuf;    //directIO: fragments of bs_info are gathered here, so whole blocks can be written without copy again.
+  int   mGatherBufSize;
+  long long mWriteBytes;      //bytes passed to write()/write2()
+  long long mWriteCopyBytes;  //bytes copied in user space before reaching fd
+  void *mpAsyncWriter;  //directIO: DirectIOAsyncWriter, write() only queues data, io thread writes to fd.
+  int  (*flush)(struct cdx_stream_info *stream);    //wait all queued data written to fd, e.g., before file rotation.
 } cdx_stream_info_t;
 
 extern struct cdx_stream_info *create_stream_handle(CedarXDataSourceDesc *datasource_desc);
@@ -24,6 +24,7 @@ int cdx_seek_stream_file(struct cdx_stream_info *stream, cdx_off_t offset, int w
 cdx_off_t cdx_tell_stream_file(struct cdx_stream_info *stream);
 ssize_t cdx_read_stream_file(void *ptr, size_t size, size_t nmemb, struct cdx_stream_info *stream);
 ssize_t cdx_write_stream_file(const void *ptr, size_t size, size_t nmemb, struct cdx_stream_info *stream);
+int cdx_write2_stream_file(void *bs_info, struct cdx_stream_info *stream);
 long long cdx_get_stream_size_file(struct cdx_stream_info *stream);
 int cdx_truncate_stream_file(struct cdx_stream_info *stream, cdx_off_t length);
 int cdx_fallocate_stream_file(struct cdx_stream_info *stream, int mode, int64_t offset, int64_t len);
@@ -35,8 +36,29 @@ int cdx_seek_fd_file(struct cdx_stream_info *stream, cdx_off_t offset, int whenc
 cdx_off_t cdx_tell_fd_file(struct cdx_stream_info *stream);
 int cdx_read_fd_file(void *ptr, size_t size, size_t nmemb, struct cdx_stream_info *stream);
 int cdx_write_fd_file(const void *ptr, size_t size, size_t nmemb, struct cdx_stream_info *stream);
+int cdx_write2_fd_file(void *bs_info, struct cdx_stream_info *stream);
 long long cdx_get_fd_size_file(struct cdx_stream_info *stream);
 int cdx_truncate_fd_file(struct cdx_stream_info *stream, cdx_off_t length);
 int cdx_fallocate_fd_file(struct cdx_stream_info *stream, int mode, int64_t offset, int64_t len);
+int cdx_flush_fd_file(struct cdx_stream_info *stream);
+int cdx_preallocate_fd_file(int fd, int64_t len, volatile int *pAbortFlag);
+
+#define DIRECTIO_ASYNC_MAX_BUF_NUM          (16)
+#define DIRECTIO_WRITE_LATENCY_LEVEL_NUM    (8)     //<5ms, <10ms, <20ms, <50ms, <100ms, <200ms, <500ms, >=500ms
+typedef struct DirectIOAsyncWriteStat
+{
+    int         mBufNum;
+    int         mBufSize;
+    long long   mWriteCount;    //write requests done by io thread
+    long long   mWriteBytes;
+    long long   mMaxLatencyUs;
+    long long   mLatencyHist[DIRECTIO_WRITE_LATENCY_LEVEL_NUM];
+    long long   mQueueDepthHist[DIRECTIO_ASYNC_MAX_BUF_NUM+1];  //queued buffers when one is queued, index is depth
+    int         mMaxQueueDepth;
+    long long   mStallCount;    //muxer thread waited for a free buffer
+    long long   mStallUs;
+    long long   mFlushCount;
+}DirectIOAsyncWriteStat;
+int cdx_get_async_write_stat_fd_file(struct cdx_stream_info *stream, DirectIOAsyncWriteStat *pStat);
 
 #endif
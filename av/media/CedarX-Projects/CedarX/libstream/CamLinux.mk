@@ -63,6 +63,30 @@ LOCAL_MODULE:= libcedarxstream
 
 include $(BUILD_SHARED_LIBRARY)
 
+include $(CLEAR_VARS)
+
+include $(LOCAL_PATH)/../../Config.mk
+
+LOCAL_SRC_FILES := \
+	tests/stream_write_bench.c
+
+LOCAL_C_INCLUDES := \
+		${CEDARX_TOP}/include \
+		${CEDARX_TOP}/include/include_stream \
+		${CEDARX_TOP}/include/include_base \
+		${CEDARX_TOP}/../ \
+
+LOCAL_SHARED_LIBRARIES := \
+        libcedarxstream \
+
+LOCAL_CFLAGS += $(CEDARX_EXT_CFLAGS)
+
+LOCAL_MODULE:= stream_write_bench
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
 
 ######################################################
 
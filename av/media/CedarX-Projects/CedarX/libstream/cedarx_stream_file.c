@@ -27,6 +27,12 @@
 #include <assert.h>
 #include <ConfigOption.h>
 #include <stdlib.h>
+#include <sys/uio.h>
+#include <CDX_Recorder.h>
+#include <fcntl.h>
+#ifndef FALLOC_FL_KEEP_SIZE
+#define FALLOC_FL_KEEP_SIZE 0x01    //linux/falloc.h
+#endif
 #if (CDXCFG_FILE_SYSTEM==OPTION_FILE_SYSTEM_DIRECT_FATFS)
 #include <fat_user.h>
 static const int FATFS_BLOCK_SIZE = (64*1024);
@@ -34,6 +40,62 @@ static const int FATFS_BLOCK_SIZE = (64*1024);
 static const int DIRECTIO_UNIT_SIZE = (64*1024);   //cluster is 64*1024, align by cluster unit will has the max speed. (512)
 static const int DIRECTIO_USER_MEMORY_ALIGN = (512);
 
+//async writer: muxer thread copies data into staging buffers, io thread writes them.
+//CDXCFG_DIRECTIO_ASYNC_BUF_NUM = 0 means write synchronously in muxer thread.
+#ifndef CDXCFG_DIRECTIO_ASYNC_BUF_NUM
+#define CDXCFG_DIRECTIO_ASYNC_BUF_NUM   (4)
+#endif
+#ifndef CDXCFG_DIRECTIO_ASYNC_BUF_SIZE
+#define CDXCFG_DIRECTIO_ASYNC_BUF_SIZE  (256*1024)
+#endif
+
+typedef struct DirectIOAsyncBuf
+{
+    char        *mpBase;        //4096 aligned, size is mBufSize + DIRECTIO_USER_MEMORY_ALIGN
+    char        *mpData;        //mpBase + pad, make data after the unaligned head block memory aligned.
+    int         mDataSize;
+    int         mCapacity;      //first buffer after seek ends at cluster boundary, then all buffers are cluster aligned.
+    cdx_off_t   mFileOffset;    //absolute offset of mpData in fd
+}DirectIOAsyncBuf;
+
+typedef struct DirectIOAsyncWriter
+{
+    pthread_t       mThreadId;
+    pthread_mutex_t mLock;
+    pthread_cond_t  mCond;
+    int             mQuitFlag;
+    int             mError;     //io thread write fail, all following write fail.
+    DirectIOAsyncBuf mBufs[DIRECTIO_ASYNC_MAX_BUF_NUM];
+    int             mBufNum;
+    int             mBufSize;
+    //buffers are used in ring order: [mWriteIdx, mWriteIdx+mReadyNum) are queued to io thread,
+    //mFillIdx is filled by muxer thread if mFilling.
+    int             mWriteIdx;
+    int             mReadyNum;
+    int             mFillIdx;
+    int             mFilling;
+    //below are only used by muxer thread.
+    int             mLogicValid;    //0 after flush, fd_desc.cur_offset is the logical position then.
+    cdx_off_t       mLogicOffset;   //absolute offset of next byte muxer writes.
+    long long       mCopyBytes;     //merged to stream->mWriteCopyBytes when io thread is idle.
+    DirectIOAsyncWriteStat mStat;
+}DirectIOAsyncWriter;
+
+//files preallocated by cdx_preallocate_fd_file(), opened without O_TRUNC by output stream.
+#define DIRECTIO_PREALLOC_FILE_MAX  (8)
+typedef struct DirectIOPreallocFile
+{
+    dev_t       mDev;
+    ino_t       mIno;
+    long long   mSize;
+}DirectIOPreallocFile;
+static DirectIOPreallocFile gPreallocFiles[DIRECTIO_PREALLOC_FILE_MAX];
+static int gPreallocFileNum = 0;
+static pthread_mutex_t gPreallocFileLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int directIOAsyncAppend(struct cdx_stream_info *stream, const char *ptr, int size);
+static int directIOAsyncFlush(struct cdx_stream_info *stream);
+static int directIOAsyncSeekInPlace(struct cdx_stream_info *stream, cdx_off_t offset, int whence);
 #endif
 
 static char *generateFilepathFromFd(const int fd)
@@ -59,6 +121,42 @@ static char *generateFilepathFromFd(const int fd)
     return strdup(absoluteFilePath);
 }
 
+#if (CDXCFG_FILE_SYSTEM!=OPTION_FILE_SYSTEM_DIRECT_FATFS)
+/* writev() all of iov, handle partial write and EINTR. iov is modified.
+   return bytes written, less than nTotalSize if fail. */
+static int writevFully(int fd, struct iovec *pIov, int nIovCnt, int nTotalSize)
+{
+    int nLeftSize = nTotalSize;
+    while(nLeftSize > 0)
+    {
+        ssize_t nWriteLen = writev(fd, pIov, nIovCnt);
+        if(nWriteLen < 0)
+        {
+            if(EINTR == errno)
+            {
+                continue;
+            }
+            ALOGE("(f:%s, l:%d) fatal error! writev[%d]bytes fail[%s]!", __FUNCTION__, __LINE__, nLeftSize, strerror(errno));
+            break;
+        }
+        nLeftSize -= nWriteLen;
+        //partial write, skip the written part.
+        while(nIovCnt > 0 && nWriteLen >= (ssize_t)pIov->iov_len)
+        {
+            nWriteLen -= pIov->iov_len;
+            pIov++;
+            nIovCnt--;
+        }
+        if(nIovCnt > 0)
+        {
+            pIov->iov_base = (char*)pIov->iov_base + nWriteLen;
+            pIov->iov_len -= nWriteLen;
+        }
+    }
+    return nTotalSize - nLeftSize;
+}
+#endif
+
 int cdx_seek_stream_file(struct cdx_stream_info *stream, cdx_off_t offset, int whence)
 {
 #if (CDXCFG_FILE_SYSTEM==OPTION_FILE_SYSTEM_DIRECT_FATFS)
@@ -213,6 +311,7 @@ ssize_t cdx_read_stream_file(void *ptr, size_t size, size_t nmemb, struct cdx_st
 
 ssize_t cdx_write_stream_file(const void *ptr, size_t size, size_t nmemb, struct cdx_stream_info *stream)
 {
+    stream->mWriteBytes += size*nmemb;
 #if (CDXCFG_FILE_SYSTEM==OPTION_FILE_SYSTEM_DIRECT_FATFS)
     int nLeftSize = size*nmemb;
     int nCurWriteLen;
@@ -251,9 +350,11 @@ ssize_t cdx_write_stream_file(const void *ptr, size_t size, size_t nmemb, struct
 //    }
 //    return num_bytes_written;
     //ALOGD("(f:%s, l:%d) ptr[%p], size[%d]nmemb[%d]file_handle[%p]!", __FUNCTION__, __LINE__, ptr, size, nmemb, stream->file_handle);
+    stream->mWriteCopyBytes += size*nmemb;  //copied to stdio buffer
     return fwrite(ptr, size, nmemb,stream->file_handle);
     //ALOGD("(f:%s, l:%d) writeNum[%d]", __FUNCTION__, __LINE__, writeNum);
 #else
+    stream->mWriteCopyBytes += size*nmemb;  //copied to stdio buffer
     return fwrite(ptr, size, nmemb,stream->file_handle);
 #endif
 }
@@ -364,6 +465,16 @@ int cdx_seek_fd_file(struct cdx_stream_info *stream, cdx_off_t offset, int whenc
     LOGV("stream %p, cur offset 0x%08llx, seek offset 0x%08llx, whence %d, length 0x%08llx",
 			stream, stream->fd_desc.cur_offset, offset, whence, stream->fd_desc.length);
     cdx_off_t seek_result;
+#if (CDXCFG_FILE_SYSTEM==OPTION_FILE_SYSTEM_DIRECT_IO)
+    if(stream->mpAsyncWriter)
+    {
+        if(directIOAsyncSeekInPlace(stream, offset, whence))
+        {
+            return 0;
+        }
+        directIOAsyncFlush(stream);
+    }
+#endif
 	if(whence == SEEK_SET) {
 		//set from start, add origial offset.
 		offset += stream->fd_desc.offset;
@@ -466,11 +577,20 @@ int cdx_seek_fd_file(struct cdx_stream_info *stream, cdx_off_t offset, int whenc
 
 cdx_off_t cdx_tell_fd_file(struct cdx_stream_info *stream)
 {
+#if (CDXCFG_FILE_SYSTEM==OPTION_FILE_SYSTEM_DIRECT_IO)
+    if(stream->mpAsyncWriter && ((DirectIOAsyncWriter*)stream->mpAsyncWriter)->mLogicValid)
+    {
+        return ((DirectIOAsyncWriter*)stream->mpAsyncWriter)->mLogicOffset - stream->fd_desc.offset;
+    }
+#endif
 	return stream->fd_desc.cur_offset - stream->fd_desc.offset;
 }
 
 int cdx_read_fd_file(void *ptr, size_t size, size_t nmemb, struct cdx_stream_info *stream)
 {
+#if (CDXCFG_FILE_SYSTEM==OPTION_FILE_SYSTEM_DIRECT_IO)
+    directIOAsyncFlush(stream);
+#endif
 	//seek to where current actual pos is.
 	int result = lseek64(stream->fd_desc.fd, stream->fd_desc.cur_offset, SEEK_SET);
 	if(result == -1) {
@@ -524,6 +644,10 @@ int cdx_write_fd_file(const void *ptr, size_t size, size_t nmemb, struct cdx_str
     char *pCurPtr = (char*)ptr;
     off64_t nByteSize = size*nmemb;
     off64_t fileOffset = result;
+    if(0 == stream->mFtruncateFlag)
+    {
+        stream->mWriteBytes += nByteSize;
+    }
     off64_t alignOffset;
     if(stream->mFtruncateFlag)
     {
@@ -628,6 +752,7 @@ int cdx_write_fd_file(const void *ptr, size_t size, size_t nmemb, struct cdx_str
             if(0 == stream->mFtruncateFlag)
             {
                 memcpy(stream->mpAlignBuf + (fileOffset - alignOffset), pCurPtr, nByteSize);
+                stream->mWriteCopyBytes += nByteSize;
             }
             result = write(stream->fd_desc.fd, stream->mpAlignBuf, DIRECTIO_UNIT_SIZE);
             if (result != DIRECTIO_UNIT_SIZE) 
@@ -643,6 +768,10 @@ int cdx_write_fd_file(const void *ptr, size_t size, size_t nmemb, struct cdx_str
                 return -1;
             }
             stream->fd_desc.cur_offset = result;
+            if(stream->mFileEndOffset < result)
+            {
+                stream->mFileEndOffset = result;
+            }
             return nmemb;
         }
         else
@@ -651,6 +780,7 @@ int cdx_write_fd_file(const void *ptr, size_t size, size_t nmemb, struct cdx_str
             if(0 == stream->mFtruncateFlag)
             {
                 memcpy(stream->mpAlignBuf + (fileOffset - alignOffset), pCurPtr, blockLeftSize);
+                stream->mWriteCopyBytes += blockLeftSize;
             }
             result = write(stream->fd_desc.fd, stream->mpAlignBuf, DIRECTIO_UNIT_SIZE);
             if (result != DIRECTIO_UNIT_SIZE) 
@@ -678,6 +808,7 @@ int cdx_write_fd_file(const void *ptr, size_t size, size_t nmemb, struct cdx_str
                 if(0 == stream->mFtruncateFlag)
                 {
                     memcpy(stream->mpAlignBuf, pCurPtr, stream->mAlignBufSize);
+                    stream->mWriteCopyBytes += stream->mAlignBufSize;
                 }
                 result = write(stream->fd_desc.fd, stream->mpAlignBuf, stream->mAlignBufSize);
                 if(result != stream->mAlignBufSize)
@@ -698,6 +829,7 @@ int cdx_write_fd_file(const void *ptr, size_t size, size_t nmemb, struct cdx_str
                 if(0 == stream->mFtruncateFlag)
                 {
                     memcpy(stream->mpAlignBuf, pCurPtr, alignSize);
+                    stream->mWriteCopyBytes += alignSize;
                 }
                 result = write(stream->fd_desc.fd, stream->mpAlignBuf, alignSize);
                 if(result != alignSize)
@@ -756,23 +888,29 @@ int cdx_write_fd_file(const void *ptr, size_t size, size_t nmemb, struct cdx_str
                 __FUNCTION__, __LINE__, DIRECTIO_UNIT_SIZE, result, curOffset + DIRECTIO_UNIT_SIZE);
             //I don't know whether it can run normally when call ftruncate() here, so I use write() to extend file size.
             memset(stream->mpAlignBuf+result, 0xFF, DIRECTIO_UNIT_SIZE-result);
-            //need update mEndOffset and mFileSize.
-            stream->mFileEndOffset = desOffset;
-            stream->mFileSize = curOffset + DIRECTIO_UNIT_SIZE;
+            //need update mEndOffset and mFileSize. preallocated file may be bigger already.
+            if(stream->mFileEndOffset < desOffset)
+            {
+                stream->mFileEndOffset = desOffset;
+            }
+            if(stream->mFileSize < curOffset + DIRECTIO_UNIT_SIZE)
+            {
+                stream->mFileSize = curOffset + DIRECTIO_UNIT_SIZE;
+            }
         }
         else
         {
-            //if can read full size, it means file not extend. so not need update mEndOffset and mFileSize.
-            if(curOffset + DIRECTIO_UNIT_SIZE == stream->mFileSize)
+            //if can read full size, it means file not extend. so not need update mFileSize.
+            if(curOffset + DIRECTIO_UNIT_SIZE <= stream->mFileSize)
             {
-                //if meet file physical end, process mEndOffset carefully.
+                //inside physical size, e.g., preallocated file, process mEndOffset carefully.
                 if(stream->mFileEndOffset < desOffset)
                 {
-                    ALOGW("(f:%s, l:%d) Be careful! update FileEndOffset[%lld] to [%lld]!", __FUNCTION__, __LINE__, stream->mFileEndOffset, desOffset);
+                    ALOGV("(f:%s, l:%d) update FileEndOffset[%lld] to [%lld]!", __FUNCTION__, __LINE__, stream->mFileEndOffset, desOffset);
                     stream->mFileEndOffset = desOffset;
                 }
             }
-            else if(curOffset + DIRECTIO_UNIT_SIZE > stream->mFileSize)
+            else
             {
                 ALOGE("(f:%s, l:%d) fatal error! [%lld][%d][%lld]!", __FUNCTION__, __LINE__, curOffset, DIRECTIO_UNIT_SIZE, stream->mFileSize);
                 assert(0);
@@ -787,6 +925,7 @@ int cdx_write_fd_file(const void *ptr, size_t size, size_t nmemb, struct cdx_str
         if(0 == stream->mFtruncateFlag)
         {
             memcpy(stream->mpAlignBuf, pCurPtr, nByteSize);
+            stream->mWriteCopyBytes += nByteSize;
         }
         result = write(stream->fd_desc.fd, stream->mpAlignBuf, DIRECTIO_UNIT_SIZE);
         if(result != DIRECTIO_UNIT_SIZE)
@@ -826,6 +965,401 @@ int cdx_write_fd_file(const void *ptr, size_t size, size_t nmemb, struct cdx_str
     return nmemb;
 }
 
+/*******************************************************************************
+Function name: cdx_write2_fd_file
+Description: 
+    write fragments of CDXRecorderBsInfo without joining them first.
+    DirectIO: fragments are gathered into mpGatherBuf once, placed so that the
+    data after the unaligned head block starts at DIRECTIO_USER_MEMORY_ALIGN,
+    then cdx_write_fd_file() writes whole blocks from it directly, only head
+    and tail block are copied to mpAlignBuf.
+Return: 
+    bytes written, -1 if fail.
+*******************************************************************************/
+int cdx_write2_fd_file(void *bs_info, struct cdx_stream_info *stream)
+{
+    CDXRecorderBsInfo *pBsInfo = (CDXRecorderBsInfo*)bs_info;
+    int i;
+    int nTotalSize = 0;
+    for(i=0; i<pBsInfo->bs_count; i++)
+    {
+        nTotalSize += pBsInfo->bs_size[i];
+    }
+    if(0 == nTotalSize)
+    {
+        return 0;
+    }
+    if(stream->mpAsyncWriter)
+    {
+        for(i=0; i<pBsInfo->bs_count; i++)
+        {
+            if(directIOAsyncAppend(stream, pBsInfo->bs_data[i], pBsInfo->bs_size[i]) != 0)
+            {
+                return -1;
+            }
+        }
+        return nTotalSize;
+    }
+    int nHeadLeftSize = 0;
+    if(stream->fd_desc.cur_offset%DIRECTIO_UNIT_SIZE != 0)
+    {
+        nHeadLeftSize = DIRECTIO_UNIT_SIZE - stream->fd_desc.cur_offset%DIRECTIO_UNIT_SIZE;
+    }
+    int nPadSize = (DIRECTIO_USER_MEMORY_ALIGN - nHeadLeftSize%DIRECTIO_USER_MEMORY_ALIGN)%DIRECTIO_USER_MEMORY_ALIGN;
+    if(NULL == stream->mpGatherBuf || stream->mGatherBufSize < nPadSize + nTotalSize)
+    {
+        if(stream->mpGatherBuf)
+        {
+            free(stream->mpGatherBuf);
+            stream->mpGatherBuf = NULL;
+        }
+        stream->mGatherBufSize = (nPadSize + nTotalSize + DIRECTIO_UNIT_SIZE - 1)/DIRECTIO_UNIT_SIZE*DIRECTIO_UNIT_SIZE;
+        int ret = posix_memalign((void **)&stream->mpGatherBuf, 4096, stream->mGatherBufSize);
+        if(ret!=0)
+        {
+            ALOGE("(f:%s, l:%d) fatal error! malloc [%d]bytes fail!", __FUNCTION__, __LINE__, stream->mGatherBufSize);
+            stream->mpGatherBuf = NULL;
+            stream->mGatherBufSize = 0;
+            return -1;
+        }
+    }
+    char *pDst = stream->mpGatherBuf + nPadSize;
+    for(i=0; i<pBsInfo->bs_count; i++)
+    {
+        memcpy(pDst, pBsInfo->bs_data[i], pBsInfo->bs_size[i]);
+        pDst += pBsInfo->bs_size[i];
+    }
+    stream->mWriteCopyBytes += nTotalSize;
+    if(cdx_write_fd_file(stream->mpGatherBuf + nPadSize, 1, nTotalSize, stream) != nTotalSize)
+    {
+        return -1;
+    }
+    return nTotalSize;
+}
+
+/*******************************************************************************
+Function name: directIOAsyncWriteThread
+Description: 
+    io thread of DirectIOAsyncWriter. write queued buffers in order by the
+    synchronous cdx_write_fd_file(), so a slow sdcard only blocks this thread,
+    muxer thread blocks only when all staging buffers are queued.
+*******************************************************************************/
+static void* directIOAsyncWriteThread(void *pThreadData)
+{
+    struct cdx_stream_info *stream = (struct cdx_stream_info*)pThreadData;
+    DirectIOAsyncWriter *pWriter = (DirectIOAsyncWriter*)stream->mpAsyncWriter;
+    pthread_mutex_lock(&pWriter->mLock);
+    while(1)
+    {
+        while(0 == pWriter->mReadyNum && 0 == pWriter->mQuitFlag)
+        {
+            pthread_cond_wait(&pWriter->mCond, &pWriter->mLock);
+        }
+        if(0 == pWriter->mReadyNum)
+        {
+            break;
+        }
+        DirectIOAsyncBuf *pBuf = &pWriter->mBufs[pWriter->mWriteIdx];
+        int nError = pWriter->mError;
+        pthread_mutex_unlock(&pWriter->mLock);
+
+        int ret = -1;
+        CDX_S64 tm1 = CDX_GetSysTimeUsMonotonic();
+        if(0 == nError)
+        {
+            stream->fd_desc.cur_offset = pBuf->mFileOffset;
+            ret = cdx_write_fd_file(pBuf->mpData, 1, pBuf->mDataSize, stream);
+        }
+        CDX_S64 nLatencyUs = CDX_GetSysTimeUsMonotonic() - tm1;
+
+        pthread_mutex_lock(&pWriter->mLock);
+        if(0 == nError)
+        {
+            if(ret != pBuf->mDataSize)
+            {
+                ALOGE("(f:%s, l:%d) fatal error! write [%d]bytes at [%lld] fail[%d], following data are discarded!", 
+                    __FUNCTION__, __LINE__, pBuf->mDataSize, pBuf->mFileOffset, ret);
+                pWriter->mError = -1;
+            }
+            int nLevel;
+            if(nLatencyUs < 5000)           nLevel = 0;
+            else if(nLatencyUs < 10000)     nLevel = 1;
+            else if(nLatencyUs < 20000)     nLevel = 2;
+            else if(nLatencyUs < 50000)     nLevel = 3;
+            else if(nLatencyUs < 100000)    nLevel = 4;
+            else if(nLatencyUs < 200000)    nLevel = 5;
+            else if(nLatencyUs < 500000)    nLevel = 6;
+            else                            nLevel = 7;
+            pWriter->mStat.mLatencyHist[nLevel]++;
+            if(nLatencyUs > pWriter->mStat.mMaxLatencyUs)
+            {
+                pWriter->mStat.mMaxLatencyUs = nLatencyUs;
+            }
+            if(nLatencyUs >= 100000)
+            {
+                ALOGW("(f:%s, l:%d) write [%d]bytes use [%lld]ms, queued[%d]", __FUNCTION__, __LINE__, pBuf->mDataSize, nLatencyUs/1000, pWriter->mReadyNum);
+            }
+            pWriter->mStat.mWriteCount++;
+            pWriter->mStat.mWriteBytes += pBuf->mDataSize;
+        }
+        pBuf->mDataSize = 0;
+        pWriter->mWriteIdx = (pWriter->mWriteIdx + 1)%pWriter->mBufNum;
+        pWriter->mReadyNum--;
+        pthread_cond_broadcast(&pWriter->mCond);
+    }
+    pthread_mutex_unlock(&pWriter->mLock);
+    return NULL;
+}
+
+static int directIOAsyncCreate(struct cdx_stream_info *stream)
+{
+    DirectIOAsyncWriter *pWriter = (DirectIOAsyncWriter*)malloc(sizeof(DirectIOAsyncWriter));
+    if(NULL == pWriter)
+    {
+        ALOGE("(f:%s, l:%d) fatal error! malloc fail!", __FUNCTION__, __LINE__);
+        return -1;
+    }
+    memset(pWriter, 0, sizeof(DirectIOAsyncWriter));
+    pWriter->mBufNum = CDXCFG_DIRECTIO_ASYNC_BUF_NUM;
+    if(pWriter->mBufNum > DIRECTIO_ASYNC_MAX_BUF_NUM)
+    {
+        pWriter->mBufNum = DIRECTIO_ASYNC_MAX_BUF_NUM;
+    }
+    pWriter->mBufSize = (CDXCFG_DIRECTIO_ASYNC_BUF_SIZE + DIRECTIO_UNIT_SIZE - 1)/DIRECTIO_UNIT_SIZE*DIRECTIO_UNIT_SIZE;
+    int i;
+    for(i=0; i<pWriter->mBufNum; i++)
+    {
+        if(posix_memalign((void **)&pWriter->mBufs[i].mpBase, 4096, pWriter->mBufSize + DIRECTIO_USER_MEMORY_ALIGN) != 0)
+        {
+            ALOGE("(f:%s, l:%d) fatal error! malloc [%d]bytes fail!", __FUNCTION__, __LINE__, pWriter->mBufSize);
+            pWriter->mBufs[i].mpBase = NULL;
+            goto _err0;
+        }
+    }
+    pWriter->mStat.mBufNum = pWriter->mBufNum;
+    pWriter->mStat.mBufSize = pWriter->mBufSize;
+    pthread_mutex_init(&pWriter->mLock, NULL);
+    pthread_cond_init(&pWriter->mCond, NULL);
+    stream->mpAsyncWriter = pWriter;
+    if(pthread_create(&pWriter->mThreadId, NULL, directIOAsyncWriteThread, stream) != 0)
+    {
+        ALOGE("(f:%s, l:%d) fatal error! create thread fail!", __FUNCTION__, __LINE__);
+        stream->mpAsyncWriter = NULL;
+        pthread_cond_destroy(&pWriter->mCond);
+        pthread_mutex_destroy(&pWriter->mLock);
+        goto _err0;
+    }
+    ALOGD("(f:%s, l:%d) directIO async writer, buffer [%d]x[%d]bytes", __FUNCTION__, __LINE__, pWriter->mBufNum, pWriter->mBufSize);
+    return 0;
+
+_err0:
+    for(i=0; i<pWriter->mBufNum; i++)
+    {
+        if(pWriter->mBufs[i].mpBase)
+        {
+            free(pWriter->mBufs[i].mpBase);
+        }
+    }
+    free(pWriter);
+    return -1;
+}
+
+static void directIOAsyncDestroy(struct cdx_stream_info *stream)
+{
+    DirectIOAsyncWriter *pWriter = (DirectIOAsyncWriter*)stream->mpAsyncWriter;
+    if(NULL == pWriter)
+    {
+        return;
+    }
+    directIOAsyncFlush(stream);
+    pthread_mutex_lock(&pWriter->mLock);
+    pWriter->mQuitFlag = 1;
+    pthread_cond_broadcast(&pWriter->mCond);
+    pthread_mutex_unlock(&pWriter->mLock);
+    pthread_join(pWriter->mThreadId, NULL);
+
+    DirectIOAsyncWriteStat *pStat = &pWriter->mStat;
+    ALOGD("(f:%s, l:%d) stream[%p] async write [%lld]times [%lld]bytes, maxLatency[%lld]ms, latency hist(<5,10,20,50,100,200,500,>=500ms)[%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld]", 
+        __FUNCTION__, __LINE__, stream, pStat->mWriteCount, pStat->mWriteBytes, pStat->mMaxLatencyUs/1000,
+        pStat->mLatencyHist[0], pStat->mLatencyHist[1], pStat->mLatencyHist[2], pStat->mLatencyHist[3],
+        pStat->mLatencyHist[4], pStat->mLatencyHist[5], pStat->mLatencyHist[6], pStat->mLatencyHist[7]);
+    ALOGD("(f:%s, l:%d) stream[%p] maxQueueDepth[%d]/[%d], stall [%lld]times [%lld]ms, flush [%lld]times", 
+        __FUNCTION__, __LINE__, stream, pStat->mMaxQueueDepth, pStat->mBufNum, pStat->mStallCount, pStat->mStallUs/1000, pStat->mFlushCount);
+
+    int i;
+    for(i=0; i<pWriter->mBufNum; i++)
+    {
+        free(pWriter->mBufs[i].mpBase);
+    }
+    pthread_cond_destroy(&pWriter->mCond);
+    pthread_mutex_destroy(&pWriter->mLock);
+    free(pWriter);
+    stream->mpAsyncWriter = NULL;
+}
+
+/* muxer thread. queue filling buffer to io thread. */
+static void directIOAsyncQueueFillBuf(DirectIOAsyncWriter *pWriter)
+{
+    pthread_mutex_lock(&pWriter->mLock);
+    pWriter->mFilling = 0;
+    pWriter->mReadyNum++;
+    pWriter->mStat.mQueueDepthHist[pWriter->mReadyNum]++;
+    if(pWriter->mReadyNum > pWriter->mStat.mMaxQueueDepth)
+    {
+        pWriter->mStat.mMaxQueueDepth = pWriter->mReadyNum;
+    }
+    pthread_cond_broadcast(&pWriter->mCond);
+    pthread_mutex_unlock(&pWriter->mLock);
+}
+
+/* muxer thread. wait a free buffer and begin to fill it at mLogicOffset. */
+static int directIOAsyncStartFillBuf(struct cdx_stream_info *stream)
+{
+    DirectIOAsyncWriter *pWriter = (DirectIOAsyncWriter*)stream->mpAsyncWriter;
+    if(0 == pWriter->mLogicValid)
+    {
+        //io thread is idle after flush.
+        pWriter->mLogicOffset = stream->fd_desc.cur_offset;
+        pWriter->mLogicValid = 1;
+    }
+    pthread_mutex_lock(&pWriter->mLock);
+    if(pWriter->mReadyNum >= pWriter->mBufNum)
+    {
+        CDX_S64 tm1 = CDX_GetSysTimeUsMonotonic();
+        while(pWriter->mReadyNum >= pWriter->mBufNum)
+        {
+            pthread_cond_wait(&pWriter->mCond, &pWriter->mLock);
+        }
+        pWriter->mStat.mStallCount++;
+        pWriter->mStat.mStallUs += CDX_GetSysTimeUsMonotonic() - tm1;
+    }
+    int nError = pWriter->mError;
+    pWriter->mFillIdx = (pWriter->mWriteIdx + pWriter->mReadyNum)%pWriter->mBufNum;
+    pthread_mutex_unlock(&pWriter->mLock);
+    if(nError != 0)
+    {
+        return -1;
+    }
+    DirectIOAsyncBuf *pBuf = &pWriter->mBufs[pWriter->mFillIdx];
+    int nHeadLeftSize = 0;
+    if(pWriter->mLogicOffset%DIRECTIO_UNIT_SIZE != 0)
+    {
+        nHeadLeftSize = DIRECTIO_UNIT_SIZE - pWriter->mLogicOffset%DIRECTIO_UNIT_SIZE;
+    }
+    pBuf->mpData = pBuf->mpBase + (DIRECTIO_USER_MEMORY_ALIGN - nHeadLeftSize%DIRECTIO_USER_MEMORY_ALIGN)%DIRECTIO_USER_MEMORY_ALIGN;
+    pBuf->mDataSize = 0;
+    pBuf->mCapacity = pWriter->mBufSize - (DIRECTIO_UNIT_SIZE - nHeadLeftSize)%DIRECTIO_UNIT_SIZE;
+    pBuf->mFileOffset = pWriter->mLogicOffset;
+    pWriter->mFilling = 1;
+    return 0;
+}
+
+/* muxer thread. copy data to staging buffers, queue full ones. */
+static int directIOAsyncAppend(struct cdx_stream_info *stream, const char *ptr, int size)
+{
+    DirectIOAsyncWriter *pWriter = (DirectIOAsyncWriter*)stream->mpAsyncWriter;
+    while(size > 0)
+    {
+        if(0 == pWriter->mFilling)
+        {
+            if(directIOAsyncStartFillBuf(stream) != 0)
+            {
+                return -1;
+            }
+        }
+        DirectIOAsyncBuf *pBuf = &pWriter->mBufs[pWriter->mFillIdx];
+        int nCopySize = pBuf->mCapacity - pBuf->mDataSize;
+        if(nCopySize > size)
+        {
+            nCopySize = size;
+        }
+        memcpy(pBuf->mpData + pBuf->mDataSize, ptr, nCopySize);
+        pBuf->mDataSize += nCopySize;
+        pWriter->mLogicOffset += nCopySize;
+        pWriter->mCopyBytes += nCopySize;
+        ptr += nCopySize;
+        size -= nCopySize;
+        if(pBuf->mDataSize == pBuf->mCapacity)
+        {
+            directIOAsyncQueueFillBuf(pWriter);
+        }
+    }
+    return 0;
+}
+
+/* muxer thread. queue the partial buffer and wait until io thread writes all. */
+static int directIOAsyncFlush(struct cdx_stream_info *stream)
+{
+    DirectIOAsyncWriter *pWriter = (DirectIOAsyncWriter*)stream->mpAsyncWriter;
+    if(NULL == pWriter)
+    {
+        return 0;
+    }
+    if(pWriter->mFilling)
+    {
+        directIOAsyncQueueFillBuf(pWriter);
+    }
+    pthread_mutex_lock(&pWriter->mLock);
+    while(pWriter->mReadyNum > 0)
+    {
+        pthread_cond_wait(&pWriter->mCond, &pWriter->mLock);
+    }
+    pWriter->mStat.mFlushCount++;
+    int ret = pWriter->mError;
+    pthread_mutex_unlock(&pWriter->mLock);
+    pWriter->mLogicValid = 0;
+    stream->mWriteCopyBytes += pWriter->mCopyBytes;
+    pWriter->mCopyBytes = 0;
+    return ret;
+}
+
+/* seek to where muxer is writing need not wait io thread. */
+static int directIOAsyncSeekInPlace(struct cdx_stream_info *stream, cdx_off_t offset, int whence)
+{
+    DirectIOAsyncWriter *pWriter = (DirectIOAsyncWriter*)stream->mpAsyncWriter;
+    if(0 == pWriter->mLogicValid)
+    {
+        return 0;
+    }
+    if(SEEK_CUR == whence && 0 == offset)
+    {
+        return 1;
+    }
+    if(SEEK_SET == whence && offset + stream->fd_desc.offset == pWriter->mLogicOffset)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+static int cdx_async_write_fd_file(const void *ptr, size_t size, size_t nmemb, struct cdx_stream_info *stream)
+{
+    if(NULL == ptr || stream->mFtruncateFlag)
+    {
+        //extend file by write(), do it synchronously.
+        directIOAsyncFlush(stream);
+        return cdx_write_fd_file(ptr, size, nmemb, stream);
+    }
+    if(directIOAsyncAppend(stream, (const char*)ptr, size*nmemb) != 0)
+    {
+        return -1;
+    }
+    return nmemb;
+}
+
+int cdx_get_async_write_stat_fd_file(struct cdx_stream_info *stream, DirectIOAsyncWriteStat *pStat)
+{
+    DirectIOAsyncWriter *pWriter = (DirectIOAsyncWriter*)stream->mpAsyncWriter;
+    if(NULL == pWriter)
+    {
+        return -1;
+    }
+    pthread_mutex_lock(&pWriter->mLock);
+    memcpy(pStat, &pWriter->mStat, sizeof(DirectIOAsyncWriteStat));
+    pthread_mutex_unlock(&pWriter->mLock);
+    return 0;
+}
+
 #else
 int cdx_write_fd_file(const void *ptr, size_t size, size_t nmemb, struct cdx_stream_info *stream)
 {
@@ -850,6 +1384,7 @@ int cdx_write_fd_file(const void *ptr, size_t size, size_t nmemb, struct cdx_str
     }
     if (num_bytes_written != -1) 
     {
+        stream->mWriteBytes += num_bytes_written;
     	num_bytes_written /= size;
     }
     else
@@ -860,10 +1395,146 @@ int cdx_write_fd_file(const void *ptr, size_t size, size_t nmemb, struct cdx_str
     return num_bytes_written;
 }
 
+/*******************************************************************************
+Function name: cdx_write2_fd_file
+Description: 
+    write fragments of CDXRecorderBsInfo by one writev(), no copy in user space.
+Return: 
+    bytes written, -1 if fail.
+*******************************************************************************/
+int cdx_write2_fd_file(void *bs_info, struct cdx_stream_info *stream)
+{
+    CDXRecorderBsInfo *pBsInfo = (CDXRecorderBsInfo*)bs_info;
+    struct iovec iov[4];
+    int nIovCnt = 0;
+    int nTotalSize = 0;
+    int i;
+    for(i=0; i<pBsInfo->bs_count; i++)
+    {
+        if(pBsInfo->bs_size[i] > 0)
+        {
+            iov[nIovCnt].iov_base = pBsInfo->bs_data[i];
+            iov[nIovCnt].iov_len = pBsInfo->bs_size[i];
+            nIovCnt++;
+            nTotalSize += pBsInfo->bs_size[i];
+        }
+    }
+    off64_t result = lseek64(stream->fd_desc.fd, stream->fd_desc.cur_offset, SEEK_SET);
+    if(result == -1)
+    {
+        ALOGE("(f:%s, l:%d) fatal error! seek fail!", __FUNCTION__, __LINE__);
+        return -1;
+    }
+    int nWriteSize = writevFully(stream->fd_desc.fd, iov, nIovCnt, nTotalSize);
+    stream->fd_desc.cur_offset += nWriteSize;
+    stream->mWriteBytes += nWriteSize;
+    return nWriteSize == nTotalSize ? nTotalSize : -1;
+}
+
+int cdx_get_async_write_stat_fd_file(struct cdx_stream_info *stream, DirectIOAsyncWriteStat *pStat)
+{
+    return -1;
+}
+
 #endif
 
+int cdx_flush_fd_file(struct cdx_stream_info *stream)
+{
+#if (CDXCFG_FILE_SYSTEM==OPTION_FILE_SYSTEM_DIRECT_IO)
+    return directIOAsyncFlush(stream);
+#else
+    return 0;
+#endif
+}
+
+/*******************************************************************************
+Function name: cdx_write2_stream_file
+Description: 
+    FILE stream: flush what stdio buffered, then write all fragments by one
+    writev() on the underlying fd, no copy in user space. stdio is seeked to
+    the new position after that, so later fwrite()/ftello() continue from it.
+    FatFs has no fd, fragments are passed to cdx_write_stream_file() one by one.
+Return: 
+    bytes written, -1 if fail.
+*******************************************************************************/
+int cdx_write2_stream_file(void *bs_info, struct cdx_stream_info *stream)
+{
+    CDXRecorderBsInfo *pBsInfo = (CDXRecorderBsInfo*)bs_info;
+    int nTotalSize = 0;
+    int i;
+#if (CDXCFG_FILE_SYSTEM==OPTION_FILE_SYSTEM_DIRECT_FATFS)
+    for(i=0; i<pBsInfo->bs_count; i++)
+    {
+        if(pBsInfo->bs_size[i] <= 0)
+        {
+            continue;
+        }
+        if(cdx_write_stream_file(pBsInfo->bs_data[i], 1, pBsInfo->bs_size[i], stream) != pBsInfo->bs_size[i])
+        {
+            ALOGE("(f:%s, l:%d) fatal error! write fragment[%d] size[%d] fail!", __FUNCTION__, __LINE__, i, pBsInfo->bs_size[i]);
+            return -1;
+        }
+        nTotalSize += pBsInfo->bs_size[i];
+    }
+    return nTotalSize;
+#else
+    struct iovec iov[4];
+    int nIovCnt = 0;
+    for(i=0; i<pBsInfo->bs_count; i++)
+    {
+        if(pBsInfo->bs_size[i] > 0)
+        {
+            iov[nIovCnt].iov_base = pBsInfo->bs_data[i];
+            iov[nIovCnt].iov_len = pBsInfo->bs_size[i];
+            nIovCnt++;
+            nTotalSize += pBsInfo->bs_size[i];
+        }
+    }
+    if(0 == nTotalSize)
+    {
+        return 0;
+    }
+    cdx_off_t nPos = ftello(stream->file_handle);
+    if(-1 == nPos || fflush(stream->file_handle) != 0)
+    {
+        ALOGE("(f:%s, l:%d) fatal error! flush stdio buffer fail[%s]!", __FUNCTION__, __LINE__, strerror(errno));
+        return -1;
+    }
+    int fd = fileno(stream->file_handle);
+    int nWriteSize = -1;
+    if(lseek64(fd, nPos, SEEK_SET) != -1)
+    {
+        nWriteSize = writevFully(fd, iov, nIovCnt, nTotalSize);
+    }
+    else
+    {
+        ALOGE("(f:%s, l:%d) fatal error! seek fail!", __FUNCTION__, __LINE__);
+    }
+    if(nWriteSize > 0)
+    {
+        stream->mWriteBytes += nWriteSize;
+        nPos += nWriteSize;
+    }
+    //resync stdio with the fd, it caches the file position.
+    if(fseeko(stream->file_handle, nPos, SEEK_SET) != 0)
+    {
+        ALOGE("(f:%s, l:%d) fatal error! seek to [%lld] fail!", __FUNCTION__, __LINE__, nPos);
+        return -1;
+    }
+    return nWriteSize == nTotalSize ? nTotalSize : -1;
+#endif
+}
+
 long long cdx_get_fd_size_file(struct cdx_stream_info *stream)
 {
+#if (CDXCFG_FILE_SYSTEM==OPTION_FILE_SYSTEM_DIRECT_IO)
+    directIOAsyncFlush(stream);
+    if(stream->mIODirectionFlag)
+    {
+        //physical size may be bigger because of block align or preallocation.
+        return stream->mFileEndOffset - stream->fd_desc.offset;
+    }
+#endif
     if(stream->mFileEndOffset != stream->mFileSize)
     {
         ALOGE("(f:%s, l:%d) fatal error! [%lld]!=[%lld]", __FUNCTION__, __LINE__, stream->mFileEndOffset, stream->mFileSize);
@@ -889,6 +1560,9 @@ long long cdx_get_fd_size_file(struct cdx_stream_info *stream)
 
 int cdx_truncate_fd_file(struct cdx_stream_info *stream, cdx_off_t length)
 {
+#if (CDXCFG_FILE_SYSTEM==OPTION_FILE_SYSTEM_DIRECT_IO)
+    directIOAsyncFlush(stream);
+#endif
     int ret = ftruncate(stream->fd_desc.fd, length);
     if(ret!=0)
     {
@@ -899,6 +1573,157 @@ int cdx_truncate_fd_file(struct cdx_stream_info *stream, cdx_off_t length)
     return ret;
 }
 
+#if (CDXCFG_FILE_SYSTEM==OPTION_FILE_SYSTEM_DIRECT_IO)
+/* return preallocated size and forget the file, -1 if it is not preallocated. */
+static long long directIOTakePreallocFile(int fd)
+{
+    struct stat fileStat;
+    long long nSize = -1;
+    int i;
+    if(fstat(fd, &fileStat) != 0)
+    {
+        return -1;
+    }
+    pthread_mutex_lock(&gPreallocFileLock);
+    for(i=0; i<gPreallocFileNum; i++)
+    {
+        if(gPreallocFiles[i].mDev == fileStat.st_dev && gPreallocFiles[i].mIno == fileStat.st_ino)
+        {
+            nSize = gPreallocFiles[i].mSize;
+            gPreallocFiles[i] = gPreallocFiles[--gPreallocFileNum];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&gPreallocFileLock);
+    if(nSize >= 0 && fileStat.st_size < nSize)
+    {
+        ALOGW("(f:%s, l:%d) preallocated file is shrunk [%lld]<[%lld], ignore it", __FUNCTION__, __LINE__, (long long)fileStat.st_size, nSize);
+        nSize = -1;
+    }
+    return nSize;
+}
+#endif
+
+/*******************************************************************************
+Function name: cdx_preallocate_fd_file
+Description: 
+    preallocate an output file before it is given to muxer, called on a
+    background thread ahead of file rotation.
+    VFS: fallocate() with FALLOC_FL_KEEP_SIZE, blocks are reserved but file
+    size is still 0, so muxer writes it as a new file.
+    DirectIO: fill it with 0xFF blocks by O_DIRECT write, the same way as
+    seek extend in recording. Output stream opens it without truncate, and
+    cut it to the written size when destroyed.
+    pAbortFlag: if not NULL, the fill stops when *pAbortFlag becomes nonzero,
+    the file is not recorded as preallocated then. At most the block being
+    written still lands after that, muxer overwrites or cuts it.
+Return: 
+    0 if success.
+*******************************************************************************/
+int cdx_preallocate_fd_file(int fd, int64_t len, volatile int *pAbortFlag)
+{
+    if(fd < 0 || len <= 0)
+    {
+        ALOGE("(f:%s, l:%d) fatal error! wrong fd[%d] len[%lld]", __FUNCTION__, __LINE__, fd, len);
+        return -1;
+    }
+#if (CDXCFG_FILE_SYSTEM==OPTION_FILE_SYSTEM_DIRECT_FATFS)
+    ALOGW("(f:%s, l:%d) fatfs not support preallocate fd", __FUNCTION__, __LINE__);
+    return -1;
+#elif (CDXCFG_FILE_SYSTEM==OPTION_FILE_SYSTEM_DIRECT_IO)
+    char *pFilePath = generateFilepathFromFd(fd);
+    if(NULL == pFilePath)
+    {
+        return -1;
+    }
+    int nFd = open(pFilePath, O_RDWR | O_DIRECT);
+    free(pFilePath);
+    if(nFd < 0)
+    {
+        ALOGE("(f:%s, l:%d) fatal error! open fail(%s)", __FUNCTION__, __LINE__, strerror(errno));
+        return -1;
+    }
+    char *pBuf = NULL;
+    if(posix_memalign((void **)&pBuf, 4096, DIRECTIO_UNIT_SIZE) != 0)
+    {
+        ALOGE("(f:%s, l:%d) fatal error! malloc fail!", __FUNCTION__, __LINE__);
+        close(nFd);
+        return -1;
+    }
+    memset(pBuf, 0xFF, DIRECTIO_UNIT_SIZE);
+    long long nAlignLen = (len + DIRECTIO_UNIT_SIZE - 1)/DIRECTIO_UNIT_SIZE*DIRECTIO_UNIT_SIZE;
+    long long nWriteLen = 0;
+    CDX_S64 tm1 = CDX_GetSysTimeUsMonotonic();
+    int ret = 0;
+    if(lseek64(nFd, 0, SEEK_SET) != 0)
+    {
+        ret = -1;
+    }
+    while(0 == ret && nWriteLen < nAlignLen)
+    {
+        if(pAbortFlag && *pAbortFlag)
+        {
+            ALOGW("(f:%s, l:%d) abort at [%lld], file is given up", __FUNCTION__, __LINE__, nWriteLen);
+            ret = -1;
+            break;
+        }
+        ssize_t wrtSize = write(nFd, pBuf, DIRECTIO_UNIT_SIZE);
+        if(wrtSize != DIRECTIO_UNIT_SIZE)
+        {
+            ALOGE("(f:%s, l:%d) fatal error! write[%d]bytes at [%lld] fail[%s]!", __FUNCTION__, __LINE__, DIRECTIO_UNIT_SIZE, nWriteLen, strerror(errno));
+            ret = -1;
+            break;
+        }
+        nWriteLen += DIRECTIO_UNIT_SIZE;
+    }
+    CDX_S64 tm2 = CDX_GetSysTimeUsMonotonic();
+    free(pBuf);
+    if(0 == ret && pAbortFlag && *pAbortFlag)
+    {
+        ret = -1;
+    }
+    if(0 == ret)
+    {
+        struct stat fileStat;
+        if(fstat(nFd, &fileStat) == 0)
+        {
+            pthread_mutex_lock(&gPreallocFileLock);
+            if(gPreallocFileNum >= DIRECTIO_PREALLOC_FILE_MAX)
+            {
+                ALOGW("(f:%s, l:%d) too many preallocated files, forget the oldest", __FUNCTION__, __LINE__);
+                memmove(&gPreallocFiles[0], &gPreallocFiles[1], sizeof(DirectIOPreallocFile)*(DIRECTIO_PREALLOC_FILE_MAX-1));
+                gPreallocFileNum--;
+            }
+            gPreallocFiles[gPreallocFileNum].mDev = fileStat.st_dev;
+            gPreallocFiles[gPreallocFileNum].mIno = fileStat.st_ino;
+            gPreallocFiles[gPreallocFileNum].mSize = nAlignLen;
+            gPreallocFileNum++;
+            pthread_mutex_unlock(&gPreallocFileLock);
+        }
+        else
+        {
+            ret = -1;
+        }
+    }
+    close(nFd);
+    ALOGD("(f:%s, l:%d) fd[%d] preallocate [%lld]bytes, use [%lld]ms, ret[%d]", __FUNCTION__, __LINE__, fd, nAlignLen, (tm2-tm1)/1000, ret);
+    return ret;
+#else
+    if(pAbortFlag && *pAbortFlag)
+    {
+        return -1;
+    }
+    CDX_S64 tm1 = CDX_GetSysTimeUsMonotonic();
+    if(fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, len) < 0)
+    {
+        ALOGE("(f:%s, l:%d) fatal error! Failed to fallocate size %lld, (%s)", __FUNCTION__, __LINE__, len, strerror(errno));
+        return -1;
+    }
+    ALOGD("(f:%s, l:%d) fd[%d] fallocate [%lld]bytes, use [%lld]ms", __FUNCTION__, __LINE__, fd, len, (CDX_GetSysTimeUsMonotonic()-tm1)/1000);
+    return 0;
+#endif
+}
+
 int cdx_fallocate_fd_file(struct cdx_stream_info *stream, int mode, int64_t offset, int64_t len)
 {
 #if (CDXCFG_FILE_SYSTEM==OPTION_FILE_SYSTEM_DIRECT_IO)
@@ -1058,6 +1883,7 @@ static int destory_outstream_handle_file(struct cdx_stream_info *stm_info)
 	}
 #else
   #if (CDXCFG_FILE_SYSTEM==OPTION_FILE_SYSTEM_DIRECT_IO)
+    directIOAsyncDestroy(stm_info);
     if(stm_info->mFileEndOffset < stm_info->mFileSize)
     {
         ALOGD("(f:%s, l:%d) fd[%d], [%lld]<[%lld], DirectIO use ftruncate() before close.", 
@@ -1108,6 +1934,14 @@ static int destory_outstream_handle_file(struct cdx_stream_info *stm_info)
         stm_info->mpAlignBuf = NULL;
     }
     stm_info->mAlignBufSize = 0;
+    if(stm_info->mpGatherBuf)
+    {
+        free(stm_info->mpGatherBuf);
+        stm_info->mpGatherBuf = NULL;
+    }
+    stm_info->mGatherBufSize = 0;
+    ALOGD("(f:%s, l:%d) stream[%p] write [%lld]bytes, user space copy [%lld]bytes", 
+        __FUNCTION__, __LINE__, stm_info, stm_info->mWriteBytes, stm_info->mWriteCopyBytes);
 	return 0;
 }
 
@@ -1132,14 +1966,19 @@ int create_outstream_handle_file(struct cdx_stream_info *stm_info, CedarXDataSou
     {
         //ALOGD("(f:%s, l:%d) fd[%d], offset[%lld], length[%lld]", __FUNCTION__, __LINE__, datasource_desc->ext_fd_desc.fd, datasource_desc->ext_fd_desc.offset, datasource_desc->ext_fd_desc.length);
         #if (CDXCFG_FILE_SYSTEM==OPTION_FILE_SYSTEM_DIRECT_IO)
-            //get filepath, reopen again!
+            //get filepath, reopen again! preallocated file keeps its size, it is cut when destroy.
+            long long nPreallocSize = directIOTakePreallocFile(datasource_desc->ext_fd_desc.fd);
             stm_info->mpFilePath = generateFilepathFromFd(datasource_desc->ext_fd_desc.fd);
-            stm_info->fd_desc.fd = open(stm_info->mpFilePath, O_CREAT | O_TRUNC | O_RDWR | O_DIRECT, 0666);
+            stm_info->fd_desc.fd = open(stm_info->mpFilePath, O_CREAT | O_RDWR | O_DIRECT | (nPreallocSize > 0 ? 0 : O_TRUNC), 0666);
             stm_info->fd_desc.offset = datasource_desc->ext_fd_desc.offset;
             stm_info->fd_desc.cur_offset = datasource_desc->ext_fd_desc.offset;
             stm_info->fd_desc.length = datasource_desc->ext_fd_desc.length;
-            stm_info->mFileEndOffset = lseek64(stm_info->fd_desc.fd, 0, SEEK_END);
-            stm_info->mFileSize = stm_info->mFileEndOffset;
+            stm_info->mFileSize = lseek64(stm_info->fd_desc.fd, 0, SEEK_END);
+            stm_info->mFileEndOffset = nPreallocSize > 0 ? 0 : stm_info->mFileSize;
+            if(nPreallocSize > 0)
+            {
+                ALOGD("(f:%s, l:%d) use preallocated file, size[%lld]", __FUNCTION__, __LINE__, stm_info->mFileSize);
+            }
             if(stm_info->mFileEndOffset!=0)
             {
                 ALOGE("(f:%s, l:%d) fatal error! mEndOffset[%lld], mFileSize[%lld] should be 0!", __FUNCTION__, __LINE__, stm_info->mFileEndOffset, stm_info->mFileSize);
@@ -1152,11 +1991,24 @@ int create_outstream_handle_file(struct cdx_stream_info *stm_info, CedarXDataSou
         	stm_info->tell  = cdx_tell_fd_file ;
         	stm_info->read  = cdx_read_fd_file ;
         	stm_info->write = cdx_write_fd_file;
+            stm_info->write2 = cdx_write2_fd_file;
             stm_info->truncate = cdx_truncate_fd_file;
             stm_info->fallocate = cdx_fallocate_fd_file;
         	stm_info->getsize = cdx_get_fd_size_file;
+            stm_info->flush = cdx_flush_fd_file;
             stm_info->destory = destory_outstream_handle_file;
             stm_info->seek(stm_info, 0, SEEK_SET);
+            if(CDXCFG_DIRECTIO_ASYNC_BUF_NUM > 0)
+            {
+                if(0 == directIOAsyncCreate(stm_info))
+                {
+                    stm_info->write = cdx_async_write_fd_file;
+                }
+                else
+                {
+                    ALOGW("(f:%s, l:%d) create async writer fail, write synchronously!", __FUNCTION__, __LINE__);
+                }
+            }
         	return 0;
         #else
           #if 1
@@ -1203,9 +2055,11 @@ int create_outstream_handle_file(struct cdx_stream_info *stm_info, CedarXDataSou
         	stm_info->tell  = cdx_tell_fd_file ;
         	stm_info->read  = cdx_read_fd_file ;
         	stm_info->write = cdx_write_fd_file;
+            stm_info->write2 = cdx_write2_fd_file;
             stm_info->truncate = cdx_truncate_fd_file;
             stm_info->fallocate = cdx_fallocate_fd_file;
         	stm_info->getsize = cdx_get_fd_size_file;
+            stm_info->flush = cdx_flush_fd_file;
         	stm_info->destory = destory_outstream_handle_file;
             stm_info->seek(stm_info, 0, SEEK_SET);
             return 0;
@@ -1241,6 +2095,7 @@ int create_outstream_handle_file(struct cdx_stream_info *stm_info, CedarXDataSou
 	stm_info->tell  = cdx_tell_stream_file ;
 	stm_info->read  = cdx_read_stream_file ;
 	stm_info->write = cdx_write_stream_file;
+	stm_info->write2 = cdx_write2_stream_file;
     stm_info->truncate = cdx_truncate_stream_file;
     stm_info->fallocate = cdx_fallocate_stream_file;
 	stm_info->getsize = cdx_get_stream_size_file;
@@ -36,7 +36,9 @@ namespace android {
 //CedarXNativeRenderer::CedarXNativeRenderer(const sp<ANativeWindow> &nativeWindow, const sp<MetaData> &meta)
 //    : mNativeWindow(nativeWindow)
 CedarXNativeRenderer::CedarXNativeRenderer(const unsigned int hlay, const sp<MetaData> &meta)
-    : mVideoLayerId(hlay)
+    : mVideoLayerId(hlay),
+      mHeldCount(0),
+      mLastFrameId(-1)
 {
     int32_t halFormat,screenID; //halFormat = e_hwc_format <==> VirtualHWCRenderFormat
     size_t bufWidth, bufHeight;
@@ -84,6 +86,9 @@ CedarXNativeRenderer::CedarXNativeRenderer(const unsigned int hlay, const sp<Met
 	src.crop_h = mHeight;
 	src.format = halFormat;
 	mHwDisplay->hwd_layer_set_src(mVideoLayerId, &src);
+	// frames go to the screen on vsync, the newest one if several are due
+	mHwDisplay->hwd_layer_set_release_callback(mVideoLayerId, onFrameReleased, this);
+	mHwDisplay->hwd_layer_set_present_mode(mVideoLayerId, HWD_PRESENT_LATEST);
 #if 0
     if(halFormat == HAL_PIXEL_FORMAT_YV12)
     {
@@ -176,6 +181,8 @@ CedarXNativeRenderer::CedarXNativeRenderer(const unsigned int hlay, const sp<Met
 
 CedarXNativeRenderer::~CedarXNativeRenderer()
 {
+	mHwDisplay->hwd_layer_set_present_mode(mVideoLayerId, HWD_PRESENT_IMMEDIATE);
+	mHwDisplay->hwd_layer_set_release_callback(mVideoLayerId, NULL, NULL);
 //    if(pCedarXNativeRendererAdapter)
 //    {
 //        delete pCedarXNativeRendererAdapter;
@@ -199,15 +206,51 @@ void CedarXNativeRenderer::render(const void *data, size_t size, void *platformP
     overlay_para.top_c             = pVirtuallibhwclayerpara->top_u;
     overlay_para.bottom_y          = 0;
     overlay_para.bottom_c          = 0;
+	{
+		Mutex::Autolock lock(mFrameLock);
+		if (mHeldCount == (int)(sizeof(mHeldIds) / sizeof(mHeldIds[0]))) {
+			LOGW("(f:%s, l:%d) frame %d never handed back", __FUNCTION__, __LINE__, mHeldIds[0]);
+			mHeldCount--;
+			memmove(mHeldIds, mHeldIds + 1, mHeldCount * sizeof(mHeldIds[0]));
+		}
+		mHeldIds[mHeldCount++] = overlay_para.number;
+		mLastFrameId = overlay_para.number;
+	}
 	mHwDisplay->hwd_layer_render(mVideoLayerId, &overlay_para);
 //    convertlibhwclayerpara_NativeRendererVirtual2Arch(&overlay_para, pVirtuallibhwclayerpara);
 //    mNativeWindow->perform(mNativeWindow.get(), NATIVE_WINDOW_SETPARAMETER, HWC_LAYER_SETFRAMEPARA, (uint32_t)(&overlay_para));
 }
 
 
-int CedarXNativeRenderer::control(int cmd, int para)
+void CedarXNativeRenderer::onFrameReleased(void *cookie, unsigned int hlay,
+        const libhwclayerpara_t *frame, int shown)
 {
+	CedarXNativeRenderer *renderer = (CedarXNativeRenderer *)cookie;
+	Mutex::Autolock lock(renderer->mFrameLock);
+	int i;
+
+	for (i = 0; i < renderer->mHeldCount; i++) {
+		if (renderer->mHeldIds[i] == (int)frame->number) {
+			renderer->mHeldCount--;
+			memmove(renderer->mHeldIds + i, renderer->mHeldIds + i + 1,
+					(renderer->mHeldCount - i) * sizeof(renderer->mHeldIds[0]));
+			break;
+		}
+	}
+}
 
+/*
+ * The decoder asks for the frame on display (CDX_EVENT_VIDEORENDERGETDISPID)
+ * and reuses the ones rendered before it. Frames wait for vsync in HwDisplay
+ * and stay on screen until a later one has been latched, so this is the
+ * oldest frame HwDisplay has not handed back yet.
+ */
+int CedarXNativeRenderer::control(int cmd, int para)
+{
+	if (cmd == VIDEORENDER_CMD_GETCURFRAMEPARA) {
+		Mutex::Autolock lock(mFrameLock);
+		return mHeldCount > 0 ? mHeldIds[0] : mLastFrameId;
+	}
     return 0;
 }
 }  // namespace android
@@ -55,6 +55,14 @@ private:
     int32_t mCropWidth, mCropHeight;
     int32_t mLayerShowed;
 
+    // ids of the frames HwDisplay holds, oldest first, see control()
+    static void onFrameReleased(void *cookie, unsigned int hlay,
+            const libhwclayerpara_t *frame, int shown);
+    Mutex mFrameLock;
+    int mHeldIds[HWD_PRESENT_QUEUE_DEPTH + HWD_RETIRED_MAX + 1];
+    int mHeldCount;
+    int mLastFrameId;
+
     CedarXNativeRenderer(const CedarXNativeRenderer &);
     CedarXNativeRenderer &operator=(const CedarXNativeRenderer &);
     //friend class CedarXNativeRendererAdapter;
@@ -43,6 +43,10 @@
 #include <include_base/FsWriter.h>
 #include <include_base/CDX_SystemBase.h>
 #include <ConfigOption.h>
+extern "C" {
+#include <cedarx_stream_file.h>
+}
+#include <errno.h>
 //#include <linux/videodev2.h>
 
 #define F_LOG 	LOGV("%s, line: %d", __FUNCTION__, __LINE__);
@@ -381,6 +385,8 @@ CedarXRecorder::CedarXRecorder()
 	: mOutputFd(-1)
 	, mFallocateLength(0)
 	, mUrl(NULL)
+	, mBsDumpPath(NULL)
+	, mBsDumpStream(NULL)
 	, mStarted(false)
 	, mPrepared(false)
 	, mRecModeFlag(0)
@@ -440,7 +446,21 @@ CedarXRecorder::CedarXRecorder()
 #endif
 	memset(mCameraHalVersion, 0, sizeof(mCameraHalVersion));
 	mEncData.clear();
+	mBsNextSeq = 0;
+	mBsConsumers.clear();
+	mBsConsumerIdCounter = BS_DEFAULT_CONSUMER;
+	mBsKeyFrameWanted = false;
+	mBsKeyFrameRequested = false;
+	mBsRingHeap = NULL;
+	mBsRingHead = 0;
+	mBsRingGeneration = 0;
+	mBsWaitAborted = false;
+	memset(&mBsRingStat, 0, sizeof(EncRingStatistics));
 	memset(&mPpsInfo, 0, sizeof(VencHeaderData));
+	mPrepareExit = false;
+	mPrepareAbortFlag = 0;
+	mPreparedFiles.clear();
+	memset(&mRotateStat, 0, sizeof(FileRotateStatistics));
 
     mSampleCount = 0;
 	
@@ -451,6 +471,7 @@ CedarXRecorder::~CedarXRecorder()
     LOGV("CedarXRecorder Destructor");
 
     stop();
+    stopPrepareThread();
     if(mBsFrameMemory != NULL) {
     	mBsFrameMemory.clear();
     	mBsFrameMemory = NULL;
@@ -467,6 +488,11 @@ CedarXRecorder::~CedarXRecorder()
 		mUrl = NULL;
 	}
 
+	if (mBsDumpPath != NULL) {
+		free(mBsDumpPath);
+		mBsDumpPath = NULL;
+	}
+
 #ifdef FOR_CTS_TEST
 	if (mCallingProcessName != NULL) {
 		free(mCallingProcessName);
@@ -475,12 +501,7 @@ CedarXRecorder::~CedarXRecorder()
 #endif
     {
         Mutex::Autolock lock(mQueueLock);
-        while (!mEncData.isEmpty()) {
-            EncQueueBuffer &buf = mEncData.editItemAt(0);
-            buf.mem.clear();
-            mEncData.removeAt(0);
-        }
-        mEncData.clear();
+        clearBsRing();
     }
 
 //    if(pCedarXRecorderAdapter)
@@ -1179,6 +1200,8 @@ status_t CedarXRecorder::setParameter(
         if (safe_strtoi32(value.string(), &nEnable)) {
             return enableDynamicBitRateControl((bool)nEnable);
         }
+    } else if (key == "param-bs-dump-path") {
+        return setParamBsDumpPath(value.string());
     } else {
         ALOGE("setParameter: failed to find key %s", key.string());
     }
@@ -1853,6 +1876,17 @@ status_t CedarXRecorder::start()
 	ALOGD("mLatencyStartUs: %lldms", mLatencyStartUs/1000);
 	LOGV("VIDEO_LATENCY_TIME: %dus, AUDIO_LATENCY_TIME: %dus", VIDEO_LATENCY_TIME, AUDIO_LATENCY_TIME);
 
+    if (mBsDumpPath != NULL && mBsDumpStream == NULL) {
+        CedarXDataSourceDesc desc;
+        memset(&desc, 0, sizeof(CedarXDataSourceDesc));
+        desc.source_type = CEDARX_SOURCE_FILEPATH;
+        desc.source_url = mBsDumpPath;
+        mBsDumpStream = create_outstream_handle(&desc);
+        if (mBsDumpStream == NULL) {
+            ALOGW("(f:%s, l:%d) open bs dump file[%s] fail, don't dump", __FUNCTION__, __LINE__, mBsDumpPath);
+        }
+    }
+
 	mStarted = true;
 	mCdxRecorder->control((void*)mCdxRecorder, CDX_CMD_START, 0, 0);
 
@@ -1910,15 +1944,14 @@ status_t CedarXRecorder::stop()
 	mCdxRecorder->control((void*)mCdxRecorder, CDX_CMD_STOP, 0, 0);
 	CDXRecorder_Destroy((void*)mCdxRecorder);
 	mCdxRecorder = NULL;
+    if (mBsDumpStream != NULL) {
+        destroy_outstream_handle(mBsDumpStream);
+        mBsDumpStream = NULL;
+    }
 	
     {
         Mutex::Autolock lock(mQueueLock);
-        while (!mEncData.isEmpty()) {
-            EncQueueBuffer &buf = mEncData.editItemAt(0);
-            buf.mem.clear();
-            mEncData.removeAt(0);
-        }
-        mEncData.clear();
+        clearBsRing();
     }
     
 	mSoftFrameRateCtrl.enable = false;
@@ -2144,6 +2177,39 @@ status_t CedarXRecorder::dump(
     result.append(buffer);
     snprintf(buffer, SIZE, "     Bit rate (bps): %d\n", mVideoBitRate);
     result.append(buffer);
+    snprintf(buffer, SIZE, "   Bs ring\n");
+    result.append(buffer);
+    snprintf(buffer, SIZE, "     Size (bytes): %d, head: %d\n", mBsRingHeap != NULL ? (int)mBsRingHeap->getSize() : 0, (int)mBsRingHead);
+    result.append(buffer);
+    snprintf(buffer, SIZE, "     Frames kept: %d, peak: %d\n", mEncData.size(), mBsRingStat.mMaxOccupiedSlots);
+    result.append(buffer);
+    snprintf(buffer, SIZE, "     Pushed: %lld, overflow drop: %lld, forced release: %lld, private heap: %lld\n", 
+        mBsRingStat.mPushCount, mBsRingStat.mOverflowDropCount, mBsRingStat.mForcedReleaseCount, mBsRingStat.mPrivateHeapCount);
+    result.append(buffer);
+    for (size_t i = 0; i < mBsConsumers.size(); i++) {
+        const BsConsumer &consumer = mBsConsumers.valueAt(i);
+        const BsFrameWaitStatistics &stat = consumer.mWaitStat;
+        snprintf(buffer, SIZE, "     Consumer %d (pid %d, policy %d): lag %lld frames, in use %d, dropped %lld, forced release %lld\n",
+            mBsConsumers.keyAt(i), consumer.mPid, consumer.mDropPolicy, mBsNextSeq - consumer.mReadSeq,
+            consumer.mInUse.size(), consumer.mDropCount, consumer.mForcedReleaseCount);
+        result.append(buffer);
+        snprintf(buffer, SIZE, "       waits %lld, wakeups %lld, timeouts %lld, frames/wakeup %lld, wait avg %lldus max %lldus\n",
+            stat.mWaitCount, stat.mWakeupCount, stat.mTimeoutCount,
+            stat.mWakeupCount > 0 ? stat.mWakeupFrames / stat.mWakeupCount : 0LL,
+            stat.mWaitCount > 0 ? stat.mTotalWaitUs / stat.mWaitCount : 0LL, stat.mMaxWaitUs);
+        result.append(buffer);
+    }
+    snprintf(buffer, SIZE, "   File rotation\n");
+    result.append(buffer);
+    snprintf(buffer, SIZE, "     Rotations: %lld, preallocated: %lld, still preallocating: %lld, files waiting: %d\n",
+        mRotateStat.mRotateCount, mRotateStat.mPreparedHitCount, mRotateStat.mPrepareBusyCount, mPreparedFiles.size());
+    result.append(buffer);
+    snprintf(buffer, SIZE, "     Gap (us): last %lld, avg %lld, max %lld\n", mRotateStat.mLastGapUs,
+        mRotateStat.mRotateCount > 0 ? mRotateStat.mTotalGapUs / mRotateStat.mRotateCount : 0LL, mRotateStat.mMaxGapUs);
+    result.append(buffer);
+    snprintf(buffer, SIZE, "     Lost frames: last %d, max %d, total %lld\n",
+        mRotateStat.mLastLostFrames, mRotateStat.mMaxLostFrames, mRotateStat.mTotalLostFrames);
+    result.append(buffer);
     ::write(fd, result.string(), result.size());
     return OK;
 }
@@ -2282,6 +2348,7 @@ void CedarXRecorder::dataCallbackTimestamp(int64_t timestampUs,
     {
         ALOGW("(f:%s, l:%d) Be careful! linux csi discard frame! buf.timeStamp[%lld]-lastPts[%lld]=[%lld]us >[%d]us, frameRate[%d][%d]", 
             __FUNCTION__, __LINE__, buf.timeStamp, mDebugLastVideoPts, buf.timeStamp-mDebugLastVideoPts, mMaxDurationPerFrame*2, mSrcFrameRate, mFrameRate);
+        countRotateLostFrames((buf.timeStamp - mDebugLastVideoPts)/mMaxDurationPerFrame - 1);
     }
     mDebugLastVideoPts = buf.timeStamp;
 	ret = mCdxRecorder->control((void*)mCdxRecorder, CDX_CMD_SEND_BUF, (unsigned int)&buf, 0); 
@@ -2289,6 +2356,7 @@ void CedarXRecorder::dataCallbackTimestamp(int64_t timestampUs,
 	{
         ALOGW("(f:%s, l:%d) fatal error! discard frame! buf.index[%d], send_buf ret[%d]", __FUNCTION__, __LINE__, buf.index, ret);
 		CedarXReleaseFrame(buf.index);
+        countRotateLostFrames(1);
 	}
 #if 0
     if(mRecordFileFlag)
@@ -2443,50 +2511,666 @@ status_t CedarXRecorder::readMediaBufferCallback(void *buf_header)
 	return OK;
 }
 
+/* must hold mQueueLock. BS_DEFAULT_CONSUMER is created at the first call, start from the oldest frame. */
+BsConsumer *CedarXRecorder::getBsConsumerLocked(int consumerId)
+{
+    ssize_t index = mBsConsumers.indexOfKey(consumerId);
+    if (index < 0) {
+        if (consumerId != BS_DEFAULT_CONSUMER) {
+            return NULL;
+        }
+        BsConsumer consumer;
+        consumer.mDropPolicy = BSCONSUMER_DROP_OLDEST;
+        consumer.mPid = IPCThreadState::self()->getCallingPid();
+        consumer.mReadSeq = mEncData.isEmpty() ? mBsNextSeq : mEncData[0].seq;
+        consumer.mWaitKeyFrame = false;
+        consumer.mDropCount = 0;
+        consumer.mForcedReleaseCount = 0;
+        consumer.mForcedUnacked = 0;
+        memset(&consumer.mWaitStat, 0, sizeof(BsFrameWaitStatistics));
+        index = mBsConsumers.add(consumerId, consumer);
+    }
+    return &mBsConsumers.editValueAt(index);
+}
+
+/*******************************************************************************
+Function name: android.CedarXRecorder.registerBsConsumer
+Description: 
+    add one consumer of encoded frames, e.g., RTSP, cloud upload. Every
+    consumer has its own read cursor. When it falls ENC_BACKUP_BUFFER_NUM
+    frames behind, its frames are dropped by dropPolicy, other consumers and
+    encoder are not affected. It starts from the newest queued key frame.
+Return: 
+    consumerId > 0 if success.
+*******************************************************************************/
+int CedarXRecorder::registerBsConsumer(int dropPolicy)
+{
+    if (dropPolicy != BSCONSUMER_DROP_OLDEST && dropPolicy != BSCONSUMER_SKIP_TO_KEYFRAME) {
+        ALOGE("(f:%s, l:%d) unknown drop policy[%d]", __FUNCTION__, __LINE__, dropPolicy);
+        return BAD_VALUE;
+    }
+	Mutex::Autolock lock(mQueueLock);
+    BsConsumer consumer;
+    consumer.mDropPolicy = dropPolicy;
+    consumer.mPid = IPCThreadState::self()->getCallingPid();
+    consumer.mReadSeq = mBsNextSeq;
+    consumer.mWaitKeyFrame = true;
+    for (ssize_t i = (ssize_t)mEncData.size() - 1; i >= 0; i--) {
+        if (mEncData[i].flags & BSFRAME_FLAG_KEYFRAME) {
+            consumer.mReadSeq = mEncData[i].seq;
+            consumer.mWaitKeyFrame = false;
+            break;
+        }
+    }
+    consumer.mDropCount = 0;
+    consumer.mForcedReleaseCount = 0;
+    consumer.mForcedUnacked = 0;
+    memset(&consumer.mWaitStat, 0, sizeof(BsFrameWaitStatistics));
+    if (consumer.mWaitKeyFrame) {
+        mBsKeyFrameWanted = true;
+    }
+    int consumerId = ++mBsConsumerIdCounter;
+    mBsConsumers.add(consumerId, consumer);
+    ALOGD("registerBsConsumer: id[%d], policy[%d], pid[%d]", consumerId, dropPolicy, consumer.mPid);
+    return consumerId;
+}
+
+status_t CedarXRecorder::unregisterBsConsumer(int consumerId)
+{
+	Mutex::Autolock lock(mQueueLock);
+    if (mBsConsumers.removeItem(consumerId) < 0) {
+        ALOGW("unregisterBsConsumer: consumer[%d] not exist", consumerId);
+        return BAD_VALUE;
+    }
+    trimBsFrames(ENC_BACKUP_BUFFER_NUM);
+    mBsFrameCond.broadcast();
+    return OK;
+}
+
+status_t CedarXRecorder::getBsConsumerStatus(int consumerId, BsConsumerStatus *pStatus)
+{
+	Mutex::Autolock lock(mQueueLock);
+    BsConsumer *pConsumer = getBsConsumerLocked(consumerId);
+    if (pConsumer == NULL) {
+        return BAD_VALUE;
+    }
+    memset(pStatus, 0, sizeof(BsConsumerStatus));
+    pStatus->queuedFrames = countBsFrames(pConsumer, NULL);
+    pStatus->inUseFrames = pConsumer->mInUse.size();
+    if (pStatus->queuedFrames > 0) {
+        const EncQueueBuffer &oldest = mEncData[pConsumer->mReadSeq - mEncData[0].seq];
+        pStatus->lagUs = mEncData[mEncData.size() - 1].header.pts - oldest.header.pts;
+    }
+    pStatus->droppedFrames = pConsumer->mDropCount;
+    pStatus->forcedReleaseFrames = pConsumer->mForcedReleaseCount;
+    return OK;
+}
+
+/* must hold mQueueLock. return index in mEncData of the next frame for consumer, -1 if none. */
+ssize_t CedarXRecorder::nextBsFrameIndex(BsConsumer *pConsumer)
+{
+    while (pConsumer->mReadSeq < mBsNextSeq) {
+        ssize_t index = pConsumer->mReadSeq - mEncData[0].seq;
+        while (!pConsumer->mSkipSeq.isEmpty() && pConsumer->mSkipSeq[0] < pConsumer->mReadSeq) {
+            pConsumer->mSkipSeq.removeAt(0);
+        }
+        if (!pConsumer->mSkipSeq.isEmpty() && pConsumer->mSkipSeq[0] == pConsumer->mReadSeq) {
+            pConsumer->mSkipSeq.removeAt(0);
+            pConsumer->mReadSeq++;
+            continue;
+        }
+        if (pConsumer->mWaitKeyFrame && !(mEncData[index].flags & BSFRAME_FLAG_KEYFRAME)) {
+            pConsumer->mReadSeq++;
+            pConsumer->mDropCount++;
+            continue;
+        }
+        pConsumer->mWaitKeyFrame = false;
+        return index;
+    }
+    return -1;
+}
+
+/* must hold mQueueLock. count frames the consumer can read now. */
+int CedarXRecorder::countBsFrames(const BsConsumer *pConsumer, bool *pHasKeyFrame)
+{
+    int count = 0;
+    bool bWaitKeyFrame = pConsumer->mWaitKeyFrame;
+    size_t skipIndex = 0;
+    if (pHasKeyFrame != NULL) {
+        *pHasKeyFrame = false;
+    }
+    for (int64_t seq = pConsumer->mReadSeq; seq < mBsNextSeq; seq++) {
+        const EncQueueBuffer &buf = mEncData[seq - mEncData[0].seq];
+        while (skipIndex < pConsumer->mSkipSeq.size() && pConsumer->mSkipSeq[skipIndex] < seq) {
+            skipIndex++;
+        }
+        if (skipIndex < pConsumer->mSkipSeq.size() && pConsumer->mSkipSeq[skipIndex] == seq) {
+            continue;
+        }
+        if (bWaitKeyFrame && !(buf.flags & BSFRAME_FLAG_KEYFRAME)) {
+            continue;
+        }
+        bWaitKeyFrame = false;
+        if ((buf.flags & BSFRAME_FLAG_KEYFRAME) && pHasKeyFrame != NULL) {
+            *pHasKeyFrame = true;
+        }
+        count++;
+    }
+    return count;
+}
+
+/*******************************************************************************
+Function name: android.CedarXRecorder.dropBsConsumerFrames
+Description: 
+    consumer falls behind, drop its queued frames without breaking the
+    stream it decodes. must hold mQueueLock.
+    BSCONSUMER_DROP_OLDEST: drop the oldest non-reference frame. If there is
+        none, or bDropOldest is set, drop from the oldest frame to the next
+        key frame, i.e., the rest of the GOP.
+    BSCONSUMER_SKIP_TO_KEYFRAME: jump to the next queued key frame.
+    If no key frame is queued, the consumer waits for the next one, and
+    encoder is asked for an IDR, so the consumer recovers in one frame.
+Return: 
+    true if the oldest queued frame of consumer is dropped.
+*******************************************************************************/
+bool CedarXRecorder::dropBsConsumerFrames(int consumerId, BsConsumer *pConsumer, bool bDropOldest)
+{
+    if (pConsumer->mReadSeq >= mBsNextSeq) {
+        return false;
+    }
+    int64_t oldReadSeq = pConsumer->mReadSeq;
+    int64_t dropNum = 0;
+    const EncQueueBuffer &oldest = mEncData[oldReadSeq - mEncData[0].seq];
+    if (pConsumer->mDropPolicy == BSCONSUMER_DROP_OLDEST && (oldest.flags & BSFRAME_FLAG_DISPOSABLE)) {
+        pConsumer->mReadSeq++;
+        dropNum = 1;
+    } else if (pConsumer->mDropPolicy == BSCONSUMER_DROP_OLDEST && !bDropOldest) {
+        for (int64_t seq = oldReadSeq + 1; seq < mBsNextSeq; seq++) {
+            if ((mEncData[seq - mEncData[0].seq].flags & BSFRAME_FLAG_DISPOSABLE)
+                && (pConsumer->mSkipSeq.isEmpty() || pConsumer->mSkipSeq[pConsumer->mSkipSeq.size() - 1] < seq)) {
+                pConsumer->mSkipSeq.push_back(seq);
+                dropNum = 1;
+                break;
+            }
+        }
+    }
+    if (dropNum == 0) {
+        //oldest frame is referenced by the rest of its GOP, drop them together.
+        pConsumer->mReadSeq = mBsNextSeq;
+        pConsumer->mWaitKeyFrame = true;
+        for (int64_t seq = oldReadSeq + 1; seq < mBsNextSeq; seq++) {
+            if (mEncData[seq - mEncData[0].seq].flags & BSFRAME_FLAG_KEYFRAME) {
+                pConsumer->mReadSeq = seq;
+                pConsumer->mWaitKeyFrame = false;
+                break;
+            }
+        }
+        dropNum = pConsumer->mReadSeq - oldReadSeq;
+        if (pConsumer->mWaitKeyFrame) {
+            mBsKeyFrameWanted = true;
+        }
+    }
+    pConsumer->mDropCount += dropNum;
+    mBsRingStat.mOverflowDropCount += dropNum;
+    mListener->notify(MEDIA_RECORDER_EVENT_ERROR, MEDIA_ERROR_BACKUP_BUFFER_OVERFLOW, consumerId);
+    return pConsumer->mReadSeq != oldReadSeq;
+}
+
+/*
+ * must hold mQueueLock. free the count oldest frames got by consumer.
+ * frames taken back by makeBsRingRoom() or clearBsRing() are the oldest the
+ * APP holds, they are counted off first.
+ */
+void CedarXRecorder::releaseBsConsumerFrames(BsConsumer *pConsumer, int count)
+{
+    int acked = count < pConsumer->mForcedUnacked ? count : pConsumer->mForcedUnacked;
+    pConsumer->mForcedUnacked -= acked;
+    count -= acked;
+    if (count > (int)pConsumer->mInUse.size()) {
+        ALOGW("releaseBsConsumerFrames: free %d frames, but consumer only hold %d", count, pConsumer->mInUse.size());
+        count = pConsumer->mInUse.size();
+    }
+    pConsumer->mInUse.removeItemsAt(0, count);
+    trimBsFrames(ENC_BACKUP_BUFFER_NUM);
+}
+
+/* must hold mQueueLock. free the frames got by consumer up to lastSeq, frames taken back are gone already. */
+void CedarXRecorder::releaseBsConsumerFramesTo(BsConsumer *pConsumer, int64_t lastSeq)
+{
+    size_t count = 0;
+    while (count < pConsumer->mInUse.size() && pConsumer->mInUse[count].seq <= lastSeq) {
+        count++;
+    }
+    pConsumer->mInUse.removeItemsAt(0, count);
+    pConsumer->mForcedUnacked = 0;
+    trimBsFrames(ENC_BACKUP_BUFFER_NUM);
+}
+
 sp<IMemory> CedarXRecorder::getOneBsFrame(int mode)
 {
     //ALOGV("getOneBsFrame");
 	Mutex::Autolock lock(mQueueLock);
-	if (!mEncData.isEmpty()) {
-        EncQueueBuffer &buf = mEncData.editItemAt(0);
-		if (buf.isUsing) {
-			ALOGW("getOneBsFrame: APP need return buffer before get another one!!");
-			return NULL;
-		}
-		buf.isUsing = true;
-        sp<IMemory> mem = buf.mem;
-        mEncData.removeAt(0);
-    	return mem;
+    BsConsumer *pConsumer = getBsConsumerLocked(BS_DEFAULT_CONSUMER);
+    ssize_t index = nextBsFrameIndex(pConsumer);
+	if (index >= 0) {
+        const EncQueueBuffer &buf = mEncData[index];
+        //give APP its own view, so we know when APP drops it, see makeBsRingRoom().
+        ssize_t offset;
+        size_t size;
+        sp<IMemoryHeap> heap = buf.mem->getMemory(&offset, &size);
+        BsInUseFrame frame;
+        frame.seq = buf.seq;
+        frame.mem = new MemoryBase(heap, offset, size);
+        pConsumer->mInUse.push_back(frame);
+        pConsumer->mReadSeq++;
+    	return frame.mem;
 	} else {
         //ALOGW("queue buffer is empty mEncData.size = %d", mEncData.size());
 		return NULL;
 	}
 }
 
+/*******************************************************************************
+Function name: android.CedarXRecorder.freeOneBsFrame
+Description: 
+    return the oldest frame got by getOneBsFrame() to the ring, its memory
+    will be overwritten by following frames.
+*******************************************************************************/
 void CedarXRecorder::freeOneBsFrame()
 {
     //ALOGV("freeOneBsFrame");
-  #if 0
 	Mutex::Autolock lock(mQueueLock);
-	if (!mEncData.isEmpty()) {
-		EncQueueBuffer &buf = mEncData.editItemAt(0);
-		buf.mem.clear();
-		buf.mem = NULL;
-		buf.isUsing = false;
-		mEncData.removeAt(0);
-        //ALOGV("remove mEncData.size = %d", mEncData.size());
-	}
-  #endif
+    releaseBsConsumerFrames(getBsConsumerLocked(BS_DEFAULT_CONSUMER), 1);
+}
+
+/*******************************************************************************
+Function name: android.CedarXRecorder.getBsFrames
+Description: 
+    get at most maxFrames queued frames of consumer in one call. If no frame
+    is queued, wait timeoutMs for the next one. Frames are returned by
+    freeBsFrames() with the seq of the last one done with.
+*******************************************************************************/
+status_t CedarXRecorder::getBsFrames(int consumerId, int maxFrames, int timeoutMs, Vector<sp<IMemoryHeap> > *heaps, Vector<BsFrameDesc> *frames)
+{
+	Mutex::Autolock lock(mQueueLock);
+    BsConsumer *pConsumer = getBsConsumerLocked(consumerId);
+    if (pConsumer == NULL) {
+        return BAD_VALUE;
+    }
+    if (countBsFrames(pConsumer, NULL) == 0 && timeoutMs > 0) {
+        waitBsFrameLocked(consumerId, 1, 0, timeoutMs);
+        pConsumer = getBsConsumerLocked(consumerId);
+        if (pConsumer == NULL || mBsWaitAborted) {
+            return DEAD_OBJECT;
+        }
+    }
+    int num = 0;
+    ssize_t index;
+    while (num < maxFrames && (index = nextBsFrameIndex(pConsumer)) >= 0) {
+        const EncQueueBuffer &buf = mEncData[index];
+        BsInUseFrame frame;
+        frame.seq = buf.seq;
+        pConsumer->mInUse.push_back(frame);
+        pConsumer->mReadSeq++;
+
+        ssize_t offset;
+        size_t size;
+        sp<IMemoryHeap> heap = buf.mem->getMemory(&offset, &size);
+        size_t heapIndex;
+        for (heapIndex = 0; heapIndex < heaps->size(); heapIndex++) {
+            if (heaps->itemAt(heapIndex) == heap) {
+                break;
+            }
+        }
+        if (heapIndex == heaps->size()) {
+            heaps->push_back(heap);
+        }
+
+        BsFrameDesc desc;
+        memset(&desc, 0, sizeof(BsFrameDesc));
+        desc.heapIndex = heapIndex;
+        desc.offset = offset + buf.dataOffset;
+        desc.size = buf.dataSize;
+        desc.flags = buf.flags;
+        desc.pts = buf.header.pts;
+        desc.CurrQp = buf.header.CurrQp;
+        desc.avQp = buf.header.avQp;
+        desc.nGopIndex = buf.header.nGopIndex;
+        desc.nFrameIndex = buf.header.nFrameIndex;
+        desc.nTotalIndex = buf.header.nTotalIndex;
+        desc.seq = buf.seq;
+        frames->push_back(desc);
+        num++;
+    }
+    return OK;
+}
+
+status_t CedarXRecorder::freeBsFrames(int consumerId, int64_t lastSeq)
+{
+	Mutex::Autolock lock(mQueueLock);
+    BsConsumer *pConsumer = getBsConsumerLocked(consumerId);
+    if (pConsumer == NULL) {
+        return BAD_VALUE;
+    }
+    releaseBsConsumerFramesTo(pConsumer, lastSeq);
+    return OK;
+}
+
+/*******************************************************************************
+Function name: android.CedarXRecorder.waitBsFrames
+Description: 
+    block until minFrames frames are queued for consumer, or a key frame is
+    queued if BSFRAME_WAIT_KEYFRAME is set, or timeoutMs passed.
+    pushOneBsFrame() wakes up waiters directly, so consumers don't need to
+    poll getOneBsFrame().
+Return: 
+    OK, TIMED_OUT, or DEAD_OBJECT if recorder is stopped or consumer is
+    unregistered during waiting.
+*******************************************************************************/
+status_t CedarXRecorder::waitBsFrames(int consumerId, int minFrames, int waitFlags, int timeoutMs, int *pQueuedFrames)
+{
+	Mutex::Autolock lock(mQueueLock);
+    if (getBsConsumerLocked(consumerId) == NULL) {
+        return BAD_VALUE;
+    }
+    status_t ret = waitBsFrameLocked(consumerId, minFrames, waitFlags, timeoutMs);
+    if (pQueuedFrames != NULL) {
+        BsConsumer *pConsumer = getBsConsumerLocked(consumerId);
+        *pQueuedFrames = pConsumer != NULL ? countBsFrames(pConsumer, NULL) : 0;
+    }
+    return ret;
+}
+
+/*******************************************************************************
+Function name: android.CedarXRecorder.abortBsFrameWaits
+Description: 
+    wake up every getBsFrames()/waitBsFrames() caller with DEAD_OBJECT and
+    make later calls return at once. Called before the recorder is deleted,
+    so release() doesn't wait for the callers' timeouts.
+*******************************************************************************/
+void CedarXRecorder::abortBsFrameWaits()
+{
+	Mutex::Autolock lock(mQueueLock);
+    mBsWaitAborted = true;
+    mBsRingGeneration++;
+    mBsFrameCond.broadcast();
+}
+
+/* must hold mQueueLock. consumer may be removed during waiting, so look it up by id every time. */
+status_t CedarXRecorder::waitBsFrameLocked(int consumerId, int minFrames, int waitFlags, int timeoutMs)
+{
+    status_t ret = OK;
+    int generation = mBsRingGeneration;
+    nsecs_t startTime = systemTime();
+    nsecs_t endTime = startTime + (nsecs_t)timeoutMs * 1000000LL;
+    int queuedFrames = 0;
+    if (minFrames < 1) {
+        minFrames = 1;
+    }
+    while (1) {
+        BsConsumer *pConsumer = getBsConsumerLocked(consumerId);
+        if (pConsumer == NULL || generation != mBsRingGeneration || mBsWaitAborted) {
+            return DEAD_OBJECT;
+        }
+        bool bHasKeyFrame;
+        queuedFrames = countBsFrames(pConsumer, &bHasKeyFrame);
+        if (queuedFrames >= minFrames || ((waitFlags & BSFRAME_WAIT_KEYFRAME) && bHasKeyFrame)) {
+            break;
+        }
+        nsecs_t remain = endTime - systemTime();
+        if (remain <= 0) {
+            ret = TIMED_OUT;
+            break;
+        }
+        mBsFrameCond.waitRelative(mQueueLock, remain);
+    }
+
+    BsFrameWaitStatistics &stat = getBsConsumerLocked(consumerId)->mWaitStat;
+    int64_t waitUs = (systemTime() - startTime) / 1000;
+    stat.mWaitCount++;
+    if (ret == OK) {
+        stat.mWakeupCount++;
+        stat.mWakeupFrames += queuedFrames;
+    } else {
+        stat.mTimeoutCount++;
+    }
+    stat.mTotalWaitUs += waitUs;
+    if (waitUs > stat.mMaxWaitUs) {
+        stat.mMaxWaitUs = waitUs;
+    }
+    return ret;
+}
+
+/*******************************************************************************
+Function name: android.CedarXRecorder.allocBsRingSlot
+Description: 
+    reserve size bytes in mBsRingHeap, must hold mQueueLock.
+    Frames are freed in push order, so the oldest ring frame in mEncData is
+    the tail of the ring.
+Return: 
+    OK: pBuf is filled.
+    NO_MEMORY: ring is full now, caller can free frames and retry.
+    BAD_VALUE: frame can never be put in ring, caller must use a private heap.
+*******************************************************************************/
+status_t CedarXRecorder::allocBsRingSlot(size_t size, EncQueueBuffer *pBuf)
+{
+    size_t alignedSize = (size + ENC_BS_RING_ALIGN - 1) & ~(ENC_BS_RING_ALIGN - 1);
+    if (mBsRingHeap == NULL) {
+        mBsRingHeap = new MemoryHeapBase(ENC_BS_RING_SIZE, 0, "CedarXRecorderBsRing");
+        if (mBsRingHeap == NULL || mBsRingHeap->getHeapID() < 0) {
+            ALOGE("(f:%s, l:%d) fatal error! create bs ring heap fail", __FUNCTION__, __LINE__);
+            mBsRingHeap.clear();
+            return BAD_VALUE;
+        }
+        mBsRingHead = 0;
+    }
+    size_t capacity = mBsRingHeap->getSize();
+    if (alignedSize > capacity) {
+        return BAD_VALUE;
+    }
+
+    const EncQueueBuffer *pOldest = NULL;
+    for (size_t i = 0; i < mEncData.size(); i++) {
+        if (mEncData[i].inRing) {
+            pOldest = &mEncData[i];
+            break;
+        }
+    }
+
+    size_t offset;
+    if (pOldest == NULL) {
+        offset = 0;
+    } else {
+        size_t tail = pOldest->offset;
+        if (mBsRingHead > tail) {
+            if (capacity - mBsRingHead >= alignedSize) {
+                offset = mBsRingHead;
+            } else if (tail >= alignedSize) {
+                offset = 0;     //skip the unused end of ring.
+            } else {
+                return NO_MEMORY;
+            }
+        } else if (tail - mBsRingHead >= alignedSize) {   //head == tail means ring is full.
+            offset = mBsRingHead;
+        } else {
+            return NO_MEMORY;
+        }
+    }
+
+    pBuf->mem = new MemoryBase(mBsRingHeap, offset, size);
+    if (pBuf->mem == NULL) {
+        return BAD_VALUE;
+    }
+    pBuf->inRing = true;
+    pBuf->offset = offset;
+    pBuf->size = alignedSize;
+    mBsRingHead = offset + alignedSize;
+    return OK;
+}
+
+/*******************************************************************************
+Function name: android.CedarXRecorder.trimBsFrames
+Description: 
+    free the oldest frames which no consumer needs, but keep the newest
+    backlog frames for consumers coming later. must hold mQueueLock.
+*******************************************************************************/
+void CedarXRecorder::trimBsFrames(size_t backlog)
+{
+    int64_t minSeq = mBsNextSeq;
+    for (size_t i = 0; i < mBsConsumers.size(); i++) {
+        const BsConsumer &consumer = mBsConsumers.valueAt(i);
+        int64_t seq = consumer.mInUse.isEmpty() ? consumer.mReadSeq : consumer.mInUse[0].seq;
+        if (seq < minSeq) {
+            minSeq = seq;
+        }
+    }
+    size_t num = 0;
+    while (num < mEncData.size() && mEncData[num].seq < minSeq && mEncData.size() - num > backlog) {
+        num++;
+    }
+    if (num > 0) {
+        mEncData.removeItemsAt(0, num);
+    }
+}
+
+/*******************************************************************************
+Function name: android.CedarXRecorder.makeBsRingRoom
+Description: 
+    ring is full, free the oldest frame. must hold mQueueLock.
+    1. drop backlog frames no consumer needs.
+    2. consumers which are still queuing the oldest frame skip it by policy,
+       in-use frames which APP has already dropped are taken back.
+    3. consumers still holding the oldest frame lose it, a slow consumer
+       can't stop the encoder.
+Return: 
+    true if the oldest frame is freed.
+*******************************************************************************/
+bool CedarXRecorder::makeBsRingRoom()
+{
+    if (mEncData.isEmpty()) {
+        return false;
+    }
+    int64_t oldestSeq = mEncData[0].seq;
+    trimBsFrames(0);
+    if (mEncData.isEmpty() || mEncData[0].seq != oldestSeq) {
+        return true;
+    }
+    for (size_t i = 0; i < mBsConsumers.size(); i++) {
+        BsConsumer &consumer = mBsConsumers.editValueAt(i);
+        if (!consumer.mInUse.isEmpty() && consumer.mInUse[0].seq == oldestSeq) {
+            sp<IMemory> &mem = consumer.mInUse.editItemAt(0).mem;
+            if (mem != NULL && mem->getStrongCount() == 1) {
+                //APP still calls freeOneBsFrame() for it.
+                consumer.mInUse.removeAt(0);
+                consumer.mForcedUnacked++;
+            }
+        } else if (consumer.mReadSeq == oldestSeq) {
+            dropBsConsumerFrames(mBsConsumers.keyAt(i), &consumer, true);
+        }
+    }
+    trimBsFrames(0);
+    if (mEncData.isEmpty() || mEncData[0].seq != oldestSeq) {
+        return true;
+    }
+    for (size_t i = 0; i < mBsConsumers.size(); i++) {
+        BsConsumer &consumer = mBsConsumers.editValueAt(i);
+        if (!consumer.mInUse.isEmpty() && consumer.mInUse[0].seq == oldestSeq) {
+            ALOGW("makeBsRingRoom: consumer[%d] hold frame too long, take it back!", mBsConsumers.keyAt(i));
+            consumer.mInUse.removeAt(0);
+            consumer.mForcedReleaseCount++;
+            consumer.mForcedUnacked++;
+            mBsRingStat.mForcedReleaseCount++;
+            mListener->notify(MEDIA_RECORDER_EVENT_INFO, MEDIA_RECORDER_INFO_BSFRAME_FORCED_RELEASE, mBsConsumers.keyAt(i));
+        }
+    }
+    trimBsFrames(0);
+    return mEncData.isEmpty() || mEncData[0].seq != oldestSeq;
+}
+
+/*******************************************************************************
+Function name: android.CedarXRecorder.clearBsRing
+Description: 
+    drop all frames and the ring heap, consumers are kept and restart from
+    the next pushed frame. must hold mQueueLock.
+    APP may still map the heap, it is released when APP drops its frames.
+*******************************************************************************/
+void CedarXRecorder::clearBsRing()
+{
+    mEncData.clear();
+    for (size_t i = 0; i < mBsConsumers.size(); i++) {
+        BsConsumer &consumer = mBsConsumers.editValueAt(i);
+        consumer.mForcedUnacked += consumer.mInUse.size();
+        consumer.mInUse.clear();
+        consumer.mReadSeq = mBsNextSeq;
+    }
+    mBsRingHeap.clear();
+    mBsRingHead = 0;
+    mBsRingGeneration++;
+    mBsFrameCond.broadcast();
+}
+
+/* state of parseH264FrameFlags() across the bs_data fragments of one frame. */
+typedef struct H264FrameParser
+{
+    uint32_t    nWindow;        //last 3 bytes, a start code may be split between fragments
+    bool        bHeaderNext;    //next byte is a NAL header
+    int         nFlags;
+} H264FrameParser;
+
+/*******************************************************************************
+Function name: android.CedarXRecorder.parseH264FrameFlags
+Description: 
+    walk Annex-B start codes of one fragment of an encoded h264 frame,
+    classify the frame by NAL unit type and nal_ref_idc. All slices of a
+    picture share both, so the first slice decides and the slice data is
+    not scanned.
+    IDR slice(5) -> BSFRAME_FLAG_KEYFRAME
+    SPS(7)/PPS(8) -> BSFRAME_FLAG_CODEC_CONFIG
+    slice with nal_ref_idc 0 -> BSFRAME_FLAG_DISPOSABLE, no other frame
+        refers to it, so it can be dropped without breaking the GOP.
+Return: 
+    true when the first slice is found, following fragments needn't be parsed.
+*******************************************************************************/
+static bool parseH264FrameFlags(H264FrameParser *pParser, const uint8_t *data, size_t size)
+{
+    uint32_t window = pParser->nWindow;
+    size_t i;
+    for (i = 0; i < size; i++) {
+        if (pParser->bHeaderNext) {
+            pParser->bHeaderNext = false;
+            int nalRefIdc = (data[i] >> 5) & 0x3;
+            int nalType = data[i] & 0x1f;
+            if (nalType >= 1 && nalType <= 5) {
+                if (nalType == 5) {
+                    pParser->nFlags |= BSFRAME_FLAG_KEYFRAME;
+                } else if (nalRefIdc == 0) {
+                    pParser->nFlags |= BSFRAME_FLAG_DISPOSABLE;
+                }
+                return true;
+            }
+            if (nalType == 7 || nalType == 8) {
+                pParser->nFlags |= BSFRAME_FLAG_CODEC_CONFIG;
+            }
+        }
+        window = ((window << 8) | data[i]) & 0xffffff;
+        if (window == 0x000001) {
+            pParser->bHeaderNext = true;
+        }
+    }
+    pParser->nWindow = window;
+    return false;
 }
 
 int CedarXRecorder::pushOneBsFrame(int mode)
 {
     int i;
     CDXRecorderBsInfo frame;
-	sp<IMemory>         bsFrameMemory;
+    EncQueueBuffer buf;
+    status_t ret;
+    int flags = 0;
+    bool bNeedKeyFrame = false;
 
     Mutex::Autolock lock(mLock);
-    //mBsFrameMemory.clear();
     if (mCdxRecorder == NULL) {
         LOGE("mCdxRecorder is not initialized");
         return -1;
@@ -2499,15 +3183,23 @@ int CedarXRecorder::pushOneBsFrame(int mode)
     //store videoExtraData, process change fd!
     {
         RawPacketType type = (RawPacketType)(((RawPacketHeader*)frame.bs_data[0])->stream_type);
-        char* data0 = frame.bs_data[1];
-        int flags = 0;
         if (type == RawPacketTypeVideo) 
         {
-            if (data0[0] == 0x00 && data0[1] == 0x00 && 
-                data0[2] == 0x00 && data0[3] == 0x01 && 
-                data0[4] == 0x65) 
+            if (mVideoEncoder == VIDEO_ENCODER_H264)
             {
-                flags =  AVPACKET_FLAG_KEYFRAME;
+                H264FrameParser parser;
+                memset(&parser, 0, sizeof(H264FrameParser));
+                parser.nWindow = 0xffffff;
+                for (i = 1; i < frame.bs_count; i++) {
+                    if (parseH264FrameFlags(&parser, (const uint8_t*)frame.bs_data[i], frame.bs_size[i])) {
+                        break;
+                    }
+                }
+                flags = parser.nFlags;
+            }
+            else if (((RawPacketHeader*)frame.bs_data[0])->nFrameIndex == 0)
+            {
+                flags = BSFRAME_FLAG_KEYFRAME;
             }
         }
         else if(type == RawPacketTypeVideoExtra) 
@@ -2517,6 +3209,22 @@ int CedarXRecorder::pushOneBsFrame(int mode)
             int size0 = frame.bs_size[1];
             ALOGD("find VideoExtraData[%p]size[%d], store it!", data0, size0);
     	} 
+        if (mBsDumpStream != NULL && (type == RawPacketTypeVideo || type == RawPacketTypeVideoExtra)) {
+            //fragments after the RawPacketHeader go to the file by one write2(), not joined first.
+            CDXRecorderBsInfo es;
+            memset(&es, 0, sizeof(CDXRecorderBsInfo));
+            for (i = 1; i < frame.bs_count; i++) {
+                es.bs_data[es.bs_count] = frame.bs_data[i];
+                es.bs_size[es.bs_count] = frame.bs_size[i];
+                es.total_size += frame.bs_size[i];
+                es.bs_count++;
+            }
+            if (cdx_write2(&es, mBsDumpStream) < 0) {
+                ALOGW("(f:%s, l:%d) write bs dump fail, stop dumping", __FUNCTION__, __LINE__);
+                destroy_outstream_handle(mBsDumpStream);
+                mBsDumpStream = NULL;
+            }
+        }
     }
 
 	if (((RawPacketHeader*)frame.bs_data[0])->stream_type != RawPacketTypeVideo)
@@ -2526,89 +3234,82 @@ int CedarXRecorder::pushOneBsFrame(int mode)
 	}
 
     size_t size = frame.total_size + 4;
-    sp<MemoryHeapBase> heap = new MemoryHeapBase(size);
-    if (heap == NULL) {
-        LOGE("failed to create MemoryDealer");
-        return -1;
-    }
-
-    bsFrameMemory = new MemoryBase(heap, 0, size);
-    if (bsFrameMemory == NULL) {
-        LOGE("not enough memory for VideoFrame size=%u", size);
-        return -1;
-    }
+    {
+        Mutex::Autolock lock(mQueueLock);
+        while ((ret = allocBsRingSlot(size, &buf)) == NO_MEMORY) {
+            if (!makeBsRingRoom()) {
+                break;
+            }
+        }
+        if (ret != OK) {
+            if (ret == NO_MEMORY) {
+                ALOGW("pushOneBsFrame: bs ring can't free space, use private heap!");
+            }
+            sp<MemoryHeapBase> heap = new MemoryHeapBase(size);
+            if (heap == NULL || heap->getHeapID() < 0) {
+                LOGE("failed to create MemoryHeapBase size=%u", size);
+                mCdxRecorder->control((void*)mCdxRecorder, CDX_CMD_FREE_ONE_BSFRAME, 0, (unsigned int)&frame);
+                return -1;
+            }
+            buf.mem = new MemoryBase(heap, 0, size);
+            buf.inRing = false;
+            buf.offset = 0;
+            buf.size = size;
+            mBsRingStat.mPrivateHeapCount++;
+        }
 
-    uint8_t *ptr_dst = (uint8_t *)bsFrameMemory->pointer();
+        uint8_t *ptr_dst = (uint8_t *)buf.mem->pointer();
 
-    memcpy(ptr_dst, &frame.total_size, 4);
-    ptr_dst += 4;
+        memcpy(ptr_dst, &frame.total_size, 4);
+        ptr_dst += 4;
 
-    int total_bs_size=0;
-    for (i=0; i<frame.bs_count; i++) {
-    	memcpy(ptr_dst, frame.bs_data[i], frame.bs_size[i]);
-    	ptr_dst += frame.bs_size[i];
-        total_bs_size+=frame.bs_size[i];
-	}
-    if(total_bs_size != frame.total_size)
-    {
-        ALOGE("(f:%s, l:%d) fatal error! BsFrameSize[%d]!=[%d]", __FUNCTION__, __LINE__, total_bs_size, frame.total_size);
-    }
+        int total_bs_size=0;
+        for (i=0; i<frame.bs_count; i++) {
+        	memcpy(ptr_dst, frame.bs_data[i], frame.bs_size[i]);
+        	ptr_dst += frame.bs_size[i];
+            total_bs_size+=frame.bs_size[i];
+    	}
+        if(total_bs_size != frame.total_size)
+        {
+            ALOGE("(f:%s, l:%d) fatal error! BsFrameSize[%d]!=[%d]", __FUNCTION__, __LINE__, total_bs_size, frame.total_size);
+        }
 
-#if 0
-{
-	int *total_size, *stream_type, *data_size;
-	long long *pts;
-	ptr_dst = (uint8_t *)bsFrameMemory->pointer();
-	total_size = (int*)ptr_dst;
-	ptr_dst += sizeof(int);
-	stream_type = (int*)ptr_dst;
-	ptr_dst += sizeof(int);
-	data_size = (int*)ptr_dst;
-	ptr_dst += sizeof(int);
-	pts = (long long *)ptr_dst;
-	ALOGV("pushOneBsFrame: total_size=%d, stream_type=%d, data_size=%d, pts=%lld", *total_size, *stream_type, *data_size, *pts);
-}
-#endif
+        memcpy(&buf.header, frame.bs_data[0], sizeof(RawPacketHeader));
+        buf.dataOffset = 4 + frame.bs_size[0];
+        buf.dataSize = frame.total_size - frame.bs_size[0];
+        buf.flags = flags;
+        buf.seq = mBsNextSeq++;
+    	mEncData.push_back(buf);
+        if (flags & BSFRAME_FLAG_KEYFRAME) {
+            mBsKeyFrameRequested = false;
+        }
 
+        for (size_t j = 0; j < mBsConsumers.size(); j++) {
+            BsConsumer &consumer = mBsConsumers.editValueAt(j);
+            int queuedFrames = countBsFrames(&consumer, NULL);
+            if (queuedFrames > ENC_BACKUP_BUFFER_NUM) {
+                ALOGW("pushOneBsFrame: consumer[%d] queue_buffer_size %d, inUse %d", 
+                    mBsConsumers.keyAt(j), queuedFrames, consumer.mInUse.size());
+                dropBsConsumerFrames(mBsConsumers.keyAt(j), &consumer, false);
+            }
+        }
+        trimBsFrames(ENC_BACKUP_BUFFER_NUM);
+        mBsFrameCond.broadcast();
+        mBsRingStat.mPushCount++;
+        if ((int)mEncData.size() > mBsRingStat.mMaxOccupiedSlots) {
+            mBsRingStat.mMaxOccupiedSlots = mEncData.size();
+        }
+        //ALOGV("add mEncData.size = %d", mEncData.size());
+        bNeedKeyFrame = mBsKeyFrameWanted && !mBsKeyFrameRequested;
+        if (bNeedKeyFrame) {
+            mBsKeyFrameWanted = false;
+            mBsKeyFrameRequested = true;
+        }
+    }
     mCdxRecorder->control((void*)mCdxRecorder, CDX_CMD_FREE_ONE_BSFRAME, 0, (unsigned int)&frame);
-    {
-        Mutex::Autolock lock(mQueueLock);
-    	if (mEncData.size() > ENC_BACKUP_BUFFER_NUM) {
-    		mListener->notify(MEDIA_RECORDER_EVENT_ERROR, MEDIA_ERROR_BACKUP_BUFFER_OVERFLOW, 0);
-    		{
-    			//Mutex::Autolock lock(mQueueLock);
-    			EncQueueBuffer &buf = mEncData.editItemAt(0);
-    			ALOGW("pushOneBsFrame: queue_buffer_size %d, isUsing=%d", mEncData.size(), buf.isUsing);
-    			if (!buf.isUsing) {
-    				buf.mem.clear();
-    				buf.mem = NULL;
-    				buf.isUsing = false;
-    				mEncData.removeAt(0);
-    			} else {
-    				ALOGW("pushOneBsFrame: APP need return buffer!!");
-    				for (size_t i = 1; i < mEncData.size(); i++) {
-    					EncQueueBuffer &buf = mEncData.editItemAt(i);
-    					if (!buf.isUsing) {
-    						buf.mem.clear();
-    						buf.mem = NULL;
-    						buf.isUsing = false;
-    						mEncData.removeAt(i);
-    						break;
-    					}
-    				}
-    			}
-    		}
-    	}
-        
-    	{
-    		EncQueueBuffer buf;
-    		buf.isUsing = false;
-    		buf.mem = bsFrameMemory;
-    		//Mutex::Autolock lock(mQueueLock);
-    		mEncData.push_back(buf);
-            //ALOGD("buf.mem.getMemory()->getHeapID()=%d", buf.mem->getMemory()->getHeapID());
-            //ALOGV("add mEncData.size = %d", mEncData.size());
-    	}
+    if (bNeedKeyFrame) {
+        ALOGD("pushOneBsFrame: consumer lost its GOP, request IDR frame");
+        reencodeIFrame();
     }
 	return 0;
 }
@@ -2660,18 +3361,31 @@ status_t CedarXRecorder::setOutputFileSync(int fd, int64_t fallocateLength, int
 
 	if (mPrepared == true) 
     {
+        int64_t startUs = systemTime() / 1000;
+        bool bPreparedFile = false;
+        int nPreparedFd = -1;
+        struct stat fileStat;
+        if (fd >= 0 && fstat(fd, &fileStat) == 0)
+        {
+            bPreparedFile = takePreparedOutputFile(fileStat.st_dev, fileStat.st_ino, &nPreparedFd);
+        }
         CdxFdT fileDesc;
         memset(&fileDesc, 0, sizeof(CdxFdT));
         fileDesc.mFd = fd;
-        fileDesc.mnFallocateLen = fallocateLength;
+        fileDesc.mnFallocateLen = bPreparedFile ? 0 : fallocateLength;   //preallocated already, muxer need not wait for it.
         fileDesc.mMuxerId = muxerId;
         //ret = mCdxRecorder->control((void*)mCdxRecorder, CDX_CMD_SET_SAVE_FILE, (unsigned int)fd, fallocateLength);
         ret = mCdxRecorder->control((void*)mCdxRecorder, CDX_CMD_SET_SAVE_FILE, 0, (unsigned int)&fileDesc);
+        if (nPreparedFd >= 0)
+        {
+            close(nPreparedFd);
+        }
 		if (ret != OK) 
         {
 			ALOGE("SET SAVE FILE failed");
 			return ret;
 		}
+        finishFileRotation(startUs, bPreparedFile);
 //        ret = mCdxRecorder->control((void*)mCdxRecorder, CDX_CMD_FALLOCATE_FILE, 0, (unsigned int)fileLength);
 //		if (ret != OK) 
 //        {
@@ -2694,18 +3408,41 @@ status_t CedarXRecorder::setOutputFileSync(const char* path, int64_t fallocateLe
 
     if (mPrepared == true) 
     {
+        int64_t startUs = systemTime() / 1000;
+        bool bPreparedFile = false;
+        int nPreparedFd = -1;
+        struct stat fileStat;
+        if (path != NULL && stat(path, &fileStat) == 0)
+        {
+            bPreparedFile = takePreparedOutputFile(fileStat.st_dev, fileStat.st_ino, &nPreparedFd);
+        }
         CdxFdT fileDesc;
         memset(&fileDesc, 0, sizeof(CdxFdT));
-        fileDesc.mPath = (char*)path;
-        fileDesc.mFd = -1;
-        fileDesc.mnFallocateLen = fallocateLength;
+        if (bPreparedFile)
+        {
+            //opening by path truncates the file, give muxer the preallocated fd instead.
+            fileDesc.mPath = NULL;
+            fileDesc.mFd = nPreparedFd;
+            fileDesc.mnFallocateLen = 0;
+        }
+        else
+        {
+            fileDesc.mPath = (char*)path;
+            fileDesc.mFd = -1;
+            fileDesc.mnFallocateLen = fallocateLength;
+        }
         fileDesc.mMuxerId = muxerId;
         ret = mCdxRecorder->control((void*)mCdxRecorder, CDX_CMD_SET_SAVE_FILE, 0, (unsigned int)&fileDesc);
+        if (nPreparedFd >= 0)
+        {
+            close(nPreparedFd);
+        }
         if (ret != OK) 
         {
             ALOGE("SET SAVE FILE failed");
             return ret;
         }
+        finishFileRotation(startUs, bPreparedFile);
     }
     else
     {
@@ -2715,6 +3452,253 @@ status_t CedarXRecorder::setOutputFileSync(const char* path, int64_t fallocateLe
     return OK;
 }
 
+/*******************************************************************************
+Function name: android.CedarXRecorder.prepareOutputFile
+Description: 
+    give the file of next segment ahead of setOutputFileSync(), it is
+    preallocated on mPrepareThread, so the switch need not wait for fallocate.
+    fd is dup, caller can close it.
+Return: 
+    OK if file is queued.
+*******************************************************************************/
+status_t CedarXRecorder::prepareOutputFile(int fd, int64_t fallocateLength)
+{
+    ALOGV("(f:%s, l:%d) fd[%d], len[%lld]", __FUNCTION__, __LINE__, fd, fallocateLength);
+    if (fd < 0 || fallocateLength <= 0)
+    {
+        ALOGE("(f:%s, l:%d) fatal error! wrong fd[%d] len[%lld]", __FUNCTION__, __LINE__, fd, fallocateLength);
+        return BAD_VALUE;
+    }
+    int nFd = dup(fd);
+    if (nFd < 0)
+    {
+        ALOGE("(f:%s, l:%d) fatal error! dup fd[%d] fail(%s)", __FUNCTION__, __LINE__, fd, strerror(errno));
+        return UNKNOWN_ERROR;
+    }
+    return queuePreparedOutputFile(nFd, fallocateLength);
+}
+
+status_t CedarXRecorder::prepareOutputFile(const char* path, int64_t fallocateLength)
+{
+    ALOGV("(f:%s, l:%d) path[%s], len[%lld]", __FUNCTION__, __LINE__, path, fallocateLength);
+    if (path == NULL || fallocateLength <= 0)
+    {
+        ALOGE("(f:%s, l:%d) fatal error! wrong path[%p] len[%lld]", __FUNCTION__, __LINE__, path, fallocateLength);
+        return BAD_VALUE;
+    }
+    int nFd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0666);
+    if (nFd < 0)
+    {
+        ALOGE("(f:%s, l:%d) fatal error! open[%s] fail(%s)", __FUNCTION__, __LINE__, path, strerror(errno));
+        return UNKNOWN_ERROR;
+    }
+    return queuePreparedOutputFile(nFd, fallocateLength);
+}
+
+/* take over fd. */
+status_t CedarXRecorder::queuePreparedOutputFile(int fd, int64_t fallocateLength)
+{
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0)
+    {
+        ALOGE("(f:%s, l:%d) fatal error! fstat fd[%d] fail(%s)", __FUNCTION__, __LINE__, fd, strerror(errno));
+        close(fd);
+        return UNKNOWN_ERROR;
+    }
+    Mutex::Autolock lock(mPrepareLock);
+    for (size_t i = 0; i < mPreparedFiles.size(); i++)
+    {
+        const PreparedOutputFile &file = mPreparedFiles.itemAt(i);
+        if (file.mDev == fileStat.st_dev && file.mIno == fileStat.st_ino && file.mState != OUTPUT_FILE_PREPARE_ABANDONED)
+        {
+            ALOGW("(f:%s, l:%d) file is prepared already", __FUNCTION__, __LINE__);
+            close(fd);
+            return OK;
+        }
+    }
+    if (mPreparedFiles.size() >= OUTPUT_FILE_PREPARE_MAX)
+    {
+        ALOGW("(f:%s, l:%d) too many files[%d] waiting for rotation", __FUNCTION__, __LINE__, mPreparedFiles.size());
+        close(fd);
+        return WOULD_BLOCK;
+    }
+    PreparedOutputFile file;
+    file.mFd = fd;
+    file.mDev = fileStat.st_dev;
+    file.mIno = fileStat.st_ino;
+    file.mFallocateLen = fallocateLength;
+    file.mState = OUTPUT_FILE_PREPARE_PENDING;
+    file.mResult = OK;
+    mPreparedFiles.add(file);
+    if (mPrepareThread == NULL)
+    {
+        mPrepareExit = false;
+        mPrepareThread = new OutputFilePrepareThread(this);
+        mPrepareThread->run("CedarXPrepareFile");
+    }
+    mPrepareCond.broadcast();
+    return OK;
+}
+
+bool CedarXRecorder::prepareOutputFileLoop()
+{
+    int fd;
+    int64_t len;
+    {
+        Mutex::Autolock lock(mPrepareLock);
+        size_t i = 0;
+        while (!mPrepareExit)
+        {
+            for (i = 0; i < mPreparedFiles.size(); i++)
+            {
+                if (mPreparedFiles[i].mState == OUTPUT_FILE_PREPARE_PENDING)
+                {
+                    break;
+                }
+            }
+            if (i < mPreparedFiles.size())
+            {
+                break;
+            }
+            mPrepareCond.wait(mPrepareLock);
+        }
+        if (mPrepareExit)
+        {
+            return false;
+        }
+        PreparedOutputFile &file = mPreparedFiles.editItemAt(i);
+        file.mState = OUTPUT_FILE_PREPARE_RUNNING;
+        fd = file.mFd;
+        len = file.mFallocateLen;
+        mPrepareAbortFlag = 0;
+    }
+
+    //file of RUNNING or ABANDONED state is not removed by others, so fd is valid here.
+    int ret = cdx_preallocate_fd_file(fd, len, &mPrepareAbortFlag);
+
+    Mutex::Autolock lock(mPrepareLock);
+    for (size_t i = 0; i < mPreparedFiles.size(); i++)
+    {
+        PreparedOutputFile &file = mPreparedFiles.editItemAt(i);
+        if (file.mFd == fd)
+        {
+            if (file.mState == OUTPUT_FILE_PREPARE_ABANDONED)
+            {
+                close(fd);
+                mPreparedFiles.removeAt(i);
+                break;
+            }
+            file.mState = OUTPUT_FILE_PREPARE_DONE;
+            file.mResult = (ret == 0) ? OK : UNKNOWN_ERROR;
+            break;
+        }
+    }
+    mPrepareCond.broadcast();
+    return true;
+}
+
+/*******************************************************************************
+Function name: android.CedarXRecorder.takePreparedOutputFile
+Description: 
+    remove the file from mPreparedFiles. Never wait: a pending one, or one
+    still being preallocated, is given up and muxer fallocates it as usual.
+    The preallocation of a running one is aborted, prepare thread keeps its
+    fd until it returns.
+    *pFd is the fd kept for the file, caller closes it, -1 if not found.
+Return: 
+    true if file is preallocated successfully.
+*******************************************************************************/
+bool CedarXRecorder::takePreparedOutputFile(dev_t dev, ino_t ino, int *pFd)
+{
+    Mutex::Autolock lock(mPrepareLock);
+    *pFd = -1;
+    for (size_t i = 0; i < mPreparedFiles.size(); i++)
+    {
+        PreparedOutputFile &file = mPreparedFiles.editItemAt(i);
+        if (file.mDev != dev || file.mIno != ino || file.mState == OUTPUT_FILE_PREPARE_ABANDONED)
+        {
+            continue;
+        }
+        if (file.mState == OUTPUT_FILE_PREPARE_RUNNING)
+        {
+            ALOGW("(f:%s, l:%d) file is still being preallocated, give it up", __FUNCTION__, __LINE__);
+            file.mState = OUTPUT_FILE_PREPARE_ABANDONED;
+            mPrepareAbortFlag = 1;
+            mRotateStat.mPrepareBusyCount++;
+            return false;
+        }
+        bool bPrepared = (file.mState == OUTPUT_FILE_PREPARE_DONE && file.mResult == OK);
+        *pFd = file.mFd;
+        mPreparedFiles.removeAt(i);
+        return bPrepared;
+    }
+    return false;
+}
+
+void CedarXRecorder::stopPrepareThread()
+{
+    sp<OutputFilePrepareThread> thread;
+    {
+        Mutex::Autolock lock(mPrepareLock);
+        mPrepareExit = true;
+        mPrepareAbortFlag = 1;
+        mPrepareCond.broadcast();
+        thread = mPrepareThread;
+        mPrepareThread.clear();
+    }
+    if (thread != NULL)
+    {
+        thread->requestExitAndWait();
+    }
+    Mutex::Autolock lock(mPrepareLock);
+    for (size_t i = 0; i < mPreparedFiles.size(); i++)
+    {
+        close(mPreparedFiles[i].mFd);
+    }
+    mPreparedFiles.clear();
+}
+
+void CedarXRecorder::finishFileRotation(int64_t startUs, bool bPrepared)
+{
+    Mutex::Autolock lock(mPrepareLock);
+    int64_t nowUs = systemTime() / 1000;
+    int64_t gapUs = nowUs - startUs;
+    mRotateStat.mRotateCount++;
+    if (bPrepared)
+    {
+        mRotateStat.mPreparedHitCount++;
+    }
+    mRotateStat.mLastGapUs = gapUs;
+    mRotateStat.mTotalGapUs += gapUs;
+    if (gapUs > mRotateStat.mMaxGapUs)
+    {
+        mRotateStat.mMaxGapUs = gapUs;
+    }
+    mRotateStat.mLastRotateUs = nowUs;
+    mRotateStat.mLastLostFrames = 0;
+    ALOGD("(f:%s, l:%d) rotate file[%lld], preallocated[%d], gap[%lld]us", __FUNCTION__, __LINE__, mRotateStat.mRotateCount, bPrepared, gapUs);
+}
+
+/* frames lost soon after a rotation are counted to it. */
+void CedarXRecorder::countRotateLostFrames(int frames)
+{
+    if (frames <= 0)
+    {
+        return;
+    }
+    Mutex::Autolock lock(mPrepareLock);
+    if (mRotateStat.mRotateCount == 0 || systemTime() / 1000 - mRotateStat.mLastRotateUs > ROTATE_LOST_FRAME_WINDOW_US)
+    {
+        return;
+    }
+    mRotateStat.mLastLostFrames += frames;
+    mRotateStat.mTotalLostFrames += frames;
+    if (mRotateStat.mLastLostFrames > mRotateStat.mMaxLostFrames)
+    {
+        mRotateStat.mMaxLostFrames = mRotateStat.mLastLostFrames;
+    }
+}
+
 int CedarXRecorder::addOutputFormatAndOutputSink(int of, int fd, int FallocateLen, bool callback_out_flag)
 {
     ALOGD("(f:%s, l:%d) (of:%d, fd:%d, FallocateLen:%d, callback_out_flag:%d)", __FUNCTION__, __LINE__, of, fd, FallocateLen, callback_out_flag);
@@ -3001,6 +3985,19 @@ status_t CedarXRecorder::setParamImpactDurationAfTime(int aftime)
 	return NO_ERROR;
 }
 
+status_t CedarXRecorder::setParamBsDumpPath(const char *path)
+{
+    ALOGV("setParamBsDumpPath(%s)", path);
+    if (mBsDumpPath != NULL) {
+        free(mBsDumpPath);
+        mBsDumpPath = NULL;
+    }
+    if (path != NULL && path[0] != '\0') {
+        mBsDumpPath = strdup(path);
+    }
+    return NO_ERROR;
+}
+
 status_t CedarXRecorder::setImpactFileDuration(int bfTimeMs, int afTimeMs)
 {
     ALOGV("setImpactFileDuration(%d, %d)", bfTimeMs, afTimeMs);
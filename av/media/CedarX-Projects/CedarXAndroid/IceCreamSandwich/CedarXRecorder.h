@@ -4,6 +4,8 @@
 #include <media/MediaRecorderBase.h>
 #include <camera/CameraParameters.h>
 #include <utils/String8.h>
+#include <utils/KeyedVector.h>
+#include <utils/threads.h>
 #include <binder/MemoryBase.h>
 #include <binder/MemoryHeapBase.h>
 #include <media/AudioRecord.h>
@@ -19,6 +21,8 @@
 
 #include <vencoder.h>
 
+struct cdx_stream_info;
+
 namespace android {
 
 class Camera;
@@ -32,6 +36,10 @@ class AudioRecord;
 #define VIDEO_LATENCY_TIME_CTS	  0
 #define MAX_FILE_SIZE		(2*1024*1024*1024LL - 200*1024*1024)
 #define ENC_BACKUP_BUFFER_NUM	10
+#define ENC_BS_RING_SIZE		(2*1024*1024)   //shared memory preallocated for encoded frames waiting to be fetched.
+#define ENC_BS_RING_ALIGN		32
+#define OUTPUT_FILE_PREPARE_MAX	4   //next segment files preallocated ahead of rotation.
+#define ROTATE_LOST_FRAME_WINDOW_US	(2*1000*1000)   //frames lost in this window after rotation are counted to it.
 //#define ADD_CEDARXRECORDER_NOTIFICATIONCLIENT
 
 struct OutputSinkInfo   //counterparts: CdxOutputSinkInfo
@@ -52,9 +60,89 @@ typedef enum CDX_RECORDER_MEDIATYPE {
 typedef struct EncQueueBuffer
 {
 	sp<IMemory>	mem;
-	bool		isUsing;
+	int64_t		seq;        //sequence number, continuous in mEncData
+	bool		inRing;     //false: frame is too big for ring, it owns a private heap.
+	size_t		offset;     //offset in mBsRingHeap
+	size_t		size;       //bytes reserved in mBsRingHeap, aligned to ENC_BS_RING_ALIGN
+	size_t		dataOffset; //offset of frame payload in mem
+	size_t		dataSize;
+	RawPacketHeader header;
+	int			flags;      //BSFRAME_FLAG_KEYFRAME, BSFRAME_FLAG_CODEC_CONFIG, BSFRAME_FLAG_DISPOSABLE
 } EncQueueBuffer;
 
+typedef struct EncRingStatistics
+{
+    int64_t mPushCount;         //frames stored into the ring
+    int64_t mOverflowDropCount; //frames skipped by consumers because queue or ring was full
+    int64_t mForcedReleaseCount;    //in-use frames taken back because ring was full
+    int64_t mPrivateHeapCount;  //frames bigger than the ring, stored in a private heap
+    int     mMaxOccupiedSlots;  //peak of frames kept in mEncData
+} EncRingStatistics;
+
+typedef struct BsFrameWaitStatistics
+{
+    int64_t mWaitCount;
+    int64_t mWakeupCount;       //condition is satisfied
+    int64_t mTimeoutCount;
+    int64_t mWakeupFrames;      //queued frames when waked up, sum
+    int64_t mTotalWaitUs;
+    int64_t mMaxWaitUs;
+} BsFrameWaitStatistics;
+
+typedef struct BsInUseFrame
+{
+    int64_t     seq;
+    sp<IMemory> mem;    //view given by getOneBsFrame(), NULL for getBsFrames().
+} BsInUseFrame;
+
+/* every consumer reads mEncData with its own cursor, the encoder never waits for it. */
+typedef struct BsConsumer
+{
+    int         mDropPolicy;    //BSCONSUMER_DROP_OLDEST, BSCONSUMER_SKIP_TO_KEYFRAME
+    pid_t       mPid;
+    int64_t     mReadSeq;       //next frame to read
+    bool        mWaitKeyFrame;  //skip frames until next key frame
+    Vector<int64_t> mSkipSeq;   //disposable frames dropped in the middle of queue, ascending
+    Vector<BsInUseFrame> mInUse;    //frames got but not freed, in read order
+    int64_t     mDropCount;
+    int64_t     mForcedReleaseCount;
+    int         mForcedUnacked; //frames taken back which freeOneBsFrame() has not returned yet
+    BsFrameWaitStatistics mWaitStat;
+} BsConsumer;
+
+
+enum OutputFilePrepareState
+{
+    OUTPUT_FILE_PREPARE_PENDING = 0,
+    OUTPUT_FILE_PREPARE_RUNNING,
+    OUTPUT_FILE_PREPARE_DONE,
+    OUTPUT_FILE_PREPARE_ABANDONED,  //rotated to while RUNNING, prepare thread closes it.
+};
+
+/* next segment file given by prepareOutputFile(), preallocated by mPrepareThread. */
+typedef struct PreparedOutputFile
+{
+    int         mFd;            //dup of the caller's fd, or opened by path
+    dev_t       mDev;
+    ino_t       mIno;
+    int64_t     mFallocateLen;
+    int         mState;         //OutputFilePrepareState
+    status_t    mResult;
+} PreparedOutputFile;
+
+typedef struct FileRotateStatistics
+{
+    int64_t mRotateCount;
+    int64_t mPreparedHitCount;  //rotations which used a preallocated file
+    int64_t mPrepareBusyCount;  //rotations whose file was still being preallocated, given up
+    int64_t mLastGapUs;         //time spent in setOutputFileSync()
+    int64_t mMaxGapUs;
+    int64_t mTotalGapUs;
+    int64_t mLastRotateUs;      //systemTime of last rotation
+    int     mLastLostFrames;    //frames lost within ROTATE_LOST_FRAME_WINDOW_US after last rotation
+    int     mMaxLostFrames;
+    int64_t mTotalLostFrames;
+} FileRotateStatistics;
 
 typedef struct SoftFrameRateCtrl
 {
@@ -112,6 +200,13 @@ public:
     virtual status_t queueBuffer(int index, int addr_y, int addr_c, int64_t timestamp);
     virtual	sp<IMemory> getOneBsFrame(int mode);
     virtual	void freeOneBsFrame();
+    virtual int registerBsConsumer(int dropPolicy);
+    virtual status_t unregisterBsConsumer(int consumerId);
+    virtual status_t getBsConsumerStatus(int consumerId, BsConsumerStatus *pStatus);
+    virtual status_t getBsFrames(int consumerId, int maxFrames, int timeoutMs, Vector<sp<IMemoryHeap> > *heaps, Vector<BsFrameDesc> *frames);
+    virtual status_t freeBsFrames(int consumerId, int64_t lastSeq);
+    virtual status_t waitBsFrames(int consumerId, int minFrames, int waitFlags, int timeoutMs, int *pQueuedFrames);
+    virtual void abortBsFrameWaits();
     virtual	sp<IMemory> getEncDataHeader();
     virtual status_t setVideoEncodingBitRateSync(int bitRate);
     virtual status_t setVideoFrameRateSync(int frames_per_seconid);
@@ -119,6 +214,8 @@ public:
     virtual status_t reencodeIFrame();
     virtual status_t setOutputFileSync(int fd, int64_t fallocateLength, int muxerId);
     virtual status_t setOutputFileSync(const char* path, int64_t fallocateLength, int muxerId);
+    virtual status_t prepareOutputFile(int fd, int64_t fallocateLength);
+    virtual status_t prepareOutputFile(const char* path, int64_t fallocateLength);
     virtual status_t setSdcardState(bool bExist);
     virtual int addOutputFormatAndOutputSink(int of, int fd, int FallocateLen, bool callback_out_flag);
     virtual int addOutputFormatAndOutputSink(int of, const char* path, int FallocateLen, bool callback_out_flag);
@@ -217,7 +314,25 @@ private:
     status_t setParamTimeBetweenTimeLapseFrameCapture(int64_t timeUs);
     status_t setParamImpactDurationBfTime(int bftime);
     status_t setParamImpactDurationAfTime(int aftime);
+    status_t setParamBsDumpPath(const char *path);
 	int pushOneBsFrame(int mode);
+	status_t allocBsRingSlot(size_t size, EncQueueBuffer *pBuf);
+	bool makeBsRingRoom();
+	void trimBsFrames(size_t backlog);
+	void clearBsRing();
+	BsConsumer *getBsConsumerLocked(int consumerId);
+	bool dropBsConsumerFrames(int consumerId, BsConsumer *pConsumer, bool bDropOldest);
+	ssize_t nextBsFrameIndex(BsConsumer *pConsumer);
+	int countBsFrames(const BsConsumer *pConsumer, bool *pHasKeyFrame);
+	void releaseBsConsumerFrames(BsConsumer *pConsumer, int count);
+	void releaseBsConsumerFramesTo(BsConsumer *pConsumer, int64_t lastSeq);
+	status_t waitBsFrameLocked(int consumerId, int minFrames, int waitFlags, int timeoutMs);
+	status_t queuePreparedOutputFile(int fd, int64_t fallocateLength);
+	bool takePreparedOutputFile(dev_t dev, ino_t ino, int *pFd);
+	void stopPrepareThread();
+	bool prepareOutputFileLoop();
+	void finishFileRotation(int64_t startUs, bool bPrepared);
+	void countRotateLostFrames(int frames);
 	status_t CreateAudioRecorder();
 	void releaseOneRecordingFrame(const sp<IMemory>& frame, int bufIdx);
 	status_t isCameraAvailable(const sp<ICamera>& camera,
@@ -275,6 +390,8 @@ private:
     int mOutputFd;
     int	mFallocateLength; //match with mOutputFd
     char *mUrl;
+    char *mBsDumpPath;  //"param-bs-dump-path", encoded video is also written there as elementary stream.
+    struct cdx_stream_info *mBsDumpStream;
 
     // mOutputFormat, mOutputFd, mOutputFd2, mResetFdFlag, mUrl is for old method.
     // mOutputSinkInfoVector is for new method. Donot use two methods at the same time.
@@ -293,6 +410,7 @@ private:
 	Mutex mStateLock;
 	Mutex mLock;
 	Mutex mQueueLock;
+	Condition mBsFrameCond;     //signal when one frame is pushed to mEncData.
 	Mutex mSetParamLock;
 	Mutex mDurationLock;
 	
@@ -325,7 +443,17 @@ private:
 #endif
 	//int                 mAudioEncodeType;
 	bool				mOutputVideosizeflag;
-	Vector<EncQueueBuffer> mEncData;
+	Vector<EncQueueBuffer> mEncData;       //encoded frames kept for consumers, oldest first, guarded by mQueueLock.
+	int64_t             mBsNextSeq;         //seq of next pushed frame
+	sp<MemoryHeapBase>  mBsRingHeap;
+	size_t              mBsRingHead;        //next write offset in mBsRingHeap
+	EncRingStatistics   mBsRingStat;
+	int                 mBsRingGeneration;  //increase when ring is cleared, wake up waiters.
+	bool                mBsWaitAborted;     //recorder is being released, no more waiting.
+	KeyedVector<int, BsConsumer> mBsConsumers;  //BS_DEFAULT_CONSUMER is for getOneBsFrame()
+	int                 mBsConsumerIdCounter;
+	bool                mBsKeyFrameWanted;  //some consumer waits for key frame, ask encoder for IDR.
+	bool                mBsKeyFrameRequested;   //IDR asked, wait for it.
 	VencHeaderData mPpsInfo;
 //    bool mRecordFileFlag;   //true:fwrite file; false:callback out, not fwrite file.
 //    bool mResetDurationStatistics;
@@ -343,6 +471,24 @@ private:
     int64_t mSampleCount;
     int64_t mDebugLastVideoPts; //unit:us
 
+    class OutputFilePrepareThread : public Thread
+    {
+    public:
+        OutputFilePrepareThread(CedarXRecorder *recorder)
+            : Thread(false), mRecorder(recorder) {}
+    private:
+        virtual bool threadLoop() { return mRecorder->prepareOutputFileLoop(); }
+        CedarXRecorder *mRecorder;
+    };
+    friend class OutputFilePrepareThread;
+    sp<OutputFilePrepareThread> mPrepareThread;
+    Mutex               mPrepareLock;
+    Condition           mPrepareCond;   //signal when a file is queued or prepared.
+    bool                mPrepareExit;
+    volatile int        mPrepareAbortFlag;  //stop preallocating the RUNNING file
+    Vector<PreparedOutputFile> mPreparedFiles;
+    FileRotateStatistics mRotateStat;   //protected by mPrepareLock
+
     int setFrameRateControl(int reqFrameRate, int srcFrameRate, int *numerator, int *denominator);
     SoftFrameRateCtrl mSoftFrameRateCtrl;
     status_t enableDynamicBitRateControl(bool bEnable);
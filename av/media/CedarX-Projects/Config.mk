@@ -170,3 +170,11 @@ else
   CEDARX_EXT_CFLAGS += -DCDXCFG_FILE_SYSTEM=0
 endif
 
+# staging buffers of directIO async writer, 0 means write synchronously in muxer thread.
+ifneq ($(CEDARX_DIRECTIO_ASYNC_BUF_NUM),)
+  CEDARX_EXT_CFLAGS += -DCDXCFG_DIRECTIO_ASYNC_BUF_NUM=$(CEDARX_DIRECTIO_ASYNC_BUF_NUM)
+endif
+ifneq ($(CEDARX_DIRECTIO_ASYNC_BUF_SIZE),)
+  CEDARX_EXT_CFLAGS += -DCDXCFG_DIRECTIO_ASYNC_BUF_SIZE=$(CEDARX_DIRECTIO_ASYNC_BUF_SIZE)
+endif
+
@@ -10,6 +10,7 @@ LOCAL_SRC_FILES := \
 LOCAL_SHARED_LIBRARIES := \
 	libutils \
     libvdecoder \
+    libstagefright_color_conversion \
 
 LOCAL_MODULE_TAGS := optional
 LOCAL_MODULE:= libjpegdecoder
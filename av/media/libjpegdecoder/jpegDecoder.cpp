@@ -8,6 +8,7 @@
 #include <string.h>
 
 #include <binder/IMemory.h>
+#include <media/stagefright/YUVRowConverter.h>
 
 #include "jpegDecoder.h"
 
@@ -28,12 +29,19 @@ JpegDecoder::~JpegDecoder()
 }
 
 status_t JpegDecoder::initialize(int jpgWidth, int jpgHeight)
+{
+    return initialize(jpgWidth, jpgHeight, getMaxOutScaleDownRatio(jpgWidth, jpgHeight));
+}
+
+status_t JpegDecoder::initialize(int jpgWidth, int jpgHeight, int scaleDownRatio)
 {
     int ret;
-    int i;
-    int nOutput, nActual;
 
-    ALOGV("initialize(%d, %d)", jpgWidth, jpgHeight);
+    ALOGV("initialize(%d, %d, 1/%d)", jpgWidth, jpgHeight, 1 << scaleDownRatio);
+    if (scaleDownRatio < 0 || scaleDownRatio > JPEG_DECODER_MAX_SCALE_DOWN_RATIO) {
+        ALOGE("<F:%s, L:%d> bad scale down ratio %d!", __FUNCTION__, __LINE__, scaleDownRatio);
+        return BAD_VALUE;
+    }
     mDecoder = CreateVideoDecoder();
     if(mDecoder == NULL){
         ALOGE("<F:%s, L:%d> CreateVideoDecoder error!", __FUNCTION__, __LINE__);
@@ -59,49 +67,13 @@ status_t JpegDecoder::initialize(int jpgWidth, int jpgHeight)
     //mConfig.eOutputPixelFormat          = PIXEL_FORMAT_YUV_MB32_420;
     mConfig.bDisable3D                  = 1;
     mConfig.nVbvBufferSize              = 4*1024*1024;
-    mConfig.bScaleDownEn = 0;
-    mConfig.nHorizonScaleDownRatio = 0;
-    mConfig.nVerticalScaleDownRatio = 0;
+    mConfig.bScaleDownEn = scaleDownRatio > 0;
+    mConfig.nHorizonScaleDownRatio = scaleDownRatio;
+    mConfig.nVerticalScaleDownRatio = scaleDownRatio;
     mConfig.nSecHorizonScaleDownRatio = 0;
     mConfig.nSecVerticalScaleDownRatio = 0;
     mConfig.nFrameBufferNum = 1;
 
-#if 1
-    if (mStreamInfo.nWidth > JPEG_DECODER_MAX_OUT_WIDTH)
-    {
-        mConfig.bScaleDownEn = 1;
-        nOutput = JPEG_DECODER_MAX_OUT_WIDTH;
-        nActual = mStreamInfo.nWidth;
-        for (i=0; nOutput<nActual; i++)
-        {
-            nOutput*=2;
-        }
-        mConfig.nHorizonScaleDownRatio = i;
-    }
-    if (mStreamInfo.nHeight > JPEG_DECODER_MAX_OUT_HEIGHT)
-    {
-        mConfig.bScaleDownEn = 1;
-        nOutput = JPEG_DECODER_MAX_OUT_HEIGHT;
-        nActual = mStreamInfo.nHeight;
-        for (i=0; nOutput<nActual; i++)
-        {
-            nOutput*=2;
-        }
-        mConfig.nVerticalScaleDownRatio = i;
-    }
-    if (mConfig.bScaleDownEn == 1) {
-        if (mConfig.nHorizonScaleDownRatio > mConfig.nVerticalScaleDownRatio) {
-            mConfig.nVerticalScaleDownRatio = mConfig.nHorizonScaleDownRatio;
-        } else {
-            mConfig.nHorizonScaleDownRatio = mConfig.nVerticalScaleDownRatio;
-        }
-    }
-    if (mConfig.nVerticalScaleDownRatio > 3) {
-        mConfig.nVerticalScaleDownRatio = 3;
-        mConfig.nHorizonScaleDownRatio = 3;
-    }
-#endif
-
 	ret = InitializeVideoDecoder(mDecoder, &mStreamInfo, &mConfig);
 	if(ret < 0){
 		ALOGE("<F:%s, L:%d> InitializeVideoDecoder error!", __FUNCTION__, __LINE__);
@@ -112,6 +84,45 @@ status_t JpegDecoder::initialize(int jpgWidth, int jpgHeight)
     return NO_ERROR;
 }
 
+int JpegDecoder::getMaxOutScaleDownRatio(int jpgWidth, int jpgHeight)
+{
+    int ratio = 0;
+
+    // keep the picture within JPEG_DECODER_MAX_OUT_WIDTH x HEIGHT
+    while (ratio < JPEG_DECODER_MAX_SCALE_DOWN_RATIO
+            && ((JPEG_DECODER_MAX_OUT_WIDTH << ratio) < jpgWidth
+                || (JPEG_DECODER_MAX_OUT_HEIGHT << ratio) < jpgHeight)) {
+        ratio++;
+    }
+    return ratio;
+}
+
+int JpegDecoder::getScaleDownRatio(int jpgWidth, int jpgHeight, int boxWidth, int boxHeight)
+{
+    int ratio = 0;
+
+    if (jpgWidth <= 0 || jpgHeight <= 0 || boxWidth <= 0 || boxHeight <= 0) {
+        return getMaxOutScaleDownRatio(jpgWidth, jpgHeight);
+    }
+    // The picture is fitted into the box keeping its aspect ratio, so the
+    // tighter side decides. Stop before the decoded picture gets smaller
+    // than the fitted one, the rest is left to YUV420_to_RGB.
+    if ((int64_t)jpgWidth * boxHeight > (int64_t)jpgHeight * boxWidth) {
+        while (ratio < JPEG_DECODER_MAX_SCALE_DOWN_RATIO
+                && (jpgWidth >> (ratio + 1)) >= boxWidth) {
+            ratio++;
+        }
+    } else {
+        while (ratio < JPEG_DECODER_MAX_SCALE_DOWN_RATIO
+                && (jpgHeight >> (ratio + 1)) >= boxHeight) {
+            ratio++;
+        }
+    }
+    // a box larger than the output cap does not lift the cap
+    int maxOutRatio = getMaxOutScaleDownRatio(jpgWidth, jpgHeight);
+    return (ratio > maxOutRatio) ? ratio : maxOutRatio;
+}
+
 status_t JpegDecoder::destroy()
 {
 	ALOGV("destroy");
@@ -211,59 +222,103 @@ status_t JpegDecoder::releaseFrame(VideoPicture *picture)
     return ReturnPicture(mDecoder, picture);
 }
 
-void JpegDecoder::YV12_to_RGB24(unsigned char *yv12, unsigned char *rgb24, int width, int height)
+// The coefficients YV12_to_RGB24 always used, in 8 bit fixed point:
+// B = Y + 2.03211 * (U - 128)
+// G = Y - 0.39465 * (U - 128) - 0.58060 * (V - 128)
+// R = Y + 1.13983 * (V - 128)
+// The sums are shifted down, which truncates like the float casts did for
+// everything that does not clip to 0 anyway.
+static const YUVRowConverter::Coeffs kYUVCoeffs = { 0, 256, 520, 101, 149, 292 };
+
+status_t JpegDecoder::YUV420_to_RGB(const unsigned char *yuv, int yuvFormat, int width, int height,
+        unsigned char *rgb, int rgbFormat, int dstWidth, int dstHeight, bool flip)
+{
+    return YUV420_to_RGB(yuv, yuvFormat, width, height, width, height,
+            rgb, rgbFormat, dstWidth, dstHeight, flip);
+}
+
+status_t JpegDecoder::YUV420_to_RGB(const unsigned char *yuv, int yuvFormat, int width, int height,
+        int stride, int sliceHeight, unsigned char *rgb, int rgbFormat,
+        int dstWidth, int dstHeight, bool flip)
 {
-    if(yv12 == NULL || rgb24 == NULL) {
-        return;
+    if (yuv == NULL || rgb == NULL || width < 2 || height < 2
+            || stride < width || sliceHeight < height
+            || dstWidth < 1 || dstHeight < 1) {
+        ALOGE("YUV420_to_RGB bad size %dx%d -> %dx%d", width, height, dstWidth, dstHeight);
+        return BAD_VALUE;
     }
-    const long nYLen = long(height * width);
-    const int nHfWidth = (width >> 1);
-    if(nYLen < 1 || nHfWidth < 1)  {
-        return;
+    if (rgbFormat != RGB_FORMAT_ARGB8888 && rgbFormat != RGB_FORMAT_RGB565
+            && rgbFormat != RGB_FORMAT_RGB24) {
+        ALOGE("YUV420_to_RGB unsupported rgb format %d", rgbFormat);
+        return BAD_VALUE;
     }
 
-    // yv12 format y data length is width*height, U data and V data length is width*height/4
-    unsigned char *yData = yv12; //y address
-    unsigned char *vData = yData + nYLen; //u address
-    unsigned char *uData = vData + nYLen / 4;  //v address
-    // Convert YV12 to RGB24
-    int rgb[3];
-    int i, j, m, n, x, y;
-    m = -width;
-    n = -nHfWidth;
-    for(y = 0; y < height; ++y)
-    {
-        m += width;
-        if(!(y % 2)) {
-            n += nHfWidth;
-        }
-        for(x = 0; x < width; ++x)
-        {
-            i = m + x;
-            j = n + (x >> 1);
-#if 0
-            rgb[2] = int((float)yData[i] + 1.370705 * (float)(vData[j] - 128));
-            rgb[1] = int((float)yData[i] - 0.698001 * (float)(uData[j] - 128)  - 0.703125 * (float)(vData[j] - 128));
-            rgb[0] = int((float)yData[i] + 1.732446 * (float)(uData[j] - 128));
-#else
-            rgb[2] = int((float)yData[i] + 1.13983 * (float)(vData[j] - 128));
-            rgb[1] = int((float)yData[i] - 0.39465 * (float)(uData[j] - 128)  - 0.58060 * (float)(vData[j] - 128));
-            rgb[0] = int((float)yData[i] + 2.03211 * (float)(uData[j] - 128));
-#endif
-            j = nYLen - width - m + x;
-            i = (j << 1) + j;
-            for(int j = 0; j < 3; ++j)
-            {
-                if (rgb[j] < 0) {
-                    rgb24[i+j] = 0;
-                } else if (rgb[j] > 255) {
-                    rgb24[i+j] = 255;
-                } else {
-                    rgb24[i+j] = rgb[j];
-                }
-            }
-        }
+    const unsigned char *yData = yuv;
+    const unsigned char *uData;
+    const unsigned char *vData;
+    const int ySize = stride * sliceHeight;
+    int uvStride, uvStep;
+
+    switch (yuvFormat) {
+    case YUV420_FORMAT_YV12:
+        vData = yData + ySize;
+        uData = vData + ySize / 4;
+        uvStride = stride / 2;
+        uvStep = 1;
+        break;
+    case YUV420_FORMAT_I420:
+        uData = yData + ySize;
+        vData = uData + ySize / 4;
+        uvStride = stride / 2;
+        uvStep = 1;
+        break;
+    case YUV420_FORMAT_NV12:
+        uData = yData + ySize;
+        vData = uData + 1;
+        uvStride = stride;
+        uvStep = 2;
+        break;
+    case YUV420_FORMAT_NV21:
+        vData = yData + ySize;
+        uData = vData + 1;
+        uvStride = stride;
+        uvStep = 2;
+        break;
+    default:
+        ALOGE("YUV420_to_RGB unsupported yuv format %d", yuvFormat);
+        return BAD_VALUE;
     }
+
+    YUVRowConverter converter(kYUVCoeffs,
+            (rgbFormat == RGB_FORMAT_ARGB8888) ? YUVRowConverter::kBGRA8888
+            : (rgbFormat == RGB_FORMAT_RGB565) ? YUVRowConverter::kRGB565
+            : YUVRowConverter::kBGR888);
+    const int bpp = converter.bytesPerPixel();
+    const unsigned int xStep = ((unsigned int)width << 16) / dstWidth;
+    const unsigned int yStep = ((unsigned int)height << 16) / dstHeight;
+    unsigned int sy = 0;
+
+    YUVRowConverter::Row yuvRow;
+    yuvRow.mYStep = 1;
+    yuvRow.mUVStep = uvStep;
+
+    for (int row = 0; row < dstHeight; ++row, sy += yStep) {
+        int i = sy >> 16;
+        yuvRow.mY = yData + i * stride;
+        yuvRow.mU = uData + (i >> 1) * uvStride;
+        yuvRow.mV = vData + (i >> 1) * uvStride;
+        unsigned char *dst = rgb + (flip ? dstHeight - 1 - row : row) * dstWidth * bpp;
+
+        converter.convertScaled(yuvRow, dst, dstWidth, xStep);
+    }
+
+    return NO_ERROR;
+}
+
+void JpegDecoder::YV12_to_RGB24(unsigned char *yv12, unsigned char *rgb24, int width, int height)
+{
+    YUV420_to_RGB(yv12, YUV420_FORMAT_YV12, width, height,
+            rgb24, RGB_FORMAT_RGB24, width, height, true);
 }
 
 void JpegDecoder::RGB24_to_ARGB(unsigned char *rgb24, unsigned char *argb, int width, int height)
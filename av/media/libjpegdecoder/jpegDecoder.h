@@ -4,6 +4,8 @@
 #include <vdecoder.h>
 
 
+#define JPEG_DECODER_MAX_SCALE_DOWN_RATIO   3
+
 namespace android {
 
 typedef struct JpegInfo
@@ -22,6 +24,9 @@ public:
 
     status_t decode();
     status_t initialize(int jpgWidth, int jpgHeight);
+    // scaleDownRatio has the decoder output 1/2^ratio of the picture,
+    // up to JPEG_DECODER_MAX_SCALE_DOWN_RATIO (1/8).
+    status_t initialize(int jpgWidth, int jpgHeight, int scaleDownRatio);
     status_t destroy();
     VideoPicture*  getFrame(void);
     status_t releaseFrame(VideoPicture *picture);
@@ -29,10 +34,45 @@ public:
     status_t updateBuffer(int size, int64_t pts, char *data);
     status_t getJpgInfo(JpegInfo *jpgInfo);
 
+    // The largest ratio whose output still covers the picture fitted into
+    // boxWidth x boxHeight, for decoding straight to thumbnail size. Never
+    // less than what initialize(jpgWidth, jpgHeight) would pick, so the
+    // output stays within the decoder's maximum output size either way.
+    static int getScaleDownRatio(int jpgWidth, int jpgHeight, int boxWidth, int boxHeight);
+
+    enum {
+        YUV420_FORMAT_YV12 = 0,     // Y, V, U planes
+        YUV420_FORMAT_I420,         // Y, U, V planes, PIXEL_FORMAT_YUV_PLANER_420
+        YUV420_FORMAT_NV12,         // Y plane, interleaved U/V plane
+        YUV420_FORMAT_NV21,         // Y plane, interleaved V/U plane
+    };
+
+    enum {
+        RGB_FORMAT_ARGB8888 = 0,    // 0xAARRGGBB words, B, G, R, A in memory
+        RGB_FORMAT_RGB565,
+        RGB_FORMAT_RGB24,           // B, G, R in memory
+    };
+
+    // Converts a width x height YUV 4:2:0 picture to RGB in one fixed point
+    // pass. A dstWidth x dstHeight other than the source size resamples
+    // while converting (nearest sample), so a thumbnail never exists at full
+    // size. flip writes the last source row first.
+    static status_t YUV420_to_RGB(const unsigned char *yuv, int yuvFormat, int width, int height,
+            unsigned char *rgb, int rgbFormat, int dstWidth, int dstHeight, bool flip);
+    // Same for a picture whose planes are stride x sliceHeight, as the
+    // decoder hands them out; only the top left width x height is converted.
+    static status_t YUV420_to_RGB(const unsigned char *yuv, int yuvFormat, int width, int height,
+            int stride, int sliceHeight, unsigned char *rgb, int rgbFormat,
+            int dstWidth, int dstHeight, bool flip);
+
+    // RGB24 bottom-up, same as YUV420_to_RGB(YV12, RGB24, flip).
     static void YV12_to_RGB24(unsigned char *yv12, unsigned char *rgb24, int width, int height);
     static void RGB24_to_ARGB(unsigned char *rgb24, unsigned char *argb, int width, int height);
 
 private:
+    // The smallest ratio that keeps the output within the maximum output size.
+    static int getMaxOutScaleDownRatio(int jpgWidth, int jpgHeight);
+
     VideoDecoder *mDecoder;
     VideoStreamInfo mStreamInfo;
     VConfig mConfig;
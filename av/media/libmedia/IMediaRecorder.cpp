@@ -74,6 +74,16 @@ enum {
 
 	SET_IMPACT_OUTPUT_FILE,
 	SET_IMPACT_OUTPUT_FILE_URL,
+
+	GET_BSFRAMES,
+	FREE_BSFRAMES,
+	WAIT_BSFRAMES,
+	REGISTER_BS_CONSUMER,
+	UNREGISTER_BS_CONSUMER,
+	GET_BS_CONSUMER_STATUS,
+
+	PREPARE_OUTPUT_FILE,
+	PREPARE_OUTPUT_FILE_URL,
 };
 
 class BpMediaRecorder: public BpInterface<IMediaRecorder>
@@ -319,6 +329,94 @@ public:
         remote()->transact(FREE_ONE_BSFRAME, data, &reply);
 	}
 
+	int registerBsConsumer(int dropPolicy)
+	{
+		ALOGV("registerBsConsumer");
+		Parcel data, reply;
+		data.writeInterfaceToken(IMediaRecorder::getInterfaceDescriptor());
+		data.writeInt32(dropPolicy);
+		remote()->transact(REGISTER_BS_CONSUMER, data, &reply);
+		return reply.readInt32();
+	}
+
+	status_t unregisterBsConsumer(int consumerId)
+	{
+		ALOGV("unregisterBsConsumer");
+		Parcel data, reply;
+		data.writeInterfaceToken(IMediaRecorder::getInterfaceDescriptor());
+		data.writeInt32(consumerId);
+		remote()->transact(UNREGISTER_BS_CONSUMER, data, &reply);
+		return reply.readInt32();
+	}
+
+	status_t getBsConsumerStatus(int consumerId, BsConsumerStatus *pStatus)
+	{
+		ALOGV("getBsConsumerStatus");
+		Parcel data, reply;
+		data.writeInterfaceToken(IMediaRecorder::getInterfaceDescriptor());
+		data.writeInt32(consumerId);
+		remote()->transact(GET_BS_CONSUMER_STATUS, data, &reply);
+		status_t ret = reply.readInt32();
+		if (ret == NO_ERROR) {
+			reply.read(pStatus, sizeof(BsConsumerStatus));
+		}
+		return ret;
+	}
+
+	status_t getBsFrames(int consumerId, int maxFrames, int timeoutMs, Vector<sp<IMemoryHeap> > *heaps, Vector<BsFrameDesc> *frames)
+	{
+		ALOGV("getBsFrames");
+		Parcel data, reply;
+		data.writeInterfaceToken(IMediaRecorder::getInterfaceDescriptor());
+		data.writeInt32(consumerId);
+		data.writeInt32(maxFrames);
+		data.writeInt32(timeoutMs);
+		remote()->transact(GET_BSFRAMES, data, &reply);
+		status_t ret = reply.readInt32();
+		if (ret != NO_ERROR) {
+			return ret;
+		}
+		int heapCount = reply.readInt32();
+		for (int i = 0; i < heapCount; i++) {
+			heaps->push_back(interface_cast<IMemoryHeap>(reply.readStrongBinder()));
+		}
+		int frameCount = reply.readInt32();
+		if (frameCount > 0) {
+			frames->insertAt(frames->size(), frameCount);
+			reply.read(frames->editArray() + frames->size() - frameCount, frameCount * sizeof(BsFrameDesc));
+		}
+		return NO_ERROR;
+	}
+
+	status_t freeBsFrames(int consumerId, int64_t lastSeq)
+	{
+		ALOGV("freeBsFrames");
+		Parcel data, reply;
+		data.writeInterfaceToken(IMediaRecorder::getInterfaceDescriptor());
+		data.writeInt32(consumerId);
+		data.writeInt64(lastSeq);
+		remote()->transact(FREE_BSFRAMES, data, &reply);
+		return reply.readInt32();
+	}
+
+	status_t waitBsFrames(int consumerId, int minFrames, int waitFlags, int timeoutMs, int *pQueuedFrames)
+	{
+		ALOGV("waitBsFrames");
+		Parcel data, reply;
+		data.writeInterfaceToken(IMediaRecorder::getInterfaceDescriptor());
+		data.writeInt32(consumerId);
+		data.writeInt32(minFrames);
+		data.writeInt32(waitFlags);
+		data.writeInt32(timeoutMs);
+		remote()->transact(WAIT_BSFRAMES, data, &reply);
+		status_t ret = reply.readInt32();
+		int queuedFrames = reply.readInt32();
+		if (pQueuedFrames != NULL) {
+			*pQueuedFrames = queuedFrames;
+		}
+		return ret;
+	}
+
 	sp<IMemory> getEncDataHeader()
 	{
 		ALOGV("getEncDataHeader");
@@ -448,6 +546,28 @@ public:
         return reply.readInt32();
     }
 
+    status_t prepareOutputFile(int fd, int64_t fallocateLength)
+    {
+        ALOGV("prepareOutputFile(%d, %lld)", fd, fallocateLength);
+        Parcel data, reply;
+        data.writeInterfaceToken(IMediaRecorder::getInterfaceDescriptor());
+        data.writeFileDescriptor(fd);
+        data.writeInt64(fallocateLength);
+        remote()->transact(PREPARE_OUTPUT_FILE, data, &reply);
+        return reply.readInt32();
+    }
+
+    status_t prepareOutputFile(const char* path, int64_t fallocateLength)
+    {
+        ALOGV("prepareOutputFile(%s, %lld)", path, fallocateLength);
+        Parcel data, reply;
+        data.writeInterfaceToken(IMediaRecorder::getInterfaceDescriptor());
+        data.writeCString(path);
+        data.writeInt64(fallocateLength);
+        remote()->transact(PREPARE_OUTPUT_FILE_URL, data, &reply);
+        return reply.readInt32();
+    }
+
     status_t setSdcardState(bool bExist)
     {
         ALOGV("setSdcardState(%d)", bExist);
@@ -648,6 +768,74 @@ status_t BnMediaRecorder::onTransact(
 			freeOneBsFrame();
 			return NO_ERROR;
 		} break;
+		case GET_BSFRAMES: {
+			ALOGV("GET_BSFRAMES");
+			CHECK_INTERFACE(IMediaRecorder, data, reply);
+			int consumerId = data.readInt32();
+			int maxFrames = data.readInt32();
+			int timeoutMs = data.readInt32();
+			Vector<sp<IMemoryHeap> > heaps;
+			Vector<BsFrameDesc> frames;
+			status_t ret = getBsFrames(consumerId, maxFrames, timeoutMs, &heaps, &frames);
+			reply->writeInt32(ret);
+			if (ret == NO_ERROR) {
+				reply->writeInt32(heaps.size());
+				for (size_t i = 0; i < heaps.size(); i++) {
+					reply->writeStrongBinder(heaps[i]->asBinder());
+				}
+				reply->writeInt32(frames.size());
+				if (!frames.isEmpty()) {
+					reply->write(frames.array(), frames.size() * sizeof(BsFrameDesc));
+				}
+			}
+			return NO_ERROR;
+		} break;
+		case FREE_BSFRAMES: {
+			ALOGV("FREE_BSFRAMES");
+			CHECK_INTERFACE(IMediaRecorder, data, reply);
+			int consumerId = data.readInt32();
+			int64_t lastSeq = data.readInt64();
+			reply->writeInt32(freeBsFrames(consumerId, lastSeq));
+			return NO_ERROR;
+		} break;
+		case WAIT_BSFRAMES: {
+			ALOGV("WAIT_BSFRAMES");
+			CHECK_INTERFACE(IMediaRecorder, data, reply);
+			int consumerId = data.readInt32();
+			int minFrames = data.readInt32();
+			int waitFlags = data.readInt32();
+			int timeoutMs = data.readInt32();
+			int queuedFrames = 0;
+			reply->writeInt32(waitBsFrames(consumerId, minFrames, waitFlags, timeoutMs, &queuedFrames));
+			reply->writeInt32(queuedFrames);
+			return NO_ERROR;
+		} break;
+		case REGISTER_BS_CONSUMER: {
+			ALOGV("REGISTER_BS_CONSUMER");
+			CHECK_INTERFACE(IMediaRecorder, data, reply);
+			int dropPolicy = data.readInt32();
+			reply->writeInt32(registerBsConsumer(dropPolicy));
+			return NO_ERROR;
+		} break;
+		case UNREGISTER_BS_CONSUMER: {
+			ALOGV("UNREGISTER_BS_CONSUMER");
+			CHECK_INTERFACE(IMediaRecorder, data, reply);
+			int consumerId = data.readInt32();
+			reply->writeInt32(unregisterBsConsumer(consumerId));
+			return NO_ERROR;
+		} break;
+		case GET_BS_CONSUMER_STATUS: {
+			ALOGV("GET_BS_CONSUMER_STATUS");
+			CHECK_INTERFACE(IMediaRecorder, data, reply);
+			int consumerId = data.readInt32();
+			BsConsumerStatus status;
+			status_t ret = getBsConsumerStatus(consumerId, &status);
+			reply->writeInt32(ret);
+			if (ret == NO_ERROR) {
+				reply->write(&status, sizeof(BsConsumerStatus));
+			}
+			return NO_ERROR;
+		} break;
         case GET_ENC_DATA_HEADER: {
         	ALOGV("GET_ENC_DATA_HEADER");
 			CHECK_INTERFACE(IMediaRecorder, data, reply);
@@ -847,6 +1035,22 @@ status_t BnMediaRecorder::onTransact(
             reply->writeInt32(setOutputFileSync(path, fallocateLength, muxerId));
             return NO_ERROR;
         } break;
+        case PREPARE_OUTPUT_FILE: {
+            ALOGV("PREPARE_OUTPUT_FILE");
+            CHECK_INTERFACE(IMediaRecorder, data, reply);
+            int fd = data.readFileDescriptor();
+            int64_t fallocateLength = data.readInt64();
+            reply->writeInt32(prepareOutputFile(fd, fallocateLength));
+            return NO_ERROR;
+        } break;
+        case PREPARE_OUTPUT_FILE_URL: {
+            ALOGV("PREPARE_OUTPUT_FILE_URL");
+            CHECK_INTERFACE(IMediaRecorder, data, reply);
+            const char* path = data.readCString();
+            int64_t fallocateLength = data.readInt64();
+            reply->writeInt32(prepareOutputFile(path, fallocateLength));
+            return NO_ERROR;
+        } break;
         case SET_SDCARD_STATE: {
             ALOGV("SET_SDCARD_STATE");
             CHECK_INTERFACE(IMediaRecorder, data, reply);
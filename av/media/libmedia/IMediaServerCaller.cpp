@@ -14,6 +14,7 @@ enum {
     DISCONNECT = IBinder::FIRST_CALL_TRANSACTION,
     JPEG_DECODE,
     JPEG_DECODE_URL,
+    JPEG_DECODE_THUMBNAIL,
 };
 
 class BpMediaServerCaller: public BpInterface<IMediaServerCaller>
@@ -59,6 +60,22 @@ public:
         }
         return interface_cast<IMemory>(reply.readStrongBinder());
     }
+
+    sp<IMemory> jpegDecodeThumbnail(const char *path, int width, int height)
+    {
+        ALOGV("jpegDecodeThumbnail(%s, %dx%d)", path, width, height);
+        Parcel data, reply;
+        data.writeInterfaceToken(IMediaServerCaller::getInterfaceDescriptor());
+        data.writeCString(path);
+        data.writeInt32(width);
+        data.writeInt32(height);
+        remote()->transact(JPEG_DECODE_THUMBNAIL, data, &reply);
+        status_t ret = reply.readInt32();
+        if (ret != NO_ERROR) {
+            return NULL;
+        }
+        return interface_cast<IMemory>(reply.readStrongBinder());
+    }
 };
 
 IMPLEMENT_META_INTERFACE(MediaServerCaller, "android.media.IMediaServerCaller");
@@ -101,6 +118,21 @@ status_t BnMediaServerCaller::onTransact(
             }
             return NO_ERROR;
         } break;
+        case JPEG_DECODE_THUMBNAIL: {
+            ALOGV("JPEG_DECODE_THUMBNAIL");
+            CHECK_INTERFACE(IMediaServerCaller, data, reply);
+            const char* path = data.readCString();
+            int width = data.readInt32();
+            int height = data.readInt32();
+            sp<IMemory> thumbnail = jpegDecodeThumbnail(path, width, height);
+            if (thumbnail == NULL) {
+                reply->writeInt32(UNKNOWN_ERROR);
+            } else {
+                reply->writeInt32(NO_ERROR);
+                reply->writeStrongBinder(thumbnail->asBinder());
+            }
+            return NO_ERROR;
+        } break;
         default:
             return BBinder::onTransact(code, data, reply, flags);
     }
@@ -460,6 +460,72 @@ void MediaRecorder::freeOneBsFrame()
 	mMediaRecorder->freeOneBsFrame();
 }
 
+int MediaRecorder::registerBsConsumer(int dropPolicy)
+{
+	ALOGV("registerBsConsumer");
+	if(mMediaRecorder == NULL) {
+		ALOGE("media recorder is not initialized yet");
+		return INVALID_OPERATION;
+	}
+
+	return mMediaRecorder->registerBsConsumer(dropPolicy);
+}
+
+status_t MediaRecorder::unregisterBsConsumer(int consumerId)
+{
+	ALOGV("unregisterBsConsumer");
+	if(mMediaRecorder == NULL) {
+		ALOGE("media recorder is not initialized yet");
+		return INVALID_OPERATION;
+	}
+
+	return mMediaRecorder->unregisterBsConsumer(consumerId);
+}
+
+status_t MediaRecorder::getBsConsumerStatus(int consumerId, BsConsumerStatus *pStatus)
+{
+	ALOGV("getBsConsumerStatus");
+	if(mMediaRecorder == NULL) {
+		ALOGE("media recorder is not initialized yet");
+		return INVALID_OPERATION;
+	}
+
+	return mMediaRecorder->getBsConsumerStatus(consumerId, pStatus);
+}
+
+status_t MediaRecorder::getBsFrames(int consumerId, int maxFrames, int timeoutMs, Vector<sp<IMemoryHeap> > *heaps, Vector<BsFrameDesc> *frames)
+{
+	ALOGV("getBsFrames");
+	if(mMediaRecorder == NULL) {
+		ALOGE("media recorder is not initialized yet");
+		return INVALID_OPERATION;
+	}
+
+	return mMediaRecorder->getBsFrames(consumerId, maxFrames, timeoutMs, heaps, frames);
+}
+
+status_t MediaRecorder::freeBsFrames(int consumerId, int64_t lastSeq)
+{
+	ALOGV("freeBsFrames");
+	if(mMediaRecorder == NULL) {
+		ALOGE("media recorder is not initialized yet");
+		return INVALID_OPERATION;
+	}
+
+	return mMediaRecorder->freeBsFrames(consumerId, lastSeq);
+}
+
+status_t MediaRecorder::waitBsFrames(int consumerId, int minFrames, int waitFlags, int timeoutMs, int *pQueuedFrames)
+{
+	ALOGV("waitBsFrames");
+	if(mMediaRecorder == NULL) {
+		ALOGE("media recorder is not initialized yet");
+		return INVALID_OPERATION;
+	}
+
+	return mMediaRecorder->waitBsFrames(consumerId, minFrames, waitFlags, timeoutMs, pQueuedFrames);
+}
+
 sp<IMemory> MediaRecorder::getEncDataHeader()
 {
 	ALOGV("getEncDataHeader");
@@ -958,6 +1024,34 @@ status_t MediaRecorder::setOutputFileSync(const char* path, int64_t fallocateLen
     return ret;
 }
 
+status_t MediaRecorder::prepareOutputFile(int fd, int64_t fallocateLength)
+{
+    ALOGV("prepareOutputFile(%d, %lld)", fd, fallocateLength);
+    if (mMediaRecorder == NULL) {
+        ALOGE("media recorder is not initialized yet");
+        return INVALID_OPERATION;
+    }
+    if (fd < 0) {
+        ALOGE("Invalid file descriptor: %d", fd);
+        return BAD_VALUE;
+    }
+    return mMediaRecorder->prepareOutputFile(fd, fallocateLength);
+}
+
+status_t MediaRecorder::prepareOutputFile(const char* path, int64_t fallocateLength)
+{
+    ALOGV("prepareOutputFile(%s, %lld)", path, fallocateLength);
+    if (mMediaRecorder == NULL) {
+        ALOGE("media recorder is not initialized yet");
+        return INVALID_OPERATION;
+    }
+    if (path == NULL) {
+        ALOGE("Invalid file path=NULL");
+        return BAD_VALUE;
+    }
+    return mMediaRecorder->prepareOutputFile(path, fallocateLength);
+}
+
 status_t MediaRecorder::setSdcardState(bool bExist)
 {
     ALOGV("setSdcardState(%d)", bExist);
@@ -95,6 +95,17 @@ sp<IMemory> MediaServerCaller::jpegDecode(const char *path)
     return mCaller->jpegDecode(path);
 }
 
+sp<IMemory> MediaServerCaller::jpegDecodeThumbnail(const char *path, int width, int height)
+{
+    ALOGV("jpegDecodeThumbnail(%s, %dx%d)", path, width, height);
+    Mutex::Autolock lock(mLock);
+    if (mCaller == NULL) {
+        ALOGE("caller is not initialized");
+        return NULL;
+    }
+    return mCaller->jpegDecodeThumbnail(path, width, height);
+}
+
 void MediaServerCaller::DeathNotifier::binderDied(const wp<IBinder>& who) {
     Mutex::Autolock lock(MediaServerCaller::sServiceLock);
     MediaServerCaller::sService.clear();
@@ -35,6 +35,7 @@ LOCAL_SRC_FILES:=               \
     MovAvInfoDetect.cpp         \
     MediaVideoResizerClient.cpp \
     MediaServerCallerClient.cpp \
+    JpegThumbnailCache.cpp      \
 
 #    MidiFile.cpp                \
 #    MidiMetadataRetriever.cpp   \
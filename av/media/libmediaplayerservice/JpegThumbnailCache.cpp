@@ -0,0 +1,93 @@
+//#define LOG_NDEBUG 0
+#define LOG_TAG "JpegThumbnailCache"
+#include <utils/Log.h>
+
+#include "JpegThumbnailCache.h"
+
+namespace android {
+
+bool JpegThumbnailCache::Key::sameFile(const Key &other) const
+{
+    return mtime == other.mtime && fileSize == other.fileSize && path == other.path;
+}
+
+bool JpegThumbnailCache::Key::operator==(const Key &other) const
+{
+    return width == other.width && height == other.height && sameFile(other);
+}
+
+JpegThumbnailCache::JpegThumbnailCache(size_t maxBytes)
+    : mBytes(0),
+      mMaxBytes(maxBytes),
+      mHits(0),
+      mMisses(0)
+{
+}
+
+JpegThumbnailCache::~JpegThumbnailCache()
+{
+    clear();
+}
+
+sp<IMemory> JpegThumbnailCache::get(const Key &key)
+{
+    Mutex::Autolock lock(mLock);
+    for (List<Entry>::iterator it = mEntries.begin(); it != mEntries.end(); ++it) {
+        if (it->key == key) {
+            Entry entry = *it;
+            mEntries.erase(it);
+            mEntries.push_front(entry);
+            mHits++;
+            ALOGV("hit %s %dx%d (%u hits, %u misses)",
+                    key.path.string(), key.width, key.height, mHits, mMisses);
+            return entry.thumbnail;
+        }
+    }
+    mMisses++;
+    return NULL;
+}
+
+void JpegThumbnailCache::put(const Key &key, const sp<IMemory> &thumbnail)
+{
+    Mutex::Autolock lock(mLock);
+    List<Entry>::iterator it = mEntries.begin();
+    while (it != mEntries.end()) {
+        // the same thumbnail or one of an older version of the file
+        if (it->key == key || (it->key.path == key.path && !it->key.sameFile(key))) {
+            mBytes -= it->thumbnail->size();
+            it = mEntries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (thumbnail->size() > mMaxBytes) {
+        return;
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.thumbnail = thumbnail;
+    mEntries.push_front(entry);
+    mBytes += thumbnail->size();
+    trimLocked();
+}
+
+void JpegThumbnailCache::clear()
+{
+    Mutex::Autolock lock(mLock);
+    mEntries.clear();
+    mBytes = 0;
+}
+
+void JpegThumbnailCache::trimLocked()
+{
+    while (mBytes > mMaxBytes && !mEntries.empty()) {
+        List<Entry>::iterator last = mEntries.end();
+        --last;
+        ALOGV("evict %s %dx%d", last->key.path.string(), last->key.width, last->key.height);
+        mBytes -= last->thumbnail->size();
+        mEntries.erase(last);
+    }
+}
+
+}; /* namespace android */
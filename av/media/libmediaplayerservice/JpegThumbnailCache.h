@@ -0,0 +1,55 @@
+#ifndef __JPEG_THUMBNAIL_CACHE_H__
+#define __JPEG_THUMBNAIL_CACHE_H__
+
+#include <sys/types.h>
+
+#include <utils/Mutex.h>
+#include <utils/List.h>
+#include <utils/String8.h>
+#include <binder/IMemory.h>
+
+namespace android {
+
+// Decoded thumbnails of files, least recently used dropped first once the
+// cache holds more than maxBytes. A file is identified by path, mtime and
+// size, so a rewritten file misses and its stale thumbnails are dropped.
+class JpegThumbnailCache
+{
+public:
+    struct Key {
+        String8 path;
+        time_t mtime;
+        off_t fileSize;
+        int width;
+        int height;
+
+        bool sameFile(const Key &other) const;
+        bool operator==(const Key &other) const;
+    };
+
+    explicit JpegThumbnailCache(size_t maxBytes);
+    ~JpegThumbnailCache();
+
+    sp<IMemory> get(const Key &key);
+    void put(const Key &key, const sp<IMemory> &thumbnail);
+    void clear();
+
+private:
+    struct Entry {
+        Key key;
+        sp<IMemory> thumbnail;
+    };
+
+    void trimLocked();
+
+    Mutex mLock;
+    List<Entry> mEntries;   // most recently used first
+    size_t mBytes;
+    size_t mMaxBytes;
+    uint32_t mHits;
+    uint32_t mMisses;
+};
+
+}; /* namespace android */
+
+#endif /* __JPEG_THUMBNAIL_CACHE_H__ */
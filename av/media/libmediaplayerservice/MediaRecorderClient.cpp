@@ -285,6 +285,95 @@ void MediaRecorderClient::freeOneBsFrame()
     mRecorder->freeOneBsFrame();
 }
 
+int MediaRecorderClient::registerBsConsumer(int dropPolicy)
+{
+    ALOGV("registerBsConsumer");
+    Mutex::Autolock lock(mLock);
+    if (mRecorder == NULL) {
+        ALOGE("recorder is not initialized");
+        return NO_INIT;
+    }
+    return mRecorder->registerBsConsumer(dropPolicy);
+}
+
+status_t MediaRecorderClient::unregisterBsConsumer(int consumerId)
+{
+    ALOGV("unregisterBsConsumer");
+    Mutex::Autolock lock(mLock);
+    if (mRecorder == NULL) {
+        ALOGE("recorder is not initialized");
+        return NO_INIT;
+    }
+    return mRecorder->unregisterBsConsumer(consumerId);
+}
+
+status_t MediaRecorderClient::getBsConsumerStatus(int consumerId, BsConsumerStatus *pStatus)
+{
+    ALOGV("getBsConsumerStatus");
+    Mutex::Autolock lock(mLock);
+    if (mRecorder == NULL) {
+        ALOGE("recorder is not initialized");
+        return NO_INIT;
+    }
+    return mRecorder->getBsConsumerStatus(consumerId, pStatus);
+}
+
+status_t MediaRecorderClient::getBsFrames(int consumerId, int maxFrames, int timeoutMs, Vector<sp<IMemoryHeap> > *heaps, Vector<BsFrameDesc> *frames)
+{
+    ALOGV("getBsFrames");
+    MediaRecorderBase *recorder;
+    {
+        Mutex::Autolock lock(mLock);
+        if (mRecorder == NULL) {
+            ALOGE("recorder is not initialized");
+            return NO_INIT;
+        }
+        recorder = mRecorder;
+        mBsFrameWaiters++;
+    }
+    //may block timeoutMs, don't hold mLock, or other calls are blocked too.
+    status_t ret = recorder->getBsFrames(consumerId, maxFrames, timeoutMs, heaps, frames);
+    {
+        Mutex::Autolock lock(mLock);
+        mBsFrameWaiters--;
+        mBsFrameWaitersCond.broadcast();
+    }
+    return ret;
+}
+
+status_t MediaRecorderClient::freeBsFrames(int consumerId, int64_t lastSeq)
+{
+    ALOGV("freeBsFrames");
+    Mutex::Autolock lock(mLock);
+    if (mRecorder == NULL) {
+        ALOGE("recorder is not initialized");
+        return NO_INIT;
+    }
+    return mRecorder->freeBsFrames(consumerId, lastSeq);
+}
+
+status_t MediaRecorderClient::waitBsFrames(int consumerId, int minFrames, int waitFlags, int timeoutMs, int *pQueuedFrames)
+{
+    ALOGV("waitBsFrames");
+    MediaRecorderBase *recorder;
+    {
+        Mutex::Autolock lock(mLock);
+        if (mRecorder == NULL) {
+            ALOGE("recorder is not initialized");
+            return NO_INIT;
+        }
+        recorder = mRecorder;
+        mBsFrameWaiters++;
+    }
+    status_t ret = recorder->waitBsFrames(consumerId, minFrames, waitFlags, timeoutMs, pQueuedFrames);
+    {
+        Mutex::Autolock lock(mLock);
+        mBsFrameWaiters--;
+        mBsFrameWaitersCond.broadcast();
+    }
+    return ret;
+}
+
 sp<IMemory> MediaRecorderClient::getEncDataHeader()
 {
     ALOGV("getEncDataHeader");
@@ -379,6 +468,13 @@ status_t MediaRecorderClient::release()
 {
     ALOGV("release");
     Mutex::Autolock lock(mLock);
+    if (mRecorder != NULL && mBsFrameWaiters > 0) {
+        //waiters only return on a new frame or their timeout otherwise.
+        mRecorder->abortBsFrameWaits();
+    }
+    while (mBsFrameWaiters > 0) {
+        mBsFrameWaitersCond.wait(mLock);
+    }
     if (mRecorder != NULL) {
         delete mRecorder;
         mRecorder = NULL;
@@ -392,6 +488,7 @@ MediaRecorderClient::MediaRecorderClient(const sp<MediaPlayerService>& service,
 {
     ALOGV("Client constructor");
     mPid = pid;
+    mBsFrameWaiters = 0;
     //mRecorder = new StagefrightRecorder;
     mRecorder = new CedarXRecorder;
     mMediaPlayerService = service;
@@ -465,6 +562,28 @@ status_t MediaRecorderClient::setOutputFileSync(const char* path, int64_t falloc
     return mRecorder->setOutputFileSync(path, fallocateLength, muxerId);
 }
 
+status_t MediaRecorderClient::prepareOutputFile(int fd, int64_t fallocateLength)
+{
+    ALOGV("prepareOutputFile(%d, %lld)", fd, fallocateLength);
+    Mutex::Autolock lock(mLock);
+    if (mRecorder == NULL) {
+        ALOGE("recorder is not initialized");
+        return NO_INIT;
+    }
+    return mRecorder->prepareOutputFile(fd, fallocateLength);
+}
+
+status_t MediaRecorderClient::prepareOutputFile(const char* path, int64_t fallocateLength)
+{
+    ALOGV("prepareOutputFile(%s, %lld)", path, fallocateLength);
+    Mutex::Autolock lock(mLock);
+    if (mRecorder == NULL) {
+        ALOGE("recorder is not initialized");
+        return NO_INIT;
+    }
+    return mRecorder->prepareOutputFile(path, fallocateLength);
+}
+
 status_t MediaRecorderClient::setSdcardState(bool bExist)
 {
     ALOGV("setSdcardState(%d)", bExist);
@@ -61,6 +61,12 @@ public:
     virtual 	status_t queueBuffer(int index, int addr_y, int addr_c, int64_t timestamp);
     virtual		sp<IMemory> getOneBsFrame(int mode);
     virtual		void freeOneBsFrame();
+    virtual     int registerBsConsumer(int dropPolicy);
+    virtual     status_t unregisterBsConsumer(int consumerId);
+    virtual     status_t getBsConsumerStatus(int consumerId, BsConsumerStatus *pStatus);
+    virtual     status_t getBsFrames(int consumerId, int maxFrames, int timeoutMs, Vector<sp<IMemoryHeap> > *heaps, Vector<BsFrameDesc> *frames);
+    virtual     status_t freeBsFrames(int consumerId, int64_t lastSeq);
+    virtual     status_t waitBsFrames(int consumerId, int minFrames, int waitFlags, int timeoutMs, int *pQueuedFrames);
 	virtual		sp<IMemory> getEncDataHeader();
 	status_t    setVideoEncodingBitRateSync(int bitRate);
 	status_t    setVideoFrameRateSync(int frames_per_second);
@@ -68,6 +74,8 @@ public:
     status_t    reencodeIFrame();
     status_t    setOutputFileSync(int fd, int64_t fallocateLength, int muxerId);
     status_t    setOutputFileSync(const char* path, int64_t fallocateLength, int muxerId);
+    status_t    prepareOutputFile(int fd, int64_t fallocateLength);
+    status_t    prepareOutputFile(const char* path, int64_t fallocateLength);
     status_t    setSdcardState(bool bExist);
 
     virtual     int addOutputFormatAndOutputSink(int of, int fd, int FallocateLen, bool callback_out_flag);
@@ -89,6 +97,9 @@ private:
     pid_t                  mPid;
     Mutex                  mLock;
     MediaRecorderBase      *mRecorder;
+    // bs frame waiters run without mLock, release() must wait for them.
+    int                    mBsFrameWaiters;
+    Condition              mBsFrameWaitersCond;
     sp<MediaPlayerService> mMediaPlayerService;
 };
 
@@ -4,6 +4,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <dirent.h>
 #include <unistd.h>
 
@@ -23,6 +24,7 @@
 #include <jpegDecoder.h>
 
 #include "MediaServerCallerClient.h"
+#include "JpegThumbnailCache.h"
 #include <cedarx_stream.h>
 
 namespace android {
@@ -42,6 +44,11 @@ enum FORMAT_CONVERT_COLORFORMAT {
 
 //#define DEBUG_JPEG_DEC_SAVE_DATA
 
+// RGB565 thumbnails shared by all callers, a 160x120 one is 37.5KB
+#define JPEG_THUMBNAIL_CACHE_SIZE   (4*1024*1024)
+
+static JpegThumbnailCache gThumbnailCache(JPEG_THUMBNAIL_CACHE_SIZE);
+
 typedef struct ScalerParameter{
 	int mode; //0: YV12 1:thumb yuv420p
 	int format_in;
@@ -102,7 +109,8 @@ void MediaServerCallerClient::disconnect()
     IPCThreadState::self()->flushCommands();
 }
 
-sp<IMemory> MediaServerCallerClient::jpegDecodeBuf(sp<JpegDecoder> jpgDecoder, uint8_t *jpgbuf, int filesize)
+sp<IMemory> MediaServerCallerClient::jpegDecodeBuf(sp<JpegDecoder> jpgDecoder, uint8_t *jpgbuf, int filesize,
+        int boxWidth, int boxHeight, uint32_t heapFlags)
 {
     char *buf0, *buf1;
     int size0, size1;
@@ -121,7 +129,12 @@ sp<IMemory> MediaServerCallerClient::jpegDecodeBuf(sp<JpegDecoder> jpgDecoder, u
         return NULL;
     }
     ALOGD("jpeg size(%dx%d)", jpgInfo.width, jpgInfo.height);
-    ret = jpgDecoder->initialize(jpgInfo.width, jpgInfo.height);
+    if (boxWidth > 0 && boxHeight > 0) {
+        ret = jpgDecoder->initialize(jpgInfo.width, jpgInfo.height,
+                JpegDecoder::getScaleDownRatio(jpgInfo.width, jpgInfo.height, boxWidth, boxHeight));
+    } else {
+        ret = jpgDecoder->initialize(jpgInfo.width, jpgInfo.height);
+    }
     if (ret != NO_ERROR) {
         ALOGE("initialize error!");
         free(jpgbuf);
@@ -180,120 +193,133 @@ sp<IMemory> MediaServerCallerClient::jpegDecodeBuf(sp<JpegDecoder> jpgDecoder, u
     int height = picture->nBottomOffset - picture->nTopOffset;
     ALOGD("output size(%dx%d), alignSize(%dx%d), PixelFormat=%d", width, height, align_w, align_h, picture->ePixelFormat);
 
+    // fit into the box keeping the aspect ratio, never scale up
+    int outWidth = width;
+    int outHeight = height;
+    if (boxWidth > 0 && boxHeight > 0 && (width > boxWidth || height > boxHeight)) {
+        if ((int64_t)width * boxHeight > (int64_t)height * boxWidth) {
+            outWidth = boxWidth;
+            outHeight = (int)((int64_t)height * boxWidth / width);
+        } else {
+            outHeight = boxHeight;
+            outWidth = (int)((int64_t)width * boxHeight / height);
+        }
+        if (outWidth < 1) {
+            outWidth = 1;
+        }
+        if (outHeight < 1) {
+            outHeight = 1;
+        }
+    }
+
     size_t sizeY = align_w * align_h;
-    uint8_t *pBuf;
-    pBuf = (uint8_t*)malloc((sizeY>>1)*3);
-    if (pBuf == NULL) {
-        ALOGE("Failed to alloc yv12 buffer!");
+    uint8_t *pBuf = NULL;
+    uint8_t *y_addr;
+
+    if (picture->ePixelFormat == PIXEL_FORMAT_YUV_PLANER_420) {
+        // already I420, which both converters read, convert in place
+        y_addr = (uint8_t*)picture->pData0;
+    } else if (picture->ePixelFormat == PIXEL_FORMAT_YUV_MB32_420
+            || picture->ePixelFormat == PIXEL_FORMAT_YV12) {
+        pBuf = (uint8_t*)malloc((sizeY>>1)*3);
+        if (pBuf == NULL) {
+            ALOGE("Failed to alloc yv12 buffer!");
+            jpgDecoder->releaseFrame(picture);
+            jpgDecoder->destroy();
+            return NULL;
+        }
+        int ylen = sizeY;
+        int ulen = sizeY >> 2;
+        int vlen = sizeY >> 2;
+        y_addr = pBuf;
+        uint8_t *u_addr = y_addr + ylen;
+        uint8_t *v_addr = u_addr + ulen;
+
+        if(picture->ePixelFormat == PIXEL_FORMAT_YUV_MB32_420) {
+            ScalerParameter scalerPara;
+            scalerPara.format_in = CONVERT_COLOR_FORMAT_YUV420MB;
+            scalerPara.format_out = CONVERT_COLOR_FORMAT_YUV420PLANNER;
+            scalerPara.width_in   = align_w;
+            scalerPara.height_in  = align_h;
+            scalerPara.width_out  = align_w;
+            scalerPara.height_out = align_h;
+            scalerPara.addr_y_in  = (void*)picture->pData0;
+            scalerPara.addr_c_in  = (void*)picture->pData1;
+            scalerPara.mode = 1;
+            scalerPara.addr_y_out = (unsigned int)y_addr;
+            scalerPara.addr_u_out = (unsigned int)u_addr;
+            scalerPara.addr_v_out = (unsigned int)v_addr;
+            SoftwarePictureScaler(&scalerPara);
+        } else {
+            memcpy(y_addr, picture->pData0, ylen);
+            memcpy(v_addr, picture->pData1, vlen);
+            memcpy(u_addr, picture->pData1+vlen, ulen);
+        }
+    } else {
+        ALOGE("unsupport PixelFormat(%d)!", picture->ePixelFormat);
         jpgDecoder->releaseFrame(picture);
         jpgDecoder->destroy();
         return NULL;
     }
-    int ylen = sizeY;
-    int ulen = sizeY >> 2;
-    int vlen = sizeY >> 2;
-    uint8_t *y_addr = pBuf;
-    uint8_t *u_addr = y_addr + ylen;
-    uint8_t *v_addr = u_addr + ulen;
-
-    if(picture->ePixelFormat == PIXEL_FORMAT_YUV_MB32_420) {
-        ScalerParameter scalerPara;
-        scalerPara.format_in = CONVERT_COLOR_FORMAT_YUV420MB;
-        scalerPara.format_out = CONVERT_COLOR_FORMAT_YUV420PLANNER;
-        scalerPara.width_in   = align_w;
-        scalerPara.height_in  = align_h;
-        scalerPara.width_out  = align_w;
-        scalerPara.height_out = align_h;
-        scalerPara.addr_y_in  = (void*)picture->pData0;
-        scalerPara.addr_c_in  = (void*)picture->pData1;
-        scalerPara.mode = 1;
-        scalerPara.addr_y_out = (unsigned int)y_addr;
-        scalerPara.addr_u_out = (unsigned int)u_addr;
-        scalerPara.addr_v_out = (unsigned int)v_addr;
-        SoftwarePictureScaler(&scalerPara);
-    } else if (picture->ePixelFormat == PIXEL_FORMAT_YV12) {
-        memcpy(y_addr, picture->pData0, ylen);
-        memcpy(v_addr, picture->pData1, vlen);
-        memcpy(u_addr, picture->pData1+vlen, ulen);
-    } else if (picture->ePixelFormat == PIXEL_FORMAT_YUV_PLANER_420) {
-        memcpy(y_addr, picture->pData0, ylen+ulen+vlen);
+
+    // convert straight into the shared memory handed to the caller
+    size_t frameSize = outWidth * outHeight * 2;
+    size_t memsize = sizeof(VideoFrame) + frameSize;
+    sp<MemoryHeapBase> heap = new MemoryHeapBase(memsize, heapFlags);
+    sp<IMemory> memory;
+    if (heap == NULL || heap->getBase() == MAP_FAILED) {
+        ALOGE("failed to create MemoryHeapBase");
     } else {
-        ALOGE("unsupport PixelFormat(%d)!", picture->ePixelFormat);
+        memory = new MemoryBase(heap, 0, memsize);
+    }
+    if (memory == NULL) {
+        ALOGE("not enough memory for argbMemory size=%u", memsize);
         jpgDecoder->releaseFrame(picture);
         jpgDecoder->destroy();
         free(pBuf);
         return NULL;
     }
-    jpgDecoder->releaseFrame(picture);
-    jpgDecoder->destroy();
+    VideoFrame *frameCopy = static_cast<VideoFrame *>(memory->pointer());
+    frameCopy->mWidth = outWidth;
+    frameCopy->mHeight = outHeight;
+    frameCopy->mDisplayWidth = outWidth;
+    frameCopy->mDisplayHeight = outHeight;
+    frameCopy->mSize = frameSize;
+    frameCopy->mRotationAngle = 0;
+    frameCopy->mData = (uint8_t *)frameCopy + sizeof(VideoFrame);
 
-    VideoFrame *frame = new VideoFrame;
-    if (frame == NULL) {
-        ALOGE("Failed to alloc VideoFrame!");
-        free(pBuf);
-        return NULL;
-    }
-    frame->mWidth         = width;
-    frame->mHeight        = height;
-    frame->mDisplayWidth  = width;
-    frame->mDisplayHeight = height;
-    frame->mSize          = width * height * 2;
-    frame->mRotationAngle = 0;
-    frame->mData          = new uint8_t[frame->mSize];
-    if (frame->mData == NULL) {
-        ALOGE("Failed to alloc frame->mData!");
-        delete frame;
-        free(pBuf);
-        return NULL;
+    if (boxWidth > 0 && boxHeight > 0) {
+        ret = JpegDecoder::YUV420_to_RGB(y_addr, JpegDecoder::YUV420_FORMAT_I420,
+                width, height, align_w, align_h, frameCopy->mData,
+                JpegDecoder::RGB_FORMAT_RGB565, outWidth, outHeight, false);
+    } else {
+        // full pictures keep the limited range BT.601 colours they always had
+        ColorConverter converter((OMX_COLOR_FORMATTYPE)OMX_COLOR_FormatYUV420Planar, OMX_COLOR_Format16bitRGB565);
+        CHECK(converter.isValid());
+
+        ret = converter.convert(y_addr,
+                          align_w,
+                          align_h,
+                          0,
+                          0,
+                          width - 1,
+                          height - 1,
+                          frameCopy->mData,
+                          outWidth,
+                          outHeight,
+                          0,
+                          0,
+                          outWidth - 1,
+                          outHeight - 1);
     }
-    ColorConverter converter((OMX_COLOR_FORMATTYPE)OMX_COLOR_FormatYUV420Planar, OMX_COLOR_Format16bitRGB565);
-    CHECK(converter.isValid());
-
-    ret = converter.convert(y_addr,
-                      align_w,
-                      align_h,
-                      0,
-                      0,
-                      frame->mWidth - 1,
-                      frame->mHeight - 1,
-                      frame->mData,
-                      frame->mWidth,
-                      frame->mHeight,
-                      0,
-                      0,
-                      frame->mWidth - 1,
-                      frame->mHeight - 1);
+    jpgDecoder->releaseFrame(picture);
+    jpgDecoder->destroy();
     free(pBuf);
     if (ret != NO_ERROR) {
-        ALOGE("ColorConverter error(%d)", ret);
-        delete frame;
-        return NULL;
-    }
-
-    size_t memsize = sizeof(VideoFrame) + frame->mSize;
-    sp<MemoryHeapBase> heap = new MemoryHeapBase(memsize);
-    if (heap == NULL) {
-        ALOGE("failed to create MemoryHeapBase");
-        delete frame;
+        ALOGE("color convert error(%d)", ret);
         return NULL;
     }
-    sp<IMemory> memory = new MemoryBase(heap, 0, memsize);
-    if (memory == NULL) {
-        ALOGE("not enough memory for argbMemory size=%u", memsize);
-        delete frame;
-        return NULL;
-    }
-    VideoFrame *frameCopy = static_cast<VideoFrame *>(memory->pointer());
-    frameCopy->mWidth = frame->mWidth;
-    frameCopy->mHeight = frame->mHeight;
-    frameCopy->mDisplayWidth = frame->mDisplayWidth;
-    frameCopy->mDisplayHeight = frame->mDisplayHeight;
-    frameCopy->mSize = frame->mSize;
-    frameCopy->mRotationAngle = frame->mRotationAngle;
-    frameCopy->mData = (uint8_t *)frameCopy + sizeof(VideoFrame);
-    memcpy(frameCopy->mData, frame->mData, frame->mSize);
     ALOGV("jpegDecode end");
-    delete frame;
     return memory;
 }
 
@@ -337,22 +363,8 @@ sp<IMemory> MediaServerCallerClient::jpegDecode(int fd)
     return jpegDecodeBuf(jpgDecoder, jpgbuf, filesize);
 }
 
-sp<IMemory> MediaServerCallerClient::jpegDecode(const char *path)
+uint8_t *MediaServerCallerClient::readJpegFile(const char *path, int *filesize)
 {
-    char *buf0, *buf1;
-    int size0, size1;
-    void *addrYVir = NULL, *addrUVir = NULL, *addrVVir = NULL;
-    VideoPicture *picture;
-    JpegInfo jpgInfo;
-    status_t ret;
-    int i;
-
-    ALOGV("jpegDecode(%s)", path);
-    sp<JpegDecoder> jpgDecoder = new JpegDecoder();
-    if (jpgDecoder == NULL) {
-        ALOGE("Failed to alloc JpegDecoder!!");
-        return NULL;
-    }
     CedarXDataSourceDesc dataSourceDesc;
     memset(&dataSourceDesc, 0, sizeof(CedarXDataSourceDesc));
     dataSourceDesc.source_url = (char*)path;
@@ -364,19 +376,81 @@ sp<IMemory> MediaServerCallerClient::jpegDecode(const char *path)
         return NULL;
     }
     pStream->seek(pStream, 0, SEEK_END);
-    int filesize = pStream->tell(pStream);
+    *filesize = pStream->tell(pStream);
     pStream->seek(pStream, 0, SEEK_SET);
 
-    uint8_t *jpgbuf = (uint8_t*)malloc(filesize);
+    uint8_t *jpgbuf = (uint8_t*)malloc(*filesize);
     if (jpgbuf == NULL) {
         ALOGE("Failed to alloc jpg buffer!");
         destory_stream_handle(pStream);
         return NULL;
     }
-    pStream->read(jpgbuf, 1, filesize, pStream);
+    pStream->read(jpgbuf, 1, *filesize, pStream);
     destory_stream_handle(pStream);
+    return jpgbuf;
+}
+
+sp<IMemory> MediaServerCallerClient::jpegDecode(const char *path)
+{
+    int filesize;
+
+    ALOGV("jpegDecode(%s)", path);
+    sp<JpegDecoder> jpgDecoder = new JpegDecoder();
+    if (jpgDecoder == NULL) {
+        ALOGE("Failed to alloc JpegDecoder!!");
+        return NULL;
+    }
+    uint8_t *jpgbuf = readJpegFile(path, &filesize);
+    if (jpgbuf == NULL) {
+        return NULL;
+    }
 
     return jpegDecodeBuf(jpgDecoder, jpgbuf, filesize);
 }
+
+sp<IMemory> MediaServerCallerClient::jpegDecodeThumbnail(const char *path, int width, int height)
+{
+    struct stat st;
+    int filesize;
+
+    ALOGV("jpegDecodeThumbnail(%s, %dx%d)", path, width, height);
+    if (width <= 0 || height <= 0) {
+        ALOGE("bad thumbnail size %dx%d", width, height);
+        return NULL;
+    }
+    if (stat(path, &st) != 0) {
+        ALOGE("stat error(%s), path=%s", strerror(errno), path);
+        return NULL;
+    }
+
+    JpegThumbnailCache::Key key;
+    key.path = path;
+    key.mtime = st.st_mtime;
+    key.fileSize = st.st_size;
+    key.width = width;
+    key.height = height;
+    sp<IMemory> thumbnail = gThumbnailCache.get(key);
+    if (thumbnail != NULL) {
+        return thumbnail;
+    }
+
+    sp<JpegDecoder> jpgDecoder = new JpegDecoder();
+    if (jpgDecoder == NULL) {
+        ALOGE("Failed to alloc JpegDecoder!!");
+        return NULL;
+    }
+    uint8_t *jpgbuf = readJpegFile(path, &filesize);
+    if (jpgbuf == NULL) {
+        return NULL;
+    }
+    // the cached frame is handed to every caller, so it maps read-only
+    // in their processes; only this one writes it, before it is shared
+    thumbnail = jpegDecodeBuf(jpgDecoder, jpgbuf, filesize, width, height,
+            MemoryHeapBase::READ_ONLY);
+    if (thumbnail != NULL) {
+        gThumbnailCache.put(key, thumbnail);
+    }
+    return thumbnail;
+}
 }; /* namespace android */
 
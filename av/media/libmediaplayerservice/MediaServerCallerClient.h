@@ -20,9 +20,16 @@ public:
     virtual void disconnect();
     virtual sp<IMemory> jpegDecode(int fd);
     virtual sp<IMemory> jpegDecode(const char *path);
+    virtual sp<IMemory> jpegDecodeThumbnail(const char *path, int width, int height);
 
 private:
-    sp<IMemory> jpegDecodeBuf(sp<JpegDecoder> jpgDecoder, uint8_t *jpgbuf, int filesize);
+    // boxWidth x boxHeight > 0 fits the picture into that box, with
+    // JpegDecoder's full range colours. Without a box the picture is
+    // converted by ColorConverter (limited range BT.601) as before.
+    // heapFlags go to the MemoryHeapBase the frame is returned in.
+    sp<IMemory> jpegDecodeBuf(sp<JpegDecoder> jpgDecoder, uint8_t *jpgbuf, int filesize,
+            int boxWidth = 0, int boxHeight = 0, uint32_t heapFlags = 0);
+    uint8_t *readJpegFile(const char *path, int *filesize);
     friend class MediaPlayerService;
 
     explicit MediaServerCallerClient(pid_t pid);
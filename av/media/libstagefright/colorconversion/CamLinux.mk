@@ -2,7 +2,8 @@ LOCAL_PATH:= $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:=                     \
-        ColorConverter.cpp
+        ColorConverter.cpp            \
+        YUVRowConverter.cpp
 
 LOCAL_C_INCLUDES := \
         $(TOP)/frameworks/include/media/openmax \
@@ -12,6 +13,27 @@ LOCAL_SHARED_LIBRARIES := \
 	libutils          \
 	libcutils         \
 
+ifeq ($(TARGET_ARCH),arm)
+LOCAL_CFLAGS += -mfpu=neon
+endif
+
 LOCAL_MODULE:= libstagefright_color_conversion
 
 include $(BUILD_SHARED_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=                     \
+        tests/colorconversion_bench.cpp
+
+LOCAL_C_INCLUDES := \
+        $(TOP)/frameworks/include/media/openmax
+
+LOCAL_SHARED_LIBRARIES := \
+	libstagefright_color_conversion
+
+LOCAL_MODULE:= colorconversion_bench
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
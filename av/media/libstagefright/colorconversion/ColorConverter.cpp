@@ -24,20 +24,30 @@
 
 namespace android {
 
+// B = 1.164 * (Y - 16) + 2.018 * (U - 128)
+// G = 1.164 * (Y - 16) - 0.813 * (V - 128) - 0.391 * (U - 128)
+// R = 1.164 * (Y - 16) + 1.596 * (V - 128)
+static const int32_t kCoeffsBT601[5] = { 298, 517, 100, 208, 409 };
+
+// B = 1.164 * (Y - 16) + 2.112 * (U - 128)
+// G = 1.164 * (Y - 16) - 0.533 * (V - 128) - 0.213 * (U - 128)
+// R = 1.164 * (Y - 16) + 1.793 * (V - 128)
+static const int32_t kCoeffsBT709[5] = { 298, 541, 55, 136, 459 };
+
 ColorConverter::ColorConverter(
         OMX_COLOR_FORMATTYPE from, OMX_COLOR_FORMATTYPE to)
     : mSrcFormat(from),
       mDstFormat(to),
-      mClip(NULL) {
+      mVectorEnabled(true) {
+    setColorMatrix(kColorMatrixBT601);
 }
 
 ColorConverter::~ColorConverter() {
-    delete[] mClip;
-    mClip = NULL;
 }
 
 bool ColorConverter::isValid() const {
-    if (mDstFormat != OMX_COLOR_Format16bitRGB565) {
+    if (mDstFormat != OMX_COLOR_Format16bitRGB565
+            && mDstFormat != OMX_COLOR_Format32BitRGBA8888) {
         return false;
     }
 
@@ -54,6 +64,27 @@ bool ColorConverter::isValid() const {
     }
 }
 
+void ColorConverter::setColorMatrix(ColorMatrix matrix) {
+    const int32_t *coeffs =
+        (matrix == kColorMatrixBT709) ? kCoeffsBT709 : kCoeffsBT601;
+
+    mMatrix = matrix;
+    mCoeffs.mYOffset = 16;
+    mCoeffs.mY = coeffs[0];
+    mCoeffs.mUB = coeffs[1];
+    mCoeffs.mUG = coeffs[2];
+    mCoeffs.mVG = coeffs[3];
+    mCoeffs.mVR = coeffs[4];
+}
+
+void ColorConverter::setVectorEnabled(bool enabled) {
+    mVectorEnabled = enabled;
+}
+
+size_t ColorConverter::dstBytesPerPixel() const {
+    return (mDstFormat == OMX_COLOR_Format32BitRGBA8888) ? 4 : 2;
+}
+
 ColorConverter::BitmapParams::BitmapParams(
         void *bits,
         size_t width, size_t height,
@@ -85,7 +116,7 @@ status_t ColorConverter::convert(
         size_t dstWidth, size_t dstHeight,
         size_t dstCropLeft, size_t dstCropTop,
         size_t dstCropRight, size_t dstCropBottom) {
-    if (mDstFormat != OMX_COLOR_Format16bitRGB565) {
+    if (!isValid()) {
         return ERROR_UNSUPPORTED;
     }
 
@@ -132,65 +163,52 @@ status_t ColorConverter::convert(
     return err;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+void ColorConverter::convertRow(
+        const YUVRow &row, void *dst, size_t width, bool swapRB) const {
+    YUVRowConverter::RGBFormat format;
+    if (mDstFormat == OMX_COLOR_Format32BitRGBA8888) {
+        format = swapRB ? YUVRowConverter::kBGRA8888 : YUVRowConverter::kRGBA8888;
+    } else {
+        format = swapRB ? YUVRowConverter::kBGR565 : YUVRowConverter::kRGB565;
+    }
+
+    YUVRowConverter converter(mCoeffs, format);
+    converter.setVectorEnabled(mVectorEnabled);
+    converter.convert(row, dst, width);
+}
+
 status_t ColorConverter::convertCbYCrY(
         const BitmapParams &src, const BitmapParams &dst) {
     // XXX Untested
 
-    uint8_t *kAdjustedClip = initClip();
-
     if (!((src.mCropLeft & 1) == 0
         && src.cropWidth() == dst.cropWidth()
         && src.cropHeight() == dst.cropHeight())) {
         return ERROR_UNSUPPORTED;
     }
 
-    uint16_t *dst_ptr = (uint16_t *)dst.mBits
-        + dst.mCropTop * dst.mWidth + dst.mCropLeft;
+    size_t bpp = dstBytesPerPixel();
+    uint8_t *dst_ptr = (uint8_t *)dst.mBits
+        + (dst.mCropTop * dst.mWidth + dst.mCropLeft) * bpp;
 
     const uint8_t *src_ptr = (const uint8_t *)src.mBits
         + (src.mCropTop * dst.mWidth + src.mCropLeft) * 2;
 
+    // U Y1 V Y2
+    YUVRow row;
+    row.mYStep = 2;
+    row.mUVStep = 4;
+
     for (size_t y = 0; y < src.cropHeight(); ++y) {
-        for (size_t x = 0; x < src.cropWidth(); x += 2) {
-            signed y1 = (signed)src_ptr[2 * x + 1] - 16;
-            signed y2 = (signed)src_ptr[2 * x + 3] - 16;
-            signed u = (signed)src_ptr[2 * x] - 128;
-            signed v = (signed)src_ptr[2 * x + 2] - 128;
-
-            signed u_b = u * 517;
-            signed u_g = -u * 100;
-            signed v_g = -v * 208;
-            signed v_r = v * 409;
-
-            signed tmp1 = y1 * 298;
-            signed b1 = (tmp1 + u_b) / 256;
-            signed g1 = (tmp1 + v_g + u_g) / 256;
-            signed r1 = (tmp1 + v_r) / 256;
-
-            signed tmp2 = y2 * 298;
-            signed b2 = (tmp2 + u_b) / 256;
-            signed g2 = (tmp2 + v_g + u_g) / 256;
-            signed r2 = (tmp2 + v_r) / 256;
-
-            uint32_t rgb1 =
-                ((kAdjustedClip[r1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[b1] >> 3);
-
-            uint32_t rgb2 =
-                ((kAdjustedClip[r2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[b2] >> 3);
-
-            if (x + 1 < src.cropWidth()) {
-                *(uint32_t *)(&dst_ptr[x]) = (rgb2 << 16) | rgb1;
-            } else {
-                dst_ptr[x] = rgb1;
-            }
-        }
+        row.mY = src_ptr + 1;
+        row.mU = src_ptr;
+        row.mV = src_ptr + 2;
+        convertRow(row, dst_ptr, src.cropWidth(), false);
 
         src_ptr += src.mWidth * 2;
-        dst_ptr += dst.mWidth;
+        dst_ptr += dst.mWidth * bpp;
     }
 
     return OK;
@@ -204,10 +222,9 @@ status_t ColorConverter::convertYUV420Planar(
         return ERROR_UNSUPPORTED;
     }
 
-    uint8_t *kAdjustedClip = initClip();
-
-    uint16_t *dst_ptr = (uint16_t *)dst.mBits
-        + dst.mCropTop * dst.mWidth + dst.mCropLeft;
+    size_t bpp = dstBytesPerPixel();
+    uint8_t *dst_ptr = (uint8_t *)dst.mBits
+        + (dst.mCropTop * dst.mWidth + dst.mCropLeft) * bpp;
 
     const uint8_t *src_y =
         (const uint8_t *)src.mBits + src.mCropTop * src.mWidth + src.mCropLeft;
@@ -219,63 +236,15 @@ status_t ColorConverter::convertYUV420Planar(
     const uint8_t *src_v =
         src_u + (src.mWidth / 2) * (src.mHeight / 2);
 
+    YUVRow row;
+    row.mYStep = 1;
+    row.mUVStep = 1;
+
     for (size_t y = 0; y < src.cropHeight(); ++y) {
-        for (size_t x = 0; x < src.cropWidth(); x += 2) {
-            // B = 1.164 * (Y - 16) + 2.018 * (U - 128)
-            // G = 1.164 * (Y - 16) - 0.813 * (V - 128) - 0.391 * (U - 128)
-            // R = 1.164 * (Y - 16) + 1.596 * (V - 128)
-
-            // B = 298/256 * (Y - 16) + 517/256 * (U - 128)
-            // G = .................. - 208/256 * (V - 128) - 100/256 * (U - 128)
-            // R = .................. + 409/256 * (V - 128)
-
-            // min_B = (298 * (- 16) + 517 * (- 128)) / 256 = -277
-            // min_G = (298 * (- 16) - 208 * (255 - 128) - 100 * (255 - 128)) / 256 = -172
-            // min_R = (298 * (- 16) + 409 * (- 128)) / 256 = -223
-
-            // max_B = (298 * (255 - 16) + 517 * (255 - 128)) / 256 = 534
-            // max_G = (298 * (255 - 16) - 208 * (- 128) - 100 * (- 128)) / 256 = 432
-            // max_R = (298 * (255 - 16) + 409 * (255 - 128)) / 256 = 481
-
-            // clip range -278 .. 535
-
-            signed y1 = (signed)src_y[x] - 16;
-            signed y2 = (signed)src_y[x + 1] - 16;
-
-            signed u = (signed)src_u[x / 2] - 128;
-            signed v = (signed)src_v[x / 2] - 128;
-
-            signed u_b = u * 517;
-            signed u_g = -u * 100;
-            signed v_g = -v * 208;
-            signed v_r = v * 409;
-
-            signed tmp1 = y1 * 298;
-            signed b1 = (tmp1 + u_b) / 256;
-            signed g1 = (tmp1 + v_g + u_g) / 256;
-            signed r1 = (tmp1 + v_r) / 256;
-
-            signed tmp2 = y2 * 298;
-            signed b2 = (tmp2 + u_b) / 256;
-            signed g2 = (tmp2 + v_g + u_g) / 256;
-            signed r2 = (tmp2 + v_r) / 256;
-
-            uint32_t rgb1 =
-                ((kAdjustedClip[r1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[b1] >> 3);
-
-            uint32_t rgb2 =
-                ((kAdjustedClip[r2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[b2] >> 3);
-
-            if (x + 1 < src.cropWidth()) {
-                *(uint32_t *)(&dst_ptr[x]) = (rgb2 << 16) | rgb1;
-            } else {
-                dst_ptr[x] = rgb1;
-            }
-        }
+        row.mY = src_y;
+        row.mU = src_u;
+        row.mV = src_v;
+        convertRow(row, dst_ptr, src.cropWidth(), false);
 
         src_y += src.mWidth;
 
@@ -284,7 +253,7 @@ status_t ColorConverter::convertYUV420Planar(
             src_v += src.mWidth / 2;
         }
 
-        dst_ptr += dst.mWidth;
+        dst_ptr += dst.mWidth * bpp;
     }
 
     return OK;
@@ -292,16 +261,15 @@ status_t ColorConverter::convertYUV420Planar(
 
 status_t ColorConverter::convertQCOMYUV420SemiPlanar(
         const BitmapParams &src, const BitmapParams &dst) {
-    uint8_t *kAdjustedClip = initClip();
-
     if (!((src.mCropLeft & 1) == 0
             && src.cropWidth() == dst.cropWidth()
             && src.cropHeight() == dst.cropHeight())) {
         return ERROR_UNSUPPORTED;
     }
 
-    uint16_t *dst_ptr = (uint16_t *)dst.mBits
-        + dst.mCropTop * dst.mWidth + dst.mCropLeft;
+    size_t bpp = dstBytesPerPixel();
+    uint8_t *dst_ptr = (uint8_t *)dst.mBits
+        + (dst.mCropTop * dst.mWidth + dst.mCropLeft) * bpp;
 
     const uint8_t *src_y =
         (const uint8_t *)src.mBits + src.mCropTop * src.mWidth + src.mCropLeft;
@@ -310,45 +278,15 @@ status_t ColorConverter::convertQCOMYUV420SemiPlanar(
         (const uint8_t *)src_y + src.mWidth * src.mHeight
         + src.mCropTop * src.mWidth + src.mCropLeft;
 
+    YUVRow row;
+    row.mYStep = 1;
+    row.mUVStep = 2;
+
     for (size_t y = 0; y < src.cropHeight(); ++y) {
-        for (size_t x = 0; x < src.cropWidth(); x += 2) {
-            signed y1 = (signed)src_y[x] - 16;
-            signed y2 = (signed)src_y[x + 1] - 16;
-
-            signed u = (signed)src_u[x & ~1] - 128;
-            signed v = (signed)src_u[(x & ~1) + 1] - 128;
-
-            signed u_b = u * 517;
-            signed u_g = -u * 100;
-            signed v_g = -v * 208;
-            signed v_r = v * 409;
-
-            signed tmp1 = y1 * 298;
-            signed b1 = (tmp1 + u_b) / 256;
-            signed g1 = (tmp1 + v_g + u_g) / 256;
-            signed r1 = (tmp1 + v_r) / 256;
-
-            signed tmp2 = y2 * 298;
-            signed b2 = (tmp2 + u_b) / 256;
-            signed g2 = (tmp2 + v_g + u_g) / 256;
-            signed r2 = (tmp2 + v_r) / 256;
-
-            uint32_t rgb1 =
-                ((kAdjustedClip[b1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[r1] >> 3);
-
-            uint32_t rgb2 =
-                ((kAdjustedClip[b2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[r2] >> 3);
-
-            if (x + 1 < src.cropWidth()) {
-                *(uint32_t *)(&dst_ptr[x]) = (rgb2 << 16) | rgb1;
-            } else {
-                dst_ptr[x] = rgb1;
-            }
-        }
+        row.mY = src_y;
+        row.mU = src_u;
+        row.mV = src_u + 1;
+        convertRow(row, dst_ptr, src.cropWidth(), true);
 
         src_y += src.mWidth;
 
@@ -356,7 +294,7 @@ status_t ColorConverter::convertQCOMYUV420SemiPlanar(
             src_u += src.mWidth;
         }
 
-        dst_ptr += dst.mWidth;
+        dst_ptr += dst.mWidth * bpp;
     }
 
     return OK;
@@ -366,16 +304,15 @@ status_t ColorConverter::convertYUV420SemiPlanar(
         const BitmapParams &src, const BitmapParams &dst) {
     // XXX Untested
 
-    uint8_t *kAdjustedClip = initClip();
-
     if (!((src.mCropLeft & 1) == 0
             && src.cropWidth() == dst.cropWidth()
             && src.cropHeight() == dst.cropHeight())) {
         return ERROR_UNSUPPORTED;
     }
 
-    uint16_t *dst_ptr = (uint16_t *)dst.mBits
-        + dst.mCropTop * dst.mWidth + dst.mCropLeft;
+    size_t bpp = dstBytesPerPixel();
+    uint8_t *dst_ptr = (uint8_t *)dst.mBits
+        + (dst.mCropTop * dst.mWidth + dst.mCropLeft) * bpp;
 
     const uint8_t *src_y =
         (const uint8_t *)src.mBits + src.mCropTop * src.mWidth + src.mCropLeft;
@@ -384,45 +321,15 @@ status_t ColorConverter::convertYUV420SemiPlanar(
         (const uint8_t *)src_y + src.mWidth * src.mHeight
         + src.mCropTop * src.mWidth + src.mCropLeft;
 
+    YUVRow row;
+    row.mYStep = 1;
+    row.mUVStep = 2;
+
     for (size_t y = 0; y < src.cropHeight(); ++y) {
-        for (size_t x = 0; x < src.cropWidth(); x += 2) {
-            signed y1 = (signed)src_y[x] - 16;
-            signed y2 = (signed)src_y[x + 1] - 16;
-
-            signed v = (signed)src_u[x & ~1] - 128;
-            signed u = (signed)src_u[(x & ~1) + 1] - 128;
-
-            signed u_b = u * 517;
-            signed u_g = -u * 100;
-            signed v_g = -v * 208;
-            signed v_r = v * 409;
-
-            signed tmp1 = y1 * 298;
-            signed b1 = (tmp1 + u_b) / 256;
-            signed g1 = (tmp1 + v_g + u_g) / 256;
-            signed r1 = (tmp1 + v_r) / 256;
-
-            signed tmp2 = y2 * 298;
-            signed b2 = (tmp2 + u_b) / 256;
-            signed g2 = (tmp2 + v_g + u_g) / 256;
-            signed r2 = (tmp2 + v_r) / 256;
-
-            uint32_t rgb1 =
-                ((kAdjustedClip[b1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[r1] >> 3);
-
-            uint32_t rgb2 =
-                ((kAdjustedClip[b2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[r2] >> 3);
-
-            if (x + 1 < src.cropWidth()) {
-                *(uint32_t *)(&dst_ptr[x]) = (rgb2 << 16) | rgb1;
-            } else {
-                dst_ptr[x] = rgb1;
-            }
-        }
+        row.mY = src_y;
+        row.mU = src_u + 1;
+        row.mV = src_u;
+        convertRow(row, dst_ptr, src.cropWidth(), true);
 
         src_y += src.mWidth;
 
@@ -430,7 +337,7 @@ status_t ColorConverter::convertYUV420SemiPlanar(
             src_u += src.mWidth;
         }
 
-        dst_ptr += dst.mWidth;
+        dst_ptr += dst.mWidth * bpp;
     }
 
     return OK;
@@ -438,61 +345,30 @@ status_t ColorConverter::convertYUV420SemiPlanar(
 
 status_t ColorConverter::convertTIYUV420PackedSemiPlanar(
         const BitmapParams &src, const BitmapParams &dst) {
-    uint8_t *kAdjustedClip = initClip();
-
     if (!((src.mCropLeft & 1) == 0
             && src.cropWidth() == dst.cropWidth()
             && src.cropHeight() == dst.cropHeight())) {
         return ERROR_UNSUPPORTED;
     }
 
-    uint16_t *dst_ptr = (uint16_t *)dst.mBits
-        + dst.mCropTop * dst.mWidth + dst.mCropLeft;
+    size_t bpp = dstBytesPerPixel();
+    uint8_t *dst_ptr = (uint8_t *)dst.mBits
+        + (dst.mCropTop * dst.mWidth + dst.mCropLeft) * bpp;
 
     const uint8_t *src_y = (const uint8_t *)src.mBits;
 
     const uint8_t *src_u =
         (const uint8_t *)src_y + src.mWidth * (src.mHeight - src.mCropTop / 2);
 
+    YUVRow row;
+    row.mYStep = 1;
+    row.mUVStep = 2;
+
     for (size_t y = 0; y < src.cropHeight(); ++y) {
-        for (size_t x = 0; x < src.cropWidth(); x += 2) {
-            signed y1 = (signed)src_y[x] - 16;
-            signed y2 = (signed)src_y[x + 1] - 16;
-
-            signed u = (signed)src_u[x & ~1] - 128;
-            signed v = (signed)src_u[(x & ~1) + 1] - 128;
-
-            signed u_b = u * 517;
-            signed u_g = -u * 100;
-            signed v_g = -v * 208;
-            signed v_r = v * 409;
-
-            signed tmp1 = y1 * 298;
-            signed b1 = (tmp1 + u_b) / 256;
-            signed g1 = (tmp1 + v_g + u_g) / 256;
-            signed r1 = (tmp1 + v_r) / 256;
-
-            signed tmp2 = y2 * 298;
-            signed b2 = (tmp2 + u_b) / 256;
-            signed g2 = (tmp2 + v_g + u_g) / 256;
-            signed r2 = (tmp2 + v_r) / 256;
-
-            uint32_t rgb1 =
-                ((kAdjustedClip[r1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[b1] >> 3);
-
-            uint32_t rgb2 =
-                ((kAdjustedClip[r2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[b2] >> 3);
-
-            if (x + 1 < src.cropWidth()) {
-                *(uint32_t *)(&dst_ptr[x]) = (rgb2 << 16) | rgb1;
-            } else {
-                dst_ptr[x] = rgb1;
-            }
-        }
+        row.mY = src_y;
+        row.mU = src_u;
+        row.mV = src_u + 1;
+        convertRow(row, dst_ptr, src.cropWidth(), false);
 
         src_y += src.mWidth;
 
@@ -500,25 +376,10 @@ status_t ColorConverter::convertTIYUV420PackedSemiPlanar(
             src_u += src.mWidth;
         }
 
-        dst_ptr += dst.mWidth;
+        dst_ptr += dst.mWidth * bpp;
     }
 
     return OK;
 }
 
-uint8_t *ColorConverter::initClip() {
-    static const signed kClipMin = -278;
-    static const signed kClipMax = 535;
-
-    if (mClip == NULL) {
-        mClip = new uint8_t[kClipMax - kClipMin + 1];
-
-        for (signed i = kClipMin; i <= kClipMax; ++i) {
-            mClip[i - kClipMin] = (i < 0) ? 0 : (i > 255) ? 255 : (uint8_t)i;
-        }
-    }
-
-    return &mClip[-kClipMin];
-}
-
 };  // namespace android
@@ -0,0 +1,405 @@
+/*
+ * Copyright (C) 2009 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "YUVRowConverter"
+#include <utils/Log.h>
+
+#include <string.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define YUV_ROW_CONVERTER_NEON
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#define YUV_ROW_CONVERTER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/YUVRowConverter.h>
+
+namespace android {
+
+typedef YUVRowConverter::Coeffs Coeffs;
+typedef YUVRowConverter::Row Row;
+
+// The sums are divided by 256 with an arithmetic shift. It only differs
+// from a division for negative sums, which clip to 0 either way. Written
+// as a select rather than two compares so the compiler emits it without
+// branches; noisy chroma mispredicts them.
+static inline uint8_t clip(int32_t x) {
+    return ((uint32_t)x > 255) ? (uint8_t)(~x >> 31) : (uint8_t)x;
+}
+
+static inline size_t formatBytesPerPixel(int format) {
+    switch (format) {
+        case YUVRowConverter::kRGB565:
+        case YUVRowConverter::kBGR565:
+            return 2;
+        case YUVRowConverter::kBGR888:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+// One output pixel, packed for a little endian store like the old RGB565
+// loops did two pixels at a time.
+template<int format>
+static inline uint32_t packPixel(int32_t tmp, int32_t v_r, int32_t uv_g, int32_t u_b) {
+    uint32_t r = clip((tmp + v_r) >> 8);
+    uint32_t g = clip((tmp + uv_g) >> 8);
+    uint32_t b = clip((tmp + u_b) >> 8);
+
+    switch (format) {
+        case YUVRowConverter::kRGB565:
+            return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+        case YUVRowConverter::kBGR565:
+            return ((b >> 3) << 11) | ((g >> 2) << 5) | (r >> 3);
+        case YUVRowConverter::kRGBA8888:
+            return r | (g << 8) | (b << 16) | (255u << 24);
+        case YUVRowConverter::kBGRA8888:
+            return b | (g << 8) | (r << 16) | (255u << 24);
+        default:
+            return b | (g << 8) | (r << 16);
+    }
+}
+
+// Reference converter, any width, two pixels share chroma. The layout is
+// fixed at compile time so the pixel loop carries no format branches.
+template<int format, size_t yStep, size_t uvStep>
+static void convertRowScalar(
+        const Coeffs &c, const uint8_t *y,
+        const uint8_t *u, const uint8_t *v, uint8_t *dst, size_t width) {
+    const size_t bpp = formatBytesPerPixel(format);
+    const int32_t yOffset = c.mYOffset;
+    const int32_t cY = c.mY, cUB = c.mUB, cUG = c.mUG, cVG = c.mVG, cVR = c.mVR;
+
+    for (size_t x = 0; x < width; x += 2) {
+        int32_t u0 = (int32_t)*u - 128;
+        int32_t v0 = (int32_t)*v - 128;
+
+        int32_t u_b = u0 * cUB;
+        int32_t uv_g = -u0 * cUG - v0 * cVG;
+        int32_t v_r = v0 * cVR;
+
+        uint32_t p0 = packPixel<format>(((int32_t)y[0] - yOffset) * cY, v_r, uv_g, u_b);
+        if (x + 1 == width) {
+            memcpy(dst, &p0, bpp);
+            break;
+        }
+        uint32_t p1 = packPixel<format>(((int32_t)y[yStep] - yOffset) * cY, v_r, uv_g, u_b);
+
+        if (bpp == 2) {
+            uint32_t pair = p0 | (p1 << 16);
+            memcpy(dst, &pair, 4);
+        } else {
+            memcpy(dst, &p0, bpp);
+            memcpy(dst + bpp, &p1, bpp);
+        }
+
+        y += 2 * yStep;
+        u += uvStep;
+        v += uvStep;
+        dst += 2 * bpp;
+    }
+}
+
+template<int format>
+static void convertRowScalar(
+        const Coeffs &c, const Row &row, uint8_t *dst, size_t width) {
+    if (row.mYStep == 1 && row.mUVStep == 1) {
+        convertRowScalar<format, 1, 1>(c, row.mY, row.mU, row.mV, dst, width);
+    } else if (row.mYStep == 1 && row.mUVStep == 2) {
+        convertRowScalar<format, 1, 2>(c, row.mY, row.mU, row.mV, dst, width);
+    } else if (row.mYStep == 2 && row.mUVStep == 4) {
+        convertRowScalar<format, 2, 4>(c, row.mY, row.mU, row.mV, dst, width);
+    } else {
+        CHECK(!"Should not be here. Unknown row layout.");
+    }
+}
+
+template<int format>
+static void convertRowScaled(
+        const Coeffs &c, const Row &row, uint8_t *dst, size_t width, uint32_t xStep) {
+    const size_t bpp = formatBytesPerPixel(format);
+    uint32_t sx = 0;
+
+    for (size_t x = 0; x < width; ++x, sx += xStep) {
+        size_t i = sx >> 16;
+        int32_t u0 = (int32_t)row.mU[(i >> 1) * row.mUVStep] - 128;
+        int32_t v0 = (int32_t)row.mV[(i >> 1) * row.mUVStep] - 128;
+
+        uint32_t p = packPixel<format>(
+                ((int32_t)row.mY[i * row.mYStep] - c.mYOffset) * c.mY,
+                v0 * c.mVR, -u0 * c.mUG - v0 * c.mVG, u0 * c.mUB);
+        memcpy(dst + x * bpp, &p, bpp);
+    }
+}
+
+#if defined(YUV_ROW_CONVERTER_NEON)
+
+// 16 pixels per iteration, 32 bit intermediates so the result matches
+// convertRowScalar exactly. Returns the number of pixels converted.
+static size_t convertRowVector(
+        const Coeffs &c, const uint8_t *y,
+        const uint8_t *u, const uint8_t *v, size_t uvStep,
+        uint8_t *dst, size_t bpp, size_t width, bool swapRB) {
+    const int16x4_t kYOffset = vdup_n_s16(c.mYOffset);
+    const int16x8_t k128 = vdupq_n_s16(128);
+    size_t x;
+
+    for (x = 0; x + 16 <= width; x += 16) {
+        uint8x16_t yv = vld1q_u8(y + x);
+        uint8x8_t uv8, vv8;
+
+        if (uvStep == 1) {
+            uv8 = vld1_u8(u + x / 2);
+            vv8 = vld1_u8(v + x / 2);
+        } else {
+            uint8x8x2_t pair = vld2_u8((u < v ? u : v) + x);
+            uv8 = (u < v) ? pair.val[0] : pair.val[1];
+            vv8 = (u < v) ? pair.val[1] : pair.val[0];
+        }
+
+        int16x8_t u16 = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(uv8)), k128);
+        int16x8_t v16 = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vv8)), k128);
+
+        // per chroma sample, then each one is used by two pixels
+        int16x8x2_t uDup = vzipq_s16(u16, u16);
+        int16x8x2_t vDup = vzipq_s16(v16, v16);
+
+        uint8x8_t r[2], g[2], b[2];
+        for (int h = 0; h < 2; ++h) {
+            uint8x8_t yHalf = h ? vget_high_u8(yv) : vget_low_u8(yv);
+            int16x8_t y16 = vreinterpretq_s16_u16(vmovl_u8(yHalf));
+            int16x4_t yl = vsub_s16(vget_low_s16(y16), kYOffset);
+            int16x4_t yh = vsub_s16(vget_high_s16(y16), kYOffset);
+            int16x8_t uh = uDup.val[h];
+            int16x8_t vh = vDup.val[h];
+
+            int32x4_t tl = vmull_n_s16(yl, c.mY);
+            int32x4_t th = vmull_n_s16(yh, c.mY);
+
+            int32x4_t rl = vmlal_n_s16(tl, vget_low_s16(vh), c.mVR);
+            int32x4_t rh = vmlal_n_s16(th, vget_high_s16(vh), c.mVR);
+            int32x4_t gl = vmlsl_n_s16(
+                    vmlsl_n_s16(tl, vget_low_s16(uh), c.mUG), vget_low_s16(vh), c.mVG);
+            int32x4_t gh = vmlsl_n_s16(
+                    vmlsl_n_s16(th, vget_high_s16(uh), c.mUG), vget_high_s16(vh), c.mVG);
+            int32x4_t bl = vmlal_n_s16(tl, vget_low_s16(uh), c.mUB);
+            int32x4_t bh = vmlal_n_s16(th, vget_high_s16(uh), c.mUB);
+
+            r[h] = vqmovun_s16(vcombine_s16(vqshrn_n_s32(rl, 8), vqshrn_n_s32(rh, 8)));
+            g[h] = vqmovun_s16(vcombine_s16(vqshrn_n_s32(gl, 8), vqshrn_n_s32(gh, 8)));
+            b[h] = vqmovun_s16(vcombine_s16(vqshrn_n_s32(bl, 8), vqshrn_n_s32(bh, 8)));
+        }
+
+        for (int h = 0; h < 2; ++h) {
+            uint8x8_t rr = swapRB ? b[h] : r[h];
+            uint8x8_t bb = swapRB ? r[h] : b[h];
+
+            if (bpp == 2) {
+                uint16x8_t rgb = vshll_n_u8(rr, 8);
+                rgb = vsriq_n_u16(rgb, vshll_n_u8(g[h], 8), 5);
+                rgb = vsriq_n_u16(rgb, vshll_n_u8(bb, 8), 11);
+                vst1q_u16((uint16_t *)dst + x + 8 * h, rgb);
+            } else {
+                uint8x8x4_t rgba;
+                rgba.val[0] = rr;
+                rgba.val[1] = g[h];
+                rgba.val[2] = bb;
+                rgba.val[3] = vdup_n_u8(255);
+                vst4_u8(dst + 4 * (x + 8 * h), rgba);
+            }
+        }
+    }
+
+    return x;
+}
+
+#elif defined(YUV_ROW_CONVERTER_SSE2)
+
+// 8 pixels of one channel: madd of (a, b) pairs with (ka, kb), >> 8, clipped.
+static inline __m128i maddClip(
+        __m128i a, __m128i b, __m128i k, __m128i extra_lo, __m128i extra_hi) {
+    __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), k), extra_lo);
+    __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), k), extra_hi);
+    __m128i s = _mm_packs_epi32(_mm_srai_epi32(lo, 8), _mm_srai_epi32(hi, 8));
+    return _mm_packus_epi16(s, s);
+}
+
+// 16 pixels per iteration, 32 bit intermediates so the result matches
+// convertRowScalar exactly. Returns the number of pixels converted.
+static size_t convertRowVector(
+        const Coeffs &c, const uint8_t *y,
+        const uint8_t *u, const uint8_t *v, size_t uvStep,
+        uint8_t *dst, size_t bpp, size_t width, bool swapRB) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i kYOffset = _mm_set1_epi16(c.mYOffset);
+    const __m128i k128 = _mm_set1_epi16(128);
+    const __m128i kLow = _mm_set1_epi16(0xff);
+    const __m128i kAlpha = _mm_set1_epi8((char)0xff);
+    const __m128i kYV = _mm_set_epi16(
+            c.mVR, c.mY, c.mVR, c.mY, c.mVR, c.mY, c.mVR, c.mY);
+    const __m128i kYU = _mm_set_epi16(
+            c.mUB, c.mY, c.mUB, c.mY, c.mUB, c.mY, c.mUB, c.mY);
+    const __m128i kUV = _mm_set_epi16(
+            -c.mVG, -c.mUG, -c.mVG, -c.mUG, -c.mVG, -c.mUG, -c.mVG, -c.mUG);
+    const __m128i kY0 = _mm_set_epi16(0, c.mY, 0, c.mY, 0, c.mY, 0, c.mY);
+    size_t x;
+
+    for (x = 0; x + 16 <= width; x += 16) {
+        __m128i yv = _mm_loadu_si128((const __m128i *)(y + x));
+        __m128i u16, v16;
+
+        if (uvStep == 1) {
+            u16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(u + x / 2)), zero);
+            v16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(v + x / 2)), zero);
+        } else {
+            __m128i pair = _mm_loadu_si128((const __m128i *)((u < v ? u : v) + x));
+            __m128i even = _mm_and_si128(pair, kLow);
+            __m128i odd = _mm_srli_epi16(pair, 8);
+            u16 = (u < v) ? even : odd;
+            v16 = (u < v) ? odd : even;
+        }
+        u16 = _mm_sub_epi16(u16, k128);
+        v16 = _mm_sub_epi16(v16, k128);
+
+        __m128i r[2], g[2], b[2];
+        for (int h = 0; h < 2; ++h) {
+            __m128i y16 = _mm_sub_epi16(
+                    h ? _mm_unpackhi_epi8(yv, zero) : _mm_unpacklo_epi8(yv, zero), kYOffset);
+            // each chroma sample is used by two pixels
+            __m128i uh = h ? _mm_unpackhi_epi16(u16, u16) : _mm_unpacklo_epi16(u16, u16);
+            __m128i vh = h ? _mm_unpackhi_epi16(v16, v16) : _mm_unpacklo_epi16(v16, v16);
+
+            __m128i uvLo = _mm_madd_epi16(_mm_unpacklo_epi16(uh, vh), kUV);
+            __m128i uvHi = _mm_madd_epi16(_mm_unpackhi_epi16(uh, vh), kUV);
+
+            r[h] = maddClip(y16, vh, kYV, zero, zero);
+            g[h] = maddClip(y16, zero, kY0, uvLo, uvHi);
+            b[h] = maddClip(y16, uh, kYU, zero, zero);
+        }
+
+        for (int h = 0; h < 2; ++h) {
+            __m128i rr = swapRB ? b[h] : r[h];
+            __m128i bb = swapRB ? r[h] : b[h];
+
+            if (bpp == 2) {
+                __m128i r16 = _mm_slli_epi16(
+                        _mm_srli_epi16(_mm_unpacklo_epi8(rr, zero), 3), 11);
+                __m128i g16 = _mm_slli_epi16(
+                        _mm_srli_epi16(_mm_unpacklo_epi8(g[h], zero), 2), 5);
+                __m128i b16 = _mm_srli_epi16(_mm_unpacklo_epi8(bb, zero), 3);
+                _mm_storeu_si128((__m128i *)((uint16_t *)dst + x + 8 * h),
+                        _mm_or_si128(_mm_or_si128(r16, g16), b16));
+            } else {
+                __m128i rg = _mm_unpacklo_epi8(rr, g[h]);
+                __m128i ba = _mm_unpacklo_epi8(bb, kAlpha);
+                uint8_t *out = dst + 4 * (x + 8 * h);
+                _mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi16(rg, ba));
+                _mm_storeu_si128((__m128i *)(out + 16), _mm_unpackhi_epi16(rg, ba));
+            }
+        }
+    }
+
+    return x;
+}
+
+#endif
+
+YUVRowConverter::YUVRowConverter(const Coeffs &coeffs, RGBFormat format)
+    : mCoeffs(coeffs),
+      mFormat(format),
+      mVectorEnabled(true) {
+}
+
+void YUVRowConverter::setVectorEnabled(bool enabled) {
+    mVectorEnabled = enabled;
+}
+
+size_t YUVRowConverter::bytesPerPixel() const {
+    return formatBytesPerPixel(mFormat);
+}
+
+void YUVRowConverter::convert(const Row &row, void *dst, size_t width) const {
+    size_t bpp = bytesPerPixel();
+    size_t done = 0;
+
+#if defined(YUV_ROW_CONVERTER_NEON) || defined(YUV_ROW_CONVERTER_SSE2)
+    if (mVectorEnabled && mFormat != kBGR888 && row.mYStep == 1
+            && (row.mUVStep == 1 || row.mUVStep == 2)) {
+        done = convertRowVector(
+                mCoeffs, row.mY, row.mU, row.mV, row.mUVStep,
+                (uint8_t *)dst, bpp, width,
+                mFormat == kBGR565 || mFormat == kBGRA8888);
+    }
+#endif
+
+    // |done| is even, so the remaining pixels start on a chroma sample
+    Row tail = row;
+    tail.mY += done * row.mYStep;
+    tail.mU += (done / 2) * row.mUVStep;
+    tail.mV += (done / 2) * row.mUVStep;
+    uint8_t *out = (uint8_t *)dst + done * bpp;
+
+    switch (mFormat) {
+        case kRGB565:
+            convertRowScalar<kRGB565>(mCoeffs, tail, out, width - done);
+            break;
+        case kBGR565:
+            convertRowScalar<kBGR565>(mCoeffs, tail, out, width - done);
+            break;
+        case kRGBA8888:
+            convertRowScalar<kRGBA8888>(mCoeffs, tail, out, width - done);
+            break;
+        case kBGRA8888:
+            convertRowScalar<kBGRA8888>(mCoeffs, tail, out, width - done);
+            break;
+        case kBGR888:
+            convertRowScalar<kBGR888>(mCoeffs, tail, out, width - done);
+            break;
+    }
+}
+
+void YUVRowConverter::convertScaled(
+        const Row &row, void *dst, size_t width, uint32_t xStep) const {
+    if (xStep == (1u << 16)) {
+        convert(row, dst, width);
+        return;
+    }
+
+    switch (mFormat) {
+        case kRGB565:
+            convertRowScaled<kRGB565>(mCoeffs, row, (uint8_t *)dst, width, xStep);
+            break;
+        case kBGR565:
+            convertRowScaled<kBGR565>(mCoeffs, row, (uint8_t *)dst, width, xStep);
+            break;
+        case kRGBA8888:
+            convertRowScaled<kRGBA8888>(mCoeffs, row, (uint8_t *)dst, width, xStep);
+            break;
+        case kBGRA8888:
+            convertRowScaled<kBGRA8888>(mCoeffs, row, (uint8_t *)dst, width, xStep);
+            break;
+        case kBGR888:
+            convertRowScaled<kBGR888>(mCoeffs, row, (uint8_t *)dst, width, xStep);
+            break;
+    }
+}
+
+};  // namespace android
@@ -0,0 +1,114 @@
+/*
+ * Converts a random 1280x720 frame with every source format, output format
+ * and matrix ColorConverter supports, once with the vectorized rows and
+ * once with the scalar path. Reports megapixels per second for both and
+ * fails if the outputs differ.
+ *
+ * usage: colorconversion_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <media/stagefright/ColorConverter.h>
+
+using namespace android;
+
+static const size_t kWidth = 1280;
+static const size_t kHeight = 720;
+
+static int64_t nowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000ll + ts.tv_nsec / 1000;
+}
+
+static double run(
+        ColorConverter &converter, const uint8_t *src, uint8_t *dst, int iterations) {
+    int64_t start = nowUs();
+    for (int i = 0; i < iterations; ++i) {
+        converter.convert(
+                src, kWidth, kHeight, 0, 0, kWidth - 1, kHeight - 1,
+                dst, kWidth, kHeight, 0, 0, kWidth - 1, kHeight - 1);
+    }
+    int64_t elapsed = nowUs() - start;
+    return elapsed > 0 ? (double)kWidth * kHeight * iterations / elapsed : 0;
+}
+
+int main(int argc, char **argv) {
+    static const struct {
+        OMX_COLOR_FORMATTYPE mFormat;
+        const char *mName;
+    } kSrc[] = {
+        { OMX_COLOR_FormatYUV420Planar, "YUV420Planar" },
+        { OMX_COLOR_FormatYUV420SemiPlanar, "YUV420SemiPlanar" },
+        { OMX_QCOM_COLOR_FormatYVU420SemiPlanar, "QCOMYVU420SemiPlanar" },
+        { OMX_TI_COLOR_FormatYUV420PackedSemiPlanar, "TIYUV420PackedSemiPlanar" },
+        { OMX_COLOR_FormatCbYCrY, "CbYCrY" },
+    };
+    static const struct {
+        OMX_COLOR_FORMATTYPE mFormat;
+        const char *mName;
+    } kDst[] = {
+        { OMX_COLOR_Format16bitRGB565, "RGB565" },
+        { OMX_COLOR_Format32BitRGBA8888, "RGBA8888" },
+    };
+
+    int iterations = (argc > 1) ? atoi(argv[1]) : 20;
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    // large enough for every source layout
+    size_t srcSize = kWidth * kHeight * 2;
+    size_t dstSize = kWidth * kHeight * 4;
+    uint8_t *src = new uint8_t[srcSize];
+    uint8_t *dstVector = new uint8_t[dstSize];
+    uint8_t *dstScalar = new uint8_t[dstSize];
+
+    srand(1);
+    for (size_t i = 0; i < srcSize; ++i) {
+        src[i] = rand() & 0xff;
+    }
+
+    int failed = 0;
+    for (size_t s = 0; s < sizeof(kSrc) / sizeof(kSrc[0]); ++s) {
+        for (size_t d = 0; d < sizeof(kDst) / sizeof(kDst[0]); ++d) {
+            for (int m = 0; m < 2; ++m) {
+                ColorConverter converter(kSrc[s].mFormat, kDst[d].mFormat);
+                ColorConverter::ColorMatrix matrix = m
+                    ? ColorConverter::kColorMatrixBT709
+                    : ColorConverter::kColorMatrixBT601;
+                converter.setColorMatrix(matrix);
+
+                memset(dstVector, 0, dstSize);
+                memset(dstScalar, 0, dstSize);
+
+                converter.setVectorEnabled(true);
+                double vectorMps = run(converter, src, dstVector, iterations);
+                converter.setVectorEnabled(false);
+                double scalarMps = run(converter, src, dstScalar, iterations);
+
+                bool exact = !memcmp(dstVector, dstScalar, dstSize);
+                if (!exact) {
+                    ++failed;
+                }
+
+                printf("%-26s %-9s %s: scalar %7.1f MP/s, vector %7.1f MP/s, x%.2f %s\n",
+                        kSrc[s].mName, kDst[d].mName, m ? "BT.709" : "BT.601",
+                        scalarMps, vectorMps,
+                        scalarMps > 0 ? vectorMps / scalarMps : 0,
+                        exact ? "exact" : "MISMATCH");
+            }
+        }
+    }
+
+    delete[] src;
+    delete[] dstVector;
+    delete[] dstScalar;
+
+    return failed ? 1 : 0;
+}
@@ -154,6 +154,30 @@ status_t CedarDisplay::openAdasScreen(unsigned int hlay, int open)
 	return mediaDisplay->open(hlay, open);
 }
 
+status_t CedarDisplay::beginTransaction()
+{
+	sp<Display> mediaDisplay = reinterpret_cast<Display*>(mNativeContext);
+    if (mediaDisplay == 0) return BAD_VALUE;
+
+	return mediaDisplay->beginTransaction();
+}
+
+status_t CedarDisplay::commitTransaction()
+{
+	sp<Display> mediaDisplay = reinterpret_cast<Display*>(mNativeContext);
+    if (mediaDisplay == 0) return BAD_VALUE;
+
+	return mediaDisplay->commitTransaction();
+}
+
+status_t CedarDisplay::setPresentMode(unsigned int hlay, int mode)
+{
+	sp<Display> mediaDisplay = reinterpret_cast<Display*>(mNativeContext);
+    if (mediaDisplay == 0) return BAD_VALUE;
+
+	return mediaDisplay->setPresentMode(hlay, mode);
+}
+
 
 }; // namespace android
 
@@ -81,13 +81,17 @@ public:
     //void addCallbackBuffer(JNIEnv *env, jbyteArray cbb, int msgType);
     void addCallbackBuffer(sp<CMediaMemory>& cbb, int msgType);
     
-    void setCallbackMode(bool installed, bool manualMode);
+    void setCallbackMode(bool installed, bool manualMode, int sharedBufferNum = 0);
+    void releasePreviewFrame(const void *data);
+    bool isSharedFrameHeld(const sp<IMemory>& frame);
     sp<Camera> getCamera() { Mutex::Autolock _l(mLock); return mCamera; }
     bool isRawImageCallbackBufferAvailable() const;
     void release();
 
 private:
     void copyAndPost(const sp<IMemory>& dataPtr, int msgType);
+    void postSharedFrame_l(const sp<IMemory>& dataPtr);
+    void releaseSharedFrames_l();
     void clearCallbackBuffers_l(Vector<sp<CMediaMemory> > *buffers);
     void clearCallbackBuffers_l();
     //jbyteArray getCallbackBuffer(JNIEnv *env, Vector<jbyteArray> *buffers, size_t bufferSize);
@@ -122,6 +126,13 @@ private:
     bool mManualBufferMode;              // Whether to use application managed buffers.
     bool mManualCameraCallbackSet;       // Whether the callback has been set, used to
                                          // reduce unnecessary calls to set the callback.
+
+    /*
+     * Shared buffer mode: preview frames are camera service buffers posted
+     * without copy, kept here until application releases them.
+     */
+    int mSharedBufferNum;                // 0: not in shared buffer mode
+    Vector<sp<IMemory> > mSharedFrames;
 };
 bool HerbCameraContext::isRawImageCallbackBufferAvailable() const
 {
@@ -143,6 +154,7 @@ HerbCameraContext::HerbCameraContext(HerbCamera* pC, const sp<Camera>& camera)
 
     mManualBufferMode = false;
     mManualCameraCallbackSet = false;
+    mSharedBufferNum = 0;
 
     mpHerbCamera = pC;
 }
@@ -170,6 +182,9 @@ void HerbCameraContext::release()
 //        mRectClass = NULL;
 //    }
     clearCallbackBuffers_l();
+    if (mCamera != NULL) {
+        releaseSharedFrames_l();
+    }
     mCamera.clear();
 }
 
@@ -318,6 +333,14 @@ void HerbCameraContext::postData(int32_t msgType, const sp<IMemory>& dataPtr,
         case 0:
             break;
 
+        case CAMERA_MSG_PREVIEW_FRAME:
+            if (mSharedBufferNum > 0) {
+                postSharedFrame_l(dataPtr);
+            } else {
+                copyAndPost(dataPtr, dataMsgType);
+            }
+            break;
+
         case CAMERA_MSG_ADAS_METADATA:
         case CAMERA_MSG_COMPRESSED_IMAGE:
         case CAMERA_MSG_POSTVIEW_FRAME:
@@ -398,12 +421,27 @@ void HerbCameraContext::postMetadata(int32_t msgType, camera_frame_metadata_t *m
     HerbCamera::postEventFromNative(mpHerbCamera, msgType, 0, 0, &obj);
 }
 
-void HerbCameraContext::setCallbackMode(bool installed, bool manualMode)
+void HerbCameraContext::setCallbackMode(bool installed, bool manualMode, int sharedBufferNum)
 {
     Mutex::Autolock _l(mLock);
     mManualBufferMode = manualMode;
     mManualCameraCallbackSet = false;
 
+    // camera service keeps copied frames until they are released only when
+    // its buffer number is set, so set it when entering or leaving shared mode.
+    if (!installed) {
+        sharedBufferNum = 0;
+    }
+    if (sharedBufferNum != mSharedBufferNum) {
+        CameraParameters params(mCamera->getParameters());
+        params.setPreviewCallbackBufferNum(sharedBufferNum);
+        mCamera->setParameters(params.flatten());
+        mSharedBufferNum = sharedBufferNum;
+    }
+    if (mSharedBufferNum == 0) {
+        releaseSharedFrames_l();
+    }
+
     // In order to limit the over usage of binder threads, all non-manual buffer
     // callbacks use CAMERA_FRAME_CALLBACK_FLAG_BARCODE_SCANNER mode now.
     //
@@ -419,6 +457,10 @@ void HerbCameraContext::setCallbackMode(bool installed, bool manualMode)
             mCamera->setPreviewCallbackFlags(CAMERA_FRAME_CALLBACK_FLAG_CAMERA);
             mManualCameraCallbackSet = true;
         }
+    } else if (mSharedBufferNum > 0) {
+        // every frame is copied once to camera service buffer, throttled by release.
+        mCamera->setPreviewCallbackFlags(CAMERA_FRAME_CALLBACK_FLAG_CAMERA);
+        clearCallbackBuffers_l(&mCallbackBuffers);
     } else {
         mCamera->setPreviewCallbackFlags(CAMERA_FRAME_CALLBACK_FLAG_BARCODE_SCANNER);
         clearCallbackBuffers_l(&mCallbackBuffers);
@@ -467,6 +509,63 @@ void HerbCameraContext::addCallbackBuffer(sp<CMediaMemory>& cbb, int msgType)
     }
 }
 
+void HerbCameraContext::postSharedFrame_l(const sp<IMemory>& dataPtr)
+{
+    if (dataPtr == NULL || dataPtr->pointer() == NULL) {
+        ALOGE("(f:%s, l:%d) preview frame is NULL", __FUNCTION__, __LINE__);
+        return;
+    }
+    mSharedFrames.add(dataPtr);
+    ALOGV("postSharedFrame: %p, %d frames held", dataPtr->pointer(), mSharedFrames.size());
+    HerbCamera::postEventFromNative(mpHerbCamera, CAMERA_MSG_PREVIEW_FRAME,
+            HerbCamera::PREVIEW_FRAME_SHARED, 0, (void*)&dataPtr);
+}
+
+void HerbCameraContext::releasePreviewFrame(const void *data)
+{
+    sp<IMemory> frame;
+    sp<Camera> camera;
+    {
+        Mutex::Autolock _l(mLock);
+        for (size_t i = 0; i < mSharedFrames.size(); i++) {
+            if (mSharedFrames[i]->pointer() == data) {
+                frame = mSharedFrames[i];
+                mSharedFrames.removeAt(i);
+                break;
+            }
+        }
+        camera = mCamera;
+    }
+    if (frame == NULL) {
+        ALOGW("(f:%s, l:%d) frame %p is not held, released already?", __FUNCTION__, __LINE__, data);
+        return;
+    }
+    if (camera != NULL) {
+        camera->releasePreviewFrame(frame);
+    }
+}
+
+// false once the frame was released, by the application or by leaving shared mode.
+bool HerbCameraContext::isSharedFrameHeld(const sp<IMemory>& frame)
+{
+    Mutex::Autolock _l(mLock);
+    for (size_t i = 0; i < mSharedFrames.size(); i++) {
+        if (mSharedFrames[i] == frame) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void HerbCameraContext::releaseSharedFrames_l()
+{
+    ALOGV("Releasing shared frames, %d remained", mSharedFrames.size());
+    for (size_t i = 0; i < mSharedFrames.size(); i++) {
+        mCamera->releasePreviewFrame(mSharedFrames[i]);
+    }
+    mSharedFrames.clear();
+}
+
 //void JNICameraContext::clearCallbackBuffers_l(JNIEnv *env)
 void HerbCameraContext::clearCallbackBuffers_l()
 {
@@ -556,6 +655,22 @@ void HerbCamera::EventHandler::handleMessage(const MediaCallbackMessage &msg)
         case CAMERA_MSG_PREVIEW_FRAME:
         {
             PreviewCallback *pCb = mpCamera->mpPreviewCallback;
+            if (msg.dataCompressedImage != NULL) {
+                // shared buffer mode, application releases the frame by releasePreviewFrame().
+                sp<IMemory> frame = msg.dataCompressedImage;
+                HerbCameraContext* context = reinterpret_cast<HerbCameraContext*>(mpCamera->mNativeContext);
+                if (context == NULL || !context->isSharedFrameHeld(frame)) {
+                    // released while queued, camera service may be filling it again
+                    ALOGV("drop preview frame %p, released already", frame->pointer());
+                    return;
+                }
+                if (pCb != NULL) {
+                    pCb->onPreviewFrame(frame->pointer(), frame->size(), mpCamera);
+                } else {
+                    mpCamera->releasePreviewFrame(frame->pointer());
+                }
+                return;
+            }
             if (pCb != NULL) {
                 ALOGE("(f:%s, l:%d) only for test, for fun. Don't use it now", __FUNCTION__, __LINE__);
                 if (mpCamera->mOneShot) {
@@ -986,9 +1101,9 @@ void HerbCamera::setOneShotPreviewCallback(PreviewCallback *pCb)
     setHasPreviewCallback(pCb != NULL, false);
 }
 
-void HerbCamera::setHasPreviewCallback(bool installed, bool manualBuffer)
+void HerbCamera::setHasPreviewCallback(bool installed, bool manualBuffer, int sharedBufferNum)
 {
-    ALOGV("setHasPreviewCallback: installed:%d, manualBuffer:%d", (int)installed, (int)manualBuffer);
+    ALOGV("setHasPreviewCallback: installed:%d, manualBuffer:%d, sharedBufferNum:%d", (int)installed, (int)manualBuffer, sharedBufferNum);
     // Important: Only install preview_callback if the Java code has called
     // setPreviewCallback() with a non-null value, otherwise we'd pay to memcpy
     // each preview frame for nothing.
@@ -998,7 +1113,7 @@ void HerbCamera::setHasPreviewCallback(bool installed, bool manualBuffer)
 
     // setCallbackMode will take care of setting the context flags and calling
     // camera->setPreviewCallbackFlags within a mutex for us.
-    context->setCallbackMode(installed, manualBuffer);
+    context->setCallbackMode(installed, manualBuffer, sharedBufferNum);
 }
 
 void HerbCamera::setPreviewCallbackWithBuffer(PreviewCallback *pCb) {
@@ -1008,6 +1123,27 @@ void HerbCamera::setPreviewCallbackWithBuffer(PreviewCallback *pCb) {
         setHasPreviewCallback(pCb != NULL, true);
 }
 
+void HerbCamera::setPreviewCallbackWithSharedBuffer(PreviewCallback *pCb, int bufferNum)
+{
+    if (bufferNum <= 0) {
+        ALOGE("(f:%s, l:%d) wrong bufferNum[%d]", __FUNCTION__, __LINE__, bufferNum);
+        return;
+    }
+    mpPreviewCallback = pCb;
+    mOneShot = false;
+    mWithBuffer = true;     // frames are throttled by release, not by one-shot re-arm.
+    setHasPreviewCallback(pCb != NULL, false, bufferNum);
+}
+
+void HerbCamera::releasePreviewFrame(const void *data)
+{
+    HerbCameraContext* context = reinterpret_cast<HerbCameraContext*>(mNativeContext);
+
+    if (context != NULL) {
+        context->releasePreviewFrame(data);
+    }
+}
+
 void HerbCamera::addCallbackBuffer(sp<CMediaMemory> &callbackBuffer)
 {
     _addCallbackBuffer(callbackBuffer, CAMERA_MSG_PREVIEW_FRAME);
@@ -1057,7 +1193,8 @@ void HerbCamera::postEventFromNative(HerbCamera* pC, int what, int arg1, int arg
         if (CAMERA_MSG_COMPRESSED_IMAGE == msg.what ||
             CAMERA_MSG_ADAS_METADATA == msg.what ||
             CAMERA_MSG_POSTVIEW_FRAME == msg.what ||
-            CAMERA_MSG_QRDECODE == msg.what)
+            CAMERA_MSG_QRDECODE == msg.what ||
+            (CAMERA_MSG_PREVIEW_FRAME == msg.what && PREVIEW_FRAME_SHARED == arg1))
         {
             msg.obj = NULL;
             msg.dataCompressedImage = *(sp<IMemory>*)obj;
@@ -67,5 +67,20 @@ sp<IMemory> CedarMediaServerCaller::jpegDecode(String8 path)
     }
 }
 
+sp<IMemory> CedarMediaServerCaller::jpegDecodeThumbnail(String8 path, int width, int height)
+{
+    if (mCaller == NULL)
+    {
+        ALOGE("MediaServerCaller not initialize!");
+        return NULL;
+    }
+    if(path.isEmpty())
+    {
+        ALOGE("(f:%s, l:%d) path is empty", __FUNCTION__, __LINE__);
+        return NULL;
+    }
+    return mCaller->jpegDecodeThumbnail(path.string(), width, height);
+}
+
 }; /* namespace android */
 
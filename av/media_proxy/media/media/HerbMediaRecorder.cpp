@@ -702,6 +702,48 @@ status_t HerbMediaRecorder::setOutputFileSync(char* path, int64_t fallocateLengt
     return mr->setOutputFileSync(path, fallocateLength, muxerId);
 }
 
+status_t HerbMediaRecorder::prepareOutputFile(int fd, int64_t fallocateLength)
+{
+    ALOGV("prepareOutputFile fd=%d", fd);
+	if (fd < 0) {
+		ALOGE("Invalid parameter");
+		return BAD_VALUE;
+	}
+    sp<MediaRecorder> mr = getMediaRecorder();
+	if (mr == NULL) {
+		ALOGE("<%s> MediaRecorder not initialize", __FUNCTION__);
+		return NO_INIT;
+	}
+    return mr->prepareOutputFile(fd, fallocateLength);
+}
+
+status_t HerbMediaRecorder::prepareOutputFile(char* path, int64_t fallocateLength)
+{
+    ALOGV("prepareOutputFile path=%s", path);
+    status_t ret;
+    sp<MediaRecorder> mr = getMediaRecorder();
+	if (mr == NULL) {
+		ALOGE("<%s> MediaRecorder not initialize", __FUNCTION__);
+		return NO_INIT;
+	}
+    if(path != NULL)
+    {
+        if (strncasecmp(path, "http://", 7) != 0 && strncasecmp(path, FatFsPrefixString, strlen(FatFsPrefixString)) != 0)
+        {
+            int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+            if (fd < 0) 
+            {
+                ALOGE("Failed to open %s(%s)", path, strerror(errno));
+                return UNKNOWN_ERROR;
+            }
+            ret = mr->prepareOutputFile(fd, fallocateLength);
+            ::close(fd);
+            return ret;
+        }
+    }
+    return mr->prepareOutputFile(path, fallocateLength);
+}
+
 status_t HerbMediaRecorder::setOutputFileFd(int fd, long offset, long length)
 {
     ALOGV("setOutputFileFd");
@@ -862,6 +904,7 @@ sp<VEncBuffer> HerbMediaRecorder::getOneBsFrame(int mode, sp<IMemory> *frame)
 		//ALOGV("getOneBsFrame get buffer NULL!");
 		return NULL;
 	}
+	mBsFrameHeap = mem->getMemory();
 	sp<VEncBuffer> recData = new VEncBuffer;
 	char *ptr_dst = (char *)mem->pointer();
 	memcpy(&recData->total_size, ptr_dst, sizeof(int));
@@ -905,6 +948,96 @@ void HerbMediaRecorder::freeOneBsFrame(sp<VEncBuffer> recData, sp<IMemory> frame
 	mr->freeOneBsFrame();
 }
 
+int HerbMediaRecorder::registerBsConsumer(int dropPolicy)
+{
+	sp<MediaRecorder> mr = getMediaRecorder();
+	if (mr == NULL) {
+		ALOGE("<%s> MediaRecorder not initialize", __FUNCTION__);
+		return NO_INIT;
+	}
+	return mr->registerBsConsumer(dropPolicy);
+}
+
+status_t HerbMediaRecorder::unregisterBsConsumer(int consumerId)
+{
+	sp<MediaRecorder> mr = getMediaRecorder();
+	if (mr == NULL) {
+		ALOGE("<%s> MediaRecorder not initialize", __FUNCTION__);
+		return NO_INIT;
+	}
+	return mr->unregisterBsConsumer(consumerId);
+}
+
+status_t HerbMediaRecorder::getBsConsumerStatus(int consumerId, BsConsumerStatus *pStatus)
+{
+	sp<MediaRecorder> mr = getMediaRecorder();
+	if (mr == NULL) {
+		ALOGE("<%s> MediaRecorder not initialize", __FUNCTION__);
+		return NO_INIT;
+	}
+	return mr->getBsConsumerStatus(consumerId, pStatus);
+}
+
+status_t HerbMediaRecorder::getBsFrames(int maxFrames, int timeoutMs, Vector<sp<VEncBuffer> > *frames, int consumerId)
+{
+	sp<MediaRecorder> mr = getMediaRecorder();
+	if (mr == NULL) {
+		ALOGE("<%s> MediaRecorder not initialize", __FUNCTION__);
+		return NO_INIT;
+	}
+	Vector<sp<IMemoryHeap> > heaps;
+	Vector<BsFrameDesc> descs;
+	status_t ret = mr->getBsFrames(consumerId, maxFrames, timeoutMs, &heaps, &descs);
+	if (ret != OK) {
+		return ret;
+	}
+	for (size_t i = 0; i < descs.size(); i++) {
+		const BsFrameDesc &desc = descs[i];
+		sp<VEncBuffer> recData = new VEncBuffer;
+		recData->heap = heaps[desc.heapIndex];
+		recData->total_size = desc.size;
+		recData->stream_type = 0;
+		recData->data_size = desc.size;
+		recData->pts = desc.pts;
+		recData->CurrQp = desc.CurrQp;
+		recData->avQp = desc.avQp;
+		recData->nGopIndex = desc.nGopIndex;
+		recData->nFrameIndex = desc.nFrameIndex;
+		recData->nTotalIndex = desc.nTotalIndex;
+		recData->keyFrame = (desc.flags & BSFRAME_FLAG_KEYFRAME) != 0;
+		recData->seq = desc.seq;
+		recData->data = (char *)recData->heap->getBase() + desc.offset;
+		frames->push_back(recData);
+	}
+	if (!heaps.isEmpty()) {
+		mBsFrameHeap = heaps[0];
+	}
+	return OK;
+}
+
+status_t HerbMediaRecorder::freeBsFrames(const sp<VEncBuffer> &lastFrame, int consumerId)
+{
+	sp<MediaRecorder> mr = getMediaRecorder();
+	if (mr == NULL) {
+		ALOGE("<%s> MediaRecorder not initialize", __FUNCTION__);
+		return NO_INIT;
+	}
+	if (lastFrame == NULL) {
+		return BAD_VALUE;
+	}
+	return mr->freeBsFrames(consumerId, lastFrame->seq);
+}
+
+status_t HerbMediaRecorder::waitBsFrames(int minFrames, int waitFlags, int timeoutMs, int *pQueuedFrames, int consumerId)
+{
+	sp<MediaRecorder> mr = getMediaRecorder();
+	if (mr == NULL) {
+		ALOGE("<%s> MediaRecorder not initialize", __FUNCTION__);
+		return NO_INIT;
+	}
+	return mr->waitBsFrames(consumerId, minFrames, waitFlags, timeoutMs, pQueuedFrames);
+}
+
 sp<IMemory> HerbMediaRecorder::getEncDataHeader()
 {
 	sp<MediaRecorder> mr = getMediaRecorder();
@@ -942,6 +1075,7 @@ void HerbMediaRecorder::release()
 		mr->setListener(NULL);
 		mr->release();
 	}
+	mBsFrameHeap.clear();
 }
 
 status_t HerbMediaRecorder::setVideoEncodingIFramesNumberInterval(int nMaxKeyItl)
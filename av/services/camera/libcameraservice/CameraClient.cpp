@@ -30,6 +30,10 @@ namespace android {
 #define LOG1(...) ALOGD_IF(gLogLevel >= 1, __VA_ARGS__);
 #define LOG2(...) ALOGD_IF(gLogLevel >= 2, __VA_ARGS__);
 
+// copied preview frame buffers when the client does not release them
+#define DEFAULT_PREVIEW_CALLBACK_BUFFER_NUM 2
+#define MAX_PREVIEW_CALLBACK_BUFFER_NUM 8
+
 static int getCallingPid() {
     return IPCThreadState::self()->getCallingPid();
 }
@@ -58,6 +62,10 @@ CameraClient::CameraClient(const sp<CameraService>& cameraService,
     mPreviewCallbackFlag = CAMERA_FRAME_CALLBACK_FLAG_NOOP;
     mOrientation = getOrientation(0, mCameraFacing == CAMERA_FACING_FRONT);
     mPlayShutterSound = true;
+    mPreviewBufferNext = 0;
+    mPreviewCallbackBufferNum = 0;
+    mPreviewCallbackFrames = 0;
+    mPreviewCallbackDrops = 0;
     LOG1("CameraClient::CameraClient X (pid %d, id %d)", callingPid, cameraId);
 }
 
@@ -120,6 +128,15 @@ status_t CameraClient::dump(int fd, const Vector<String16>& args) {
             mClientPid);
     len = (len > SIZE - 1) ? SIZE - 1 : len;
     write(fd, buffer, len);
+    size_t busy = 0;
+    for (size_t i = 0; i < mPreviewBuffers.size(); i++) {
+        if (mPreviewBuffers[i].busy) busy++;
+    }
+    len = snprintf(buffer, SIZE, "    preview callback buffers: %d (set %d), held by client %d, frames %lld, dropped %lld\n",
+            mPreviewBuffers.size(), mPreviewCallbackBufferNum, busy,
+            mPreviewCallbackFrames, mPreviewCallbackDrops);
+    len = (len > SIZE - 1) ? SIZE - 1 : len;
+    write(fd, buffer, len);
     return mHardware->dump(fd, args);
 }
 
@@ -465,7 +482,7 @@ void CameraClient::stopPreview() {
     disableMsgType(CAMERA_MSG_PREVIEW_FRAME);
     mHardware->stopPreview();
 
-    mPreviewBuffer.clear();
+    clearPreviewBuffers();
 }
 
 // stop recording mode
@@ -478,7 +495,7 @@ void CameraClient::stopRecording() {
     mHardware->stopRecording();
     mCameraService->playSound(CameraService::SOUND_RECORDING);
 
-    mPreviewBuffer.clear();
+    clearPreviewBuffers();
 }
 
 // release a recording frame
@@ -488,6 +505,24 @@ void CameraClient::releaseRecordingFrame(const sp<IMemory>& mem) {
     mHardware->releaseRecordingFrame(mem);
 }
 
+// release a copied preview frame
+void CameraClient::releasePreviewFrame(const sp<IMemory>& mem) {
+    Mutex::Autolock lock(mLock);
+    if (checkPidAndHardware() != NO_ERROR) return;
+    if (mem == 0) return;
+
+    sp<IBinder> binder = mem->asBinder();
+    for (size_t i = 0; i < mPreviewBuffers.size(); i++) {
+        PreviewCallbackSlot& slot = mPreviewBuffers.editItemAt(i);
+        if (slot.frame != 0 && slot.frame->asBinder() == binder) {
+            slot.busy = false;
+            return;
+        }
+    }
+    // buffers are reallocated after stopPreview() or depth change.
+    LOG1("releasePreviewFrame: frame %p is not found", binder.get());
+}
+
 status_t CameraClient::storeMetaDataInBuffers(bool enabled)
 {
     LOG1("storeMetaDataInBuffers: %s", enabled? "true": "false");
@@ -572,6 +607,20 @@ status_t CameraClient::setParameters(const String8& params) {
     if (result != NO_ERROR) return result;
 
     CameraParameters p(params);
+    if (p.get(CameraParameters::KEY_AWEXTEND_PREVIEW_CALLBACK_BUFFER_NUM) != NULL) {
+        int num = p.getPreviewCallbackBufferNum();
+        if (num < 0) {
+            num = 0;
+        } else if (num > MAX_PREVIEW_CALLBACK_BUFFER_NUM) {
+            ALOGW("preview callback buffer num %d is too big, use %d", num, MAX_PREVIEW_CALLBACK_BUFFER_NUM);
+            num = MAX_PREVIEW_CALLBACK_BUFFER_NUM;
+        }
+        if (num != mPreviewCallbackBufferNum) {
+            LOG1("preview callback buffer num %d -> %d", mPreviewCallbackBufferNum, num);
+            mPreviewCallbackBufferNum = num;
+            clearPreviewBuffers();
+        }
+    }
     return mHardware->setParameters(p);
 }
 
@@ -1004,38 +1053,70 @@ void CameraClient::copyFrameAndPostCopiedFrame(
         camera_frame_metadata_t *metadata) {
     LOG2("copyFrameAndPostCopiedFrame");
     // It is necessary to copy out of pmem before sending this to
-    // the callback. For efficiency, reuse the same MemoryHeapBase
-    // provided it's big enough. Don't allocate the memory or
+    // the callback. Copy to a slot which the client is not reading, so a
+    // frame in use is never overwritten. Don't allocate the memory or
     // perform the copy if there's no callback.
-    // hold the preview lock while we grab a reference to the preview buffer
-    sp<MemoryHeapBase> previewBuffer;
-
-    if (mPreviewBuffer == 0) {
-        mPreviewBuffer = new MemoryHeapBase(size, 0, NULL);
-    } else if (size > mPreviewBuffer->virtualSize()) {
-        mPreviewBuffer.clear();
-        mPreviewBuffer = new MemoryHeapBase(size, 0, NULL);
+    bool explicitRelease = (mPreviewCallbackBufferNum > 0);
+    size_t num = explicitRelease ? mPreviewCallbackBufferNum : DEFAULT_PREVIEW_CALLBACK_BUFFER_NUM;
+    if (mPreviewBuffers.size() != num) {
+        clearPreviewBuffers();
+        PreviewCallbackSlot emptySlot;
+        emptySlot.busy = false;
+        mPreviewBuffers.insertAt(emptySlot, 0, num);
+    }
+
+    ssize_t index = -1;
+    for (size_t i = 0; i < num; i++) {
+        size_t k = (mPreviewBufferNext + i) % num;
+        if (!mPreviewBuffers[k].busy) {
+            index = k;
+            break;
+        }
     }
-    if (mPreviewBuffer == 0) {
-        ALOGE("failed to allocate space for preview buffer");
+    if (index < 0) {
+        LOG2("all %d preview buffers are held by client, drop frame", num);
+        mPreviewCallbackDrops++;
         mLock.unlock();
         return;
     }
-    previewBuffer = mPreviewBuffer;
-
-    memcpy(previewBuffer->base(), (uint8_t *)heap->base() + offset, size);
 
-    sp<MemoryBase> frame = new MemoryBase(previewBuffer, 0, size);
-    if (frame == 0) {
-        ALOGE("failed to allocate space for frame callback");
-        mLock.unlock();
-        return;
+    PreviewCallbackSlot& slot = mPreviewBuffers.editItemAt(index);
+    if (slot.heap == 0 || size > slot.heap->virtualSize()) {
+        // the slot is not held by client, it is safe to reallocate.
+        slot.frame.clear();
+        slot.heap = new MemoryHeapBase(size, 0, NULL);
+        if (slot.heap == 0 || slot.heap->getHeapID() < 0) {
+            ALOGE("failed to allocate space for preview buffer");
+            slot.heap.clear();
+            mLock.unlock();
+            return;
+        }
+    }
+    if (slot.frame == 0 || slot.frame->size() != size) {
+        slot.frame = new MemoryBase(slot.heap, 0, size);
+        if (slot.frame == 0) {
+            ALOGE("failed to allocate space for frame callback");
+            mLock.unlock();
+            return;
+        }
     }
 
+    memcpy(slot.heap->base(), (uint8_t *)heap->base() + offset, size);
+    slot.busy = explicitRelease;
+    mPreviewBufferNext = (index + 1) % num;
+    mPreviewCallbackFrames++;
+    sp<MemoryBase> frame = slot.frame;
+
     mLock.unlock();
     client->dataCallback(msgType, frame, metadata);
 }
 
+void CameraClient::clearPreviewBuffers() {
+    // heaps held by client are freed when it drops them.
+    mPreviewBuffers.clear();
+    mPreviewBufferNext = 0;
+}
+
 int CameraClient::getOrientation(int degrees, bool mirror) {
     if (!mirror) {
         if (degrees == 0) return 0;
@@ -17,11 +17,13 @@
 #ifndef ANDROID_SERVERS_CAMERA_CAMERACLIENT_H
 #define ANDROID_SERVERS_CAMERA_CAMERACLIENT_H
 
+#include <binder/MemoryBase.h>
+#include <binder/MemoryHeapBase.h>
+#include <utils/Vector.h>
 #include "CameraService.h"
 
 namespace android {
 
-class MemoryHeapBase;
 class CameraHardwareInterface;
 
 class CameraClient : public CameraService::Client
@@ -44,6 +46,7 @@ public:
     virtual void            stopRecording();
     virtual bool            recordingEnabled();
     virtual void            releaseRecordingFrame(const sp<IMemory>& mem);
+    virtual void            releasePreviewFrame(const sp<IMemory>& mem);
     virtual status_t        autoFocus();
     virtual status_t        cancelAutoFocus();
     virtual status_t        takePicture(int msgType);
@@ -115,6 +118,7 @@ private:
         const sp<IMemoryHeap>& heap,
         size_t offset, size_t size,
         camera_frame_metadata_t *metadata);
+    void                    clearPreviewBuffers();
 
     int                     getOrientation(int orientation, bool mirror);
 
@@ -138,8 +142,20 @@ private:
     int                      mPreviewLayerId;
 
     // If the user want us to return a copy of the preview frame (instead
-    // of the original one), we allocate mPreviewBuffer and reuse it if possible.
-    sp<MemoryHeapBase>              mPreviewBuffer;
+    // of the original one), we copy it to one of mPreviewBuffers which the
+    // client is not reading. Heaps and MemoryBase are reused across frames.
+    // If mPreviewCallbackBufferNum is set, a slot is reused only after the
+    // client calls releasePreviewFrame(); otherwise slots are used round robin.
+    struct PreviewCallbackSlot {
+        sp<MemoryHeapBase>          heap;
+        sp<MemoryBase>              frame;
+        bool                        busy;   // posted and not released yet
+    };
+    Vector<PreviewCallbackSlot>     mPreviewBuffers;
+    size_t                          mPreviewBufferNext;     // slot to search from
+    int                             mPreviewCallbackBufferNum;  // 0: client does not release frames
+    int64_t                         mPreviewCallbackFrames;
+    int64_t                         mPreviewCallbackDrops;  // all slots were held by client
 
     // We need to avoid the deadlock when the incoming command thread and
     // the CameraHardwareInterface callback thread both want to grab mLock.
@@ -94,6 +94,7 @@ public:
         virtual void          stopRecording() = 0;
         virtual bool          recordingEnabled() = 0;
         virtual void          releaseRecordingFrame(const sp<IMemory>& mem) = 0;
+        virtual void          releasePreviewFrame(const sp<IMemory>& mem) = 0;
         virtual status_t      autoFocus() = 0;
         virtual status_t      cancelAutoFocus() = 0;
         virtual status_t      takePicture(int msgType) = 0;
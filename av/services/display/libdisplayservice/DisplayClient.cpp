@@ -62,6 +62,7 @@ DisplayClient::DisplayClient(const sp<DisplayService>& displayService,
 {
 	
 	mHlay = 0;
+	mTransactionDepth = 0;
 	mHwDisplay = HwDisplay::getInstance();
 }
 
@@ -70,6 +71,10 @@ DisplayClient::DisplayClient(const sp<DisplayService>& displayService,
 DisplayClient::~DisplayClient() {
 	
     int callingPid = getCallingPid();
+	// a client that died inside a transaction must not freeze the display
+	while (mTransactionDepth > 0) {
+		commitTransaction();
+	}
 	mHwDisplay->hwd_layer_release(mHlay);
     LOG1("DisplayClient::~DisplayClient E (pid %d, this %p)", callingPid, this);
     LOG1("DisplayClient::~DisplayClient X (pid %d, this %p)", callingPid, this);
@@ -122,45 +127,80 @@ void DisplayClient::disconnect() {
     LOG1("disconnect X (pid %d)", callingPid);
 }
 
+// Binder calls come in on any of the service's threads, so each one that
+// changes layers binds its thread to this client's transaction while it
+// runs; a transaction opened by another client never stages these.
+
 status_t DisplayClient::requestSurface(const unsigned int sur)
 {ALOGE("%s %d\n", __FUNCTION__, __LINE__);
+	HwDisplay::TransactionBinding binding(mHwDisplay, this);
 	mHlay = mHwDisplay->hwd_layer_request((struct view_info *)sur);
 	return mHlay;
 }
 
 status_t DisplayClient::setPreviewBottom(const unsigned int hlay)
 {
+	HwDisplay::TransactionBinding binding(mHwDisplay, this);
 	return mHwDisplay->hwd_layer_bottom(hlay);
 }
 
 status_t DisplayClient::setPreviewRect(const unsigned int pRect)
 {
+	HwDisplay::TransactionBinding binding(mHwDisplay, this);
 	return mHwDisplay->hwd_layer_set_rect(mHlay, (struct view_info *)pRect);
 }
 
 
 status_t DisplayClient::releaseSurface(const unsigned int hlay)
 {
+	HwDisplay::TransactionBinding binding(mHwDisplay, this);
    return mHwDisplay->hwd_layer_release(mHlay);
 }
 
 status_t DisplayClient::exchangeSurface(const unsigned int hlay1, const unsigned int hlay2, const int otherOnTop)
 {
+	HwDisplay::TransactionBinding binding(mHwDisplay, this);
 	return mHwDisplay->hwd_layer_exchange(hlay1, hlay2, otherOnTop);
 }
 
 status_t DisplayClient::clearSurface(const unsigned int hlay1)
 {
+	HwDisplay::TransactionBinding binding(mHwDisplay, this);
 	return mHwDisplay->hwd_layer_clear(hlay1);
 }
 
 status_t DisplayClient::otherScreen(int screen, unsigned int hlay1, unsigned int hlay2)
 {
+	HwDisplay::TransactionBinding binding(mHwDisplay, this);
 	return mHwDisplay->hwd_layer_other_screen(screen, hlay1, hlay2);
 }
 
+status_t DisplayClient::beginTransaction()
+{
+	Mutex::Autolock lock(mLock);
+	mTransactionDepth++;
+	return mHwDisplay->hwd_begin_transaction(this);
+}
+
+status_t DisplayClient::commitTransaction()
+{
+	Mutex::Autolock lock(mLock);
+	if (mTransactionDepth <= 0) {
+		ALOGE("commitTransaction without beginTransaction");
+		return INVALID_OPERATION;
+	}
+	mTransactionDepth--;
+	return mHwDisplay->hwd_commit_transaction(this);
+}
+
+status_t DisplayClient::setPresentMode(const unsigned int hlay, const int mode)
+{
+	return mHwDisplay->hwd_layer_set_present_mode(hlay, mode);
+}
+
 status_t DisplayClient::openSurface(const unsigned int hlay, const int open)
 {
+	HwDisplay::TransactionBinding binding(mHwDisplay, this);
 	if (open) {
 		return mHwDisplay->hwd_layer_open(hlay);
 	} else {
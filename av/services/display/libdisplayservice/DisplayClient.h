@@ -46,12 +46,16 @@ public:
 	status_t otherScreen(const int screen, const unsigned int hlay1, const unsigned int hlay2);
 	status_t openSurface(const unsigned int hlay, const int open);
 	status_t clearSurface(const unsigned int hlay1);
+	status_t beginTransaction();
+	status_t commitTransaction();
+	status_t setPresentMode(const unsigned int hlay, const int mode);
 private:
 	status_t                checkPid() const;
 	mutable Mutex                   mLock;
 
 	HwDisplay* mHwDisplay;
 	int mHlay;
+	int mTransactionDepth;  // transactions this client left open
 };
 
 }
@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <sys/types.h>
+#include <unistd.h>
 #include <pthread.h>
 
 #include <binder/IPCThreadState.h>
@@ -36,6 +37,7 @@
 #include <utils/Errors.h>
 #include <utils/Log.h>
 #include <utils/String16.h>
+#include <utils/String8.h>
 
 #include "DisplayService.h"
 #include "DisplayClient.h"
@@ -190,6 +192,59 @@ status_t DisplayService::onTransact(
     return BnDisplayService::onTransact(code, data, reply, flags);
 }
 
+status_t DisplayService::dump(int fd, const Vector<String16>& args) {
+    const size_t SIZE = 256;
+    char buffer[SIZE];
+    String8 result;
+
+    if (checkCallingPermission(String16("android.permission.DUMP")) == false) {
+        snprintf(buffer, SIZE, "Permission Denial: "
+                "can't dump DisplayService from pid=%d, uid=%d\n",
+                getCallingPid(), getCallingUid());
+        result.append(buffer);
+        write(fd, result.string(), result.size());
+        return NO_ERROR;
+    }
+
+    struct hwd_stats stats;
+    HwDisplay::getInstance()->hwd_get_stats(&stats);
+    snprintf(buffer, SIZE, "HwDisplay:\n  ioctls: %u, config reads served from shadow: %u\n",
+            stats.ioctls, stats.shadow_reads);
+    result.append(buffer);
+    snprintf(buffer, SIZE, "  transactions: %u, ioctls per commit: last %u (%u layers), avg %.2f\n",
+            stats.commits, stats.last_commit_ioctls, stats.last_commit_layers,
+            stats.commits ? (double)stats.commit_ioctls / stats.commits : 0.0);
+    result.append(buffer);
+
+#ifdef DE_2
+    static const char *modeNames[] = { "immediate", "latest", "fifo" };
+    for (unsigned int hlay = 0; hlay < CHN_NUM * LYL_NUM; hlay++) {
+        struct hwd_layer_stats layer;
+        if (HwDisplay::getInstance()->hwd_get_layer_stats(hlay, &layer) != RET_OK
+                || (layer.mode == HWD_PRESENT_IMMEDIATE && layer.presented == 0)) {
+            continue;
+        }
+        snprintf(buffer, SIZE, "  layer %u (%s): presented %u, dropped %u, late %u, queued %u\n",
+                hlay, modeNames[layer.mode], layer.presented, layer.dropped, layer.late,
+                layer.queued);
+        result.append(buffer);
+    }
+#endif
+
+    // change logging level
+    for (size_t i = 0; i + 1 < args.size(); i++) {
+        if (args[i] == String16("-v")) {
+            String8 levelStr(args[i + 1]);
+            int level = atoi(levelStr.string());
+            snprintf(buffer, SIZE, "Set Log Level to %d\n", level);
+            result.append(buffer);
+            android_atomic_write(level, &gLogLevel);
+        }
+    }
+    write(fd, result.string(), result.size());
+    return NO_ERROR;
+}
+
 sp<DisplayService::Client> DisplayService::findClientUnsafe(
                         const wp<IBinder>& displayClient, int& outIndex) {
     sp<Client> client;
@@ -44,6 +44,7 @@ public:
 	virtual void        removeClient(const sp<IDisplayClient>& displayClient);
     virtual status_t    onTransact(uint32_t code, const Parcel& data,
                                    Parcel* reply, uint32_t flags);
+    virtual status_t    dump(int fd, const Vector<String16>& args);
     virtual void onFirstRef();
 
     class Client : public BnDisplay
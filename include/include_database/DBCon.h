@@ -2,29 +2,115 @@
 #define _DBCon_H
 #include "sqlite3.h"
 #include <utils/String8.h>
+#include <utils/Vector.h>
+#include <utils/KeyedVector.h>
+#include <utils/Mutex.h>
+#include <utils/Condition.h>
 #include <stdio.h>
 
+#define DB_STMT_CACHE_SIZE 16	/* per connection */
+#define DB_WAIT_BUCKETS 128		/* lock wait histogram, four per power of two */
+
 #define ERROR(f, l, x) ALOGE("%s() [%d], code=%d errmsg=%s\n", f, l, sqlite3_errcode(x),sqlite3_errmsg(x));
 namespace android {
 
 typedef struct sqlite3 SQLCon;
 
+struct db_lock_stats
+{
+	unsigned int reads;			/* lockRead calls that got the lock */
+	unsigned int writes;
+	unsigned int blocked;		/* had to wait for it */
+	unsigned int timeouts;
+	/* microseconds waited since the database was opened, within a quarter */
+	unsigned int readWaitP50;
+	unsigned int readWaitP99;
+	unsigned int writeWaitP50;
+	unsigned int writeWaitP99;
+	unsigned int maxWait;
+	int readers;				/* holding the lock now */
+	int queuedWriters;
+};
+
 class DBCon
 {
 public:
 	bool open(const char *dbName);
 	bool close(void);
 	SQLCon* getConnect(void);
+	/*
+	 * Reader/writer lock, blocking up to timeoutMs; 0 or -1 on timeout.
+	 * Writers are served in arrival order, one at a time, on the
+	 * getConnect() connection. Readers share the lock and, with a WAL
+	 * journal, run beside the writer on connections from openReader().
+	 * Otherwise they exclude the writer and use the write connection.
+	 * An exclusive writer also waits for the readers to leave.
+	 */
+	int lockRead(unsigned int timeoutMs);
+	void unlockRead(void);
+	int lockWrite(unsigned int timeoutMs, bool exclusive = false);
+	void unlockWrite(void);
+	/* try the write lock once, true if it is taken */
 	bool lock(void);
 	void unlock(void);
+	void getLockStats(struct db_lock_stats *stats);
+	/* read only connection for one DBCtrl, NULL unless the journal is WAL */
+	SQLCon *openReader(void);
+	void closeReader(SQLCon *con);
+	bool isWal(void);
+	/*
+	 * one instance per database file, shared by every DBCtrl on it and
+	 * freed with the last of them
+	 */
 	static DBCon* getInstance(const char *dbName);
 	void freeInstance();
+	/*
+	 * prepared statements cached by connection and SQL text, hand back with
+	 * putStatement. con defaults to the write connection; the caller must
+	 * hold the lock that goes with it.
+	 */
+	sqlite3_stmt *getStatement(const String8 &sql, SQLCon *con = NULL);
+	void putStatement(sqlite3_stmt *stmt);
+	void clearStatements(void);
+	/* needs the exclusive write lock and no statement running */
+	int setJournalMode(bool wal);
 private:
 	DBCon(const char *dbName);
 	~DBCon();
-	static DBCon* mDBCon;
+	struct stmt_entry
+	{
+		SQLCon *con;
+		String8 sql;
+		sqlite3_stmt *stmt;
+		bool busy;
+		unsigned int lastUse;
+	};
+	bool waitUntil(nsecs_t deadline);
+	void addWait(unsigned int *histogram, nsecs_t start);
+	void finalizeStatements(SQLCon *con);
+	static KeyedVector<String8, DBCon*> mInstances;	/* by resolved path */
+	static Mutex mInstanceLock;
+	int mRefs;					/* guarded by mInstanceLock */
+	String8 mKey;				/* mInstances key */
+	String8 mPath;
 	SQLCon *mSQLCon;
-	bool mLock;
+
+	Mutex mStateLock;			/* guards the lock state and statistics */
+	Condition mStateCond;
+	bool mWriter;				/* write lock held */
+	bool mWriterExclusive;
+	int mExclusive;				/* exclusive writers queued or holding */
+	int mReaders;
+	Vector<unsigned int> mWriteQueue;	/* tickets of waiting writers, oldest first */
+	unsigned int mNextTicket;
+	bool mWal;
+	struct db_lock_stats mStats;
+	unsigned int mReadWait[DB_WAIT_BUCKETS];
+	unsigned int mWriteWait[DB_WAIT_BUCKETS];
+
+	Mutex mStmtLock;			/* guards the cache, not the statements */
+	Vector<stmt_entry> mStmtCache;
+	unsigned int mStmtClock;
 };
 }
 #endif //_DBCon_H
@@ -24,15 +24,98 @@ struct sql_tb
     char type[32];
 };
 
+/*
+ * Typed columns DBCtrl keeps in tables with "file" and "time" columns,
+ * filled in on insert and indexed as (category, time, file) and (time, file).
+ * category is what getElementList's filetype selects.
+ */
+enum
+{
+	DB_CATEGORY_OTHER = 0,
+	DB_CATEGORY_FRONT,		/* front camera video */
+	DB_CATEGORY_REAR,		/* rear camera video */
+	DB_CATEGORY_SOS,		/* locked event video */
+	DB_CATEGORY_PHOTO
+};
+
+enum
+{
+	DB_CAMERA_UNKNOWN = -1,
+	DB_CAMERA_FRONT,
+	DB_CAMERA_REAR
+};
+
+enum
+{
+	DB_KIND_OTHER = 0,
+	DB_KIND_VIDEO,
+	DB_KIND_PHOTO
+};
+
+#define DB_MEDIA_EXPRS 4	/* category, camera, event, kind */
+
+#define DB_ROW_MAX_COLUMNS 16
+#define DB_LIST_MAX_KEYS 3
+
+/* one column of a row read by cursorNext, typed by setColumnType */
+struct db_value
+{
+	DBC_TYPE type;
+	union {
+		unsigned int	u32;
+		long long		i64;
+		unsigned short	u16;
+		unsigned char	u8;
+		float			f;
+		double			d;
+		const char		*text;	/* valid until the next cursorNext */
+		const void		*blob;
+	};
+	int bytes;				/* length of text or blob */
+};
+
+struct db_row
+{
+	int count;
+	struct db_value value[DB_ROW_MAX_COLUMNS];
+};
+
 class DBCtrl
 {
 public:
-	DBCtrl();
+	/* dbPath only matters for the first DBCtrl, the connection is shared */
+	DBCtrl(const char *dbPath = NULL);
 	~DBCtrl();
 	void setSQL(const String8 sql);
 	String8 getSQL(void) const;
 	String8 getTableName(void) const;
 	int insertRecord(void);
+	/*
+	 * Batches, each run in one transaction with one prepared statement.
+	 * insertRecords takes rows * column count value pointers, row by row,
+	 * in the order of the table columns. sizes and durations, if given,
+	 * hold the file_size and duration of each row; without sizes the
+	 * files are stat()ed. tailSQL, if given, runs after the rows in the
+	 * same transaction and is committed or rolled back with them.
+	 * deleteRecords removes the rows whose columnName equals one of the
+	 * num values.
+	 */
+	int insertRecords(void *pValues[], int rows, const long long *sizes = NULL,
+			const unsigned int *durations = NULL, const char *tailSQL = NULL);
+	int deleteRecords(String8 columnName, DBC_TYPE type, void *pValues[], int num);
+	/*
+	 * WAL journal with synchronous=NORMAL, or the default rollback journal.
+	 * With WAL each DBCtrl reads on its own connection, beside the writer.
+	 */
+	int setJournalMode(bool wal);
+	/* waits for the database lock, shared by all DBCtrl objects */
+	void getLockStats(struct db_lock_stats *stats);
+	/*
+	 * duration and file_size columns of the row the next insertRecord
+	 * adds. Without setRecordSize the file is stat()ed.
+	 */
+	void setRecordDuration(unsigned int durationMs);
+	void setRecordSize(long long bytes);
 	int bufPrepare(void);
 	void bufRelease(void);
 	int prepare(void);
@@ -51,7 +134,65 @@ public:
 	void setColumnType(DBC_TYPE *type, int *typeSize);
 	void setFilter(const String8 filter);
 	int deleteTable(String8 tbName);
+	/*
+	 * Cursor over a query, read in one pass instead of a LIMIT n,1 query
+	 * per row. cursorOpen() selects the setRecord columns matching the
+	 * filter; the second form selects one column of the file list like
+	 * getElementList. cursorNext returns SQLITE_ROW, SQLITE_DONE or an error.
+	 */
+	int cursorOpen(void);
+	int cursorOpen(String8 columnName, int columnIdx, int filetype);
+	int cursorNext(struct db_row *row);
+	void cursorClose(void);
 private:
+	struct db_cursor
+	{
+		sqlite3_stmt *stmt;
+		String8 sql;
+		DBC_TYPE type[DB_ROW_MAX_COLUMNS];
+		int columns;
+		unsigned int row;		/* index of the row the next step returns */
+	};
+	/*
+	 * Where the last getElement call left off: the order keys of the row
+	 * it returned. Its statement is reset, the next row is found by a
+	 * range seek past these keys.
+	 */
+	struct db_list_pos
+	{
+		String8 sql;			/* query the keys were read with */
+		unsigned int row;		/* index of the row after them */
+		int keys;				/* 0 if there is nothing to seek from */
+		int type[DB_LIST_MAX_KEYS];	/* SQLITE_INTEGER, SQLITE_FLOAT or SQLITE_TEXT */
+		long long i64[DB_LIST_MAX_KEYS];
+		double d[DB_LIST_MAX_KEYS];
+		String8 text[DB_LIST_MAX_KEYS];
+	};
+	int waitLock(void);
+	SQLCon *readConnection(void);
+	bool sharesLock(SQLCon *con);
+	int lockConnection(SQLCon *con);
+	void unlockConnection(SQLCon *con);
+	int runBatch(const String8 &sql, const DBC_TYPE *type, const int *typeSize,
+			int columns, void *pValues[], int rows,
+			const long long *sizes, const unsigned int *durations,
+			const char *tailSQL);
+	int bindMediaColumns(sqlite3_stmt *stmt, long long size, unsigned int durationMs);
+	void mediaColumnsSQL(const char *file, String8 expr[DB_MEDIA_EXPRS]);
+	int createMediaIndex(void);
+	int createMediaTrigger(const char *name, const char *event, const char *when);
+	int cursorStart(struct db_cursor *cursor, SQLCon *con, const String8 &sql,
+			const DBC_TYPE *type, int columns, unsigned int offset);
+	int cursorStep(struct db_cursor *cursor, struct db_row *row);
+	void cursorStop(struct db_cursor *cursor);
+	void cursorRelease(struct db_cursor *cursor);
+	void *cursorElement(const String8 &columnName, const String8 &filter,
+			const char *const keys[], int keyCount, bool desc,
+			int columnIdx, unsigned int rowNumber);
+	void *storeResult(const struct db_value *value, int columnIdx);
+	String8 createListSQL(String8 columnName, int filetype);
+	String8 createListFilter(int filetype);
+	void listKeys(const char *const **keys, int *keyCount);
 	void setTableName(const String8 name);
 	void setColumnCnt(const int num);
 	void createRequerySQL(void);
@@ -62,13 +203,20 @@ private:
 	int mTmpNum;
 	DBC_TYPE *mColumnType;
 	int *mColumnTypeSize;
-	unsigned int *mValue;
+	void **mValue;
 	String8 *mColumnName;
 	unsigned char *mFieldKey;
 	SQLCon *mSQLCon;
+	SQLCon *mReadCon;				/* ours alone, opened once the journal is WAL */
 	DBCon *mDBCon;
 	sqlite3_stmt *mSqlstmt;
 	String8 mFilter;
+	struct db_cursor mCursor;		/* cursorOpen */
+	struct db_list_pos mListPos;
+	bool mMediaIndex;				/* table has the typed media columns */
+	int mFileColumn;				/* "file" in the last insert, -1 if none */
+	unsigned int mDuration;
+	long long mSize;				/* -1 until setRecordSize */
 
 	unsigned int	result_uint32;
 	long long		result_int64;
@@ -0,0 +1,130 @@
+#ifndef _DBWRITER_H
+#define _DBWRITER_H
+#include <stdint.h>
+#include <sys/types.h>
+#include <utils/Thread.h>
+#include <utils/Mutex.h>
+#include <utils/Condition.h>
+#include <utils/String8.h>
+#include "DBCtrl.h"
+
+#define DB_WRITER_QUEUE_SIZE 64			/* power of two */
+#define DB_WRITER_MAX_PENDING 256		/* rows logged but not committed yet */
+#define DB_WRITER_TEXT_MAX 256			/* all text columns of a row together */
+#define DB_WRITER_BATCH_ROWS 32
+#define DB_WRITER_INTERVAL_MS 2000
+#define DB_WRITER_SEQ_TABLE "dbwriter_seq"	/* table name, last committed sequence number */
+
+namespace android {
+
+/* one row, copied out of the caller's values by enqueue */
+struct db_writer_record
+{
+	long long seq;			/* order in the replay log, set by the thread */
+	union {
+		unsigned int	u32;
+		long long		i64;
+		unsigned short	u16;
+		unsigned char	u8;
+		float			f;
+		double			d;
+		unsigned short	text;	/* offset in text[] */
+	} value[DB_ROW_MAX_COLUMNS];
+	char text[DB_WRITER_TEXT_MAX];
+};
+
+struct db_writer_stats
+{
+	unsigned int enqueued;
+	unsigned int full;			/* enqueue refused, the queue was full */
+	unsigned int committed;
+	unsigned int failed;		/* rows the database rejected */
+	unsigned int replayed;		/* rows of the log inserted by start */
+	unsigned int batches;
+	unsigned int maxBatch;
+	unsigned int maxCommitUs;
+};
+
+/*
+ * Write-behind inserts for one table. enqueue copies the row into a
+ * lock-free queue and returns without touching the database; a thread
+ * appends the rows to a replay log and commits them with insertRecords,
+ * DB_WRITER_BATCH_ROWS at a time or every DB_WRITER_INTERVAL_MS.
+ * Rows logged but not committed when the process dies are inserted by
+ * the next start(); rows still in the queue are lost, which is at most
+ * the time the thread takes to wake up. Keep the log off the SD card.
+ * Every batch stores the sequence number of its last row in the
+ * DB_WRITER_SEQ_TABLE table of the same database, in the same
+ * transaction, so the replay skips rows committed just before the crash.
+ */
+class DBWriter : public Thread
+{
+public:
+	/* tb and type as for DBCtrl::createTable and setColumnType */
+	DBWriter(const char *dbPath, const String8 &table, struct sql_tb *tb,
+			DBC_TYPE *type, int columns, const char *logPath = NULL);
+	virtual ~DBWriter();
+	/* creates the table, replays the log and starts the thread */
+	status_t start(void);
+	/* same values as DBCtrl::insertRecords takes for one row, -1 if full */
+	int enqueue(void *pValues[]);
+	/* waits until the rows enqueued so far are committed, 0 or -1 */
+	int flush(unsigned int timeoutMs);
+	/* flushes and ends the thread, enqueue fails afterwards */
+	void stop(void);
+	void setBatch(unsigned int rows, unsigned int intervalMs);
+	void getStats(struct db_writer_stats *stats);
+private:
+	struct queue_cell
+	{
+		volatile int32_t seq;
+		struct db_writer_record record;
+	};
+	virtual bool threadLoop();
+	bool queueEmpty(void);
+	void drain(void);
+	int commit(void);
+	int commitRows(int first, int rows, unsigned int *failed);
+	long long committedSeq(void);
+	void replay(void);
+	void fillValues(struct db_writer_record *record, void **values);
+	String8 mDBPath;
+	String8 mLogPath;
+	String8 mTable;
+	struct sql_tb *mTb;
+	DBC_TYPE *mType;
+	int mColumns;
+	uint32_t mLayout;
+	DBCtrl *mDB;
+	int mLogFd;
+
+	struct queue_cell *mQueue;
+	volatile int32_t mHead;			/* next position enqueue claims */
+	int32_t mTail;					/* next position the thread takes */
+	volatile int32_t mSleeping;		/* the thread waits for mWakeCond */
+	volatile int32_t mStopped;
+	volatile int32_t mFull;
+	bool mStarted;
+
+	struct db_writer_record *mPending;
+	int mPendingCnt;
+	nsecs_t mPendingSince;
+	void **mValues;
+	long long mSeq;					/* last sequence number given out */
+	long long mCommittedSeq;		/* read at start, rows up to it are in the table */
+	off_t mReplayOffset;			/* where the replay goes on while mKeepLog */
+	bool mKeepLog;					/* replay failed, the log has rows not read yet */
+	unsigned int mRetryMs;			/* delay before retrying a failed commit */
+
+	Mutex mLock;
+	Condition mWakeCond;
+	Condition mFlushCond;
+	int32_t mDone;					/* positions committed or rejected */
+	int mFlushWaiters;
+	unsigned int mBatchRows;
+	unsigned int mIntervalMs;
+	struct db_writer_stats mStats;
+};
+
+}
+#endif //_DBWRITER_H
@@ -54,6 +54,11 @@ public:
 	status_t open(unsigned int hlay, int open);
 	status_t openAdasScreen(unsigned int hlay, int open);	
 	status_t clearSurface(unsigned int hlay1);
+	// Layer changes between begin and commit are applied on the same vsync,
+	// e.g. when switching between front and rear camera layouts.
+	status_t beginTransaction();
+	status_t commitTransaction();
+	status_t setPresentMode(unsigned int hlay, int mode);
 private:
 	int mId;
     static const String8 TAG;   // = "CedarHwLayer";
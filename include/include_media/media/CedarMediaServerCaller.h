@@ -15,6 +15,8 @@ public:
 
     sp<IMemory> jpegDecode(int fd);
     sp<IMemory> jpegDecode(String8 path);
+    // RGB565 VideoFrame fitted into width x height, see IMediaServerCaller
+    sp<IMemory> jpegDecodeThumbnail(String8 path, int width, int height);
 
 private:
     sp<MediaServerCaller> mCaller;
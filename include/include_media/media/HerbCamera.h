@@ -373,7 +373,7 @@ public:
      */
     void setOneShotPreviewCallback(PreviewCallback *pCb);
 private:
-    void setHasPreviewCallback(bool installed, bool manualBuffer);
+    void setHasPreviewCallback(bool installed, bool manualBuffer, int sharedBufferNum = 0);
 public:
     /**
      * <p>Installs a callback to be invoked for every preview frame, using
@@ -475,6 +475,38 @@ public:
      * {@hide}
      */
     void addRawImageCallbackBuffer(sp<CMediaMemory> &callbackBuffer);
+    /**
+     * AW extend.
+     * <p>Installs a callback to be invoked for every preview frame without
+     * copy or allocation in this process. The data given to
+     * {@link PreviewCallback#onPreviewFrame} points into the shared buffer of
+     * camera service, it is valid until {@link #releasePreviewFrame} is called
+     * with it. Camera service keeps bufferNum such buffers, frames are
+     * dropped when all of them are not released.</p>
+     *
+     * <p>Other preview callback setters leave this mode, frames not released
+     * yet are given back then.</p>
+     *
+     * @param cb a callback object that receives the preview frame,
+     *     or null to stop receiving callbacks.
+     * @param bufferNum number of shared buffers, see
+     *     CameraParameters::KEY_AWEXTEND_PREVIEW_CALLBACK_BUFFER_NUM.
+     * @see #releasePreviewFrame(const void*)
+     */
+    void setPreviewCallbackWithSharedBuffer(PreviewCallback *pCb, int bufferNum);
+    /**
+     * AW extend.
+     * Gives back a frame got by the callback installed by
+     * {@link #setPreviewCallbackWithSharedBuffer}.
+     *
+     * @param data the data pointer given to onPreviewFrame().
+     */
+    void releasePreviewFrame(const void *data);
+    enum
+    {
+        // arg1 of CAMERA_MSG_PREVIEW_FRAME event, obj is sp<IMemory>* of camera service.
+        PREVIEW_FRAME_SHARED = 1,
+    };
 private:
     void addCallbackBuffer(sp<CMediaMemory> &callbackBuffer, int msgType);
     void _addCallbackBuffer(sp<CMediaMemory> &callbackBuffer, int msgType);
@@ -100,6 +100,9 @@ public:
 	int nFrameIndex;    //index of current frame in gop.
 	int nTotalIndex;    //index of current frame in whole encoded frames.
 	char *data;
+	bool keyFrame;      //only valid for getBsFrames().
+	long long seq;      //only valid for getBsFrames(), see freeBsFrames().
+	sp<IMemoryHeap> heap;   //keep data mapped, only valid for getBsFrames().
 };
 
 
@@ -123,6 +126,7 @@ private:
 
 	static Mutex msLock;
 	int64_t mLength;
+	sp<IMemoryHeap> mBsFrameHeap;  //keep recorder's bs ring mapped between frames.
 
 	class EventHandler : public MediaCallbackDispatcher
 	{
@@ -870,6 +874,39 @@ public:
     void setOnDataListener(OnDataListener *pListener);
 	sp<VEncBuffer> getOneBsFrame(int mode, sp<IMemory> *frame);
 	void freeOneBsFrame(sp<VEncBuffer> recData, sp<IMemory> frame);
+    /**
+     * Add one more reader of encoded frames, e.g., RTSP, cloud upload.
+     * Every consumer has its own read cursor, a slow consumer only loses
+     * its own frames by dropPolicy and never blocks others or the encoder.
+     *
+     * @return consumerId > 0 if success.
+     * @param dropPolicy BSCONSUMER_DROP_OLDEST or BSCONSUMER_SKIP_TO_KEYFRAME.
+     */
+	int registerBsConsumer(int dropPolicy);
+	status_t unregisterBsConsumer(int consumerId);
+	status_t getBsConsumerStatus(int consumerId, BsConsumerStatus *pStatus);
+    /**
+     * Get all queued frames (maxFrames at most) in one binder transaction.
+     * If no frame is queued, wait timeoutMs for the next one.
+     * Frames must be returned by freeBsFrames().
+     *
+     * @return OK if success, frames may be empty.
+     */
+	status_t getBsFrames(int maxFrames, int timeoutMs, Vector<sp<VEncBuffer> > *frames, int consumerId=BS_DEFAULT_CONSUMER);
+    /**
+     * Return lastFrame and every frame got before it. A frame held too long
+     * may be taken back by the recorder first, MEDIA_RECORDER_INFO_BSFRAME_FORCED_RELEASE
+     * is sent then, and freeing it later is harmless.
+     */
+	status_t freeBsFrames(const sp<VEncBuffer> &lastFrame, int consumerId=BS_DEFAULT_CONSUMER);
+    /**
+     * Block until minFrames frames are queued, or a key frame is queued when
+     * waitFlags has BSFRAME_WAIT_KEYFRAME, or timeoutMs passed.
+     *
+     * @return OK if condition is satisfied, TIMED_OUT if timeout.
+     * @param pQueuedFrames number of queued frames when return, can be NULL.
+     */
+	status_t waitBsFrames(int minFrames, int waitFlags, int timeoutMs, int *pQueuedFrames, int consumerId=BS_DEFAULT_CONSUMER);
 	sp<IMemory> getEncDataHeader();
     /** 
      *      AW extend
@@ -911,6 +948,18 @@ public:
     status_t removeOutputFormatAndOutputSink(int muxerId);
     status_t setOutputFileSync(int fd, int64_t fallocateLength=0, int muxerId=0);
 	status_t setOutputFileSync(char* path, int64_t fallocateLength=0, int muxerId=0);
+    /**
+     *      AW extend
+     * Create and preallocate the next segment file in background, before it is given
+     * to setOutputFileSync(). Then file switching needn't preallocate on the recording
+     * path. Several files can be prepared ahead.
+     *
+     * @return if success.
+     * @param fd/path next output file.
+     * @param fallocateLength bytes to preallocate, same as setOutputFileSync().
+     */
+    status_t prepareOutputFile(int fd, int64_t fallocateLength);
+    status_t prepareOutputFile(char* path, int64_t fallocateLength);
 private:
     static void postEventFromNative(HerbMediaRecorder *pMr, int what, int arg1, int arg2, void *obj=NULL);
     status_t setOutputFileFd(int fd, long offset, long length);
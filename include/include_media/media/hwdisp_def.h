@@ -43,6 +43,19 @@ struct surface
 	struct view_info view;
 };
 
+// How frames rendered to a layer reach the screen.
+enum
+{
+	HWD_PRESENT_IMMEDIATE   = 0,    // set on the layer at once (default)
+	HWD_PRESENT_LATEST      = 1,    // newest frame at each vsync, older ones dropped
+	HWD_PRESENT_FIFO        = 2     // every frame in order, one per vsync
+};
+
+// Frames a LATEST or FIFO layer holds back. Its renderer must not reuse
+// any of the last HWD_PRESENT_QUEUE_DEPTH + 1 buffers it rendered, unless
+// a release callback tells it which are free, see hwdisplay.h.
+#define HWD_PRESENT_QUEUE_DEPTH 4
+
 #ifndef E_HWC_FORMAT
 #define E_HWC_FORMAT
 enum e_hwc_format
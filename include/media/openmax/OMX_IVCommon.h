@@ -157,6 +157,10 @@ typedef enum OMX_COLOR_FORMATTYPE {
      * an acceptable range once that is done.
      * */
     OMX_COLOR_FormatAndroidOpaque = 0x7F000789,
+    /**<Reserved android colorformat, 32 bit RGBA with R in the lowest byte
+     * (R, G, B, A in memory order), the layout of HAL_PIXEL_FORMAT_RGBA_8888.
+     * */
+    OMX_COLOR_Format32BitRGBA8888 = 0x7F00A000,
     OMX_TI_COLOR_FormatYUV420PackedSemiPlanar = 0x7F000100,
     OMX_QCOM_COLOR_FormatYVU420SemiPlanar = 0x7FA30C00,
     OMX_QCOM_COLOR_FormatYUV420PackedSemiPlanar64x32Tile2m8ka = 0x7FA30C03,
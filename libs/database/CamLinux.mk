@@ -15,7 +15,8 @@
 # we have the common sources, plus some device-specific stuff
 sources := \
 DBCon.cpp \
-DBCtrl.cpp 
+DBCtrl.cpp \
+DBWriter.cpp
 	
 LOCAL_PATH:= $(call my-dir)
 
@@ -31,3 +32,17 @@ LOCAL_SHARED_LIBRARIES := \
 
 LOCAL_SRC_FILES := $(sources)
 include $(BUILD_SHARED_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	tests/database_bench.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libutils \
+	libdatabase
+
+LOCAL_MODULE := database_bench
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
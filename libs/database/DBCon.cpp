@@ -1,4 +1,9 @@
 #include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <utils/Timers.h>
 #include "include_database/DBCon.h"
 #undef LOG_NDEBUG
 #undef NDEBUG
@@ -7,7 +12,11 @@
 
 namespace android {
 
-DBCon* DBCon::mDBCon = NULL;
+KeyedVector<String8, DBCon*> DBCon::mInstances;
+Mutex DBCon::mInstanceLock;
+
+/* for locks taken outside this process, e.g. by a WAL checkpoint */
+#define DB_BUSY_TIMEOUT_MS 200
 
 bool DBCon::open(const char *dbName)
 {
@@ -16,12 +25,26 @@ bool DBCon::open(const char *dbName)
 	unsigned int count = 0;
 
 	mSQLCon = NULL;
-	if (SQLITE_OK != sqlite3_open(dbName, &mSQLCon)) {
+	mPath = dbName;
+	/* readers without WAL share this connection between threads */
+	if (SQLITE_OK != sqlite3_open_v2(dbName, &mSQLCon,
+			SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX, NULL)) {
 		ERROR(__FUNCTION__, __LINE__, mSQLCon);
 		mSQLCon = NULL;
 		ret = false;
 	}
 	ALOGD("after sqlite3_open: mSQLCon is %p, ret is %d\n", mSQLCon, ret);
+	if (mSQLCon) {
+		sqlite3_stmt *stmt = NULL;
+		sqlite3_busy_timeout(mSQLCon, DB_BUSY_TIMEOUT_MS);
+		/* WAL is a property of the file, it outlives the connection */
+		if (SQLITE_OK == sqlite3_prepare_v2(mSQLCon, "PRAGMA journal_mode", -1, &stmt, NULL)
+				&& SQLITE_ROW == sqlite3_step(stmt)) {
+			const unsigned char *mode = sqlite3_column_text(stmt, 0);
+			mWal = mode && !strcasecmp((const char *)mode, "wal");
+		}
+		sqlite3_finalize(stmt);
+	}
 	return true;
 }
 
@@ -29,6 +52,7 @@ bool DBCon::close(void)
 {
 	bool ret = true;
 
+	clearStatements();
 	if (SQLITE_OK != sqlite3_close(mSQLCon)) {
 		ERROR(__FUNCTION__, __LINE__, mSQLCon);
 		ret = false;
@@ -46,46 +70,427 @@ SQLCon* DBCon::getConnect(void)
 	return mSQLCon;
 }
 
-bool DBCon::lock(void)
+/* false once the deadline has passed, else wait for a state change */
+bool DBCon::waitUntil(nsecs_t deadline)
+{
+	nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+	if (now >= deadline) {
+		return false;
+	}
+	mStateCond.waitRelative(mStateLock, deadline - now);
+	return true;
+}
+
+/* 0-3 us exactly, then four buckets per power of two */
+static unsigned int waitBucket(unsigned int us)
+{
+	unsigned int shift = 0;
+
+	if (us < 4) {
+		return us;
+	}
+	while ((us >> shift) >= 8) {
+		shift++;
+	}
+	return (shift + 1) * 4 + ((us >> shift) & 3);
+}
+
+static unsigned int bucketLimit(unsigned int bucket)
+{
+	unsigned int shift;
+
+	if (bucket < 4) {
+		return bucket;
+	}
+	shift = bucket / 4 - 1;
+	return (unsigned int)(((unsigned long long)(4 + (bucket & 3) + 1) << shift) - 1);
+}
+
+void DBCon::addWait(unsigned int *histogram, nsecs_t start)
+{
+	unsigned int us = (unsigned int)((systemTime(SYSTEM_TIME_MONOTONIC) - start) / 1000);
+
+	histogram[waitBucket(us)]++;
+	if (us > 0) {
+		mStats.blocked++;
+	}
+	if (us > mStats.maxWait) {
+		mStats.maxWait = us;
+	}
+}
+
+int DBCon::lockRead(unsigned int timeoutMs)
+{
+	nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+	nsecs_t deadline = start + milliseconds_to_nanoseconds(timeoutMs);
+	Mutex::Autolock _l(mStateLock);
+
+	/* queued writers go first, or a stream of readers would starve them */
+	while ((!mWal || mExclusive) && (mWriter || !mWriteQueue.isEmpty())) {
+		if (!waitUntil(deadline)) {
+			mStats.timeouts++;
+			return -1;
+		}
+	}
+	mReaders++;
+	mStats.reads++;
+	addWait(mReadWait, start);
+	return 0;
+}
+
+void DBCon::unlockRead(void)
+{
+	Mutex::Autolock _l(mStateLock);
+
+	mReaders--;
+	if (mReaders == 0) {
+		mStateCond.broadcast();
+	}
+}
+
+int DBCon::lockWrite(unsigned int timeoutMs, bool exclusive)
+{
+	nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+	nsecs_t deadline = start + milliseconds_to_nanoseconds(timeoutMs);
+	Mutex::Autolock _l(mStateLock);
+	unsigned int ticket = mNextTicket++;
+	size_t i;
+
+	mWriteQueue.add(ticket);
+	if (exclusive) {
+		mExclusive++;
+	}
+	while (mWriter || mWriteQueue[0] != ticket
+			|| ((!mWal || exclusive) && mReaders > 0)) {
+		if (!waitUntil(deadline)) {
+			for (i = 0; i < mWriteQueue.size(); i++) {
+				if (mWriteQueue[i] == ticket) {
+					mWriteQueue.removeAt(i);
+					break;
+				}
+			}
+			if (exclusive) {
+				mExclusive--;
+			}
+			mStats.timeouts++;
+			/* the next writer or the readers held back for us may go */
+			mStateCond.broadcast();
+			return -1;
+		}
+	}
+	mWriteQueue.removeAt(0);
+	mWriter = true;
+	mWriterExclusive = exclusive;
+	mStats.writes++;
+	addWait(mWriteWait, start);
+	return 0;
+}
+
+void DBCon::unlockWrite(void)
 {
-	if (mLock) {
-		return true;
+	Mutex::Autolock _l(mStateLock);
+
+	mWriter = false;
+	if (mWriterExclusive) {
+		mExclusive--;
+		mWriterExclusive = false;
 	}
-	mLock = true;
-	return false;
+	mStateCond.broadcast();
+}
+
+bool DBCon::lock(void)
+{
+	return lockWrite(0) != 0;
 }
 
 void DBCon::unlock(void)
 {
-	mLock = false;
+	unlockWrite();
+}
+
+/* nearest rank percentile, as the upper end of its bucket */
+static unsigned int percentile(const unsigned int *histogram, unsigned int p)
+{
+	unsigned long long total = 0, rank, seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < DB_WAIT_BUCKETS; i++) {
+		total += histogram[i];
+	}
+	if (total == 0) {
+		return 0;
+	}
+	rank = (total * p + 99) / 100;
+	for (i = 0; i < DB_WAIT_BUCKETS; i++) {
+		seen += histogram[i];
+		if (seen >= rank) {
+			break;
+		}
+	}
+	return bucketLimit(i);
+}
+
+void DBCon::getLockStats(struct db_lock_stats *stats)
+{
+	Mutex::Autolock _l(mStateLock);
+
+	*stats = mStats;
+	stats->readers = mReaders;
+	stats->queuedWriters = mWriteQueue.size();
+	stats->readWaitP50 = percentile(mReadWait, 50);
+	stats->readWaitP99 = percentile(mReadWait, 99);
+	stats->writeWaitP50 = percentile(mWriteWait, 50);
+	stats->writeWaitP99 = percentile(mWriteWait, 99);
+}
+
+bool DBCon::isWal(void)
+{
+	Mutex::Autolock _l(mStateLock);
+	return mWal;
+}
+
+SQLCon *DBCon::openReader(void)
+{
+	SQLCon *con = NULL;
+
+	if (!isWal()) {
+		return NULL;
+	}
+	if (SQLITE_OK != sqlite3_open_v2(mPath.string(), &con, SQLITE_OPEN_READONLY, NULL)) {
+		ERROR(__FUNCTION__, __LINE__, con);
+		sqlite3_close(con);
+		return NULL;
+	}
+	sqlite3_busy_timeout(con, DB_BUSY_TIMEOUT_MS);
+	return con;
+}
+
+void DBCon::closeReader(SQLCon *con)
+{
+	if (!con || con == mSQLCon) {
+		return;
+	}
+	finalizeStatements(con);
+	if (SQLITE_OK != sqlite3_close(con)) {
+		ERROR(__FUNCTION__, __LINE__, con);
+	}
+}
+
+sqlite3_stmt *DBCon::getStatement(const String8 &sql, SQLCon *con)
+{
+	sqlite3_stmt *stmt = NULL;
+	int lru = -1;
+	size_t i, count;
+
+	if (!con) {
+		con = mSQLCon;
+	}
+	{
+		Mutex::Autolock _l(mStmtLock);
+		for (i = 0; i < mStmtCache.size(); i++) {
+			stmt_entry &entry = mStmtCache.editItemAt(i);
+			if (entry.con != con) {
+				continue;
+			}
+			if (!entry.busy && entry.sql == sql) {
+				entry.busy = true;
+				entry.lastUse = ++mStmtClock;
+				return entry.stmt;
+			}
+		}
+	}
+
+	/* con is ours, only the cache is shared */
+	if (SQLITE_OK != sqlite3_prepare_v2(con, sql.string(), -1, &stmt, NULL)) {
+		ERROR(__FUNCTION__, __LINE__, con);
+		return NULL;
+	}
+	stmt_entry entry;
+	entry.con = con;
+	entry.sql = sql;
+	entry.stmt = stmt;
+	entry.busy = true;
+
+	Mutex::Autolock _l(mStmtLock);
+	entry.lastUse = ++mStmtClock;
+	count = 0;
+	for (i = 0; i < mStmtCache.size(); i++) {
+		const stmt_entry &e = mStmtCache[i];
+		if (e.con != con) {
+			continue;
+		}
+		count++;
+		if (!e.busy && (lru < 0 || e.lastUse < mStmtCache[lru].lastUse)) {
+			lru = i;
+		}
+	}
+	if (count < DB_STMT_CACHE_SIZE) {
+		mStmtCache.add(entry);
+	} else if (lru >= 0) {
+		sqlite3_finalize(mStmtCache[lru].stmt);
+		mStmtCache.replaceAt(entry, lru);
+	}
+	/* else every cached statement is in use, this one is finalized on put */
+	return stmt;
+}
+
+void DBCon::putStatement(sqlite3_stmt *stmt)
+{
+	size_t i;
+
+	if (!stmt) {
+		return;
+	}
+	Mutex::Autolock _l(mStmtLock);
+	for (i = 0; i < mStmtCache.size(); i++) {
+		stmt_entry &entry = mStmtCache.editItemAt(i);
+		if (entry.stmt == stmt) {
+			sqlite3_reset(stmt);
+			sqlite3_clear_bindings(stmt);
+			entry.busy = false;
+			return;
+		}
+	}
+	sqlite3_finalize(stmt);
+}
+
+void DBCon::clearStatements(void)
+{
+	Mutex::Autolock _l(mStmtLock);
+	size_t i;
+
+	for (i = 0; i < mStmtCache.size(); i++) {
+		sqlite3_finalize(mStmtCache[i].stmt);
+	}
+	mStmtCache.clear();
+}
+
+void DBCon::finalizeStatements(SQLCon *con)
+{
+	Mutex::Autolock _l(mStmtLock);
+	size_t i = 0;
+
+	while (i < mStmtCache.size()) {
+		if (mStmtCache[i].con == con) {
+			sqlite3_finalize(mStmtCache[i].stmt);
+			mStmtCache.removeAt(i);
+		} else {
+			i++;
+		}
+	}
+}
+
+int DBCon::setJournalMode(bool wal)
+{
+	sqlite3_stmt *stmt = NULL;
+	const unsigned char *mode = NULL;
+	int errorCode;
+
+	errorCode = sqlite3_prepare_v2(mSQLCon, wal ? "PRAGMA journal_mode=WAL"
+			: "PRAGMA journal_mode=DELETE", -1, &stmt, NULL);
+	if (SQLITE_OK == errorCode && SQLITE_ROW == sqlite3_step(stmt)) {
+		mode = sqlite3_column_text(stmt, 0);
+	}
+	/* the pragma answers with the mode in effect, which may be unchanged */
+	if (!mode || strcasecmp((const char *)mode, wal ? "wal" : "delete") != 0) {
+		ALOGE("fail to set journal mode %s, still %s\n", wal ? "wal" : "delete",
+				mode ? (const char *)mode : "unknown");
+		sqlite3_finalize(stmt);
+		return SQLITE_ERROR;
+	}
+	sqlite3_finalize(stmt);
+	{
+		Mutex::Autolock _l(mStateLock);
+		mWal = wal;
+	}
+
+	/* WAL only needs to sync at checkpoints to stay consistent */
+	errorCode = sqlite3_exec(mSQLCon, wal ? "PRAGMA synchronous=NORMAL"
+			: "PRAGMA synchronous=FULL", NULL, NULL, NULL);
+	if (SQLITE_OK != errorCode) {
+		ERROR(__FUNCTION__, __LINE__, mSQLCon);
+	}
+	ALOGD("journal mode %s\n", wal ? "wal" : "delete");
+	return errorCode;
+}
+
+/*
+ * "a.db" and "./a.db" are one file and must share the lock. Only the
+ * directory is resolved, the file itself may not exist yet.
+ */
+static String8 instanceKey(const char *dbName)
+{
+	char realDir[PATH_MAX];
+	const char *slash = strrchr(dbName, '/');
+	String8 dir(".");
+	const char *base = dbName;
+
+	if (slash) {
+		dir = slash == dbName ? String8("/") : String8(dbName, slash - dbName);
+		base = slash + 1;
+	}
+	if (!realpath(dir.string(), realDir)) {
+		return String8(dbName);
+	}
+	String8 key(realDir);
+	if (key != "/") {
+		key.append("/");
+	}
+	key.append(base);
+	return key;
 }
 
 DBCon* DBCon::getInstance(const char *dbName)
 {
-	ALOGD("getInstance: mDBCon is %p\n", mDBCon);
-	if (!mDBCon) {
-		mDBCon = new DBCon(dbName);
+	String8 key = instanceKey(dbName);
+	DBCon *con;
+
+	Mutex::Autolock _l(mInstanceLock);
+	ssize_t index = mInstances.indexOfKey(key);
+	if (index >= 0) {
+		con = mInstances.valueAt(index);
+	} else {
+		con = new DBCon(dbName);
+		con->mKey = key;
+		mInstances.add(key, con);
 	}
-	return mDBCon;
+	con->mRefs++;
+	ALOGD("getInstance: %s is %p, refs %d\n", key.string(), con, con->mRefs);
+	return con;
 }
 
 void DBCon::freeInstance(void)
 {
-	if(mDBCon) {
-		ALOGD("delete mDBCon\n");
-		delete mDBCon;
-		mDBCon = NULL;
+	Mutex::Autolock _l(mInstanceLock);
+	if (mRefs > 0 && --mRefs > 0) {
+		return;
 	}
+	ALOGD("delete DBCon of %s\n", mKey.string());
+	mInstances.removeItem(mKey);
+	delete this;
 }
 
 DBCon::DBCon(const char *dbName)
+	: mRefs(0),
+	  mSQLCon(NULL),
+	  mWriter(false),
+	  mWriterExclusive(false),
+	  mExclusive(0),
+	  mReaders(0),
+	  mNextTicket(0),
+	  mWal(false),
+	  mStmtClock(0)
 {
+	memset(&mStats, 0, sizeof(mStats));
+	memset(mReadWait, 0, sizeof(mReadWait));
+	memset(mWriteWait, 0, sizeof(mWriteWait));
 	open(dbName);
-	mLock = false;
 }
 
 DBCon::~DBCon()
 {
+	clearStatements();
 	if (mSQLCon) {
 		ALOGD("sqlite3_close\n");
 		if (SQLITE_OK != sqlite3_close(mSQLCon)) {
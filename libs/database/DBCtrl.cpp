@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <strings.h>
+#include <sys/stat.h>
 #include "include_database/DBCtrl.h"
 #undef LOG_NDEBUG
 #undef NDEBUG
@@ -8,15 +9,17 @@
 #include <utils/Log.h>
 
 namespace android {
-#define RETRY_CNT 3
+/* about what the old three retries 200 ms apart allowed */
+#define DB_LOCK_TIMEOUT_MS 800
 
 #define ERR_TIMEOUT -2
 
 #define BEGIN_TRANSACTION "begin transaction"
 #define COMMIT_TRANSACTION "commit transaction"
+#define ROLLBACK_TRANSACTION "rollback transaction"
 
 #define DB_PATH "/data/sunxi.db"
-DBCtrl::DBCtrl()
+DBCtrl::DBCtrl(const char *dbPath)
 	:mName(""),
 	mSQL(""),
 	mColumnCnt(0),
@@ -26,17 +29,30 @@ DBCtrl::DBCtrl()
 	mValue(NULL),
 	mColumnName(NULL),
 	mFieldKey(NULL),
+	mReadCon(NULL),
 	mDBCon(NULL),
 	mSqlstmt(NULL),
-	mFilter("")
+	mFilter(""),
+	mMediaIndex(false),
+	mFileColumn(-1),
+	mDuration(0),
+	mSize(-1)
 
 {
-	mDBCon  = DBCon::getInstance(DB_PATH);
+	mCursor.stmt = NULL;
+	mCursor.columns = 0;
+	mCursor.row = 0;
+	mListPos.row = 0;
+	mListPos.keys = 0;
+	mDBCon  = DBCon::getInstance(dbPath ? dbPath : DB_PATH);
 	mSQLCon = mDBCon->getConnect();
 }
 DBCtrl::~DBCtrl()
 {
 	if(mDBCon) {
+		cursorRelease(&mCursor);
+		mDBCon->closeReader(mReadCon);
+		mReadCon = NULL;
 		ALOGD("freeInstance\n");
 		mDBCon->freeInstance();
 		mDBCon   = NULL;
@@ -89,7 +105,7 @@ void DBCtrl::setRecord(String8 columnName, void *pValue)
 		return;
 	}
 	mColumnName[mTmpNum] = columnName;
-	mValue[mTmpNum] = (unsigned int)pValue;		/* save the column adress */
+	mValue[mTmpNum] = pValue;		/* save the column adress */
 	mTmpNum++;
 }
 
@@ -103,16 +119,87 @@ void DBCtrl::setColumnType(DBC_TYPE *type, int *typeSize)
 	if (0 != typeSize) { /* just for DB_BLOB */
 		i = 0;
 		while (i < mColumnCnt) {
-			mColumnTypeSize[mTmpNum] = typeSize[i];
+			mColumnTypeSize[i] = typeSize[i];
 			i++;
 		}
 	}
 }
 
-int DBCtrl::insertRecord(void)
+static int bindColumn(sqlite3_stmt *stmt, int i, DBC_TYPE type, const void *pValue, int size)
+{
+	switch(type) {
+	case DB_UINT32:
+		return sqlite3_bind_int(stmt, i, *(const unsigned int*)pValue);
+	case DB_UINT16:
+		return sqlite3_bind_int(stmt, i, *(const unsigned short*)pValue);
+	case DB_UINT8:
+		return sqlite3_bind_int(stmt, i, *(const unsigned char*)pValue);
+	case DB_INT64:
+		return sqlite3_bind_int64(stmt, i, *(const long long*)pValue);
+	case DB_TEXT:
+		return sqlite3_bind_text(stmt, i, (const char *)pValue, -1, SQLITE_STATIC);
+	case DB_FLOAT:
+		return sqlite3_bind_double(stmt, i, *(const float*)pValue);
+	case DB_DOUBLE:
+		return sqlite3_bind_double(stmt, i, *(const double*)pValue);
+	case DB_BLOB:
+		return sqlite3_bind_blob(stmt, i, pValue, size, SQLITE_STATIC);
+	default:
+		return SQLITE_OK;
+	}
+}
+
+static void readColumn(sqlite3_stmt *stmt, int idx, DBC_TYPE type, struct db_value *value)
+{
+	value->type = type;
+	value->bytes = 0;
+	switch (type) {
+	case DB_UINT32:
+		value->u32 = (unsigned int)sqlite3_column_int(stmt, idx);
+		break;
+	case DB_INT64:
+		value->i64 = (long long)sqlite3_column_int64(stmt, idx);
+		break;
+	case DB_UINT16:
+		value->u16 = (unsigned short)sqlite3_column_int(stmt, idx);
+		break;
+	case DB_UINT8:
+		value->u8 = (unsigned char)sqlite3_column_int(stmt, idx);
+		break;
+	case DB_TEXT:
+	case DB_DATETIME:
+		value->text = (const char *)sqlite3_column_text(stmt, idx);
+		value->bytes = sqlite3_column_bytes(stmt, idx);
+		break;
+	case DB_BLOB:
+		value->blob = sqlite3_column_blob(stmt, idx);
+		value->bytes = sqlite3_column_bytes(stmt, idx);
+		break;
+	case DB_FLOAT:
+		value->f = (float)sqlite3_column_double(stmt, idx);
+		break;
+	case DB_DOUBLE:
+		value->d = sqlite3_column_double(stmt, idx);
+		break;
+	default:
+		value->i64 = 0;
+		break;
+	}
+}
+
+/* 0 for a file that is gone or was never there */
+static long long fileSize(const char *file)
 {
-	int cnt = 0;
+	struct stat st;
+
+	if (file && stat(file, &st) == 0) {
+		return st.st_size;
+	}
+	return 0;
+}
 
+int DBCtrl::insertRecord(void)
+{
 	if (!mSQLCon) {
 		ALOGE("mSQLCon is null\n");
 		return -1;
@@ -123,70 +210,192 @@ int DBCtrl::insertRecord(void)
 		return -1;
 	}
 	ALOGD("SQL is %s\n", mSQL.string());
-	while(mDBCon->lock()) {
-		if (cnt++ > RETRY_CNT) {
-			return ERR_TIMEOUT;
-		} else {
-			usleep(200000);
-		}
+	/* the card is slow, stat the file before anybody waits for us */
+	long long size = mSize;
+	if (mFileColumn >= 0 && size < 0) {
+		size = fileSize((const char *)mValue[mFileColumn]);
+	}
+	if (waitLock() != 0) {
+		return ERR_TIMEOUT;
 	}
 	int errorCode;
-	errorCode = sqlite3_prepare(mSQLCon, mSQL.string(), -1, &mSqlstmt, NULL);
-	if (SQLITE_OK != errorCode) {
-		ERROR(__FUNCTION__, __LINE__, mSQLCon);
-		return errorCode;
+	mSqlstmt = mDBCon->getStatement(mSQL);
+	if (!mSqlstmt) {
+		mDBCon->unlockWrite();
+		mTmpNum = 0;
+		return -1;
 	}
-	int idx = 0;
-	int i;
+	int idx;
 	sqlite3_exec(mSQLCon, BEGIN_TRANSACTION, NULL, NULL, NULL);
 
-	for (i=1; idx<mColumnCnt; idx++,i++) {
-		switch(mColumnType[idx]) {
-		case DB_UINT32:
-			sqlite3_bind_int(mSqlstmt, i, *(unsigned int*)mValue[idx]);
-			break;
-		case DB_UINT16:
-			sqlite3_bind_int(mSqlstmt, i, *(unsigned short*)mValue[idx]);
-			break;
-		case DB_UINT8:
-			ALOGD("mValue[idx] is %d\n", *(unsigned char *)mValue[idx]);
-			sqlite3_bind_int(mSqlstmt, i, *(unsigned char*)mValue[idx]);
-			break;
-		case DB_INT64:
-			sqlite3_bind_int64(mSqlstmt, i, *(long long*)mValue[idx]);
-			break;
-		case DB_TEXT:
-			sqlite3_bind_text(mSqlstmt, i, (char *)mValue[idx], -1, NULL);
-			break;
-		case DB_FLOAT:
-			sqlite3_bind_double(mSqlstmt, i, *(float*)mValue[idx]);
-			break;
-		case DB_DOUBLE:
-			sqlite3_bind_double(mSqlstmt, i, *(double*)mValue[idx]);
-			break;
-		case DB_BLOB:
-			sqlite3_bind_blob(mSqlstmt, i, (void*)mValue[idx], mColumnTypeSize[idx], NULL);
-			break;
-		default:
-			break;
-		}
+	for (idx=0; idx<mColumnCnt; idx++) {
+		bindColumn(mSqlstmt, idx + 1, mColumnType[idx], mValue[idx], mColumnTypeSize[idx]);
+	}
+	if (mFileColumn >= 0) {
+		bindMediaColumns(mSqlstmt, size, mDuration);
 	}
+	mDuration = 0;
+	mSize = -1;
 
 	errorCode = sqlite3_step(mSqlstmt);
 	if (SQLITE_DONE != errorCode) {
 		ERROR(__FUNCTION__, __LINE__, mSQLCon);
-		sqlite3_finalize(mSqlstmt);
-		mDBCon->unlock();
-		mTmpNum = 0;	/* set to default value */
-		sqlite3_exec(mSQLCon, COMMIT_TRANSACTION, NULL, NULL, NULL);
+	} else {
+		errorCode = SQLITE_OK;
+	}
+	mDBCon->putStatement(mSqlstmt);
+	mSqlstmt = NULL;
+	sqlite3_exec(mSQLCon, COMMIT_TRANSACTION, NULL, NULL, NULL);
+	mDBCon->unlockWrite();
+	mTmpNum = 0;	/* set to default value */
+	return errorCode;
+}
+
+/*
+ * Run one cached statement per row inside a single transaction, so a
+ * batch costs one journal sync instead of one per row. Rolls the whole
+ * batch back if a row or tailSQL fails. sizes and durations, when given,
+ * are the media columns of each row. Called with the DBCon lock held.
+ * */
+int DBCtrl::runBatch(const String8 &sql, const DBC_TYPE *type, const int *typeSize,
+		int columns, void *pValues[], int rows,
+		const long long *sizes, const unsigned int *durations,
+		const char *tailSQL)
+{
+	sqlite3_stmt *stmt;
+	int errorCode;
+	int row, idx;
+
+	stmt = mDBCon->getStatement(sql);
+	if (!stmt) {
+		return -1;
+	}
+	errorCode = sqlite3_exec(mSQLCon, BEGIN_TRANSACTION, NULL, NULL, NULL);
+	if (SQLITE_OK != errorCode) {
+		ERROR(__FUNCTION__, __LINE__, mSQLCon);
+		mDBCon->putStatement(stmt);
 		return errorCode;
 	}
+	for (row = 0; row < rows; row++) {
+		for (idx = 0; idx < columns; idx++) {
+			bindColumn(stmt, idx + 1, type[idx], pValues[row * columns + idx],
+					typeSize ? typeSize[idx] : 0);
+		}
+		if (sizes) {
+			bindMediaColumns(stmt, sizes[row], durations ? durations[row] : 0);
+		}
+		errorCode = sqlite3_step(stmt);
+		sqlite3_reset(stmt);
+		if (SQLITE_DONE != errorCode) {
+			break;
+		}
+	}
+	if (SQLITE_DONE == errorCode) {
+		errorCode = tailSQL ? sqlite3_exec(mSQLCon, tailSQL, NULL, NULL, NULL) : SQLITE_OK;
+	}
+	if (SQLITE_OK == errorCode) {
+		errorCode = sqlite3_exec(mSQLCon, COMMIT_TRANSACTION, NULL, NULL, NULL);
+	}
+	if (SQLITE_OK != errorCode) {
+		ERROR(__FUNCTION__, __LINE__, mSQLCon);
+		sqlite3_exec(mSQLCon, ROLLBACK_TRANSACTION, NULL, NULL, NULL);
+	}
+	mDBCon->putStatement(stmt);
+	return errorCode;
+}
 
-	sqlite3_finalize(mSqlstmt);
-	mDBCon->unlock();
-	mTmpNum = 0;	/* set to default value */
-	sqlite3_exec(mSQLCon, COMMIT_TRANSACTION, NULL, NULL, NULL);
-	return SQLITE_OK;
+int DBCtrl::insertRecords(void *pValues[], int rows, const long long *sizes,
+		const unsigned int *durations, const char *tailSQL)
+{
+	long long *statSizes = NULL;
+	int errorCode;
+	int row;
+
+	if (!mSQLCon) {
+		ALOGE("mSQLCon is null\n");
+		return -1;
+	}
+	if (rows <= 0) {
+		return SQLITE_OK;
+	}
+	createAddSQL();
+	if (mFileColumn >= 0 && !sizes) {
+		statSizes = new long long[rows];
+		for (row = 0; row < rows; row++) {
+			statSizes[row] = fileSize((const char *)pValues[row * mColumnCnt + mFileColumn]);
+		}
+		sizes = statSizes;
+	}
+	if (waitLock() != 0) {
+		delete [] statSizes;
+		return ERR_TIMEOUT;
+	}
+	errorCode = runBatch(mSQL, mColumnType, mColumnTypeSize, mColumnCnt, pValues, rows,
+			mFileColumn >= 0 ? sizes : NULL, durations, tailSQL);
+	mDBCon->unlockWrite();
+	delete [] statSizes;
+	mTmpNum = 0;
+	return errorCode;
+}
+
+int DBCtrl::deleteRecords(String8 columnName, DBC_TYPE type, void *pValues[], int num)
+{
+	int errorCode;
+
+	if (!mSQLCon) {
+		ALOGE("mSQLCon is null\n");
+		return -1;
+	}
+	if (num <= 0) {
+		return SQLITE_OK;
+	}
+	mSQL = "DELETE FROM ";
+	mSQL.append(mName);
+	mSQL.append(" WHERE ");
+	mSQL.append(columnName);
+	mSQL.append(" = ?");
+	if (waitLock() != 0) {
+		return ERR_TIMEOUT;
+	}
+	errorCode = runBatch(mSQL, &type, NULL, 1, pValues, num, NULL, NULL, NULL);
+	mDBCon->unlockWrite();
+	return errorCode;
+}
+
+/* file_size and duration follow the columns of the insert, see createAddSQL */
+int DBCtrl::bindMediaColumns(sqlite3_stmt *stmt, long long size, unsigned int durationMs)
+{
+	sqlite3_bind_int64(stmt, mColumnCnt + 1, size);
+	return sqlite3_bind_int(stmt, mColumnCnt + 2, durationMs);
+}
+
+void DBCtrl::setRecordDuration(unsigned int durationMs)
+{
+	mDuration = durationMs;
+}
+
+void DBCtrl::setRecordSize(long long bytes)
+{
+	mSize = bytes;
+}
+
+int DBCtrl::setJournalMode(bool wal)
+{
+	int errorCode;
+
+	/* our open cursor would keep the journal from changing */
+	cursorRelease(&mCursor);
+	if (mDBCon->lockWrite(DB_LOCK_TIMEOUT_MS, true) != 0) {
+		return ERR_TIMEOUT;
+	}
+	errorCode = mDBCon->setJournalMode(wal);
+	mDBCon->unlockWrite();
+	return errorCode;
+}
+
+void DBCtrl::getLockStats(struct db_lock_stats *stats)
+{
+	mDBCon->getLockStats(stats);
 }
 
 int DBCtrl::bufPrepare(void)
@@ -209,7 +418,7 @@ void DBCtrl::bufRelease(void)
 
 int DBCtrl::prepare(void)
 {
-	int cnt = 0;
+	SQLCon *con;
 
 	if (!mSQLCon) {
 		ALOGE("mSQLCon is null\n");
@@ -220,35 +429,28 @@ int DBCtrl::prepare(void)
 		ALOGE("mSQL is empty\n");
 		return -1;
 	}
-	while(mDBCon->lock()) {
-		if (cnt++ > RETRY_CNT) {
-			return ERR_TIMEOUT;
-		} else {
-			usleep(200000);
-		}
+	con = readConnection();
+	if (lockConnection(con) != 0) {
+		return ERR_TIMEOUT;
 	}
-	const char *errorMsg = NULL;
-	int errorCode;
 	ALOGD("SQL is %s\n", mSQL.string());
-	errorCode = sqlite3_prepare(mSQLCon, mSQL.string(), -1, &mSqlstmt, &errorMsg);
-	if (SQLITE_OK != errorCode) {
-		ERROR(__FUNCTION__, __LINE__, mSQLCon);
-		mDBCon->unlock();
+	mSqlstmt = mDBCon->getStatement(mSQL, con);
+	if (!mSqlstmt) {
+		unlockConnection(con);
 		return -1;
 	}
 
 	if(bufPrepare() == -1) {
-		mDBCon->unlock();
+		unlockConnection(con);
 		return -1;
 	}
 
-	mDBCon->unlock();
+	unlockConnection(con);
 	return 0;
 }
 
 int DBCtrl::finish(void)
 {
-	int cnt = 0;
 
 	if (!mSQLCon) {
 		ALOGE("mSQLCon is null\n");
@@ -258,17 +460,17 @@ int DBCtrl::finish(void)
 		ALOGE("mSQL is empty\n");
 		return -1;
 	}
-	while(mDBCon->lock()) {
-		if (cnt++ > RETRY_CNT) {
+	if (mSqlstmt) {
+		SQLCon *con = sqlite3_db_handle(mSqlstmt);
+		if (lockConnection(con) != 0) {
 			return ERR_TIMEOUT;
-		} else {
-			usleep(200000);
 		}
+		mDBCon->putStatement(mSqlstmt);
+		unlockConnection(con);
 	}
-	sqlite3_finalize(mSqlstmt);
+	mSqlstmt = NULL;
 	bufRelease();
 
-	mDBCon->unlock();
 	mFilter = "";
 	return 0;
 }
@@ -287,19 +489,14 @@ int DBCtrl::deleteRecord(void)
 
 int DBCtrl::executeSQL(void)
 {
-	int cnt = 0;
-	while(mDBCon->lock()) {
-		if (cnt++ > RETRY_CNT) {
-			return ERR_TIMEOUT;
-		} else {
-			usleep(200000);
-		}
+	if (waitLock() != 0) {
+		return ERR_TIMEOUT;
 	}
 	char *errorMsg = NULL;
 	int errorCode = sqlite3_exec(mSQLCon, BEGIN_TRANSACTION, NULL, NULL, &errorMsg);
 	if (SQLITE_OK != errorCode) {
 		ERROR(__FUNCTION__, __LINE__, mSQLCon);
-		mDBCon->unlock();
+		mDBCon->unlockWrite();
 		return errorCode;
 	}
 	errorCode = sqlite3_exec(mSQLCon, mSQL.string(), NULL, NULL, &errorMsg);
@@ -309,30 +506,23 @@ int DBCtrl::executeSQL(void)
 	}
 	errorCode = sqlite3_exec(mSQLCon, COMMIT_TRANSACTION, NULL, NULL, &errorMsg);
 	if (SQLITE_OK != errorCode) {
-		mDBCon->unlock();
 		ERROR(__FUNCTION__, __LINE__, mSQLCon);
 	}
-	mDBCon->unlock();
+	mDBCon->unlockWrite();
 	return errorCode;
 }
 
 int DBCtrl::sqlite3Exec(void)
 {
-	int cnt = 0;
-	while (mDBCon->lock()) {
-		if (cnt++ > RETRY_CNT) {
-			return ERR_TIMEOUT;
-		} else {
-			usleep(200000);
-		}
+	if (waitLock() != 0) {
+		return ERR_TIMEOUT;
 	}
 	char *errorMsg = NULL;
 	int errorCode = sqlite3_exec(mSQLCon, mSQL.string(), NULL, NULL, &errorMsg);
 	if (SQLITE_OK != errorCode) {
 		ERROR(__FUNCTION__, __LINE__, mSQLCon);
-		return errorCode;
 	}
-	mDBCon->unlock();
+	mDBCon->unlockWrite();
 	return errorCode;
 }
 
@@ -351,19 +541,17 @@ unsigned int DBCtrl::getRecordCnt(void)
 		ALOGE("mSQL is empty\n");
 		return -1;
 	}
-	int cnt = 0;
-	while (mDBCon->lock()) {
-		if (cnt++ > RETRY_CNT) {
-			mFilter = "";
-			return ERR_TIMEOUT;
-		} else {
-			usleep(200000);
-		}
+	SQLCon *con = readConnection();
+	if (lockConnection(con) != 0) {
+		mFilter = "";
+		return ERR_TIMEOUT;
 	}
-	const char *errorMsg = NULL;
-	int errorCode = sqlite3_prepare(mSQLCon, mSQL.string(), -1, &mSqlstmt, &errorMsg);
-	if (SQLITE_OK != errorCode) {
-		mDBCon->unlock();
+	int errorCode;
+	mSqlstmt = mDBCon->getStatement(mSQL, con);
+	if (!mSqlstmt) {
+		unlockConnection(con);
+		mFilter = "";
+		return -1;
 	}
 	int recordNum;
 	errorCode = sqlite3_step(mSqlstmt);
@@ -373,11 +561,11 @@ unsigned int DBCtrl::getRecordCnt(void)
 		recordNum = -1;
 		if (SQLITE_DONE != errorCode) {
 			mFilter = "";
-			ERROR(__FUNCTION__, __LINE__, mSQLCon);
+			ERROR(__FUNCTION__, __LINE__, con);
 		}
 	}
-	sqlite3_finalize(mSqlstmt);
-	mDBCon->unlock();
+	mDBCon->putStatement(mSqlstmt);
+	unlockConnection(con);
 	mFilter = "";
 	return recordNum;
 
@@ -387,14 +575,14 @@ int DBCtrl::getOneLine(void *pValue[])
 {
 	const char *errorMsg = NULL;
 	int errorCode;
-	int cnt = 0;
-	while (mDBCon->lock()) {
-		if (cnt++ > RETRY_CNT) {
-			mFilter = "";
-			return ERR_TIMEOUT;
-		} else {
-			usleep(200000);
-		}
+	if (!mSqlstmt) {
+		ALOGE("%s():[%d] call prepare first\n", __FUNCTION__, __LINE__);
+		return -1;
+	}
+	SQLCon *con = sqlite3_db_handle(mSqlstmt);
+	if (lockConnection(con) != 0) {
+		mFilter = "";
+		return ERR_TIMEOUT;
 	}
 	const void *tmpBlob = NULL;
 	int len, i;
@@ -444,7 +632,7 @@ int DBCtrl::getOneLine(void *pValue[])
 			}
 		}
 	}
-	mDBCon->unlock();
+	unlockConnection(con);
 	return errorCode;
 }
 
@@ -468,20 +656,17 @@ int DBCtrl::getFilterFirstLine(void *pValue[])
 		ALOGE("mSQL is empty\n");
 		return -1;
 	}
-	int cnt = 0;
-	while (mDBCon->lock()) {
-		if (cnt++ > RETRY_CNT) {
-			mFilter = "";
-			return ERR_TIMEOUT;
-		} else {
-			usleep(200000);
-		}
+	SQLCon *con = readConnection();
+	if (lockConnection(con) != 0) {
+		mFilter = "";
+		return ERR_TIMEOUT;
 	}
 
-	const char *errorMsg = NULL;
-	errorCode = sqlite3_prepare(mSQLCon, mSQL.string(), -1, &mSqlstmt, &errorMsg);
-	if (SQLITE_OK != errorCode) {
-		mDBCon->unlock();
+	mSqlstmt = mDBCon->getStatement(mSQL, con);
+	if (!mSqlstmt) {
+		unlockConnection(con);
+		mFilter = "";
+		return -1;
 	}
 
 	int recordNum;
@@ -529,22 +714,22 @@ int DBCtrl::getFilterFirstLine(void *pValue[])
 #endif
 			default:
 				ALOGD("not matched type\n");
-				sqlite3_finalize(mSqlstmt);
-				mDBCon->unlock();
+				mDBCon->putStatement(mSqlstmt);
+				unlockConnection(con);
 				mFilter = "";
 				return -1;
 			}
 		}
 	} else {
-		ERROR(__FUNCTION__, __LINE__, mSQLCon);
-		sqlite3_finalize(mSqlstmt);
-		mDBCon->unlock();
+		ERROR(__FUNCTION__, __LINE__, con);
+		mDBCon->putStatement(mSqlstmt);
+		unlockConnection(con);
 		mFilter = "";
 		return -1;
 	}
 
-	sqlite3_finalize(mSqlstmt);
-	mDBCon->unlock();
+	mDBCon->putStatement(mSqlstmt);
+	unlockConnection(con);
 //	mFilter = "";	/* filter will be still used in getRecordCnt */
 
 	return getRecordCnt();
@@ -576,20 +761,17 @@ void * DBCtrl::getFilterFirstElement(String8 column, int idx)
 		ALOGE("mSQL is empty\n");
 		return NULL;
 	}
-	int cnt = 0;
-	while (mDBCon->lock()) {
-		if (cnt++ > RETRY_CNT) {
-			mFilter = "";
-			return NULL;
-		} else {
-			usleep(200000);
-		}
+	SQLCon *con = readConnection();
+	if (lockConnection(con) != 0) {
+		mFilter = "";
+		return NULL;
 	}
 
-	const char *errorMsg = NULL;
-	errorCode = sqlite3_prepare(mSQLCon, mSQL.string(), -1, &mSqlstmt, &errorMsg);
-	if (SQLITE_OK != errorCode) {
-		mDBCon->unlock();
+	mSqlstmt = mDBCon->getStatement(mSQL, con);
+	if (!mSqlstmt) {
+		unlockConnection(con);
+		mFilter = "";
+		return NULL;
 	}
 
 	int recordNum;
@@ -644,11 +826,11 @@ void * DBCtrl::getFilterFirstElement(String8 column, int idx)
 				break;
 			}
 	} else {
-		ERROR(__FUNCTION__, __LINE__, mSQLCon);
+		ERROR(__FUNCTION__, __LINE__, con);
 	}
 
-	sqlite3_finalize(mSqlstmt);
-	mDBCon->unlock();
+	mDBCon->putStatement(mSqlstmt);
+	unlockConnection(con);
 	mFilter = "";
 	return retAddr;
 }
@@ -656,22 +838,17 @@ void * DBCtrl::getFilterFirstElement(String8 column, int idx)
 
 
 
-void * DBCtrl::getElementList(String8 columnName, int columnIdx, unsigned int rowNumber, int filetype)
+/* the WHERE clause of the file list, empty for all files */
+String8 DBCtrl::createListFilter(int filetype)
 {
-	int errorCode;
-	void *retAddr = NULL;
-	char buf[20];
+	String8 str;
 
-	bzero(buf, sizeof(buf));
-	sprintf(buf, "LIMIT %d,1", rowNumber);
-	String8 str("SELECT ");
-	str.append(columnName);
-	str.append(" ");
-	str.append("FROM ");
-	str.append(mName);
-	str.append(" ");
-
-	if (filetype == 4){
+	if (mMediaIndex) {
+		/* range scan of the (category, time, file) index */
+		if (filetype >= DB_CATEGORY_FRONT && filetype <= DB_CATEGORY_PHOTO) {
+			str.appendFormat("WHERE category = %d ", filetype);
+		}
+	} else if (filetype == 4){
 	    str.append("WHERE file like '%.jpg'");
 
 	}else if(filetype == 1){
@@ -688,94 +865,57 @@ void * DBCtrl::getElementList(String8 columnName, int columnIdx, unsigned int ro
         str.append("WHERE file like '%.mp4'AND file like '%SOS%' ");
 
 	}
+	return str;
+}
 
-	str.append(" ORDER BY time DESC ");
-    str.append(" ");
-    str.append(buf);
-	setSQL(str);
+/*
+ * Newest first. Rows of the same time follow the (category, time, file)
+ * index, the rowid makes the order total.
+ * */
+void DBCtrl::listKeys(const char *const **keys, int *keyCount)
+{
+	static const char *const mediaKeys[] = { "time", "file", "rowid" };
+	static const char *const timeKeys[] = { "time", "rowid" };
 
+	*keys = mMediaIndex ? mediaKeys : timeKeys;
+	*keyCount = mMediaIndex ? 3 : 2;
+}
 
-	if (mSQL.isEmpty()) {
-		ALOGE("mSQL is empty\n");
-		return NULL;
-	}
+static void appendOrder(String8 &str, const char *const keys[], int keyCount, bool desc)
+{
+	int i;
 
-	int cnt = 0;
-	while (mDBCon->lock()) {
-		if (cnt++ > RETRY_CNT) {
-			mFilter = "";
-			return NULL;
-		} else {
-			usleep(200000);
-		}
+	str.append(" ORDER BY ");
+	for (i = 0; i < keyCount; i++) {
+		str.appendFormat("%s%s%s", i ? ", " : "", keys[i], desc ? " DESC" : "");
 	}
+}
 
-	const char *errorMsg = NULL;
-	errorCode = sqlite3_prepare(mSQLCon, mSQL.string(), -1, &mSqlstmt, &errorMsg);
-	if (SQLITE_OK != errorCode) {
-		mDBCon->unlock();
-	}
+String8 DBCtrl::createListSQL(String8 columnName, int filetype)
+{
+	const char *const *keys;
+	int keyCount;
+	String8 str("SELECT ");
 
-	int recordNum;
-	const void *tmpBlob;
-	char *tmpStr;
-	int len;
-	errorCode = sqlite3_step(mSqlstmt);
-	if (SQLITE_ROW == errorCode) {
-			switch(mColumnType[columnIdx]) {
-			case DB_UINT32:
-				result_uint32 = (unsigned int)sqlite3_column_int(mSqlstmt, 0);
-				retAddr =  (void *)&result_uint32;
-				break;
-			case DB_INT64:
-				result_int64 = (long long)sqlite3_column_int64(mSqlstmt, 0);
-				retAddr =  (void *)&result_int64;
-				break;
-			case DB_UINT16:
-				result_uint16 = (unsigned short)sqlite3_column_int(mSqlstmt, 0);
-				retAddr =  (void *)&result_uint16;
-				break;
-			case DB_UINT8:
-				result_uint8 = (unsigned char)sqlite3_column_int(mSqlstmt, 0);
-				retAddr =  (void *)&result_uint8;
-				break;
-			case DB_TEXT:
-				tmpStr = (char *)sqlite3_column_text(mSqlstmt, 0);
-				if (tmpStr) {
-					memcpy(queryBuf[columnIdx], tmpStr, strlen(tmpStr));
-					queryBuf[columnIdx][strlen(tmpStr)] = '\0';
-					retAddr =  &queryBuf[columnIdx];
-				} else {
-					retAddr = NULL;
-				}
-				break;
-			case DB_FLOAT:
-				result_float = (float)sqlite3_column_double(mSqlstmt, 0);
-				retAddr =  (void *)&result_float;
-				break;
-			case DB_DOUBLE:
-				result_double = sqlite3_column_double(mSqlstmt, 0);
-				retAddr =  (void *)&result_double;
-				break;
-#if 0
-			case DB_BLOB:
-				tmpBlob = sqlite3_column_blob(mSqlstmt, 0);
-				len = sqlite3_column_bytes(mSqlstmt, 0);
-				memcpy((void *)pValue, tmpBlob, len);
-				break;
-#endif
-			default:
-				retAddr =  NULL;
-				break;
-			}
-	} else {
-		retAddr = NULL;
-		ERROR(__FUNCTION__, __LINE__, mSQLCon);
-	}
+	str.append(columnName);
+	str.append(" ");
+	str.append("FROM ");
+	str.append(mName);
+	str.append(" ");
+	str.append(createListFilter(filetype));
+	listKeys(&keys, &keyCount);
+	appendOrder(str, keys, keyCount, true);
+	return str;
+}
 
-	sqlite3_finalize(mSqlstmt);
-	mDBCon->unlock();
-	return retAddr;
+void * DBCtrl::getElementList(String8 columnName, int columnIdx, unsigned int rowNumber, int filetype)
+{
+	const char *const *keys;
+	int keyCount;
+
+	listKeys(&keys, &keyCount);
+	return cursorElement(columnName, createListFilter(filetype), keys, keyCount, true,
+			columnIdx, rowNumber);
 }
 
 /*
@@ -786,102 +926,364 @@ void * DBCtrl::getElementList(String8 columnName, int columnIdx, unsigned int ro
  * */
 void * DBCtrl::getElement(String8 columnName, int columnIdx, unsigned int rowNumber)
 {
-	int errorCode;
+	static const char *const keys[] = { "rowid" };
+
+	return cursorElement(columnName, String8(""), keys, 1, false, columnIdx, rowNumber);
+}
+
+/*
+ * Row rowNumber of a one column query, ordered by keys. When rowNumber is
+ * the row after the one the last call returned, it is found by seeking
+ * past that row's keys, so asking for rows 0, 1, 2... does not skip n rows
+ * each time the way LIMIT n,1 did. The statement is reset before
+ * returning; no read snapshot or SHARED lock is held between calls, and
+ * rows written meanwhile by anyone are seen.
+ * */
+void * DBCtrl::cursorElement(const String8 &columnName, const String8 &filter,
+		const char *const keys[], int keyCount, bool desc,
+		int columnIdx, unsigned int rowNumber)
+{
+	const char *op = desc ? "<" : ">";
+	sqlite3_stmt *stmt;
+	struct db_value value;
 	void *retAddr = NULL;
-	char buf[20];
+	int errorCode;
+	String8 query("SELECT ");
+	String8 str;
+	SQLCon *con;
+	bool seek;
+	int i;
 
-	bzero(buf, sizeof(buf));
-	sprintf(buf, "LIMIT %d,1", rowNumber);
-	String8 str("SELECT ");
-	str.append(columnName);
-	str.append(" ");
-	str.append("FROM ");
-	str.append(mName);
-	str.append(" ");
-	str.append(buf);
+	query.append(columnName);
+	for (i = 0; i < keyCount; i++) {
+		query.appendFormat(", %s", keys[i]);
+	}
+	query.appendFormat(" FROM %s ", mName.string());
+	query.append(filter);
+	seek = mListPos.keys == keyCount && mListPos.row == rowNumber && mListPos.sql == query;
+
+	str = query;
+	if (seek) {
+		/* k0 op= ?1 AND (k0 op ?1 OR (k0 = ?1 AND (k1 op ?2 OR ...))) */
+		str.append(filter.isEmpty() ? " WHERE " : " AND ");
+		if (keyCount > 1) {
+			str.appendFormat("%s %s= ?1 AND ", keys[0], op);
+		}
+		for (i = 0; i < keyCount - 1; i++) {
+			str.appendFormat("(%s %s ?%d OR (%s = ?%d AND ", keys[i], op, i + 1, keys[i], i + 1);
+		}
+		str.appendFormat("%s %s ?%d", keys[keyCount - 1], op, keyCount);
+		for (i = 0; i < keyCount - 1; i++) {
+			str.append("))");
+		}
+	}
+	appendOrder(str, keys, keyCount, desc);
+	str.append(seek ? " LIMIT 1" : " LIMIT 1 OFFSET ?");
 	setSQL(str);
 
-	if (mSQL.isEmpty()) {
-		ALOGE("mSQL is empty\n");
+	con = readConnection();
+	if (lockConnection(con) != 0) {
+		mFilter = "";
 		return NULL;
 	}
-//	db_msg("SQL is %s\n", mSQL.string());
-	int cnt = 0;
-	while (mDBCon->lock()) {
-		if (cnt++ > RETRY_CNT) {
-			mFilter = "";
+	stmt = mDBCon->getStatement(mSQL, con);
+	if (!stmt) {
+		unlockConnection(con);
+		return NULL;
+	}
+	if (seek) {
+		for (i = 0; i < keyCount; i++) {
+			switch (mListPos.type[i]) {
+			case SQLITE_INTEGER:
+				sqlite3_bind_int64(stmt, i + 1, mListPos.i64[i]);
+				break;
+			case SQLITE_FLOAT:
+				sqlite3_bind_double(stmt, i + 1, mListPos.d[i]);
+				break;
+			default:
+				sqlite3_bind_text(stmt, i + 1, mListPos.text[i].string(), -1, SQLITE_STATIC);
+				break;
+			}
+		}
+	} else {
+		sqlite3_bind_int(stmt, 1, rowNumber);
+	}
+
+	mListPos.keys = 0;
+	errorCode = sqlite3_step(stmt);
+	if (SQLITE_ROW == errorCode) {
+		readColumn(stmt, 0, mColumnType[columnIdx], &value);
+		retAddr = storeResult(&value, columnIdx);
+		/* a NULL key has no place to seek from, the next call skips rows */
+		for (i = 0; i < keyCount; i++) {
+			mListPos.type[i] = sqlite3_column_type(stmt, i + 1);
+			if (SQLITE_INTEGER == mListPos.type[i]) {
+				mListPos.i64[i] = sqlite3_column_int64(stmt, i + 1);
+			} else if (SQLITE_FLOAT == mListPos.type[i]) {
+				mListPos.d[i] = sqlite3_column_double(stmt, i + 1);
+			} else if (SQLITE_TEXT == mListPos.type[i]) {
+				mListPos.text[i] = (const char *)sqlite3_column_text(stmt, i + 1);
+			} else {
+				break;
+			}
+		}
+		if (i == keyCount) {
+			mListPos.sql = query;
+			mListPos.row = rowNumber + 1;
+			mListPos.keys = keyCount;
+		}
+	} else if (SQLITE_DONE != errorCode) {
+		ERROR(__FUNCTION__, __LINE__, con);
+	}
+	mDBCon->putStatement(stmt);
+	unlockConnection(con);
+	return retAddr;
+}
+
+/* copy a value where the getElement functions have always returned it */
+void * DBCtrl::storeResult(const struct db_value *value, int columnIdx)
+{
+	size_t len;
+
+	switch (value->type) {
+	case DB_UINT32:
+		result_uint32 = value->u32;
+		return (void *)&result_uint32;
+	case DB_INT64:
+		result_int64 = value->i64;
+		return (void *)&result_int64;
+	case DB_UINT16:
+		result_uint16 = value->u16;
+		return (void *)&result_uint16;
+	case DB_UINT8:
+		result_uint8 = value->u8;
+		return (void *)&result_uint8;
+	case DB_TEXT:
+		if (!value->text) {
 			return NULL;
+		}
+		len = value->bytes;
+		if (len >= sizeof(queryBuf[columnIdx])) {
+			len = sizeof(queryBuf[columnIdx]) - 1;
+		}
+		memcpy(queryBuf[columnIdx], value->text, len);
+		queryBuf[columnIdx][len] = '\0';
+		return &queryBuf[columnIdx];
+	case DB_FLOAT:
+		result_float = value->f;
+		return (void *)&result_float;
+	case DB_DOUBLE:
+		result_double = value->d;
+		return (void *)&result_double;
+	default:
+		return NULL;
+	}
+}
+
+/* the write lock, queued behind the writers that asked first */
+int DBCtrl::waitLock(void)
+{
+	return mDBCon->lockWrite(DB_LOCK_TIMEOUT_MS) == 0 ? 0 : ERR_TIMEOUT;
+}
+
+/* where a new read goes: our own connection with WAL, else the write one */
+SQLCon *DBCtrl::readConnection(void)
+{
+	if (mDBCon->isWal()) {
+		if (!mReadCon) {
+			mReadCon = mDBCon->openReader();
+		}
+		if (mReadCon) {
+			return mReadCon;
+		}
+	}
+	return mSQLCon;
+}
+
+/*
+ * Reads share the lock. Without WAL the readers keep the writer out, so
+ * they can share its connection too; with WAL it runs beside them, and
+ * a read that fell back to its connection takes the write lock instead.
+ * The journal mode only changes under the exclusive write lock, so it
+ * holds still while either lock is held.
+ * */
+bool DBCtrl::sharesLock(SQLCon *con)
+{
+	return con != mSQLCon || !mDBCon->isWal();
+}
+
+int DBCtrl::lockConnection(SQLCon *con)
+{
+	bool shared;
+	int ret;
+
+	for (;;) {
+		shared = sharesLock(con);
+		if (shared) {
+			ret = mDBCon->lockRead(DB_LOCK_TIMEOUT_MS);
+		} else {
+			ret = mDBCon->lockWrite(DB_LOCK_TIMEOUT_MS);
+		}
+		if (ret != 0) {
+			return ERR_TIMEOUT;
+		}
+		if (shared == sharesLock(con)) {
+			return 0;
+		}
+		/* the journal mode changed while we waited */
+		if (shared) {
+			mDBCon->unlockRead();
 		} else {
-			usleep(200000);
+			mDBCon->unlockWrite();
 		}
 	}
+}
 
-	const char *errorMsg = NULL;
-	errorCode = sqlite3_prepare(mSQLCon, mSQL.string(), -1, &mSqlstmt, &errorMsg);
-	if (SQLITE_OK != errorCode) {
-		mDBCon->unlock();
+void DBCtrl::unlockConnection(SQLCon *con)
+{
+	if (sharesLock(con)) {
+		mDBCon->unlockRead();
+	} else {
+		mDBCon->unlockWrite();
 	}
+}
 
-	int recordNum;
-	const void *tmpBlob;
-	char *tmpStr;
-	int len;
-	errorCode = sqlite3_step(mSqlstmt);
+/* called with the lock of con held */
+int DBCtrl::cursorStart(struct db_cursor *cursor, SQLCon *con, const String8 &sql,
+		const DBC_TYPE *type, int columns, unsigned int offset)
+{
+	int i;
+
+	cursorStop(cursor);
+	if (columns <= 0 || columns > DB_ROW_MAX_COLUMNS) {
+		ALOGE("%s():[%d] invalid column count %d\n", __FUNCTION__, __LINE__, columns);
+		return -1;
+	}
+	cursor->stmt = mDBCon->getStatement(sql, con);
+	if (!cursor->stmt) {
+		return -1;
+	}
+	if (sqlite3_bind_parameter_count(cursor->stmt) == 1) {
+		sqlite3_bind_int(cursor->stmt, 1, offset);
+	}
+	cursor->sql = sql;
+	for (i = 0; i < columns; i++) {
+		cursor->type[i] = type[i];
+	}
+	cursor->columns = columns;
+	cursor->row = offset;
+	return 0;
+}
+
+int DBCtrl::cursorStep(struct db_cursor *cursor, struct db_row *row)
+{
+	int errorCode;
+	int idx;
+
+	errorCode = sqlite3_step(cursor->stmt);
 	if (SQLITE_ROW == errorCode) {
-			switch(mColumnType[columnIdx]) {
-			case DB_UINT32:
-				result_uint32 = (unsigned int)sqlite3_column_int(mSqlstmt, 0);
-				retAddr =  (void *)&result_uint32;
-				break;
-			case DB_INT64:
-				result_int64 = (long long)sqlite3_column_int64(mSqlstmt, 0);
-				retAddr =  (void *)&result_int64;
-				break;
-			case DB_UINT16:
-				result_uint16 = (unsigned short)sqlite3_column_int(mSqlstmt, 0);
-				retAddr =  (void *)&result_uint16;
-				break;
-			case DB_UINT8:
-				result_uint8 = (unsigned char)sqlite3_column_int(mSqlstmt, 0);
-				retAddr =  (void *)&result_uint8;
-				break;
-			case DB_TEXT:
-				tmpStr = (char *)sqlite3_column_text(mSqlstmt, 0);
-				if (tmpStr) {
-					memcpy(queryBuf[columnIdx], tmpStr, strlen(tmpStr));
-					queryBuf[columnIdx][strlen(tmpStr)] = '\0';
-					retAddr =  &queryBuf[columnIdx];
-				} else {
-					retAddr = NULL;
-				}
-				break;
-			case DB_FLOAT:
-				result_float = (float)sqlite3_column_double(mSqlstmt, 0);
-				retAddr =  (void *)&result_float;
-				break;
-			case DB_DOUBLE:
-				result_double = sqlite3_column_double(mSqlstmt, 0);
-				retAddr =  (void *)&result_double;
-				break;
-#if 0
-			case DB_BLOB:
-				tmpBlob = sqlite3_column_blob(mSqlstmt, 0);
-				len = sqlite3_column_bytes(mSqlstmt, 0);
-				memcpy((void *)pValue, tmpBlob, len);
-				break;
-#endif
-			default:
-				retAddr =  NULL;
-				break;
+		if (row) {
+			row->count = cursor->columns;
+			for (idx = 0; idx < cursor->columns; idx++) {
+				readColumn(cursor->stmt, idx, cursor->type[idx], &row->value[idx]);
 			}
-	} else {
-		retAddr = NULL;
-		ERROR(__FUNCTION__, __LINE__, mSQLCon);
+		}
+		cursor->row++;
 	}
+	return errorCode;
+}
 
-	sqlite3_finalize(mSqlstmt);
-	mDBCon->unlock();
-	return retAddr;
+void DBCtrl::cursorStop(struct db_cursor *cursor)
+{
+	if (cursor->stmt) {
+		mDBCon->putStatement(cursor->stmt);
+		cursor->stmt = NULL;
+	}
+	cursor->row = 0;
+}
+
+/* cursorStop taking the lock of the cursor's connection */
+void DBCtrl::cursorRelease(struct db_cursor *cursor)
+{
+	SQLCon *con;
+
+	if (!cursor->stmt) {
+		cursor->row = 0;
+		return;
+	}
+	con = sqlite3_db_handle(cursor->stmt);
+	if (lockConnection(con) != 0) {
+		ALOGE("%s():[%d] database busy, cursor left open\n", __FUNCTION__, __LINE__);
+		return;
+	}
+	cursorStop(cursor);
+	unlockConnection(con);
+}
+
+int DBCtrl::cursorOpen(void)
+{
+	SQLCon *con;
+	int ret;
+
+	if (!mSQLCon) {
+		ALOGE("mSQLCon is null\n");
+		return -1;
+	}
+	createRequerySQL();
+	cursorRelease(&mCursor);
+	con = readConnection();
+	if (lockConnection(con) != 0) {
+		return ERR_TIMEOUT;
+	}
+	ret = cursorStart(&mCursor, con, mSQL, mColumnType, mColumnCnt, 0);
+	unlockConnection(con);
+	return ret;
+}
+
+int DBCtrl::cursorOpen(String8 columnName, int columnIdx, int filetype)
+{
+	SQLCon *con;
+	int ret;
+
+	if (!mSQLCon) {
+		ALOGE("mSQLCon is null\n");
+		return -1;
+	}
+	setSQL(createListSQL(columnName, filetype));
+	cursorRelease(&mCursor);
+	con = readConnection();
+	if (lockConnection(con) != 0) {
+		return ERR_TIMEOUT;
+	}
+	ret = cursorStart(&mCursor, con, mSQL, &mColumnType[columnIdx], 1, 0);
+	unlockConnection(con);
+	return ret;
+}
+
+int DBCtrl::cursorNext(struct db_row *row)
+{
+	SQLCon *con;
+	int errorCode;
+
+	if (!mCursor.stmt) {
+		ALOGE("no cursor open\n");
+		return -1;
+	}
+	con = sqlite3_db_handle(mCursor.stmt);
+	if (lockConnection(con) != 0) {
+		return ERR_TIMEOUT;
+	}
+	errorCode = cursorStep(&mCursor, row);
+	if (SQLITE_ROW != errorCode && SQLITE_DONE != errorCode) {
+		ERROR(__FUNCTION__, __LINE__, con);
+	}
+	unlockConnection(con);
+	return errorCode;
+}
+
+void DBCtrl::cursorClose(void)
+{
+	cursorRelease(&mCursor);
 }
 
 void DBCtrl::setColumnCnt(const int num)
@@ -890,7 +1292,7 @@ void DBCtrl::setColumnCnt(const int num)
 	mColumnName = new String8[num];
 	mColumnType = new DBC_TYPE[num];
 	mColumnTypeSize = new int[num];
-	mValue = new unsigned int[num];
+	mValue = new void *[num];
 	mFieldKey = new unsigned char[num];
 }
 
@@ -925,13 +1327,192 @@ void DBCtrl::createAddSQL(void)
 		str2.append("?, ");
 	}
 	str1.append(mColumnName[mColumnCnt-1]);
+	str2.append("?");
+
+	/* derive the media columns from the bound file name and time */
+	mFileColumn = -1;
+	if (mMediaIndex) {
+		int timeColumn = -1;
+		char param[16];
+		for (i=0; i<mColumnCnt; i++) {
+			if (mColumnName[i] == "file") {
+				mFileColumn = i;
+			} else if (mColumnName[i] == "time") {
+				timeColumn = i;
+			}
+		}
+		if (mFileColumn >= 0) {
+			String8 expr[DB_MEDIA_EXPRS];
+			sprintf(param, "?%d", mFileColumn + 1);
+			mediaColumnsSQL(param, expr);
+			str1.append(", category, camera, event, kind, start_time, file_size, duration");
+			for (i=0; i<DB_MEDIA_EXPRS; i++) {
+				str2.append(", ");
+				str2.append(expr[i]);
+			}
+			if (timeColumn >= 0) {
+				str2.appendFormat(", ?%d", timeColumn + 1);
+			} else {
+				str2.append(", strftime('%s', 'now')");
+			}
+			str2.appendFormat(", ?%d, ?%d", mColumnCnt + 1, mColumnCnt + 2);
+		}
+	}
 	str1.append(") ");
-	str2.append("?)");
+	str2.append(")");
 	mSQL = str1;
 	mSQL.append(str2);
 	mFilter = "";
 }
 
+/*
+ * category, camera, event and kind of a file name, the same LIKE rules
+ * getElementList has always filtered with, so migrated rows, new rows
+ * and the old queries agree.
+ * */
+void DBCtrl::mediaColumnsSQL(const char *file, String8 expr[DB_MEDIA_EXPRS])
+{
+	expr[0].appendFormat("CASE WHEN %s LIKE '%%.jpg' THEN %d "
+			"WHEN %s NOT LIKE '%%.mp4' THEN %d "
+			"WHEN %s LIKE '%%SOS%%' THEN %d "
+			"WHEN %s LIKE '%%A%%' AND %s NOT LIKE '%%B%%' THEN %d "
+			"WHEN %s LIKE '%%B%%' AND %s NOT LIKE '%%A%%' THEN %d "
+			"ELSE %d END",
+			file, DB_CATEGORY_PHOTO, file, DB_CATEGORY_OTHER, file, DB_CATEGORY_SOS,
+			file, file, DB_CATEGORY_FRONT, file, file, DB_CATEGORY_REAR, DB_CATEGORY_OTHER);
+	expr[1].appendFormat("CASE WHEN %s LIKE '%%A%%' AND %s NOT LIKE '%%B%%' THEN %d "
+			"WHEN %s LIKE '%%B%%' AND %s NOT LIKE '%%A%%' THEN %d ELSE %d END",
+			file, file, DB_CAMERA_FRONT, file, file, DB_CAMERA_REAR, DB_CAMERA_UNKNOWN);
+	expr[2].appendFormat("%s LIKE '%%SOS%%'", file);
+	expr[3].appendFormat("CASE WHEN %s LIKE '%%.mp4' THEN %d WHEN %s LIKE '%%.jpg' THEN %d "
+			"ELSE %d END",
+			file, DB_KIND_VIDEO, file, DB_KIND_PHOTO, DB_KIND_OTHER);
+}
+
+int DBCtrl::createMediaTrigger(const char *name, const char *event, const char *when)
+{
+	static const char *columns[] = { "category", "camera", "event", "kind" };
+	String8 expr[DB_MEDIA_EXPRS];
+	String8 str("CREATE TRIGGER IF NOT EXISTS ");
+	int i;
+
+	mediaColumnsSQL("NEW.file", expr);
+	str.appendFormat("%s_media_%s %s ON %s %s BEGIN UPDATE %s SET ",
+			mName.string(), name, event, mName.string(), when, mName.string());
+	for (i = 0; i < DB_MEDIA_EXPRS; i++) {
+		str.appendFormat("%s = %s, ", columns[i], expr[i].string());
+	}
+	str.append("start_time = NEW.time WHERE rowid = NEW.rowid; END");
+	return sqlite3_exec(mSQLCon, str.string(), NULL, NULL, NULL);
+}
+
+/*
+ * Give a table with a "file" column the typed media columns and the
+ * (category, time, file) index the file browser reads. Tables made by
+ * older versions get the columns added and filled from the file names.
+ * Called with the DBCon lock held.
+ * */
+int DBCtrl::createMediaIndex(void)
+{
+	static const char *columns[] = {
+		"category", "camera", "event", "kind", "start_time", "duration", "file_size"
+	};
+	const int count = sizeof(columns) / sizeof(columns[0]);
+	bool present[count];
+	bool hasFile = false, hasTime = false, added = false;
+	sqlite3_stmt *stmt = NULL;
+	String8 str("PRAGMA table_info(");
+	int errorCode;
+	int i;
+
+	mMediaIndex = false;
+	str.append(mName);
+	str.append(")");
+	if (SQLITE_OK != sqlite3_prepare_v2(mSQLCon, str.string(), -1, &stmt, NULL)) {
+		ERROR(__FUNCTION__, __LINE__, mSQLCon);
+		return -1;
+	}
+	for (i = 0; i < count; i++) {
+		present[i] = false;
+	}
+	while (SQLITE_ROW == sqlite3_step(stmt)) {
+		const char *name = (const char *)sqlite3_column_text(stmt, 1);
+		if (!name) {
+			continue;
+		}
+		hasFile |= !strcmp(name, "file");
+		hasTime |= !strcmp(name, "time");
+		for (i = 0; i < count; i++) {
+			present[i] |= !strcmp(name, columns[i]);
+		}
+	}
+	sqlite3_finalize(stmt);
+	if (!hasFile || !hasTime) {
+		return SQLITE_OK;
+	}
+
+	errorCode = sqlite3_exec(mSQLCon, BEGIN_TRANSACTION, NULL, NULL, NULL);
+	for (i = 0; i < count && SQLITE_OK == errorCode; i++) {
+		if (!present[i]) {
+			str = "ALTER TABLE ";
+			str.append(mName);
+			str.appendFormat(" ADD COLUMN %s INTEGER", columns[i]);
+			errorCode = sqlite3_exec(mSQLCon, str.string(), NULL, NULL, NULL);
+			added = true;
+		}
+	}
+	if (SQLITE_OK == errorCode && added) {
+		ALOGD("adding media columns to %s\n", mName.string());
+		String8 expr[DB_MEDIA_EXPRS];
+		mediaColumnsSQL("file", expr);
+		str = "UPDATE ";
+		str.append(mName);
+		str.append(" SET ");
+		for (i = 0; i < DB_MEDIA_EXPRS; i++) {
+			str.append(columns[i]);
+			str.append(" = ");
+			str.append(expr[i]);
+			str.append(", ");
+		}
+		str.append("start_time = time");
+		errorCode = sqlite3_exec(mSQLCon, str.string(), NULL, NULL, NULL);
+	}
+	if (SQLITE_OK == errorCode) {
+		str = "CREATE INDEX IF NOT EXISTS ";
+		str.append(mName);
+		str.append("_category_time ON ");
+		str.append(mName);
+		str.append("(category, time, file)");
+		errorCode = sqlite3_exec(mSQLCon, str.string(), NULL, NULL, NULL);
+	}
+	/* the list of all files seeks by time too */
+	if (SQLITE_OK == errorCode) {
+		str = "CREATE INDEX IF NOT EXISTS ";
+		str.append(mName);
+		str.append("_time ON ");
+		str.append(mName);
+		str.append("(time, file)");
+		errorCode = sqlite3_exec(mSQLCon, str.string(), NULL, NULL, NULL);
+	}
+	/* rows written with plain SQL instead of insertRecord get them too */
+	if (SQLITE_OK == errorCode) {
+		errorCode = createMediaTrigger("insert", "AFTER INSERT", "WHEN NEW.category IS NULL");
+	}
+	if (SQLITE_OK == errorCode) {
+		errorCode = createMediaTrigger("rename", "AFTER UPDATE OF file", "");
+	}
+	if (SQLITE_OK == errorCode) {
+		errorCode = sqlite3_exec(mSQLCon, COMMIT_TRANSACTION, NULL, NULL, NULL);
+	}
+	if (SQLITE_OK != errorCode) {
+		ERROR(__FUNCTION__, __LINE__, mSQLCon);
+		sqlite3_exec(mSQLCon, ROLLBACK_TRANSACTION, NULL, NULL, NULL);
+		return errorCode;
+	}
+	mMediaIndex = true;
+	return SQLITE_OK;
+}
+
 int DBCtrl::createTable(String8 tbName, struct sql_tb *tb, int cnt)
 {
 	char *errorMsg = NULL;
@@ -942,13 +1523,8 @@ int DBCtrl::createTable(String8 tbName, struct sql_tb *tb, int cnt)
 	int i = 0;
 	int errorCode;
 
-	while (mDBCon->lock()) {
-		if (cnt++ > RETRY_CNT) {
-			mDBCon->unlock();
-			return ERR_TIMEOUT;
-		} else {
-			usleep(200000);
-		}
+	if (waitLock() != 0) {
+		return ERR_TIMEOUT;
 	}
 	for (i=0; i<cnt-1; i++) {
 		str.append(tb[i].item);
@@ -968,7 +1544,13 @@ int DBCtrl::createTable(String8 tbName, struct sql_tb *tb, int cnt)
 		ERROR(__FUNCTION__, __LINE__, mSQLCon);
 	}
 	setColumnCnt(cnt);
-	mDBCon->unlock();
+	for (i=0; i<cnt; i++) {	/* insertRecords needs them without setRecord */
+		mColumnName[i] = tb[i].item;
+	}
+	if (SQLITE_OK == errorCode) {
+		createMediaIndex();
+	}
+	mDBCon->unlockWrite();
     return errorCode;
 }
 
@@ -978,10 +1560,14 @@ int DBCtrl::deleteTable(String8 tbName)
 	int errorCode;
 	String8 str("DROP TABLE IF EXISTS ");
 	str += mName;
+	if (waitLock() != 0) {
+		return ERR_TIMEOUT;
+	}
 	errorCode = sqlite3_exec(mSQLCon, str.string(), NULL, NULL, &errorMsg);
 	if(SQLITE_OK != errorCode) {
 		ERROR(__FUNCTION__, __LINE__, mSQLCon);
 	}
+	mDBCon->unlockWrite();
 	return errorCode;
 }
 
@@ -0,0 +1,629 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cutils/atomic.h>
+#include <utils/Timers.h>
+#include "include_database/DBWriter.h"
+#undef LOG_NDEBUG
+#undef NDEBUG
+#define LOG_TAG "DBWriter.cpp"
+#include <utils/Log.h>
+
+namespace android {
+
+#define DB_WRITER_MAGIC 0x44425753		/* "DBWS", rows with a sequence number */
+#define DB_WRITER_NULL_TEXT 0xffff
+#define DB_WRITER_QUEUE_MASK (DB_WRITER_QUEUE_SIZE - 1)
+#define DB_WRITER_RETRY_MS 50			/* first delay after a failed commit, doubles */
+
+#define FNV_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+/* one row in the replay log */
+struct log_entry
+{
+	uint32_t magic;
+	uint32_t layout;		/* rows of another table layout are skipped */
+	uint32_t sum;
+	struct db_writer_record record;
+};
+
+static uint32_t fnv(uint32_t hash, const void *data, size_t size)
+{
+	const unsigned char *p = (const unsigned char *)data;
+
+	while (size--) {
+		hash ^= *p++;
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+/* true if position a comes before b, the positions wrap */
+static inline bool before(int32_t a, int32_t b)
+{
+	return (int32_t)((uint32_t)a - (uint32_t)b) < 0;
+}
+
+DBWriter::DBWriter(const char *dbPath, const String8 &table, struct sql_tb *tb,
+		DBC_TYPE *type, int columns, const char *logPath)
+	: Thread(false),
+	  mDBPath(dbPath ? dbPath : ""),
+	  mTable(table),
+	  mTb(NULL),
+	  mType(NULL),
+	  mColumns(columns),
+	  mLayout(FNV_BASIS),
+	  mDB(NULL),
+	  mLogFd(-1),
+	  mQueue(NULL),
+	  mHead(0),
+	  mTail(0),
+	  mSleeping(0),
+	  mStopped(0),
+	  mFull(0),
+	  mStarted(false),
+	  mPending(NULL),
+	  mPendingCnt(0),
+	  mPendingSince(0),
+	  mValues(NULL),
+	  mSeq(0),
+	  mCommittedSeq(0),
+	  mReplayOffset(0),
+	  mKeepLog(false),
+	  mRetryMs(0),
+	  mDone(0),
+	  mFlushWaiters(0),
+	  mBatchRows(DB_WRITER_BATCH_ROWS),
+	  mIntervalMs(DB_WRITER_INTERVAL_MS)
+{
+	int i;
+
+	memset(&mStats, 0, sizeof(mStats));
+	if (logPath) {
+		mLogPath = logPath;
+	} else {
+		mLogPath = "/data/dbwriter-";
+		mLogPath.append(table);
+		mLogPath.append(".log");
+	}
+	if (columns <= 0 || columns > DB_ROW_MAX_COLUMNS) {
+		ALOGE("%s():[%d] invalid column count %d\n", __FUNCTION__, __LINE__, columns);
+		mColumns = 0;
+		return;
+	}
+	mTb = new sql_tb[columns];
+	mType = new DBC_TYPE[columns];
+	for (i = 0; i < columns; i++) {
+		if (type[i] == DB_BLOB) {
+			ALOGE("%s():[%d] blob column %s not supported\n", __FUNCTION__, __LINE__,
+					tb[i].item);
+			mColumns = 0;
+		}
+		mTb[i] = tb[i];
+		mType[i] = type[i];
+		mLayout = fnv(mLayout, tb[i].item, strlen(tb[i].item));
+		mLayout = fnv(mLayout, &type[i], sizeof(type[i]));
+	}
+
+	mQueue = new queue_cell[DB_WRITER_QUEUE_SIZE];
+	for (i = 0; i < DB_WRITER_QUEUE_SIZE; i++) {
+		mQueue[i].seq = i;
+	}
+	mPending = new db_writer_record[DB_WRITER_MAX_PENDING];
+	mValues = new void *[DB_WRITER_MAX_PENDING * columns];
+}
+
+DBWriter::~DBWriter()
+{
+	if (mDB) {
+		delete mDB;
+		mDB = NULL;
+	}
+	if (mLogFd >= 0) {
+		close(mLogFd);
+		mLogFd = -1;
+	}
+	delete [] mTb;
+	delete [] mType;
+	delete [] mQueue;
+	delete [] mPending;
+	delete [] mValues;
+}
+
+status_t DBWriter::start(void)
+{
+	status_t ret;
+
+	if (mColumns <= 0 || mStarted) {
+		return INVALID_OPERATION;
+	}
+	mDB = new DBCtrl(mDBPath.isEmpty() ? NULL : mDBPath.string());
+	if (mDB->createTable(mTable, mTb, mColumns) != SQLITE_OK) {
+		ALOGE("%s():[%d] no table %s\n", __FUNCTION__, __LINE__, mTable.string());
+		return UNKNOWN_ERROR;
+	}
+	mDB->setColumnType(mType, NULL);
+
+	mLogFd = open(mLogPath.string(), O_RDWR | O_CREAT | O_APPEND, 0600);
+	if (mLogFd < 0) {
+		ALOGW("no replay log %s: %s, a crash loses the rows not yet committed\n",
+				mLogPath.string(), strerror(errno));
+	} else {
+		mCommittedSeq = committedSeq();
+		if (mCommittedSeq < 0) {
+			/* every commit would fail on the missing table */
+			ALOGE("%s():[%d] no table %s\n", __FUNCTION__, __LINE__, DB_WRITER_SEQ_TABLE);
+			close(mLogFd);
+			mLogFd = -1;
+			return UNKNOWN_ERROR;
+		}
+		mSeq = mCommittedSeq;
+		replay();
+	}
+
+	ret = run("DBWriter", PRIORITY_BACKGROUND);
+	if (ret == NO_ERROR) {
+		mStarted = true;
+	}
+	return ret;
+}
+
+/*
+ * Bounded multi-producer queue: a cell whose seq equals the position is
+ * free, seq == position + 1 holds a row for the thread, which hands the
+ * cell back for the next lap with seq = position + DB_WRITER_QUEUE_SIZE.
+ */
+int DBWriter::enqueue(void *pValues[])
+{
+	struct db_writer_record record;
+	struct queue_cell *cell;
+	size_t used = 0, len;
+	int32_t pos;
+	int i;
+
+	if (mColumns <= 0 || android_atomic_acquire_load(&mStopped)) {
+		return -1;
+	}
+	memset(&record, 0, sizeof(record));
+	for (i = 0; i < mColumns; i++) {
+		switch (mType[i]) {
+		case DB_UINT32:
+			record.value[i].u32 = *(const unsigned int *)pValues[i];
+			break;
+		case DB_INT64:
+			record.value[i].i64 = *(const long long *)pValues[i];
+			break;
+		case DB_UINT16:
+			record.value[i].u16 = *(const unsigned short *)pValues[i];
+			break;
+		case DB_UINT8:
+			record.value[i].u8 = *(const unsigned char *)pValues[i];
+			break;
+		case DB_FLOAT:
+			record.value[i].f = *(const float *)pValues[i];
+			break;
+		case DB_DOUBLE:
+			record.value[i].d = *(const double *)pValues[i];
+			break;
+		case DB_TEXT:
+		case DB_DATETIME:
+			if (!pValues[i]) {
+				record.value[i].text = DB_WRITER_NULL_TEXT;
+				break;
+			}
+			len = strlen((const char *)pValues[i]) + 1;
+			if (used + len > DB_WRITER_TEXT_MAX) {
+				ALOGE("%s():[%d] row text longer than %d\n", __FUNCTION__, __LINE__,
+						DB_WRITER_TEXT_MAX);
+				return -1;
+			}
+			memcpy(record.text + used, pValues[i], len);
+			record.value[i].text = used;
+			used += len;
+			break;
+		default:
+			break;
+		}
+	}
+
+	pos = android_atomic_acquire_load(&mHead);
+	for (;;) {
+		cell = &mQueue[pos & DB_WRITER_QUEUE_MASK];
+		int32_t seq = android_atomic_acquire_load(&cell->seq);
+		if (seq == pos) {
+			if (android_atomic_cmpxchg(pos, pos + 1, &mHead) == 0) {
+				break;
+			}
+		} else if (before(seq, pos)) {
+			android_atomic_inc(&mFull);
+			return -1;
+		}
+		pos = android_atomic_acquire_load(&mHead);
+	}
+	memcpy(&cell->record, &record, sizeof(record));
+	android_atomic_release_store(pos + 1, &cell->seq);
+
+	/* full barrier, pairs with the thread going to sleep in threadLoop */
+	if (android_atomic_or(0, &mSleeping)) {
+		Mutex::Autolock _l(mLock);
+		mWakeCond.signal();
+	}
+	return 0;
+}
+
+bool DBWriter::queueEmpty(void)
+{
+	struct queue_cell *cell = &mQueue[mTail & DB_WRITER_QUEUE_MASK];
+
+	return android_atomic_acquire_load(&cell->seq) != mTail + 1;
+}
+
+/* move rows from the queue to mPending, logging them on the way */
+void DBWriter::drain(void)
+{
+	struct log_entry entry;
+	struct queue_cell *cell;
+	bool logged = false;
+
+	while (mPendingCnt < DB_WRITER_MAX_PENDING && !queueEmpty()) {
+		cell = &mQueue[mTail & DB_WRITER_QUEUE_MASK];
+		memcpy(&mPending[mPendingCnt], &cell->record, sizeof(cell->record));
+		android_atomic_release_store(mTail + DB_WRITER_QUEUE_SIZE, &cell->seq);
+		mTail++;
+		if (mPendingCnt == 0) {
+			mPendingSince = systemTime(SYSTEM_TIME_MONOTONIC);
+		}
+		mPending[mPendingCnt].seq = ++mSeq;
+		if (mLogFd >= 0) {
+			entry.magic = DB_WRITER_MAGIC;
+			entry.layout = mLayout;
+			memcpy(&entry.record, &mPending[mPendingCnt], sizeof(entry.record));
+			entry.sum = fnv(FNV_BASIS, &entry.record, sizeof(entry.record));
+			if (write(mLogFd, &entry, sizeof(entry)) != (ssize_t)sizeof(entry)) {
+				ALOGE("%s():[%d] replay log: %s\n", __FUNCTION__, __LINE__, strerror(errno));
+			}
+			logged = true;
+		}
+		mPendingCnt++;
+	}
+	if (logged) {
+		fdatasync(mLogFd);
+	}
+}
+
+void DBWriter::fillValues(struct db_writer_record *record, void **values)
+{
+	int i;
+
+	for (i = 0; i < mColumns; i++) {
+		if (mType[i] == DB_TEXT || mType[i] == DB_DATETIME) {
+			values[i] = record->value[i].text == DB_WRITER_NULL_TEXT ? NULL
+					: record->text + record->value[i].text;
+		} else {
+			values[i] = &record->value[i];
+		}
+	}
+}
+
+/*
+ * Rows of mPending in one transaction. A row the database rejects fails
+ * the batch, so then they go one by one and the rejected ones are
+ * dropped. Returns the rows done with, or -1 to try again later.
+ */
+int DBWriter::commitRows(int first, int rows, unsigned int *failed)
+{
+	String8 mark;
+	int errorCode;
+	int i, done;
+
+	for (i = 0; i < rows; i++) {
+		fillValues(&mPending[first + i], &mValues[i * mColumns]);
+	}
+	if (mLogFd >= 0) {
+		mark.appendFormat("INSERT OR REPLACE INTO %s VALUES('%s', %lld)", DB_WRITER_SEQ_TABLE,
+				mTable.string(), mPending[first + rows - 1].seq);
+	}
+	errorCode = mDB->insertRecords(mValues, rows, NULL, NULL,
+			mark.isEmpty() ? NULL : mark.string());
+	if (SQLITE_OK == errorCode) {
+		return rows;
+	}
+	if (SQLITE_CONSTRAINT != errorCode && SQLITE_MISMATCH != errorCode
+			&& SQLITE_TOOBIG != errorCode) {
+		ALOGW("%s():[%d] insert failed (%d), retrying later\n", __FUNCTION__, __LINE__,
+				errorCode);
+		return -1;
+	}
+	if (rows == 1) {
+		(*failed)++;
+		return 1;
+	}
+	for (i = 0; i < rows; i++) {
+		done = commitRows(first + i, 1, failed);
+		if (done < 0) {
+			return i > 0 ? i : -1;
+		}
+	}
+	return rows;
+}
+
+int DBWriter::commit(void)
+{
+	nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+	unsigned int failed = 0;
+	unsigned int us;
+	int done;
+
+	done = commitRows(0, mPendingCnt, &failed);
+	if (done <= 0) {
+		mPendingSince = systemTime(SYSTEM_TIME_MONOTONIC);
+		return -1;
+	}
+	us = (unsigned int)((systemTime(SYSTEM_TIME_MONOTONIC) - start) / 1000);
+	mPendingCnt -= done;
+	if (mPendingCnt > 0) {
+		memmove(mPending, mPending + done, mPendingCnt * sizeof(mPending[0]));
+		mPendingSince = systemTime(SYSTEM_TIME_MONOTONIC);
+	} else if (mLogFd >= 0 && !mKeepLog) {
+		/* rows still queued are not logged yet, the log holds only these */
+		if (ftruncate(mLogFd, 0) != 0) {
+			ALOGE("%s():[%d] replay log: %s\n", __FUNCTION__, __LINE__, strerror(errno));
+		}
+	}
+	if (failed) {
+		ALOGE("%s():[%d] %u rows rejected by the database\n", __FUNCTION__, __LINE__, failed);
+	}
+
+	Mutex::Autolock _l(mLock);
+	mStats.committed += done - failed;
+	mStats.failed += failed;
+	mStats.batches++;
+	if ((unsigned int)done > mStats.maxBatch) {
+		mStats.maxBatch = done;
+	}
+	if (us > mStats.maxCommitUs) {
+		mStats.maxCommitUs = us;
+	}
+	mDone += done;
+	mFlushCond.broadcast();
+	return mPendingCnt > 0 ? -1 : 0;
+}
+
+/* the sequence number committed with the last batch, -1 without the table */
+long long DBWriter::committedSeq(void)
+{
+	struct sql_tb tb[2] = { { "tb", "TEXT" }, { "seq", "INTEGER" } };
+	DBC_TYPE type[2] = { DB_TEXT, DB_INT64 };
+	DBCtrl db(mDBPath.isEmpty() ? NULL : mDBPath.string());
+	struct db_row row;
+	String8 filter;
+	long long seq = 0;
+
+	if (db.createTable(String8(DB_WRITER_SEQ_TABLE), tb, 2) != SQLITE_OK) {
+		return -1;
+	}
+	db.setColumnType(type, NULL);
+	filter.appendFormat("WHERE tb = '%s'", mTable.string());
+	db.setFilter(filter);
+	if (db.cursorOpen() == 0 && db.cursorNext(&row) == SQLITE_ROW) {
+		seq = row.value[1].i64;
+	}
+	db.cursorClose();
+	return seq;
+}
+
+/*
+ * Rows logged by a process that died before committing them. The rows
+ * up to mCommittedSeq are in the table already. If the database fails
+ * with mPending full, the rest stays in the log and threadLoop calls
+ * this again, ahead of the queue, once mPending is committed: the rows
+ * go in log order, which is what the sequence number check needs.
+ */
+void DBWriter::replay(void)
+{
+	struct log_entry entry;
+	unsigned int rows = 0, skipped = 0, committed = 0;
+	int loaded = 0;
+	off_t offset = mReplayOffset;
+
+	mKeepLog = false;
+	lseek(mLogFd, offset, SEEK_SET);
+	while (read(mLogFd, &entry, sizeof(entry)) == (ssize_t)sizeof(entry)) {
+		if (entry.magic != DB_WRITER_MAGIC
+				|| entry.sum != fnv(FNV_BASIS, &entry.record, sizeof(entry.record))) {
+			break;		/* torn by the crash */
+		}
+		if (entry.layout != mLayout) {
+			skipped++;
+		} else if (entry.record.seq <= mCommittedSeq) {
+			committed++;
+		} else {
+			if (mPendingCnt == DB_WRITER_MAX_PENDING) {
+				{
+					/* not queue positions, flush must not count them */
+					Mutex::Autolock _l(mLock);
+					mDone -= loaded;
+				}
+				loaded = 0;
+				if (commit() != 0) {
+					ALOGE("%s():[%d] database unavailable, keeping %s\n", __FUNCTION__, __LINE__,
+							mLogPath.string());
+					mKeepLog = true;
+					break;
+				}
+			}
+			memcpy(&mPending[mPendingCnt++], &entry.record, sizeof(entry.record));
+			if (entry.record.seq > mSeq) {
+				mSeq = entry.record.seq;
+			}
+			loaded++;
+			rows++;
+		}
+		offset += sizeof(entry);
+	}
+	if (rows || skipped || committed) {
+		ALOGD("replaying %u rows of %s, %u committed already, %u of another table\n",
+				rows, mLogPath.string(), committed, skipped);
+	}
+	{
+		Mutex::Autolock _l(mLock);
+		mDone -= loaded;
+		mStats.replayed += rows;
+	}
+	if (mKeepLog) {
+		mReplayOffset = offset;
+		return;
+	}
+	/* the log is read to the end, the next full commit empties it */
+	mReplayOffset = 0;
+	if (mPendingCnt > 0) {
+		commit();
+	} else if (ftruncate(mLogFd, 0) != 0) {
+		ALOGE("%s():[%d] replay log: %s\n", __FUNCTION__, __LINE__, strerror(errno));
+	}
+}
+
+bool DBWriter::threadLoop()
+{
+	nsecs_t now, due, interval;
+	bool exiting, flushing, failed = false;
+	unsigned int batchRows;
+
+	if (!mKeepLog) {
+		drain();
+	} else if (mPendingCnt == 0) {
+		replay();
+	}
+	{
+		Mutex::Autolock _l(mLock);
+		exiting = exitPending();
+		flushing = mFlushWaiters > 0;
+		batchRows = mBatchRows;
+		interval = milliseconds_to_nanoseconds(mIntervalMs);
+	}
+	if (mPendingCnt > 0) {
+		now = systemTime(SYSTEM_TIME_MONOTONIC);
+		due = mPendingSince + interval;
+		if (exiting || flushing || mPendingCnt >= (int)batchRows
+				|| mPendingCnt == DB_WRITER_MAX_PENDING || now >= due) {
+			if (commit() == 0) {
+				mRetryMs = 0;
+			} else if (exiting) {
+				ALOGE("%s():[%d] %d rows left in %s\n", __FUNCTION__, __LINE__,
+						mPendingCnt, mLogPath.string());
+				return false;
+			} else {
+				failed = true;
+			}
+		}
+	}
+	if (exiting) {
+		/* a row claimed but never written would keep us here */
+		return mPendingCnt > 0 || !queueEmpty();
+	}
+
+	Mutex::Autolock _l(mLock);
+	if (failed) {
+		/*
+		 * The card is full or gone. Neither new rows nor a flush make the
+		 * next attempt more likely to succeed, only stop cuts the delay.
+		 */
+		mRetryMs = mRetryMs ? mRetryMs * 2 : DB_WRITER_RETRY_MS;
+		if (mRetryMs > mIntervalMs) {
+			mRetryMs = mIntervalMs > DB_WRITER_RETRY_MS ? mIntervalMs : DB_WRITER_RETRY_MS;
+		}
+		due = systemTime(SYSTEM_TIME_MONOTONIC) + milliseconds_to_nanoseconds(mRetryMs);
+		while (!exitPending() && (now = systemTime(SYSTEM_TIME_MONOTONIC)) < due) {
+			mWakeCond.waitRelative(mLock, due - now);
+		}
+		return true;
+	}
+	if (exitPending() || (mFlushWaiters > 0 && mPendingCnt > 0)
+			|| (mKeepLog && mPendingCnt == 0)) {
+		return true;
+	}
+	due = milliseconds_to_nanoseconds(mIntervalMs);
+	if (mPendingCnt > 0) {
+		now = systemTime(SYSTEM_TIME_MONOTONIC);
+		due = mPendingSince + due - now;
+		if (due < milliseconds_to_nanoseconds(1)) {
+			due = milliseconds_to_nanoseconds(1);
+		}
+	}
+	android_atomic_or(1, &mSleeping);
+	if (queueEmpty()) {
+		mWakeCond.waitRelative(mLock, due);
+	}
+	android_atomic_and(0, &mSleeping);
+	return true;
+}
+
+int DBWriter::flush(unsigned int timeoutMs)
+{
+	int32_t target = android_atomic_acquire_load(&mHead);
+	nsecs_t deadline = systemTime(SYSTEM_TIME_MONOTONIC) + milliseconds_to_nanoseconds(timeoutMs);
+	nsecs_t now;
+	int ret = 0;
+
+	Mutex::Autolock _l(mLock);
+	if (!before(mDone, target)) {
+		return 0;
+	}
+	if (!mStarted) {
+		return -1;
+	}
+	mFlushWaiters++;
+	mWakeCond.signal();
+	while (before(mDone, target)) {
+		now = systemTime(SYSTEM_TIME_MONOTONIC);
+		if (now >= deadline) {
+			ret = -1;
+			break;
+		}
+		mFlushCond.waitRelative(mLock, deadline - now);
+	}
+	mFlushWaiters--;
+	return ret;
+}
+
+void DBWriter::stop(void)
+{
+	android_atomic_release_store(1, &mStopped);
+	if (!mStarted) {
+		return;
+	}
+	requestExit();
+	{
+		Mutex::Autolock _l(mLock);
+		mWakeCond.signal();
+	}
+	requestExitAndWait();
+	mStarted = false;
+	delete mDB;
+	mDB = NULL;
+}
+
+void DBWriter::setBatch(unsigned int rows, unsigned int intervalMs)
+{
+	Mutex::Autolock _l(mLock);
+
+	mBatchRows = rows > 0 ? rows : 1;
+	if (mBatchRows > DB_WRITER_MAX_PENDING) {
+		mBatchRows = DB_WRITER_MAX_PENDING;
+	}
+	mIntervalMs = intervalMs;
+}
+
+void DBWriter::getStats(struct db_writer_stats *stats)
+{
+	Mutex::Autolock _l(mLock);
+
+	*stats = mStats;
+	stats->enqueued = (unsigned int)android_atomic_acquire_load(&mHead);
+	stats->full = (unsigned int)android_atomic_acquire_load(&mFull);
+}
+
+}
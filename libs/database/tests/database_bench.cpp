@@ -0,0 +1,283 @@
+/*
+ * Inserts and then deletes rows of a recordings-like table, once with one
+ * transaction per row (insertRecord, deleteRecord) and once in batches
+ * (insertRecords, deleteRecords). Then inserts row by row while a second
+ * DBCtrl counts the rows from another thread, and reports how long that
+ * reader waited and the lock wait percentiles. Last, hands the rows to a
+ * DBWriter and reports how long enqueue took and how long flush waited.
+ * Runs with the default rollback journal and with WAL + synchronous=NORMAL.
+ *
+ * usage: database_bench [db path] [rows] [batch size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "include_database/DBCtrl.h"
+#include "include_database/DBWriter.h"
+
+using namespace android;
+
+static int64_t nowUs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000ll + ts.tv_nsec / 1000;
+}
+
+static double rate(int rows, int64_t us)
+{
+	return us > 0 ? rows * 1000000.0 / us : 0;
+}
+
+struct bench_row
+{
+	char file[64];
+	long long time;
+	unsigned int size;
+};
+
+static struct sql_tb gTable[3] = {
+	{"file", "TEXT"},
+	{"time", "INTEGER"},
+	{"size", "INTEGER"},
+};
+static DBC_TYPE gType[3] = { DB_TEXT, DB_INT64, DB_UINT32 };
+
+struct reader_arg
+{
+	const char *path;
+	volatile bool stop;
+	int reads;
+	int failed;
+	int64_t maxUs;
+};
+
+static void *readerThread(void *data)
+{
+	struct reader_arg *arg = (struct reader_arg *)data;
+	DBCtrl *db = new DBCtrl(arg->path);
+	int64_t start, us;
+
+	db->createTable(String8("bench"), gTable, 3);
+	db->setColumnType(gType, NULL);
+	while (!arg->stop) {
+		start = nowUs();
+		if ((int)db->getRecordCnt() < 0) {
+			arg->failed++;
+		}
+		us = nowUs() - start;
+		if (us > arg->maxUs) {
+			arg->maxUs = us;
+		}
+		arg->reads++;
+	}
+	delete db;
+	return NULL;
+}
+
+static void contend(DBCtrl *db, const char *path, const char *mode,
+		struct bench_row *rows, int num)
+{
+	struct reader_arg arg;
+	struct db_lock_stats stats;
+	pthread_t thread;
+	int i;
+
+	db->setSQL(String8("DELETE FROM bench"));
+	db->executeSQL();
+
+	memset(&arg, 0, sizeof(arg));
+	arg.path = path;
+	if (pthread_create(&thread, NULL, readerThread, &arg) != 0) {
+		fprintf(stderr, "no reader thread\n");
+		return;
+	}
+	for (i = 0; i < num; i++) {
+		db->setRecord(String8("file"), rows[i].file);
+		db->setRecord(String8("time"), &rows[i].time);
+		db->setRecord(String8("size"), &rows[i].size);
+		db->insertRecord();
+	}
+	arg.stop = true;
+	pthread_join(thread, NULL);
+
+	db->getLockStats(&stats);
+	printf("%-8s reader beside insertRecord: %d reads, %d failed, longest %lld us\n",
+			mode, arg.reads, arg.failed, (long long)arg.maxUs);
+	printf("%-8s lock wait us: read p50 %u p99 %u, write p50 %u p99 %u, max %u, "
+			"%u of %u blocked, %u timeouts\n", mode, stats.readWaitP50, stats.readWaitP99,
+			stats.writeWaitP50, stats.writeWaitP99, stats.maxWait, stats.blocked,
+			stats.reads + stats.writes, stats.timeouts);
+}
+
+static void run(DBCtrl *db, const char *mode, struct bench_row *rows, int num, int batch)
+{
+	void **values = new void *[batch * 3];
+	void **names = new void *[batch];
+	int64_t start;
+	int i, j, n;
+
+	db->setSQL(String8("DELETE FROM bench"));
+	db->executeSQL();
+
+	start = nowUs();
+	for (i = 0; i < num; i++) {
+		db->setRecord(String8("file"), rows[i].file);
+		db->setRecord(String8("time"), &rows[i].time);
+		db->setRecord(String8("size"), &rows[i].size);
+		if (db->insertRecord() != SQLITE_OK) {
+			fprintf(stderr, "insertRecord failed at row %d\n", i);
+		}
+	}
+	printf("%-8s insertRecord           %10.0f rows/s\n", mode, rate(num, nowUs() - start));
+
+	start = nowUs();
+	for (i = 0; i < num; i++) {
+		String8 filter("WHERE file = '");
+		filter.append(rows[i].file);
+		filter.append("'");
+		db->setFilter(filter);
+		db->deleteRecord();
+	}
+	printf("%-8s deleteRecord           %10.0f rows/s\n", mode, rate(num, nowUs() - start));
+
+	start = nowUs();
+	for (i = 0; i < num; i += n) {
+		n = (num - i < batch) ? num - i : batch;
+		for (j = 0; j < n; j++) {
+			values[j * 3] = rows[i + j].file;
+			values[j * 3 + 1] = &rows[i + j].time;
+			values[j * 3 + 2] = &rows[i + j].size;
+		}
+		if (db->insertRecords(values, n) != SQLITE_OK) {
+			fprintf(stderr, "insertRecords failed at row %d\n", i);
+		}
+	}
+	printf("%-8s insertRecords(%4d)    %10.0f rows/s\n", mode, batch, rate(num, nowUs() - start));
+	if ((int)db->getRecordCnt() != num) {
+		fprintf(stderr, "expected %d rows after insertRecords\n", num);
+	}
+
+	start = nowUs();
+	for (i = 0; i < num; i += n) {
+		n = (num - i < batch) ? num - i : batch;
+		for (j = 0; j < n; j++) {
+			names[j] = rows[i + j].file;
+		}
+		if (db->deleteRecords(String8("file"), DB_TEXT, names, n) != SQLITE_OK) {
+			fprintf(stderr, "deleteRecords failed at row %d\n", i);
+		}
+	}
+	printf("%-8s deleteRecords(%4d)    %10.0f rows/s\n", mode, batch, rate(num, nowUs() - start));
+	if (db->getRecordCnt() != 0) {
+		fprintf(stderr, "expected an empty table after deleteRecords\n");
+	}
+
+	delete [] values;
+	delete [] names;
+}
+
+static void writeBehind(DBCtrl *db, const char *path, const char *mode,
+		struct bench_row *rows, int num)
+{
+	String8 log(path);
+	sp<DBWriter> writer;
+	struct db_writer_stats stats;
+	int64_t start, us, longest = 0, total = 0;
+	int i, full = 0;
+
+	db->setSQL(String8("DELETE FROM bench"));
+	db->executeSQL();
+
+	log.append("-writer.log");
+	writer = new DBWriter(path, String8("bench"), gTable, gType, 3, log.string());
+	if (writer->start() != NO_ERROR) {
+		fprintf(stderr, "DBWriter did not start\n");
+		return;
+	}
+	for (i = 0; i < num; i++) {
+		void *values[3] = { rows[i].file, &rows[i].time, &rows[i].size };
+		start = nowUs();
+		while (writer->enqueue(values) != 0) {
+			full++;
+			usleep(1000);
+			start = nowUs();
+		}
+		us = nowUs() - start;
+		total += us;
+		if (us > longest) {
+			longest = us;
+		}
+	}
+	start = nowUs();
+	if (writer->flush(10000) != 0) {
+		fprintf(stderr, "flush timed out\n");
+	}
+	us = nowUs() - start;
+	writer->getStats(&stats);
+	writer->stop();
+	printf("%-8s DBWriter enqueue %.1f us/row, longest %lld us, %d times full; "
+			"flush %lld us\n", mode, num > 0 ? (double)total / num : 0.0,
+			(long long)longest, full, (long long)us);
+	printf("%-8s DBWriter %u batches, largest %u rows, longest commit %u us\n",
+			mode, stats.batches, stats.maxBatch, stats.maxCommitUs);
+	if ((int)db->getRecordCnt() != num) {
+		fprintf(stderr, "expected %d rows after DBWriter flush\n", num);
+	}
+	unlink(log.string());
+}
+
+static void removeDB(const char *path)
+{
+	String8 name(path);
+	unlink(name.string());
+	unlink((name + "-journal").string());
+	unlink((name + "-wal").string());
+	unlink((name + "-shm").string());
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : "/data/database_bench.db";
+	int num = argc > 2 ? atoi(argv[2]) : 500;
+	int batch = argc > 3 ? atoi(argv[3]) : 100;
+	struct bench_row *rows;
+	DBCtrl *db;
+	int i;
+
+	if (num <= 0 || batch <= 0) {
+		fprintf(stderr, "usage: %s [db path] [rows] [batch size]\n", argv[0]);
+		return 1;
+	}
+	rows = new bench_row[num];
+	for (i = 0; i < num; i++) {
+		snprintf(rows[i].file, sizeof(rows[i].file), "/mnt/extsd/video/%08d_%s.mp4",
+				i, (i & 1) ? "B" : "A");
+		rows[i].time = 1400000000ll + i * 60;
+		rows[i].size = 100 << 20;
+	}
+
+	removeDB(path);
+	db = new DBCtrl(path);
+	db->createTable(String8("bench"), gTable, 3);
+	db->setColumnType(gType, NULL);
+
+	run(db, "delete", rows, num, batch);
+	contend(db, path, "delete", rows, num);
+	writeBehind(db, path, "delete", rows, num);
+	if (db->setJournalMode(true) == SQLITE_OK) {
+		run(db, "wal", rows, num, batch);
+		contend(db, path, "wal", rows, num);
+		writeBehind(db, path, "wal", rows, num);
+	}
+
+	delete db;
+	removeDB(path);
+	delete [] rows;
+	return 0;
+}
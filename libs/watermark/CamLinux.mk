@@ -5,13 +5,55 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:= \
     water_mark.c \
+	water_mark_kernel.c \
+	water_mark_atlas.c \
 	water_mark_interface.c
 LOCAL_SHARED_LIBRARIES := \
 	libcutils \
 
+ifeq ($(TARGET_ARCH),arm)
+LOCAL_CFLAGS += -mfpu=neon
+endif
+
 LOCAL_MODULE:= libwater_mark
 
 include $(BUILD_SHARED_LIBRARY)
 
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	tests/watermark_bench.c
+LOCAL_SHARED_LIBRARIES := \
+	libwater_mark
+
+LOCAL_MODULE:= watermark_bench
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	tests/watermark_kernel_test.c
+LOCAL_SHARED_LIBRARIES := \
+	libwater_mark
+
+LOCAL_MODULE:= watermark_kernel_test
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	tools/watermark_atlas.c \
+	water_mark_atlas.c
+
+LOCAL_MODULE:= watermark_atlas
+
+include $(BUILD_HOST_EXECUTABLE)
+
 endif
 
@@ -0,0 +1,87 @@
+/*
+ * Checks every watermark row kernel supported by this cpu against the scalar
+ * reference, for all widths up to MAX_WIDTH and every start offset in a
+ * 32 byte block, with random pixels and alpha (including 0 and 255).
+ *
+ * usage: watermark_kernel_test [rounds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <water_mark.h>
+
+#define MAX_WIDTH	200
+#define MAX_OFFSET	32
+#define BUF_SIZE	(MAX_WIDTH + MAX_OFFSET)
+
+static void fill(unsigned char *p, int n)
+{
+	int i;
+
+	for (i = 0; i < n; ++i) {
+		switch (rand() & 7) {
+		case 0:
+			p[i] = 0;
+			break;
+		case 1:
+			p[i] = 255;
+			break;
+		default:
+			p[i] = rand() & 0xff;
+			break;
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const WaterMarkKernel *list;
+	const WaterMarkKernel *ref;
+	unsigned char bg[BUF_SIZE], bg_ref[BUF_SIZE];
+	unsigned char fg[BUF_SIZE], alph[BUF_SIZE];
+	int rounds = (argc > 1) ? atoi(argv[1]) : 4;
+	int number;
+	int k, r, n, off;
+	int invert;
+	int fail = 0;
+
+	list = watermark_get_kernel_list(&number);
+	ref = &list[number - 1];
+	printf("selected kernel: %s\n", watermark_get_kernel()->name);
+
+	srand(1);
+	for (k = 0; k < number - 1; ++k) {
+		for (r = 0; r < rounds; ++r) {
+			for (n = 0; n <= MAX_WIDTH; ++n) {
+				for (off = 0; off < MAX_OFFSET; ++off) {
+					fill(bg, BUF_SIZE);
+					fill(fg, BUF_SIZE);
+					fill(alph, BUF_SIZE);
+					for (invert = 0; invert < 2; ++invert) {
+						memcpy(bg_ref, bg, BUF_SIZE);
+						if (invert) {
+							ref->blend_row_invert(bg_ref + off, fg + (off^1), alph + (off>>1), n);
+							list[k].blend_row_invert(bg + off, fg + (off^1), alph + (off>>1), n);
+						} else {
+							ref->blend_row(bg_ref + off, fg + (off^1), alph + (off>>1), n);
+							list[k].blend_row(bg + off, fg + (off^1), alph + (off>>1), n);
+						}
+						if (memcmp(bg, bg_ref, BUF_SIZE)) {
+							printf("%s: blend_row%s mismatch, width %d offset %d\n",
+								list[k].name, invert ? "_invert" : "", n, off);
+							fail++;
+						}
+					}
+					if (list[k].row_sum(bg + off, n) != ref->row_sum(bg + off, n)) {
+						printf("%s: row_sum mismatch, width %d offset %d\n", list[k].name, n, off);
+						fail++;
+					}
+				}
+			}
+		}
+		printf("%s: %s\n", list[k].name, fail ? "FAILED" : "ok");
+	}
+	return fail ? 1 : 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * Build the watermark glyph atlas from the wm_<height>p_<id>.bmp files.
+ *
+ * usage: watermark_atlas [-m <char map>] <atlas file> <bmp dir> <height> [<height> ...]
+ *
+ * For every height the glyphs are read from id 0 up to the first missing
+ * file, converted to y/alph/c planes with the same code libwater_mark uses,
+ * and written after the entry table.
+ *
+ * The char map gives the character each glyph id draws, one "<id> <char>"
+ * per line, <char> is a utf-8 character or U+<hex>, '#' starts a comment.
+ * Without it the standard digit/letter/province set is used. An atlas with
+ * a char map lets a new glyph set be installed without rebuilding the
+ * library. Install the result as
+ * /system/watermark/wm_atlas.bin, initialwaterMark falls back to the bmp
+ * files when it is missing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <water_mark.h>
+
+static SinglePicture *gPic;
+static WaterMarkAtlasEntry *gEntry;
+static int gEntryCapacity;
+static unsigned int *gCode;	//[gCodeNumber], code point of each glyph id
+static int gCodeNumber;
+
+static int set_code(int id, unsigned int code)
+{
+	unsigned int *p;
+	int number;
+
+	if (id >= gCodeNumber) {
+		number = (id + 128) & ~127;
+		p = (unsigned int*)realloc(gCode, number*sizeof(unsigned int));
+		if (p == NULL) {
+			return -1;
+		}
+		memset(p + gCodeNumber, 0, (number - gCodeNumber)*sizeof(unsigned int));
+		gCode = p;
+		gCodeNumber = number;
+	}
+	gCode[id] = code;
+	return 0;
+}
+
+static int grow_entry(void)
+{
+	int capacity = gEntryCapacity ? gEntryCapacity*2 : 256;
+	SinglePicture *pic = (SinglePicture*)realloc(gPic, capacity*sizeof(SinglePicture));
+	WaterMarkAtlasEntry *entry;
+
+	if (pic == NULL) {
+		return -1;
+	}
+	gPic = pic;
+	entry = (WaterMarkAtlasEntry*)realloc(gEntry, capacity*sizeof(WaterMarkAtlasEntry));
+	if (entry == NULL) {
+		return -1;
+	}
+	memset(entry + gEntryCapacity, 0, (capacity - gEntryCapacity)*sizeof(WaterMarkAtlasEntry));
+	gEntry = entry;
+	gEntryCapacity = capacity;
+	return 0;
+}
+
+static int load_char_map(const char *filename)
+{
+	char line[256];
+	char *p;
+	unsigned int code;
+	int id, len;
+	int lineno = 0;
+	FILE *fp = fopen(filename, "r");
+
+	if (fp == NULL) {
+		fprintf(stderr, "fail to open %s(%s)\n", filename, strerror(errno));
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+		p = line + strspn(line, " \t");
+		if (*p == '#' || *p == '\n' || *p == '\0') {
+			continue;
+		}
+		id = strtol(p, &p, 0);
+		p += strspn(p, " \t");
+		if (id < 0 || id > WATERMARK_MAX_GLYPH) {
+			fprintf(stderr, "%s:%d: glyph id out of range\n", filename, lineno);
+			fclose(fp);
+			return -1;
+		}
+		if (!strncmp(p, "U+", 2)) {
+			code = strtoul(p + 2, NULL, 16);
+		} else {
+			for (len = 0; len < 4 && ((unsigned char)p[0] & (0x80 >> len)); ++len);
+			code = watermark_utf8_decode(p, len ? len : 1);
+		}
+		if (code < 0x20) {
+			fprintf(stderr, "%s:%d: invalid character\n", filename, lineno);
+			fclose(fp);
+			return -1;
+		}
+		if (set_code(id, code) != 0) {
+			fprintf(stderr, "out of memory\n");
+			fclose(fp);
+			return -1;
+		}
+	}
+	fclose(fp);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	WaterMarkAtlasHeader header;
+	char filename[1024];
+	static const unsigned char pad[4] = {0, 0, 0, 0};
+	unsigned int offset;
+	int entry_number = 0;
+	int wm_height;
+	int i, n;
+	int ret;
+	int arg = 1;
+	const WaterMarkGlyphCode *list;
+	FILE *fp;
+
+	if (argc > 2 && !strcmp(argv[1], "-m")) {
+		if (load_char_map(argv[2]) != 0) {
+			return 1;
+		}
+		arg = 3;
+	} else {
+		n = watermark_default_glyph_code(&list);
+		for (i = 0; i < n; ++i) {
+			if (set_code(list[i].id, list[i].code) != 0) {
+				fprintf(stderr, "out of memory\n");
+				return 1;
+			}
+		}
+	}
+	if (argc - arg < 3) {
+		fprintf(stderr, "usage: %s [-m <char map>] <atlas file> <bmp dir> <height> [<height> ...]\n", argv[0]);
+		return 1;
+	}
+
+	for (n = arg + 2; n < argc; ++n) {
+		wm_height = atoi(argv[n]);
+		for (i = 0; i <= WATERMARK_MAX_GLYPH; ++i) {
+			if (entry_number >= gEntryCapacity && grow_entry() != 0) {
+				fprintf(stderr, "out of memory\n");
+				return 1;
+			}
+			snprintf(filename, sizeof(filename), "%s/wm_%dp_%d.bmp", argv[arg + 1], wm_height, i);
+			ret = watermark_load_bmp(filename, &gPic[entry_number]);
+			if (ret == -1) {
+				break;
+			} else if (ret != 0) {
+				fprintf(stderr, "fail to load %s\n", filename);
+				return 1;
+			}
+			gEntry[entry_number].wm_height = wm_height;
+			gEntry[entry_number].id = i;
+			gEntry[entry_number].code = (i < gCodeNumber) ? gCode[i] : 0;
+			gEntry[entry_number].width = gPic[entry_number].width;
+			gEntry[entry_number].height = gPic[entry_number].height;
+			gEntry[entry_number].size = WATERMARK_GLYPH_SIZE(gPic[entry_number].width, gPic[entry_number].height);
+			entry_number++;
+		}
+		if (i == 0) {
+			fprintf(stderr, "no glyphs for height %d in %s\n", wm_height, argv[arg + 1]);
+			return 1;
+		}
+		printf("height %d: %d glyphs\n", wm_height, i);
+	}
+
+	offset = sizeof(header) + entry_number*sizeof(WaterMarkAtlasEntry);
+	for (i = 0; i < entry_number; ++i) {
+		gEntry[i].offset = offset;
+		offset += (gEntry[i].size + 3) & ~3;
+	}
+	header.magic = WATERMARK_ATLAS_MAGIC;
+	header.version = WATERMARK_ATLAS_VERSION;
+	header.entry_number = entry_number;
+	header.file_size = offset;
+
+	fp = fopen(argv[arg], "wb");
+	if (fp == NULL) {
+		fprintf(stderr, "fail to create %s(%s)\n", argv[arg], strerror(errno));
+		return 1;
+	}
+	fwrite(&header, sizeof(header), 1, fp);
+	fwrite(gEntry, sizeof(WaterMarkAtlasEntry), entry_number, fp);
+	for (i = 0; i < entry_number; ++i) {
+		fwrite(gPic[i].y, gEntry[i].size, 1, fp);
+		fwrite(pad, (4 - (gEntry[i].size & 3)) & 3, 1, fp);
+		free(gPic[i].y);
+	}
+	if (fclose(fp) != 0) {
+		fprintf(stderr, "fail to write %s(%s)\n", argv[arg], strerror(errno));
+		return 1;
+	}
+	printf("%s: %d glyphs, %u bytes\n", argv[arg], entry_number, offset);
+	return 0;
+}
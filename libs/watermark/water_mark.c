@@ -12,9 +12,6 @@ extern "C" {
 
 #include <water_mark.h>
 
-//only the fg_width is 8 pixels align and the fg_height is 2 pixels align
-//#define	USE_NEON
-
 // bg_width			background width
 // bg_height        background height
 
@@ -32,124 +29,27 @@ extern "C" {
 void yuv420sp_blending(int bg_width, int bg_height, int left, unsigned int top, int fg_width, int fg_height,
 					   unsigned char *bg_y, unsigned char *bg_c, unsigned char *fg_y, unsigned char *fg_c, unsigned char *alph)
 {
+	const WaterMarkKernel *kernel = watermark_get_kernel();
 	unsigned char *bg_y_p = NULL;
 	unsigned char *bg_c_p = NULL;
 	int i = 0;
-	int j = 0;
-
-	unsigned char *bg_y_p_line2 = NULL;
-	unsigned char *fg_y_line2 = NULL;
-	unsigned char *alph_line2 = NULL;
 
 	bg_y_p = bg_y + top * bg_width + left;
 	bg_c_p = bg_c + (top >>1)*bg_width + left;
 
-	bg_y_p_line2 = bg_y_p + bg_width;
-	fg_y_line2 = fg_y + fg_width;
-	alph_line2 = alph + fg_width;
-	
-#ifdef USE_NEON
-	for(i = 0; i<(int)fg_height/2; i++)
-		{
-			for(j=0; j< (int)fg_width/8; j++)
-			{
-				asm volatile (
-						
-   				        "vld1.u8         {d0}, [%[bg_y_p]]              \n\t"
-   				        "vld1.u8         {d7}, [%[bg_y_p_line2]]        \n\t"
-   				        "vld1.u8         {d3}, [%[bg_c_p]]              \n\t"
-   				         
-   				        "vld1.u8         {d2}, [%[fg_y]]!               \n\t"
-   				        "vld1.u8         {d9}, [%[fg_y_line2]]!         \n\t"
-   				        "vld1.u8         {d4}, [%[fg_c]]!               \n\t"
-
-						"vld1.u8         {d1}, [%[alph]]!               \n\t"
-   				        "vld1.u8         {d8}, [%[alph_line2]]!         \n\t"
-   				        
-
-					    "pld         	 [%[bg_y_p],#64]               \n\t"
-					    "pld         	 [%[bg_y_p_line2],#64]        \n\t"
-					    "pld         	 [%[bg_c_p],#64]             \n\t"
-					    
-					    "pld         	 [%[fg_y],#64]               \n\t"
-					    "pld         	 [%[fg_y_line2],#64]          \n\t"
-    					"pld         	 [%[fg_c],#64]               \n\t"
-
-						"pld         	 [%[alph],#64]               \n\t"
-						"pld         	 [%[alph_line2],#64]          \n\t" 
-						
-    					
-    					"mov         	 lr,   #255              		\n\t"
-    					"vdup.u8		 d5,   lr						\n\t"
-    					"mov         	 lr,   #1              			\n\t"
-    					"vdup.u8		 d12,   lr						\n\t"
-    					
-    					"vsub.u8		 d6,   d5,	d1					\n\t"
-    					"vmull.u8		 q15,  d6,	d0					\n\t"
-    					"vmlal.u8		 q15,  d2,	d1					\n\t"
-    					"vmlal.u8		 q15,  d12,	d0					\n\t"
-
-    					"vsub.u8		 d10,  d5,	d8					\n\t"
-    					"vmull.u8		 q12,  d10,	d7					\n\t"
-    					"vmlal.u8		 q12,  d9,	d8					\n\t"
-    					"vmlal.u8		 q12,  d12,	d7					\n\t"
-    					
-    
-    					"vmull.u8		 q14,  d6,	d3					\n\t"
-    					"vmlal.u8		 q14,  d4,	d1					\n\t"
-    					"vmlal.u8		 q14,  d12,	d3					\n\t"
-    					
-    
-    					"vshrn.u16		 d27,  q14,	#8					\n\t"
-    					"vshrn.u16		 d26,  q15,	#8					\n\t"
-    					"vshrn.u16		 d23,  q12,	#8					\n\t"
-    
-    					"vst1.u8		 {d26},  [%[bg_y_p]]!			\n\t"
-    					"vst1.u8		 {d23},  [%[bg_y_p_line2]]!		\n\t"
-    					"vst1.u8		 {d27},  [%[bg_c_p]]!			\n\t"
-    				    : [bg_y_p] "+r" (bg_y_p), [alph] "+r" (alph), [fg_y] "+r" (fg_y), [bg_c_p] "+r" (bg_c_p), [fg_c] "+r" (fg_c), [bg_y_p_line2] "+r" (bg_y_p_line2), [alph_line2] "+r" (alph_line2), [fg_y_line2] "+r" (fg_y_line2)
-    				    :  //[srcY] "r" (srcY)
-    				    : "cc", "memory", "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7", "d8", "d9", "d19", "d20", "d21", "d22", "d23", "d26", "d27", "d29", "d30", "d31"
-    				    );
-				}
-			alph 		+= fg_width;
-			alph_line2 	+= fg_width;
-			fg_y 		+= fg_width;
-			fg_y_line2 	+= fg_width;
-			
-			bg_y_p 		+= 2*bg_width - fg_width;
-			bg_y_p_line2+= 2*bg_width - fg_width;
-            bg_c_p		+= bg_width - fg_width;
-	}
-#else
 	for(i = 0; i<(int)fg_height; i++)
 	{
+		kernel->blend_row(bg_y_p, fg_y, alph, fg_width);
 		if((i&1) == 0)
 		{
-			for(j=0; j< (int)fg_width; j++)
-			{
-				*bg_y_p = ((256 - *alph)*(*bg_y_p) + (*fg_y++)*(*alph))>>8;
-				*bg_c_p = ((256 - *alph)*(*bg_c_p) + (*fg_c++)*(*alph))>>8;
-					
-				alph++;
-				bg_y_p++;
-				bg_c_p++;
-			}
-
-			bg_c_p = bg_c_p + bg_width - fg_width;
-		}
-		else
-		{
-			for(j=0; j< (int)fg_width; j++)
-			{
-				*bg_y_p = ((256 - *alph)*(*bg_y_p) + (*fg_y++)*(*alph))>>8;
-				alph++;
-				bg_y_p++;
-			}
+			kernel->blend_row(bg_c_p, fg_c, alph, fg_width);
+			fg_c += fg_width;
+			bg_c_p += bg_width;
 		}
-		bg_y_p = bg_y_p + bg_width - fg_width;
+		fg_y += fg_width;
+		alph += fg_width;
+		bg_y_p += bg_width;
 	}
-#endif
 }
 
 // bg_width			background width
@@ -165,88 +65,23 @@ void yuv420sp_blending(int bg_width, int bg_height, int left, unsigned int top,
 
 int region_bright_or_dark(int bg_width, int bg_height, int left, int top, int fg_width, int fg_height, unsigned char *bg_y)
 {
+	const WaterMarkKernel *kernel = watermark_get_kernel();
 	unsigned char *bg_y_p = NULL;
 
 	int i = 0;
-	int j = 0;
 	int bright_line_number = 0;
 	int value = 0;
 
 	bg_y_p = bg_y + top * bg_width + left;
-	
-	#ifdef USE_NEON
-	int value_line2 = 0;
-	unsigned char* bg_y_p_line2 = bg_y_p + bg_width;
-
-	int *pValue = &value;
-	int *pValue_line2 = &value_line2;
 
-	for(i = 0; i<(int)fg_height/2; i++)
-	{
-		value = 0;
-		value_line2 = 0;
-		asm volatile (
-   				        "vld1.u8         {d0,d1,d2}, [%[bg_y_p]]              \n\t"
-   				        "vld1.u8         {d3,d4,d5}, [%[bg_y_p_line2]]              \n\t"
-						
-    					
-    					"vpaddl.u8       d31,  d0          				\n\t"
-    					"vpaddl.u8       d30,  d1          				\n\t"
-    					"vpaddl.u8       d29,  d2          				\n\t"
-						"vpadd.u16       d28,  d31, d30          		\n\t"
-						"vpadd.u16       d27,  d28, d29          		\n\t"
-						"vpaddl.u16      d28,  d27		         		\n\t"
-						"vpaddl.u32      d31,  d28		         		\n\t"
-		
-    					"vpaddl.u8       d30,  d3          				\n\t"
-    					"vpaddl.u8       d29,  d4          				\n\t"
-    					"vpaddl.u8       d28,  d5          				\n\t"
-						"vpadd.u16       d27,  d30, d29          		\n\t"
-						"vpadd.u16       d26,  d27, d28          		\n\t"
-						"vpaddl.u16      d27,  d26		         		\n\t"
-						"vpaddl.u32      d30,  d27		         		\n\t"
-    
-    					"vmov.u32		 r0, d31[0]  					\n\t"
-    					"vmov.u32		 r1, d30[0]  					\n\t"
-    					"STR		 	 r0, [%[pValue]]  				\n\t"
-    					"STR		 	 r1, [%[pValue_line2]]  		\n\t"
-
-						
-    				    : [bg_y_p] "+r" (bg_y_p), [bg_y_p_line2] "+r" (bg_y_p_line2), [pValue] "+r" (pValue), [pValue_line2] "+r" (pValue_line2)
-    				    :  //[srcY] "r" (srcY)
-    				    : "cc", "memory", "d0", "d1", "d2", "d3", "d4", "d5", "d26", "d27", "d28", "d29", "d30", "d31"
-    				    );
-		
-		value = value/fg_width;
-		if(value > 128) {
-			bright_line_number++;
-		}	
-
-		value_line2 = value_line2/fg_width;
-		if(value_line2 > 128) {
-			bright_line_number++;
-		}	
-
-		bg_y_p = bg_y_p + 2*bg_width;
-		bg_y_p_line2 = bg_y_p_line2 + 2*bg_width;
-	}
-#else
 	for(i = 0; i<(int)fg_height; i++)
 	{
-		value = 0;
-		for(j=0; j< (int)fg_width; j++)
-		{
-			value += *bg_y_p++;
-		}
-		value = value/fg_width;
-
+		value = kernel->row_sum(bg_y_p, fg_width)/fg_width;
 		if(value > 128) {
 			bright_line_number++;
-		}		
-
-		bg_y_p = bg_y_p + bg_width - fg_width;
+		}
+		bg_y_p = bg_y_p + bg_width;
 	}
-#endif
 
 	if(bright_line_number > fg_height/2) {
 		return 1;
@@ -274,236 +109,38 @@ void yuv420sp_blending_adjust_brightness(int bg_width, int bg_height, int left,
 					   unsigned char *bg_y, unsigned char *bg_c, unsigned char *fg_y, unsigned char *fg_c, unsigned char *alph,
 					   int is_brightness)
 {
+	const WaterMarkKernel *kernel = watermark_get_kernel();
 	unsigned char *bg_y_p = NULL;
 	unsigned char *bg_c_p = NULL;
 
 	int i = 0;
-	int j = 0;
 
 	if (bg_y == NULL || bg_c == NULL || fg_y == NULL || fg_c == NULL || alph == NULL) {
 		ALOGE("<yuv420sp_blending_adjust_brightness>NULL pointer error!");
 		return;
 	}
 
-	
-	unsigned char *bg_y_p_line2 = NULL;
-	unsigned char *fg_y_line2 = NULL;
-	unsigned char *alph_line2 = NULL;
-	
 	bg_y_p = bg_y + top * bg_width + left;
 	bg_c_p = bg_c + (top >>1)*bg_width + left;
 
-	bg_y_p_line2 = bg_y_p + bg_width;
-	fg_y_line2 = fg_y + fg_width;
-	alph_line2 = alph + fg_width;
-		
-	#ifdef USE_NEON
-	if(is_brightness) {
-		for(i = 0; i<(int)fg_height/2; i++)
-		{
-			for(j=0; j< (int)fg_width/8; j++)
-			{
-				
-				asm volatile (
-				        "vld1.u8         {d0}, [%[bg_y_p]]              \n\t"
-   				        "vld1.u8         {d7}, [%[bg_y_p_line2]]        \n\t"
-   				        "vld1.u8         {d3}, [%[bg_c_p]]              \n\t"
-   				         
-   				        "vld1.u8         {d2}, [%[fg_y]]!               \n\t"
-   				        "vld1.u8         {d9}, [%[fg_y_line2]]!         \n\t"
-   				        "vld1.u8         {d4}, [%[fg_c]]!               \n\t"
-
-						"vld1.u8         {d1}, [%[alph]]!               \n\t"
-   				        "vld1.u8         {d8}, [%[alph_line2]]!         \n\t"
-   				        
-
-					    "pld         	 [%[bg_y_p],#64]               \n\t"
-					    "pld         	 [%[bg_y_p_line2],#64]        \n\t"
-					    "pld         	 [%[bg_c_p],#64]             \n\t"
-					    
-					    "pld         	 [%[fg_y],#64]               \n\t"
-					    "pld         	 [%[fg_y_line2],#64]          \n\t"
-    					"pld         	 [%[fg_c],#64]               \n\t"
-
-						"pld         	 [%[alph],#64]               \n\t"
-						"pld         	 [%[alph_line2],#64]          \n\t" 
-					
-						"mov         	 lr,   #255              		\n\t"
-						"vdup.u8		 d5,   lr						\n\t"
-						"mov         	 lr,   #1              			\n\t"
-    					"vdup.u8		 d12,   lr						\n\t"
-    					
-						"vsub.u8		 d6,   d5,	d1					\n\t"
-						"vmull.u8		 q15,  d6,	d0					\n\t"
-						"vsub.u8		 d10,  d5,	d2					\n\t"
-						"vmlal.u8		 q11,  d10,	d1					\n\t"
-						"vaddl.u8		 q10,  d0,	d1					\n\t"
-						"vadd.u16		 q15,  q10,	q11					\n\t"
-
-						"vsub.u8		 d11,  d5,	d8					\n\t"
-    					"vmull.u8		 q12,  d11,	d7					\n\t"
-    					"vsub.u8		 d10,  d5,	d9					\n\t"
-    					"vmlal.u8		 q11,  d9,	d8					\n\t"
-    					"vaddl.u8		 q10,  d7,	d8					\n\t"
-						"vadd.u16		 q12,  q10,	q11					\n\t"
-
-						"vmull.u8		 q14,  d6,	d3					\n\t"
-						"vmlal.u8		 q14,  d4,	d1					\n\t"
-						"vmlal.u8		 q14,  d12,	d3					\n\t"
-
-						"vshrn.u16		 d27,  q14,	#8					\n\t"
-						"vshrn.u16		 d26,  q15,	#8					\n\t"
-						"vshrn.u16		 d23,  q12,	#8					\n\t"
-
-						"vst1.u8		 {d26},  [%[bg_y_p]]!			\n\t"
-						"vst1.u8		 {d27},  [%[bg_c_p]]!			\n\t"
-						"vst1.u8		 {d23},  [%[bg_y_p_line2]]!		\n\t"
-				        : [bg_y_p] "+r" (bg_y_p), [alph] "+r" (alph), [fg_y] "+r" (fg_y), [bg_c_p] "+r" (bg_c_p), [fg_c] "+r" (fg_c), [bg_y_p_line2] "+r" (bg_y_p_line2), [alph_line2] "+r" (alph_line2), [fg_y_line2] "+r" (fg_y_line2)
-    				    :  //[srcY] "r" (srcY)
-    				    : "cc", "memory", "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d16", "d17", "d18", "d19", "d20", "d21", "d22", "d23", "d24", "d28", "d29", "d30", "d31"
-    				   );
-			}
-			alph 		+= fg_width;
-			alph_line2 	+= fg_width;
-			fg_y 		+= fg_width;
-			fg_y_line2 	+= fg_width;
-			
-			bg_y_p 		+= 2*bg_width - fg_width;
-			bg_y_p_line2+= 2*bg_width - fg_width;
+	//on a bright background the inverted glyph is blended, the chroma is kept
+	for(i = 0; i<(int)fg_height; i++)
+	{
+		if(is_brightness) {
+			kernel->blend_row_invert(bg_y_p, fg_y, alph, fg_width);
+		} else {
+			kernel->blend_row(bg_y_p, fg_y, alph, fg_width);
 		}
-	} else {
-		for(i = 0; i<(int)fg_height/2; i++)
+		if((i&1) == 0)
 		{
-			for(j=0; j< (int)fg_width/8; j++)
-			{
-				asm volatile (
-						
-   				        "vld1.u8         {d0}, [%[bg_y_p]]              \n\t"
-   				        "vld1.u8         {d7}, [%[bg_y_p_line2]]        \n\t"
-   				        "vld1.u8         {d3}, [%[bg_c_p]]              \n\t"
-   				         
-   				        "vld1.u8         {d2}, [%[fg_y]]!               \n\t"
-   				        "vld1.u8         {d9}, [%[fg_y_line2]]!         \n\t"
-   				        "vld1.u8         {d4}, [%[fg_c]]!               \n\t"
-
-						"vld1.u8         {d1}, [%[alph]]!               \n\t"
-   				        "vld1.u8         {d8}, [%[alph_line2]]!         \n\t"
-   				        
-
-					    "pld         	 [%[bg_y_p],#64]               \n\t"
-					    "pld         	 [%[bg_y_p_line2],#64]        \n\t"
-					    "pld         	 [%[bg_c_p],#64]             \n\t"
-					    
-					    "pld         	 [%[fg_y],#64]               \n\t"
-					    "pld         	 [%[fg_y_line2],#64]          \n\t"
-    					"pld         	 [%[fg_c],#64]               \n\t"
-
-						"pld         	 [%[alph],#64]               \n\t"
-						"pld         	 [%[alph_line2],#64]          \n\t" 
-						
-    					
-    					"mov         	 lr,   #255              		\n\t"
-    					"vdup.u8		 d5,   lr						\n\t"
-    					"mov         	 lr,   #1              			\n\t"
-    					"vdup.u8		 d12,   lr						\n\t"
-    					
-    					"vsub.u8		 d6,   d5,	d1					\n\t"
-    					"vmull.u8		 q15,  d6,	d0					\n\t"
-    					"vmlal.u8		 q15,  d2,	d1					\n\t"
-    					"vmlal.u8		 q15,  d12,	d0					\n\t"
-
-    					"vsub.u8		 d10,  d5,	d8					\n\t"
-    					"vmull.u8		 q12,  d10,	d7					\n\t"
-    					"vmlal.u8		 q12,  d9,	d8					\n\t"
-    					"vmlal.u8		 q12,  d12,	d7					\n\t"
-    					
-    
-    					"vmull.u8		 q14,  d6,	d3					\n\t"
-    					"vmlal.u8		 q14,  d4,	d1					\n\t"
-    					"vmlal.u8		 q14,  d12,	d3					\n\t"
-    					
-    
-    					"vshrn.u16		 d27,  q14,	#8					\n\t"
-    					"vshrn.u16		 d26,  q15,	#8					\n\t"
-    					"vshrn.u16		 d23,  q12,	#8					\n\t"
-    
-    					"vst1.u8		 {d26},  [%[bg_y_p]]!			\n\t"
-    					"vst1.u8		 {d23},  [%[bg_y_p_line2]]!		\n\t"
-    					"vst1.u8		 {d27},  [%[bg_c_p]]!			\n\t"
-    				    : [bg_y_p] "+r" (bg_y_p), [alph] "+r" (alph), [fg_y] "+r" (fg_y), [bg_c_p] "+r" (bg_c_p), [fg_c] "+r" (fg_c), [bg_y_p_line2] "+r" (bg_y_p_line2), [alph_line2] "+r" (alph_line2), [fg_y_line2] "+r" (fg_y_line2)
-    				    :  //[srcY] "r" (srcY)
-    				    : "cc", "memory", "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7", "d8", "d9", "d19", "d20", "d21", "d22", "d23", "d26", "d27", "d29", "d30", "d31"
-    				    );
-				}
-			alph 		+= fg_width;
-			alph_line2 	+= fg_width;
-			fg_y 		+= fg_width;
-			fg_y_line2 	+= fg_width;
-			
-			bg_y_p 		+= 2*bg_width - fg_width;
-			bg_y_p_line2+= 2*bg_width - fg_width;
-            bg_c_p		+= bg_width - fg_width;
+			kernel->blend_row(bg_c_p, fg_c, alph, fg_width);
+			fg_c += fg_width;
+			bg_c_p += bg_width;
 		}
+		fg_y += fg_width;
+		alph += fg_width;
+		bg_y_p += bg_width;
 	}
-#else
-	if(is_brightness) {
-			for(i = 0; i<(int)fg_height; i++)
-			{
-				if((i&1) == 0)
-				{
-					for(j=0; j< (int)fg_width; j++)
-					{
-						*bg_y_p = ((256 - *alph)*(*bg_y_p) + (256 - (*fg_y++))*(*alph))>>8;
-						*bg_c_p = ((256 - *alph)*(*bg_c_p) + (*fg_c++)*(*alph))>>8;
-						
-						alph++;
-						bg_y_p++;
-						bg_c_p++;
-					}
-					bg_c_p = bg_c_p + bg_width - fg_width;
-				}
-				else
-				{
-					for(j=0; j< (int)fg_width; j++)
-					{
-						*bg_y_p = ((256 - *alph)*(*bg_y_p) + (256 - (*fg_y++))*(*alph))>>8;
-						alph++;
-						bg_y_p++;
-					}
-				}
-	
-				bg_y_p = bg_y_p + bg_width - fg_width;
-			}
-		} else {
-			for(i = 0; i<(int)fg_height; i++)
-			{
-				if((i&1) == 0)
-				{
-					for(j=0; j< (int)fg_width; j++)
-					{
-						*bg_y_p = ((256 - *alph)*(*bg_y_p) + (*fg_y++)*(*alph))>>8;
-						*bg_c_p = ((256 - *alph)*(*bg_c_p) + (*fg_c++)*(*alph))>>8;
-						
-						alph++;
-						bg_y_p++;
-						bg_c_p++;
-					}
-					bg_c_p = bg_c_p + bg_width - fg_width;
-				}
-				else
-				{
-					for(j=0; j< (int)fg_width; j++)
-					{
-						*bg_y_p = ((256 - *alph)*(*bg_y_p) + (*fg_y++)*(*alph))>>8;
-						alph++;
-						bg_y_p++;
-					}
-				}
-	
-				bg_y_p = bg_y_p + bg_width - fg_width;
-			}
-		}
-#endif	
 }
 
 int watermark_blending(BackGroudLayerInfo *bg_info, WaterMarkInfo *wm_info, ShowWaterMarkParam *wm_Param)
@@ -601,6 +238,176 @@ int watermark_blending_ajust_brightness(BackGroudLayerInfo *bg_info, WaterMarkIn
 	return 0;
 }
 
+//blending with alph 0 keeps the background, so only the opaque span of each line is blended
+static void watermark_run_update_span(WaterMarkRun *run)
+{
+	int i, j, k;
+	unsigned char *alph;
+
+	for (j = 0; j < run->height; ++j) {
+		alph = run->alph + j*run->width;
+		for (i = 0; i < run->width && alph[i] == 0; ++i);
+		for (k = run->width; k > i && alph[k-1] == 0; --k);
+		run->span[2*j] = i;
+		run->span[2*j+1] = k;
+	}
+}
+
+// compose all glyphs of wm_Param into one strip, glyphs are placed side by side from x=0,
+// lines below a shorter glyph stay transparent.
+int watermark_compose_run(WaterMarkInfo *wm_info, ShowWaterMarkParam *wm_Param, WaterMarkRun *run)
+{
+	int i, j;
+	int id;
+	int total_width = 0;
+	int max_height = 0;
+	int pos_x;
+	int size;
+	unsigned char *buf;
+	SinglePicture *pic;
+
+	for (i = 0; i < wm_Param->number; ++i) {
+		id = wm_Param->id_list[i];
+		total_width += wm_info->single_pic[id].width;
+		if (wm_info->single_pic[id].height > max_height) {
+			max_height = wm_info->single_pic[id].height;
+		}
+	}
+	if (total_width <= 0 || max_height <= 0) {
+		ALOGE("<watermark_compose_run> error size(%dx%d)", total_width, max_height);
+		return -1;
+	}
+
+	//y, alph, c, span
+	size = total_width*max_height*2 + total_width*((max_height+1)/2) + max_height*2*sizeof(short);
+	if (size > run->buf_size) {
+		buf = (unsigned char*)realloc(run->y, size);
+		if (buf == NULL) {
+			ALOGE("<watermark_compose_run> alloc %d bytes error", size);
+			return -1;
+		}
+		run->y = buf;
+		run->buf_size = size;
+	}
+	run->width = total_width;
+	run->height = max_height;
+	run->alph = run->y + total_width*max_height;
+	run->c = run->alph + total_width*max_height;
+	run->span = (short*)(run->c + total_width*((max_height+1)/2));
+	memset(run->y, 0, total_width*max_height);
+	memset(run->alph, 0, total_width*max_height);
+	memset(run->c, 128, total_width*((max_height+1)/2));
+
+	pos_x = 0;
+	for (i = 0; i < wm_Param->number; ++i) {
+		id = wm_Param->id_list[i];
+		pic = &wm_info->single_pic[id];
+		for (j = 0; j < pic->height; ++j) {
+			memcpy(run->y + j*total_width + pos_x, pic->y + j*pic->width, pic->width);
+			memcpy(run->alph + j*total_width + pos_x, pic->alph + j*pic->width, pic->width);
+			if ((j&1) == 0) {
+				memcpy(run->c + (j>>1)*total_width + pos_x, pic->c + (j>>1)*pic->width, pic->width);
+			}
+		}
+		run->id_list[i] = id;
+		run->cell_x[i] = pos_x;
+		pos_x += pic->width;
+	}
+	run->number = wm_Param->number;
+	watermark_run_update_span(run);
+	return 0;
+}
+
+// re-composite only the cells whose glyph changed, the layout must stay the same, otherwise
+// the whole strip is composited again.
+// return value : number of cells composited, -1 on error
+int watermark_update_run(WaterMarkInfo *wm_info, ShowWaterMarkParam *wm_Param, WaterMarkRun *run)
+{
+	int i, j;
+	int id;
+	int changed = 0;
+	SinglePicture *old_pic;
+	SinglePicture *pic;
+
+	if (run->y == NULL || run->number != wm_Param->number) {
+		goto COMPOSE_ALL;
+	}
+	for (i = 0; i < wm_Param->number; ++i) {
+		id = wm_Param->id_list[i];
+		if (id == run->id_list[i]) {
+			continue;
+		}
+		old_pic = &wm_info->single_pic[run->id_list[i]];
+		pic = &wm_info->single_pic[id];
+		if (pic->width != old_pic->width || pic->height != old_pic->height) {
+			goto COMPOSE_ALL;
+		}
+	}
+
+	for (i = 0; i < wm_Param->number; ++i) {
+		id = wm_Param->id_list[i];
+		if (id == run->id_list[i]) {
+			continue;
+		}
+		pic = &wm_info->single_pic[id];
+		for (j = 0; j < pic->height; ++j) {
+			memcpy(run->y + j*run->width + run->cell_x[i], pic->y + j*pic->width, pic->width);
+			memcpy(run->alph + j*run->width + run->cell_x[i], pic->alph + j*pic->width, pic->width);
+			if ((j&1) == 0) {
+				memcpy(run->c + (j>>1)*run->width + run->cell_x[i], pic->c + (j>>1)*pic->width, pic->width);
+			}
+		}
+		run->id_list[i] = id;
+		changed++;
+	}
+	if (changed > 0) {
+		watermark_run_update_span(run);
+	}
+	return changed;
+
+COMPOSE_ALL:
+	if (watermark_compose_run(wm_info, wm_Param, run) != 0) {
+		return -1;
+	}
+	return wm_Param->number;
+}
+
+int watermark_blending_run(BackGroudLayerInfo *bg_info, WaterMarkRun *run, int left, int top)
+{
+	const WaterMarkKernel *kernel = watermark_get_kernel();
+	int i;
+	int x0, x1;
+	int off;
+
+	if(run->width > bg_info->width) {
+		ALOGE("<watermark_blending_run> error region(total_width=%d, bg_width=%d)", run->width, bg_info->width);
+		return -1;
+	}
+
+	for (i = 0; i < run->height; ++i) {
+		x0 = run->span[2*i];
+		x1 = run->span[2*i+1];
+		if (x0 >= x1) {
+			continue;
+		}
+		off = i*run->width + x0;
+		kernel->blend_row(bg_info->y + (top + i)*bg_info->width + left + x0, run->y + off, run->alph + off, x1 - x0);
+		if ((i&1) == 0) {
+			kernel->blend_row(bg_info->c + ((top>>1) + (i>>1))*bg_info->width + left + x0,
+				run->c + (i>>1)*run->width + x0, run->alph + off, x1 - x0);
+		}
+	}
+	return 0;
+}
+
+void watermark_release_run(WaterMarkRun *run)
+{
+	if (run->y != NULL) {
+		free(run->y);
+	}
+	memset(run, 0, sizeof(WaterMarkRun));
+}
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -5,9 +5,11 @@
 extern "C" {
 #endif /* __cplusplus */
 
-#define MAX_ICON_PIC	83
+#define WATERMARK_MAX_GLYPH	32767	//glyph ids are kept in shorts by the glyph map
 #define DISP_ICON_NUM	23
 #define MAX_WATERMARK_NUM 5
+#define WATERMARK_RUN_CACHE_NUM	8
+#define WATERMARK_RUN_TEXT_LEN	(DISP_ICON_NUM*3+3)
 
 typedef struct BackGroudLayerInfo
 {
@@ -27,10 +29,13 @@ typedef struct SinglePicture
 	unsigned char* alph;
 }SinglePicture;
 
+//y[w*h], alph[w*h], c[w*((h+1)/2)] in one buffer
+#define WATERMARK_GLYPH_SIZE(w, h)	((w)*(h)*2 + (w)*(((h)+1)/2))
+
 typedef struct WaterMarkInfo
 {
 	int picture_number; 
-	SinglePicture single_pic[MAX_ICON_PIC];
+	SinglePicture *single_pic;	//[picture_number], sized by the glyph set that is loaded
 }WaterMarkInfo;
 
 typedef struct WaterMarkPositon
@@ -65,17 +70,121 @@ typedef struct {
 	SingleWaterMark singleWaterMark[MAX_WATERMARK_NUM];
 }WaterMarkMultiple;
 
+#ifndef WATERMARK_ATLAS_FILE
+#define WATERMARK_ATLAS_FILE	"/system/watermark/wm_atlas.bin"
+#endif
+#define WATERMARK_ATLAS_MAGIC	0x314d5741	//"AWM1"
+#define WATERMARK_ATLAS_VERSION	2
+
+//glyph atlas, generated offline by watermark_atlas from the wm_<height>p_<id>.bmp files:
+//header, entry table, then the glyph planes in WATERMARK_GLYPH_SIZE layout, 4 bytes aligned.
+//All fields are little endian, offsets are from the start of the file.
+typedef struct WaterMarkAtlasHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int entry_number;
+	unsigned int file_size;
+}WaterMarkAtlasHeader;
+
+typedef struct WaterMarkAtlasEntry
+{
+	unsigned int wm_height;	//glyph set, the <height> of wm_<height>p_<id>.bmp
+	unsigned int id;
+	unsigned int code;	//unicode code point drawn by the glyph, 0 if not mapped
+	unsigned int width;
+	unsigned int height;
+	unsigned int offset;
+	unsigned int size;
+}WaterMarkAtlasEntry;
+
+#define WATERMARK_GLYPH_HASH_MIN_BITS	6	//the table doubles as glyphs are added
+
+typedef struct WaterMarkGlyphCode
+{
+	unsigned int code;
+	int id;
+}WaterMarkGlyphCode;
+
+//code point to glyph id, ascii is indexed directly, the rest goes through an open addressing hash
+typedef struct WaterMarkGlyphMap
+{
+	short ascii[128];
+	unsigned int *hash_code;	//[1 << hash_bits], 0 means empty
+	short *hash_id;
+	int hash_bits;
+	int number;
+	int default_id;	//glyph drawn for unmapped characters, -1 skips them
+}WaterMarkGlyphMap;
+
+//whole watermark string composited into one YUV420sp + alph strip, rebuilt only when the text changes
+typedef struct WaterMarkRun
+{
+	char text[WATERMARK_RUN_TEXT_LEN];	//cache key, empty when the entry is unused
+	int wm_height;	//glyph set height the strip was built from
+	int slot;	//watermark slot that last used the strip, -1 if none
+	int number;
+	int id_list[DISP_ICON_NUM];
+	int cell_x[DISP_ICON_NUM];	//left column of each glyph cell in the strip
+	int width;
+	int height;
+	unsigned char* y;
+	unsigned char* c;
+	unsigned char* alph;
+	short* span;	//[height][2], first and last+1 column with nonzero alph of each line
+	int buf_size;
+	unsigned int last_use;
+}WaterMarkRun;
+
 typedef struct _WATERMARK_CTRL
 {
 	AjustBrightnessParam ADBright;
 	WaterMarkInfo wminfo;
     WaterMarkMultiple multi;
+	int wm_height;
+	int atlas;	//glyph planes point into the shared atlas mapping
+	WaterMarkGlyphMap glyph_map;
+	unsigned int run_clock;
+	unsigned int run_hit;
+	unsigned int run_miss;
+	unsigned int run_update;	//misses served by re-compositing changed cells only
+	unsigned int run_cell_update;
+	WaterMarkRun run_cache[WATERMARK_RUN_CACHE_NUM];
 } WATERMARK_CTRL;
 
 
+void argb2yuv420sp(unsigned char* src_p, unsigned char* alph, int width, int height,
+				unsigned char* dest_y, unsigned char* dest_c);
+int watermark_load_bmp(const char *filename, SinglePicture *pic);
+int watermark_atlas_check(const void *base, unsigned int size);
+int watermark_default_glyph_code(const WaterMarkGlyphCode **list);
+unsigned int watermark_utf8_decode(const char *str, int len);
+void watermark_glyph_map_reset(WaterMarkGlyphMap *map, int default_id);
+int watermark_glyph_map_add(WaterMarkGlyphMap *map, unsigned int code, int id);
+int watermark_glyph_map_find(const WaterMarkGlyphMap *map, unsigned int code);
+void watermark_glyph_map_release(WaterMarkGlyphMap *map);
+
+//row kernels, one set per instruction set, selected at runtime
+typedef struct WaterMarkKernel
+{
+	const char *name;
+	void (*blend_row)(unsigned char *bg, const unsigned char *fg, const unsigned char *alph, int n);
+	void (*blend_row_invert)(unsigned char *bg, const unsigned char *fg, const unsigned char *alph, int n);
+	unsigned int (*row_sum)(const unsigned char *p, int n);
+}WaterMarkKernel;
+
+//best kernel of this cpu, WATERMARK_KERNEL=<name> in the environment forces one
+const WaterMarkKernel *watermark_get_kernel(void);
+//all kernels this cpu supports, the last one is the scalar reference
+const WaterMarkKernel *watermark_get_kernel_list(int *number);
+
 int watermark_blending(BackGroudLayerInfo *bg_info, WaterMarkInfo *wm_info, ShowWaterMarkParam *wm_Param);
 int watermark_blending_ajust_brightness(BackGroudLayerInfo *bg_info, WaterMarkInfo *wm_info, ShowWaterMarkParam *wm_Param, 
 	AjustBrightnessParam *ajust_Param);
+int watermark_compose_run(WaterMarkInfo *wm_info, ShowWaterMarkParam *wm_Param, WaterMarkRun *run);
+int watermark_update_run(WaterMarkInfo *wm_info, ShowWaterMarkParam *wm_Param, WaterMarkRun *run);
+int watermark_blending_run(BackGroudLayerInfo *bg_info, WaterMarkRun *run, int left, int top);
+void watermark_release_run(WaterMarkRun *run);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,358 @@
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+// glyph loading shared by libwater_mark and the host atlas tool, so no logging here
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <water_mark.h>
+
+void argb2yuv420sp(unsigned char* src_p, unsigned char* alph, 
+				int width, int height,
+				unsigned char* dest_y, unsigned char* dest_c)
+{
+	int i,j;
+	for(i = 0; i < (int)height; i++)
+    {
+		if((i&1) == 0)
+		{
+	    	for(j= 0; j< (int)width; j++)
+			{
+				*dest_y = (299*src_p[2]+587*src_p[1]+114*src_p[0])/1000;
+
+				if((j&1) == 0)
+				{
+				   //cb
+				   *dest_c++ = 128+(564*(src_p[0]-*dest_y)/1000);	
+				}
+				else
+				{
+				   // cr
+				   *dest_c++ = 128+(713*(src_p[2]-*dest_y)/1000);
+				}
+
+				*alph++ = src_p[3];
+				src_p +=4;
+				dest_y++;
+			}		
+		}
+		else
+		{
+			for(j= 0; j< (int)width; j++)
+			{
+				*dest_y = (299*src_p[2]+587*src_p[1]+114*src_p[0])/1000;
+				*alph++ = src_p[3];
+				src_p +=4;
+				dest_y++;
+			}	
+		}
+    }
+	
+	return;
+}
+
+// glyph ids of the standard wm_<height>p_<id>.bmp set, used when the atlas carries no codes
+static const WaterMarkGlyphCode gDefaultGlyphCode[] =
+{
+	{0x0020, 19},	//' '
+	{0x002D, 20},	//'-'
+	{0x002E, 49},	//'.'
+	{0x002F, 48},	//'/'
+	{0x0030, 0},	//'0'
+	{0x0031, 1},	//'1'
+	{0x0032, 2},	//'2'
+	{0x0033, 3},	//'3'
+	{0x0034, 4},	//'4'
+	{0x0035, 5},	//'5'
+	{0x0036, 6},	//'6'
+	{0x0037, 7},	//'7'
+	{0x0038, 8},	//'8'
+	{0x0039, 9},	//'9'
+	{0x003A, 21},	//':'
+	{0x0041, 22},	//'A'
+	{0x0042, 23},	//'B'
+	{0x0043, 24},	//'C'
+	{0x0044, 25},	//'D'
+	{0x0045, 26},	//'E'
+	{0x0046, 27},	//'F'
+	{0x0047, 28},	//'G'
+	{0x0048, 29},	//'H'
+	{0x0049, 30},	//'I'
+	{0x004A, 31},	//'J'
+	{0x004B, 32},	//'K'
+	{0x004C, 33},	//'L'
+	{0x004D, 34},	//'M'
+	{0x004E, 35},	//'N'
+	{0x004F, 36},	//'O'
+	{0x0050, 37},	//'P'
+	{0x0051, 38},	//'Q'
+	{0x0052, 39},	//'R'
+	{0x0053, 40},	//'S'
+	{0x0054, 41},	//'T'
+	{0x0055, 42},	//'U'
+	{0x0056, 43},	//'V'
+	{0x0057, 44},	//'W'
+	{0x0058, 45},	//'X'
+	{0x0059, 46},	//'Y'
+	{0x005A, 47},	//'Z'
+	{0x6E58, 50},	//湘
+	{0x6D25, 51},	//津
+	{0x9102, 52},	//鄂
+	{0x6CAA, 53},	//沪
+	{0x7CA4, 54},	//粤
+	{0x6E1D, 55},	//渝
+	{0x743C, 56},	//琼
+	{0x5180, 57},	//冀
+	{0x5DDD, 58},	//川
+	{0x664B, 59},	//晋
+	{0x9ED4, 60},	//黔
+	{0x8FBD, 61},	//辽
+	{0x4E91, 62},	//云
+	{0x5409, 63},	//吉
+	{0x9655, 64},	//陕
+	{0x9ED1, 65},	//黑
+	{0x7518, 66},	//甘
+	{0x82CF, 67},	//苏
+	{0x9752, 68},	//青
+	{0x6D59, 69},	//浙
+	{0x53F0, 70},	//台
+	{0x7696, 71},	//皖
+	{0x85CF, 72},	//藏
+	{0x95FD, 73},	//闽
+	{0x8499, 74},	//蒙
+	{0x8D63, 75},	//赣
+	{0x6842, 76},	//桂
+	{0x9C81, 77},	//鲁
+	{0x5B81, 78},	//宁
+	{0x8C6B, 79},	//豫
+	{0x65B0, 80},	//新
+	{0x6E2F, 81},	//港
+	{0x6FB3, 82},	//澳
+	{0x4EAC, 83},	//京
+};
+
+int watermark_default_glyph_code(const WaterMarkGlyphCode **list)
+{
+	*list = gDefaultGlyphCode;
+	return sizeof(gDefaultGlyphCode)/sizeof(gDefaultGlyphCode[0]);
+}
+
+// decode one utf-8 sequence of len bytes, 0 if it is malformed
+unsigned int watermark_utf8_decode(const char *str, int len)
+{
+	const unsigned char *s = (const unsigned char*)str;
+	unsigned int code;
+	int i;
+
+	switch (len) {
+	case 1:
+		return (s[0] < 0x80) ? s[0] : 0;
+	case 2:
+		code = s[0] & 0x1f;
+		break;
+	case 3:
+		code = s[0] & 0x0f;
+		break;
+	case 4:
+		code = s[0] & 0x07;
+		break;
+	default:
+		return 0;
+	}
+	for (i = 1; i < len; ++i) {
+		if ((s[i] & 0xc0) != 0x80) {
+			return 0;
+		}
+		code = (code << 6) | (s[i] & 0x3f);
+	}
+	return code;
+}
+
+#define GLYPH_HASH(code, bits)	(((code) * 2654435761u) >> (32 - (bits)))
+
+// the hash table is kept for the next glyph set
+void watermark_glyph_map_reset(WaterMarkGlyphMap *map, int default_id)
+{
+	int i;
+
+	for (i = 0; i < 128; ++i) {
+		map->ascii[i] = default_id;
+	}
+	if (map->hash_code != NULL) {
+		memset(map->hash_code, 0, (1 << map->hash_bits)*sizeof(map->hash_code[0]));
+	}
+	map->number = 0;
+	map->default_id = default_id;
+}
+
+static int glyph_map_insert(unsigned int *hash_code, short *hash_id, int bits, unsigned int code, int id)
+{
+	unsigned int h = GLYPH_HASH(code, bits);
+
+	while (hash_code[h] != 0 && hash_code[h] != code) {
+		h = (h + 1) & ((1 << bits) - 1);
+	}
+	hash_id[h] = id;
+	if (hash_code[h] == 0) {
+		hash_code[h] = code;
+		return 1;
+	}
+	return 0;
+}
+
+static int glyph_map_grow(WaterMarkGlyphMap *map)
+{
+	int bits = map->hash_bits ? map->hash_bits + 1 : WATERMARK_GLYPH_HASH_MIN_BITS;
+	unsigned int *hash_code = (unsigned int*)calloc(1 << bits, sizeof(unsigned int) + sizeof(short));
+	short *hash_id;
+	int i;
+
+	if (hash_code == NULL) {
+		return -1;
+	}
+	hash_id = (short*)(hash_code + (1 << bits));
+	for (i = 0; map->hash_code != NULL && i < (1 << map->hash_bits); ++i) {
+		if (map->hash_code[i] != 0) {
+			glyph_map_insert(hash_code, hash_id, bits, map->hash_code[i], map->hash_id[i]);
+		}
+	}
+	free(map->hash_code);
+	map->hash_code = hash_code;
+	map->hash_id = hash_id;
+	map->hash_bits = bits;
+	return 0;
+}
+
+// return value : 0 ok, -1 out of memory or code/id is invalid
+int watermark_glyph_map_add(WaterMarkGlyphMap *map, unsigned int code, int id)
+{
+	if (code == 0 || id < 0 || id > WATERMARK_MAX_GLYPH) {
+		return -1;
+	}
+	if (code < 128) {
+		map->ascii[code] = id;
+		return 0;
+	}
+	//keep the load factor at most 1/2 so probe chains stay short
+	if (map->hash_code == NULL || (map->number + 1)*2 > (1 << map->hash_bits)) {
+		if (glyph_map_grow(map) != 0) {
+			return -1;
+		}
+	}
+	map->number += glyph_map_insert(map->hash_code, map->hash_id, map->hash_bits, code, id);
+	return 0;
+}
+
+int watermark_glyph_map_find(const WaterMarkGlyphMap *map, unsigned int code)
+{
+	unsigned int h;
+
+	if (code < 128) {
+		return map->ascii[code];
+	}
+	if (map->hash_code == NULL) {
+		return map->default_id;
+	}
+	h = GLYPH_HASH(code, map->hash_bits);
+	while (map->hash_code[h] != 0) {
+		if (map->hash_code[h] == code) {
+			return map->hash_id[h];
+		}
+		h = (h + 1) & ((1 << map->hash_bits) - 1);
+	}
+	return map->default_id;
+}
+
+void watermark_glyph_map_release(WaterMarkGlyphMap *map)
+{
+	free(map->hash_code);
+	map->hash_code = NULL;
+	map->hash_id = NULL;
+	map->hash_bits = 0;
+	map->number = 0;
+}
+
+// load one 32 bit ARGB bmp and convert it to y, alph, c planes in one buffer at pic->y
+// return value : 0 ok, -1 open error (errno is kept), -2 format or alloc error
+int watermark_load_bmp(const char *filename, SinglePicture *pic)
+{
+	FILE *fp = NULL;
+	int width = 0, height = 0;
+	unsigned char *buf = NULL;
+
+	fp = fopen(filename, "r");
+	if (NULL == fp) {
+		return -1;
+	}
+
+	//get watermark picture size
+	fseek(fp, 18, SEEK_SET);
+	if (fread(&width, 1, 4, fp) != 4 || fread(&height, 1, 4, fp) != 4 || width == 0 || height == 0) {
+		fclose(fp);
+		return -2;
+	}
+	pic->width = abs(width);
+	pic->height = abs(height);
+
+	fseek(fp, 54, SEEK_SET);
+
+	pic->y = (unsigned char*)malloc(WATERMARK_GLYPH_SIZE(pic->width, pic->height));
+	if (NULL == pic->y) {
+		fclose(fp);
+		return -2;
+	}
+	pic->alph = pic->y + pic->width * pic->height;
+	pic->c = pic->alph + pic->width * pic->height;
+
+	buf = (unsigned char *)malloc(pic->width * pic->height * 4);
+	if (NULL == buf) {
+		free(pic->y);
+		pic->y = NULL;
+		fclose(fp);
+		return -2;
+	}
+
+	fread(buf, pic->width * pic->height * 4, 1, fp);
+
+	argb2yuv420sp(buf, pic->alph, pic->width, pic->height, pic->y, pic->c);
+
+	fclose(fp);
+	free(buf);
+	return 0;
+}
+
+// check the header and entry table of a mapped atlas file
+// return value : number of entries, -1 if the file is not a valid atlas
+int watermark_atlas_check(const void *base, unsigned int size)
+{
+	const WaterMarkAtlasHeader *header = (const WaterMarkAtlasHeader*)base;
+	const WaterMarkAtlasEntry *entry;
+	unsigned int i;
+
+	if (size < sizeof(WaterMarkAtlasHeader)
+		|| header->magic != WATERMARK_ATLAS_MAGIC
+		|| header->version != WATERMARK_ATLAS_VERSION
+		|| header->file_size != size
+		|| header->entry_number > (size - sizeof(WaterMarkAtlasHeader))/sizeof(WaterMarkAtlasEntry)) {
+		return -1;
+	}
+	entry = (const WaterMarkAtlasEntry*)(header + 1);
+	for (i = 0; i < header->entry_number; ++i) {
+		if (entry[i].id > WATERMARK_MAX_GLYPH || entry[i].width == 0 || entry[i].height == 0
+			|| entry[i].code > 0x10ffff || entry[i].width > 4096 || entry[i].height > 4096
+			|| entry[i].size != WATERMARK_GLYPH_SIZE(entry[i].width, entry[i].height)
+			|| entry[i].offset > size || entry[i].size > size - entry[i].offset) {
+			return -1;
+		}
+	}
+	return (int)header->entry_number;
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
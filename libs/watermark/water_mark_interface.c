@@ -5,6 +5,11 @@
 #include <string.h>
 #include <time.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <cutils/log.h>
 #include <include_watermark/water_mark_interface.h>
 
@@ -13,50 +18,6 @@
 #include "water_mark.h"
 
 
-static void argb2yuv420sp(unsigned char* src_p, unsigned char* alph, 
-				int width, int height,
-				unsigned char* dest_y, unsigned char* dest_c)
-{
-	int i,j;
-	for(i = 0; i < (int)height; i++)
-    {
-		if((i&1) == 0)
-		{
-	    	for(j= 0; j< (int)width; j++)
-			{
-				*dest_y = (299*src_p[2]+587*src_p[1]+114*src_p[0])/1000;
-
-				if((j&1) == 0)
-				{
-				   //cb
-				   *dest_c++ = 128+(564*(src_p[0]-*dest_y)/1000);	
-				}
-				else
-				{
-				   // cr
-				   *dest_c++ = 128+(713*(src_p[2]-*dest_y)/1000);
-				}
-
-				*alph++ = src_p[3];
-				src_p +=4;
-				dest_y++;
-			}		
-		}
-		else
-		{
-			for(j= 0; j< (int)width; j++)
-			{
-				*dest_y = (299*src_p[2]+587*src_p[1]+114*src_p[0])/1000;
-				*alph++ = src_p[3];
-				src_p +=4;
-				dest_y++;
-			}	
-		}
-    }
-	
-	return;
-}
-
 static int getWordCharNum(char val)
 {
 	int i;
@@ -76,69 +37,152 @@ static int getWordCharNum(char val)
 	return cnt;
 }
 
-static int getWordIndex(char *data, int len)
+//the standard glyph set, unmapped characters are drawn as ' '
+static void initDefaultGlyphMap(WaterMarkGlyphMap *map)
 {
-	if (len == 1) {
-		if (*data >= '0' && *data <= '9') return (*data - 0x30);
-        else if (*data >= 'A' && *data <= 'Z') return (*data - 0x2B);
-		else if (*data == ' ') return 19;
-		else if (*data == '-') return 20;
-		else if (*data == ':') return 21;
-        else if (*data == '/') return 48;
-		else if (*data == '.') return 49;
-		else return 19;
-	} else if (len == 2) {
-		return 19;
-	} else if (len == 3) {
-		if(!memcmp(data, "京", 3)) return 83;
-		else if (!memcmp(data, "湘", 3)) return 50;
-		else if (!memcmp(data, "津", 3)) return 51;
-		else if (!memcmp(data, "鄂", 3)) return 52;
-		else if (!memcmp(data, "沪", 3)) return 53;
-		else if (!memcmp(data, "粤", 3)) return 54;
-		else if (!memcmp(data, "渝", 3)) return 55;
-		else if (!memcmp(data, "琼", 3)) return 56;
-		else if (!memcmp(data, "冀", 3)) return 57;
-		else if (!memcmp(data, "川", 3)) return 58;
-		else if (!memcmp(data, "晋", 3)) return 59;
-		else if (!memcmp(data, "黔", 3)) return 60;
-		else if (!memcmp(data, "辽", 3)) return 61;
-		else if (!memcmp(data, "云", 3)) return 62;
-		else if (!memcmp(data, "吉", 3)) return 63;
-		else if (!memcmp(data, "陕", 3)) return 64;
-		else if (!memcmp(data, "黑", 3)) return 65;
-		else if (!memcmp(data, "甘", 3)) return 66;
-		else if (!memcmp(data, "苏", 3)) return 67;
-		else if (!memcmp(data, "青", 3)) return 68;
-		else if (!memcmp(data, "浙", 3)) return 69;
-		else if (!memcmp(data, "台", 3)) return 70;
-		else if (!memcmp(data, "皖", 3)) return 71;
-		else if (!memcmp(data, "藏", 3)) return 72;
-		else if (!memcmp(data, "闽", 3)) return 73;
-		else if (!memcmp(data, "蒙", 3)) return 74;
-		else if (!memcmp(data, "赣", 3)) return 75;
-		else if (!memcmp(data, "桂", 3)) return 76;
-		else if (!memcmp(data, "鲁", 3)) return 77;
-		else if (!memcmp(data, "宁", 3)) return 78;
-		else if (!memcmp(data, "豫", 3)) return 79;
-		else if (!memcmp(data, "新", 3)) return 80;
-		else if (!memcmp(data, "港", 3)) return 81;
-		else if (!memcmp(data, "澳", 3)) return 82;
-		else return 19;
-	} else {
-		return 19;
+	const WaterMarkGlyphCode *list;
+	int number;
+	int i;
+
+	number = watermark_default_glyph_code(&list);
+	watermark_glyph_map_reset(map, 19);
+	for (i = 0; i < number; ++i) {
+		watermark_glyph_map_add(map, list[i].code, list[i].id);
+	}
+}
+
+//the atlas is mapped once per process and shared by all watermark instances
+static pthread_mutex_t gAtlasLock = PTHREAD_MUTEX_INITIALIZER;
+static void *gAtlasBase = NULL;
+static unsigned int gAtlasSize = 0;
+static int gAtlasRef = 0;
+
+static void putWaterMarkAtlas(void)
+{
+	pthread_mutex_lock(&gAtlasLock);
+	if (--gAtlasRef == 0) {
+		munmap(gAtlasBase, gAtlasSize);
+		gAtlasBase = NULL;
+		gAtlasSize = 0;
 	}
-	return 19;
+	pthread_mutex_unlock(&gAtlasLock);
+}
+
+static int loadWaterMarkAtlas(WATERMARK_CTRL *wm_ctrl, int wm_height)
+{
+	const WaterMarkAtlasEntry *entry;
+	SinglePicture *pic;
+	struct stat st;
+	void *base;
+	int entry_number;
+	int glyph_number = 0;
+	int mapped = 0;
+	int space_id = -1;
+	int fd;
+	int i;
+
+	pthread_mutex_lock(&gAtlasLock);
+	if (gAtlasRef == 0) {
+		fd = open(WATERMARK_ATLAS_FILE, O_RDONLY);
+		if (fd < 0) {
+			pthread_mutex_unlock(&gAtlasLock);
+			return -1;
+		}
+		if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+			close(fd);
+			pthread_mutex_unlock(&gAtlasLock);
+			return -1;
+		}
+		base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (base == MAP_FAILED) {
+			ALOGW("<loadWaterMarkAtlas> mmap %s error(%s)", WATERMARK_ATLAS_FILE, strerror(errno));
+			pthread_mutex_unlock(&gAtlasLock);
+			return -1;
+		}
+		if (watermark_atlas_check(base, st.st_size) < 0) {
+			ALOGW("<loadWaterMarkAtlas> invalid atlas file %s", WATERMARK_ATLAS_FILE);
+			munmap(base, st.st_size);
+			pthread_mutex_unlock(&gAtlasLock);
+			return -1;
+		}
+		gAtlasBase = base;
+		gAtlasSize = st.st_size;
+	}
+	gAtlasRef++;
+	base = gAtlasBase;
+	pthread_mutex_unlock(&gAtlasLock);
+
+	entry_number = ((WaterMarkAtlasHeader*)base)->entry_number;
+	entry = (const WaterMarkAtlasEntry*)((WaterMarkAtlasHeader*)base + 1);
+
+	//an atlas that carries code points replaces the standard glyph map,
+	//characters it has no glyph for are drawn as its ' ', or skipped if it has none
+	for (i = 0; i < entry_number; ++i) {
+		if ((int)entry[i].wm_height != wm_height) {
+			continue;
+		}
+		if ((int)entry[i].id >= glyph_number) {
+			glyph_number = entry[i].id + 1;
+		}
+		if (entry[i].code != 0) {
+			mapped = 1;
+			if (entry[i].code == ' ') {
+				space_id = entry[i].id;
+			}
+		}
+	}
+	if (glyph_number == 0) {
+		putWaterMarkAtlas();
+		return -1;
+	}
+	wm_ctrl->wminfo.single_pic = (SinglePicture*)calloc(glyph_number, sizeof(SinglePicture));
+	if (wm_ctrl->wminfo.single_pic == NULL) {
+		putWaterMarkAtlas();
+		return -1;
+	}
+	if (mapped) {
+		watermark_glyph_map_reset(&wm_ctrl->glyph_map, space_id);
+	}
+
+	for (i = 0; i < entry_number; ++i) {
+		if ((int)entry[i].wm_height != wm_height) {
+			continue;
+		}
+		if (mapped && entry[i].code != 0
+			&& watermark_glyph_map_add(&wm_ctrl->glyph_map, entry[i].code, entry[i].id) != 0) {
+			ALOGW("<loadWaterMarkAtlas> no memory for code 0x%x, dropped", entry[i].code);
+		}
+		pic = &wm_ctrl->wminfo.single_pic[entry[i].id];
+		pic->id = entry[i].id;
+		pic->width = entry[i].width;
+		pic->height = entry[i].height;
+		pic->y = (unsigned char*)base + entry[i].offset;
+		pic->alph = pic->y + pic->width * pic->height;
+		pic->c = pic->alph + pic->width * pic->height;
+	}
+
+	//same as the bmp files, the glyph set ends at the first missing id
+	for (i = 0; i < glyph_number && wm_ctrl->wminfo.single_pic[i].y != NULL; ++i);
+	if (i == 0) {
+		free(wm_ctrl->wminfo.single_pic);
+		wm_ctrl->wminfo.single_pic = NULL;
+		putWaterMarkAtlas();
+		initDefaultGlyphMap(&wm_ctrl->glyph_map);
+		return -1;
+	}
+	wm_ctrl->wminfo.picture_number = i;
+	wm_ctrl->atlas = 1;
+	return 0;
 }
 
 void *initialwaterMark(int wm_height)
 {
-	FILE *fp = NULL;
-	int watermark_pic_num = MAX_ICON_PIC;
+	SinglePicture *pic;
+	int capacity = 0;
 	int i;
-	int width = 0, height = 0;
+	int ret;
 	char filename[256];
-	unsigned char *buf = NULL;
 	WATERMARK_CTRL *wm_ctrl = NULL;
 
 	ALOGD("<initialwaterMark>water mark initialize, height=%d", wm_height);
@@ -149,53 +193,45 @@ void *initialwaterMark(int wm_height)
 	}
 	memset(wm_ctrl, 0, sizeof(WATERMARK_CTRL));
 	wm_ctrl->ADBright.recycle_frame = 30;
+	wm_ctrl->wm_height = wm_height;
     wm_ctrl->multi.singleWaterMark[0].positionX = 32;
     wm_ctrl->multi.singleWaterMark[0].positionY = 32;
     wm_ctrl->multi.waterMarkNum = 1;
+	initDefaultGlyphMap(&wm_ctrl->glyph_map);
 
-	for(i = 0; i < watermark_pic_num; ++i) {
+	if (loadWaterMarkAtlas(wm_ctrl, wm_height) == 0) {
+		ALOGD("<initialwaterMark>picture_number=%d from %s", wm_ctrl->wminfo.picture_number, WATERMARK_ATLAS_FILE);
+		return (void*)wm_ctrl;
+	}
+	memset(&wm_ctrl->wminfo, 0, sizeof(wm_ctrl->wminfo));
+
+	//the glyph set ends at the first missing file
+	for(i = 0; i <= WATERMARK_MAX_GLYPH; ++i) {
+		if (i == capacity) {
+			capacity = capacity ? capacity*2 : 128;
+			pic = (SinglePicture*)realloc(wm_ctrl->wminfo.single_pic, capacity*sizeof(SinglePicture));
+			if (pic == NULL) {
+				ALOGE("<initialwaterMark> Alloc glyph table error(%s)", strerror(errno));
+				goto LOAD_ERR;
+			}
+			memset(pic + i, 0, (capacity - i)*sizeof(SinglePicture));
+			wm_ctrl->wminfo.single_pic = pic;
+		}
 		sprintf(filename, "/system/watermark/wm_%dp_%d.bmp", wm_height, i);
 
-		fp = fopen(filename, "r");
-		if (NULL == fp) {
+		ret = watermark_load_bmp(filename, &wm_ctrl->wminfo.single_pic[i]);
+		if (ret == -1) {
 			ALOGW("<initialwaterMark>Fail to open file %s(%s)!", filename, strerror(errno));
 			break;
+		} else if (ret != 0) {
+			ALOGE("<initialwaterMark>Fail to load file %s!", filename);
+			goto LOAD_ERR;
 		}
-
-		//get watermark picture size
-		fseek(fp, 18, SEEK_SET);
-		fread(&width, 1, 4, fp);
-		fread(&height, 1, 4, fp);
-		wm_ctrl->wminfo.single_pic[i].width = abs(width);
-		wm_ctrl->wminfo.single_pic[i].height = abs(height);
-
-		fseek(fp, 54, SEEK_SET);
-
-		wm_ctrl->wminfo.single_pic[i].y = (unsigned char*)malloc(wm_ctrl->wminfo.single_pic[i].width * wm_ctrl->wminfo.single_pic[i].height*5/2);
-		if (NULL == wm_ctrl->wminfo.single_pic[i].y) {
-			fclose(fp);
-			goto ALLOC_Y_ERR;
-		}
-		wm_ctrl->wminfo.single_pic[i].alph = wm_ctrl->wminfo.single_pic[i].y + wm_ctrl->wminfo.single_pic[i].width * wm_ctrl->wminfo.single_pic[i].height;
-		wm_ctrl->wminfo.single_pic[i].c = wm_ctrl->wminfo.single_pic[i].alph + wm_ctrl->wminfo.single_pic[i].width * wm_ctrl->wminfo.single_pic[i].height;
 		wm_ctrl->wminfo.single_pic[i].id = i;
-
-		buf = (unsigned char *)malloc(wm_ctrl->wminfo.single_pic[i].width * wm_ctrl->wminfo.single_pic[i].height * 4);
-		if (NULL == buf) {
-			fclose(fp);
-			goto ALLOC_BUF_ERR;
-		}
-
-		fread(buf, wm_ctrl->wminfo.single_pic[i].width * wm_ctrl->wminfo.single_pic[i].height * 4, 1, fp);
-
-		argb2yuv420sp(buf, wm_ctrl->wminfo.single_pic[i].alph, 
-				wm_ctrl->wminfo.single_pic[i].width, wm_ctrl->wminfo.single_pic[i].height,
-				wm_ctrl->wminfo.single_pic[i].y, wm_ctrl->wminfo.single_pic[i].c);
-
-		fclose(fp);
-		free(buf);
 	}
     if (i == 0) {
+        free(wm_ctrl->wminfo.single_pic);
+        watermark_glyph_map_release(&wm_ctrl->glyph_map);
         free(wm_ctrl);
         return NULL;
     } else {
@@ -205,15 +241,15 @@ void *initialwaterMark(int wm_height)
 
 	return (void*)wm_ctrl;
 
-ALLOC_BUF_ERR:
-ALLOC_Y_ERR:
-OPEN_FILE_ERR:
-	for (i = 0; i < wm_ctrl->wminfo.picture_number; ++i) {
+LOAD_ERR:
+	for (i = 0; i < capacity; ++i) {
 		if (wm_ctrl->wminfo.single_pic[i].y != NULL) {
 			free(wm_ctrl->wminfo.single_pic[i].y);
 			wm_ctrl->wminfo.single_pic[i].y = NULL;
 		}
 	}
+	free(wm_ctrl->wminfo.single_pic);
+	watermark_glyph_map_release(&wm_ctrl->glyph_map);
 	free(wm_ctrl);
 	return NULL;
 }
@@ -228,13 +264,23 @@ int releaseWaterMark(void *ctrl)
         return -1;
     }
 	
-	ALOGD("<releaseWaterMark>water mark release");
-	for (i = 0; i < wm_ctrl->wminfo.picture_number; ++i) {
-		if (wm_ctrl->wminfo.single_pic[i].y != NULL) {
-			free(wm_ctrl->wminfo.single_pic[i].y);
-			wm_ctrl->wminfo.single_pic[i].y = NULL;
+	ALOGD("<releaseWaterMark>water mark release, run cache hit=%u, miss=%u, update=%u(%u cells)",
+		wm_ctrl->run_hit, wm_ctrl->run_miss, wm_ctrl->run_update, wm_ctrl->run_cell_update);
+	for (i = 0; i < WATERMARK_RUN_CACHE_NUM; ++i) {
+		watermark_release_run(&wm_ctrl->run_cache[i]);
+	}
+	if (wm_ctrl->atlas) {
+		putWaterMarkAtlas();
+	} else {
+		for (i = 0; i < wm_ctrl->wminfo.picture_number; ++i) {
+			if (wm_ctrl->wminfo.single_pic[i].y != NULL) {
+				free(wm_ctrl->wminfo.single_pic[i].y);
+				wm_ctrl->wminfo.single_pic[i].y = NULL;
+			}
 		}
 	}
+	free(wm_ctrl->wminfo.single_pic);
+	watermark_glyph_map_release(&wm_ctrl->glyph_map);
 	free(wm_ctrl);
 	return 0;
 }
@@ -277,22 +323,99 @@ int waterMarkSetMultiple(void *ctrl, const char *waterMark)
     return 0;
 }
 
-static int doWaterMark(WaterMarkInData *data, void *ctrl)
+static WaterMarkRun *getWaterMarkRun(WATERMARK_CTRL *wm_ctrl, const char *display, int slot)
 {
-	BackGroudLayerInfo BGInfo;
 	ShowWaterMarkParam WMPara;
-	AjustBrightnessParam *ADBright;
-	WATERMARK_CTRL *wm_ctrl;
-	WaterMarkInfo *wm_info;
+	WaterMarkRun *run = NULL;
+	WaterMarkRun *slot_run = NULL;
+	int changed;
+	const char *dispBuf;
 	int buflen, wordlen;
+	int id, n;
 	int i;
-	char *dispBuf;
+
+	//at most DISP_ICON_NUM words are shown, so the key prefix covers every byte that is used
+	wm_ctrl->run_clock++;
+	for (i = 0; i < WATERMARK_RUN_CACHE_NUM; ++i) {
+		if (wm_ctrl->run_cache[i].text[0] != '\0'
+			&& wm_ctrl->run_cache[i].wm_height == wm_ctrl->wm_height
+			&& !strncmp(wm_ctrl->run_cache[i].text, display, WATERMARK_RUN_TEXT_LEN - 1)) {
+			wm_ctrl->run_cache[i].last_use = wm_ctrl->run_clock;
+			wm_ctrl->run_cache[i].slot = slot;
+			wm_ctrl->run_hit++;
+			return &wm_ctrl->run_cache[i];
+		}
+		if (wm_ctrl->run_cache[i].text[0] != '\0' && wm_ctrl->run_cache[i].slot == slot
+			&& wm_ctrl->run_cache[i].wm_height == wm_ctrl->wm_height) {
+			slot_run = &wm_ctrl->run_cache[i];
+		}
+		if (run == NULL || (run->text[0] != '\0'
+			&& (wm_ctrl->run_cache[i].text[0] == '\0' || wm_ctrl->run_cache[i].last_use < run->last_use))) {
+			run = &wm_ctrl->run_cache[i];
+		}
+	}
+	wm_ctrl->run_miss++;
+
+	buflen = strlen(display);
+	dispBuf = display;
+	n = 0;
+	for (i = 0; i < DISP_ICON_NUM; ++i) {
+		wordlen = getWordCharNum(dispBuf[0]);
+		buflen -= wordlen;
+		if (buflen < 0) {
+			break;
+		}
+		id = watermark_glyph_map_find(&wm_ctrl->glyph_map, watermark_utf8_decode(dispBuf, wordlen));
+		dispBuf += wordlen;
+		if (id < 0) {
+			continue;	//no glyph for it and no ' ' in the glyph set
+		}
+        if (id >= wm_ctrl->wminfo.picture_number) {
+            ALOGE("<F:%s, L:%d> glyph id[%d] error! wm string '%s'", __FUNCTION__, __LINE__, id, display);
+            return NULL;
+        }
+		WMPara.id_list[n++] = id;
+	}
+	if (n == 0) {
+		return NULL;
+	}
+	WMPara.number = n;
+
+	//the slot's previous text (e.g. last second's timestamp) usually differs in a few glyphs only,
+	//so its strip is patched in place instead of composing a new one
+	if (slot_run != NULL) {
+		run = slot_run;
+	}
+	run->text[0] = '\0';
+	if (slot_run != NULL) {
+		changed = watermark_update_run(&wm_ctrl->wminfo, &WMPara, run);
+		if (changed < 0) {
+			return NULL;
+		}
+		wm_ctrl->run_update++;
+		wm_ctrl->run_cell_update += changed;
+	} else if (watermark_compose_run(&wm_ctrl->wminfo, &WMPara, run) != 0) {
+		return NULL;
+	}
+	run->slot = slot;
+	strncpy(run->text, display, WATERMARK_RUN_TEXT_LEN - 1);
+	run->text[WATERMARK_RUN_TEXT_LEN - 1] = '\0';
+	run->wm_height = wm_ctrl->wm_height;
+	run->last_use = wm_ctrl->run_clock;
+	return run;
+}
+
+static int doWaterMark(WaterMarkInData *data, void *ctrl, int slot)
+{
+	BackGroudLayerInfo BGInfo;
+	WATERMARK_CTRL *wm_ctrl;
+	WaterMarkRun *run;
 
 	if (ctrl == NULL || data == NULL) {
 		ALOGE("Input parameters error!");
 		return -1;
 	}
-	if (data->display == NULL || (buflen = strlen(data->display)) == 0) {
+	if (data->display == NULL || strlen(data->display) == 0) {
 		ALOGE("invalid water mark display buffer!");
 		return -1;
 	}
@@ -302,33 +425,15 @@ static int doWaterMark(WaterMarkInData *data, void *ctrl)
 	BGInfo.height = data->height;
 	BGInfo.y = data->y;
 	BGInfo.c = data->c;
-	wm_info = &wm_ctrl->wminfo;
-	ADBright = &wm_ctrl->ADBright;
-	dispBuf = data->display;
 
-	for (i = 0; i < DISP_ICON_NUM; ++i) {
-		wordlen = getWordCharNum(dispBuf[0]);
-		buflen -= wordlen;
-		if (buflen < 0) {
-			break;
-		}
-		WMPara.id_list[i] = getWordIndex(dispBuf, wordlen);
-        if (WMPara.id_list[i] >= wm_ctrl->wminfo.picture_number) {
-            ALOGE("<F:%s, L:%d> getWordIndex[%d] error! wm string '%s'", __FUNCTION__, __LINE__, WMPara.id_list[i], data->display);
-            return -1;
-        }
-		dispBuf += wordlen;
+	//glyphs are not scaled, so the strip is shared by all channels, only the position differs
+	run = getWaterMarkRun(wm_ctrl, data->display, slot);
+	if (run == NULL) {
+		return -1;
 	}
 
-	WMPara.number = i;
-
-	WMPara.pos.x =  data->posx;
-	WMPara.pos.y = data->posy;
-
 	//watermark_blending_ajust_brightness(&BGInfo, wm_info, &WMPara, ADBright);
-	watermark_blending(&BGInfo, wm_info, &WMPara);
-
-	return 0;
+	return watermark_blending_run(&BGInfo, run, data->posx, data->posy);
 }
 
 int doWaterMarkMultiple(WaterMarkInData *data, void *ctrl, const char *time_str)
@@ -347,26 +452,26 @@ int doWaterMarkMultiple(WaterMarkInData *data, void *ctrl, const char *time_str)
             data->posx = wm_ctrl->multi.singleWaterMark[0].positionX;
             data->posy = wm_ctrl->multi.singleWaterMark[0].positionY;
             data->display = (char*)time_str;
-            doWaterMark(data, ctrl);
+            doWaterMark(data, ctrl, 0);
         }
         for (i = 1; i < wm_ctrl->multi.waterMarkNum; i++) {
             data->posx = wm_ctrl->multi.singleWaterMark[i].positionX;
             data->posy = wm_ctrl->multi.singleWaterMark[i].positionY;
             data->display = wm_ctrl->multi.singleWaterMark[i].content;
-            doWaterMark(data,ctrl);
+            doWaterMark(data, ctrl, i);
         }
     } else {
         if (wm_ctrl->multi.singleWaterMark[0].content[0] == '1') {
             data->posx = wm_ctrl->multi.singleWaterMark[0].positionX * data->scale;
             data->posy = wm_ctrl->multi.singleWaterMark[0].positionY * data->scale;
             data->display = (char*)time_str;
-            doWaterMark(data, ctrl);
+            doWaterMark(data, ctrl, 0);
         }
         for (i = 1; i < wm_ctrl->multi.waterMarkNum; i++) {
             data->posx = wm_ctrl->multi.singleWaterMark[i].positionX * data->scale;
             data->posy = wm_ctrl->multi.singleWaterMark[i].positionY * data->scale;
             data->display = wm_ctrl->multi.singleWaterMark[i].content;
-            doWaterMark(data,ctrl);
+            doWaterMark(data, ctrl, i);
         }
     }
     //preempt_enable();
@@ -0,0 +1,354 @@
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#define LOG_TAG "Water_mark_kernel"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <cutils/log.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define WATERMARK_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(__SSE2__)
+#define WATERMARK_HAVE_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define WATERMARK_HAVE_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+#include <water_mark.h>
+
+// all kernels compute bg = ((256 - a)*bg + fg*a)>>8 for every byte, the invert variant uses (256 - fg)
+// instead of fg. The sum is at most 65535, so 16 bit lanes give the same result as the scalar code.
+
+static void blend_row_c(unsigned char *bg, const unsigned char *fg, const unsigned char *alph, int n)
+{
+	int i;
+
+	for (i = 0; i < n; ++i) {
+		bg[i] = ((256 - alph[i])*bg[i] + fg[i]*alph[i])>>8;
+	}
+}
+
+static void blend_row_invert_c(unsigned char *bg, const unsigned char *fg, const unsigned char *alph, int n)
+{
+	int i;
+
+	for (i = 0; i < n; ++i) {
+		bg[i] = ((256 - alph[i])*bg[i] + (256 - fg[i])*alph[i])>>8;
+	}
+}
+
+static unsigned int row_sum_c(const unsigned char *p, int n)
+{
+	unsigned int sum = 0;
+	int i;
+
+	for (i = 0; i < n; ++i) {
+		sum += p[i];
+	}
+	return sum;
+}
+
+static int supported_always(void)
+{
+	return 1;
+}
+
+#ifdef WATERMARK_HAVE_NEON
+//(255 - a)*bg + bg + fg*a, the widening multiplies avoid 16 bit multiplies on the A7
+static void blend_row_neon(unsigned char *bg, const unsigned char *fg, const unsigned char *alph, int n)
+{
+	uint8x16_t v255 = vdupq_n_u8(255);
+	uint8x16_t b, f, a, na;
+	uint16x8_t lo, hi;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		b = vld1q_u8(bg + i);
+		f = vld1q_u8(fg + i);
+		a = vld1q_u8(alph + i);
+		na = vsubq_u8(v255, a);
+		lo = vmull_u8(vget_low_u8(na), vget_low_u8(b));
+		hi = vmull_u8(vget_high_u8(na), vget_high_u8(b));
+		lo = vmlal_u8(lo, vget_low_u8(f), vget_low_u8(a));
+		hi = vmlal_u8(hi, vget_high_u8(f), vget_high_u8(a));
+		lo = vaddw_u8(lo, vget_low_u8(b));
+		hi = vaddw_u8(hi, vget_high_u8(b));
+		vst1q_u8(bg + i, vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+	}
+	blend_row_c(bg + i, fg + i, alph + i, n - i);
+}
+
+//(256 - fg)*a = (255 - fg)*a + a
+static void blend_row_invert_neon(unsigned char *bg, const unsigned char *fg, const unsigned char *alph, int n)
+{
+	uint8x16_t v255 = vdupq_n_u8(255);
+	uint8x16_t b, nf, a, na;
+	uint16x8_t lo, hi;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		b = vld1q_u8(bg + i);
+		nf = vsubq_u8(v255, vld1q_u8(fg + i));
+		a = vld1q_u8(alph + i);
+		na = vsubq_u8(v255, a);
+		lo = vmull_u8(vget_low_u8(na), vget_low_u8(b));
+		hi = vmull_u8(vget_high_u8(na), vget_high_u8(b));
+		lo = vmlal_u8(lo, vget_low_u8(nf), vget_low_u8(a));
+		hi = vmlal_u8(hi, vget_high_u8(nf), vget_high_u8(a));
+		lo = vaddq_u16(lo, vaddl_u8(vget_low_u8(b), vget_low_u8(a)));
+		hi = vaddq_u16(hi, vaddl_u8(vget_high_u8(b), vget_high_u8(a)));
+		vst1q_u8(bg + i, vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+	}
+	blend_row_invert_c(bg + i, fg + i, alph + i, n - i);
+}
+
+static unsigned int row_sum_neon(const unsigned char *p, int n)
+{
+	uint32x4_t acc = vdupq_n_u32(0);
+	uint64x2_t sum;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		acc = vpadalq_u16(acc, vpaddlq_u8(vld1q_u8(p + i)));
+	}
+	sum = vpaddlq_u32(acc);
+	return (unsigned int)(vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1)) + row_sum_c(p + i, n - i);
+}
+
+#if defined(__aarch64__)
+static int supported_neon(void)
+{
+	return 1;
+}
+#else
+//the library may be built with -mfpu=neon for a board without it, check the kernel's cpu features
+static int supported_neon(void)
+{
+	char line[512];
+	int found = 0;
+	FILE *fp = fopen("/proc/cpuinfo", "r");
+
+	if (fp == NULL) {
+		return 0;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (!strncmp(line, "Features", 8) && strstr(line, " neon") != NULL) {
+			found = 1;
+			break;
+		}
+	}
+	fclose(fp);
+	return found;
+}
+#endif
+#endif
+
+#ifdef WATERMARK_HAVE_SSE2
+static void blend_row_sse2(unsigned char *bg, const unsigned char *fg, const unsigned char *alph, int n)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i v256 = _mm_set1_epi16(256);
+	__m128i b, f, a, lo, hi, al, ah;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		b = _mm_loadu_si128((const __m128i*)(bg + i));
+		f = _mm_loadu_si128((const __m128i*)(fg + i));
+		a = _mm_loadu_si128((const __m128i*)(alph + i));
+		al = _mm_unpacklo_epi8(a, zero);
+		ah = _mm_unpackhi_epi8(a, zero);
+		lo = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(v256, al), _mm_unpacklo_epi8(b, zero)),
+				_mm_mullo_epi16(_mm_unpacklo_epi8(f, zero), al));
+		hi = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(v256, ah), _mm_unpackhi_epi8(b, zero)),
+				_mm_mullo_epi16(_mm_unpackhi_epi8(f, zero), ah));
+		_mm_storeu_si128((__m128i*)(bg + i), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+	}
+	blend_row_c(bg + i, fg + i, alph + i, n - i);
+}
+
+static void blend_row_invert_sse2(unsigned char *bg, const unsigned char *fg, const unsigned char *alph, int n)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i v256 = _mm_set1_epi16(256);
+	__m128i b, f, a, lo, hi, al, ah;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		b = _mm_loadu_si128((const __m128i*)(bg + i));
+		f = _mm_loadu_si128((const __m128i*)(fg + i));
+		a = _mm_loadu_si128((const __m128i*)(alph + i));
+		al = _mm_unpacklo_epi8(a, zero);
+		ah = _mm_unpackhi_epi8(a, zero);
+		lo = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(v256, al), _mm_unpacklo_epi8(b, zero)),
+				_mm_mullo_epi16(_mm_sub_epi16(v256, _mm_unpacklo_epi8(f, zero)), al));
+		hi = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(v256, ah), _mm_unpackhi_epi8(b, zero)),
+				_mm_mullo_epi16(_mm_sub_epi16(v256, _mm_unpackhi_epi8(f, zero)), ah));
+		_mm_storeu_si128((__m128i*)(bg + i), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+	}
+	blend_row_invert_c(bg + i, fg + i, alph + i, n - i);
+}
+
+static unsigned int row_sum_sse2(const unsigned char *p, int n)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i acc = _mm_setzero_si128();
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(p + i)), zero));
+	}
+	return (unsigned int)(_mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8))) + row_sum_c(p + i, n - i);
+}
+
+#ifdef WATERMARK_HAVE_AVX2
+//unpack and pack both work inside 128 bit lanes, so the byte order is kept
+__attribute__((target("avx2")))
+static void blend_row_avx2(unsigned char *bg, const unsigned char *fg, const unsigned char *alph, int n)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i v256 = _mm256_set1_epi16(256);
+	__m256i b, f, a, lo, hi, al, ah;
+	int i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		b = _mm256_loadu_si256((const __m256i*)(bg + i));
+		f = _mm256_loadu_si256((const __m256i*)(fg + i));
+		a = _mm256_loadu_si256((const __m256i*)(alph + i));
+		al = _mm256_unpacklo_epi8(a, zero);
+		ah = _mm256_unpackhi_epi8(a, zero);
+		lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(v256, al), _mm256_unpacklo_epi8(b, zero)),
+				_mm256_mullo_epi16(_mm256_unpacklo_epi8(f, zero), al));
+		hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(v256, ah), _mm256_unpackhi_epi8(b, zero)),
+				_mm256_mullo_epi16(_mm256_unpackhi_epi8(f, zero), ah));
+		_mm256_storeu_si256((__m256i*)(bg + i), _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8)));
+	}
+	blend_row_sse2(bg + i, fg + i, alph + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void blend_row_invert_avx2(unsigned char *bg, const unsigned char *fg, const unsigned char *alph, int n)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i v256 = _mm256_set1_epi16(256);
+	__m256i b, f, a, lo, hi, al, ah;
+	int i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		b = _mm256_loadu_si256((const __m256i*)(bg + i));
+		f = _mm256_loadu_si256((const __m256i*)(fg + i));
+		a = _mm256_loadu_si256((const __m256i*)(alph + i));
+		al = _mm256_unpacklo_epi8(a, zero);
+		ah = _mm256_unpackhi_epi8(a, zero);
+		lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(v256, al), _mm256_unpacklo_epi8(b, zero)),
+				_mm256_mullo_epi16(_mm256_sub_epi16(v256, _mm256_unpacklo_epi8(f, zero)), al));
+		hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(v256, ah), _mm256_unpackhi_epi8(b, zero)),
+				_mm256_mullo_epi16(_mm256_sub_epi16(v256, _mm256_unpackhi_epi8(f, zero)), ah));
+		_mm256_storeu_si256((__m256i*)(bg + i), _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8)));
+	}
+	blend_row_invert_sse2(bg + i, fg + i, alph + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static unsigned int row_sum_avx2(const unsigned char *p, int n)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i acc = _mm256_setzero_si256();
+	__m128i sum;
+	int i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(p + i)), zero));
+	}
+	sum = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+	return (unsigned int)(_mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8))) + row_sum_sse2(p + i, n - i);
+}
+
+static int supported_avx2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+#endif
+#endif
+
+typedef struct WaterMarkKernelEntry
+{
+	WaterMarkKernel kernel;
+	int (*supported)(void);
+}WaterMarkKernelEntry;
+
+//best first
+static const WaterMarkKernelEntry g_kernel_entry[] =
+{
+#ifdef WATERMARK_HAVE_AVX2
+	{{"avx2", blend_row_avx2, blend_row_invert_avx2, row_sum_avx2}, supported_avx2},
+#endif
+#ifdef WATERMARK_HAVE_SSE2
+	{{"sse2", blend_row_sse2, blend_row_invert_sse2, row_sum_sse2}, supported_always},
+#endif
+#ifdef WATERMARK_HAVE_NEON
+	{{"neon", blend_row_neon, blend_row_invert_neon, row_sum_neon}, supported_neon},
+#endif
+	{{"c", blend_row_c, blend_row_invert_c, row_sum_c}, supported_always},
+};
+
+#define KERNEL_ENTRY_NUM	((int)(sizeof(g_kernel_entry)/sizeof(g_kernel_entry[0])))
+
+static pthread_once_t g_kernel_once = PTHREAD_ONCE_INIT;
+static WaterMarkKernel g_kernel_list[KERNEL_ENTRY_NUM];
+static int g_kernel_num = 0;
+static const WaterMarkKernel *g_kernel = NULL;
+
+static void watermark_kernel_init(void)
+{
+	const char *force = getenv("WATERMARK_KERNEL");
+	int i;
+
+	for (i = 0; i < KERNEL_ENTRY_NUM; ++i) {
+		if (g_kernel_entry[i].supported()) {
+			g_kernel_list[g_kernel_num++] = g_kernel_entry[i].kernel;
+		}
+	}
+	g_kernel = &g_kernel_list[0];
+	if (force != NULL) {
+		for (i = 0; i < g_kernel_num; ++i) {
+			if (!strcmp(force, g_kernel_list[i].name)) {
+				g_kernel = &g_kernel_list[i];
+				break;
+			}
+		}
+		if (i == g_kernel_num) {
+			ALOGW("<watermark_kernel_init> kernel '%s' is not supported", force);
+		}
+	}
+	ALOGD("<watermark_kernel_init> use %s kernel", g_kernel->name);
+}
+
+const WaterMarkKernel *watermark_get_kernel(void)
+{
+	pthread_once(&g_kernel_once, watermark_kernel_init);
+	return g_kernel;
+}
+
+const WaterMarkKernel *watermark_get_kernel_list(int *number)
+{
+	pthread_once(&g_kernel_once, watermark_kernel_init);
+	*number = g_kernel_num;
+	return g_kernel_list;
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+